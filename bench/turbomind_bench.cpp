@@ -0,0 +1,475 @@
+// End-to-end benchmark of the C API: drives a synthetic workload against a model
+// directory and reports throughput, TTFT/ITL/E2E percentiles and GPU memory.
+//
+//   turbomind_bench --model-dir DIR --requests 500 --concurrency 32 --rate 8
+//                   --prompt-len 256:2048 --output-len 128 --shared-prefix 0.5
+//
+// Lengths are N (fixed) or MIN:MAX (uniform). --rate 0 submits closed-loop; a
+// positive rate draws Poisson arrivals and measures latencies from the arrival
+// time, so queueing behind busy workers is counted. --json writes the summary
+// for release-gate comparisons.
+
+#include "turbomind_wrapper.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct LengthDist {
+    int min = 0;
+    int max = 0;
+    
+    int sample(std::mt19937_64& rng) const {
+        return min == max ? min : std::uniform_int_distribution<int>(min, max)(rng);
+    }
+};
+
+struct Options {
+    std::string model_dir;
+    std::string config;
+    std::string weight_type = "half";
+    std::string weights_dir;
+    std::string json_path;
+    std::string trace_path;
+    int device_id = 0;
+    int requests = 200;
+    int warmup = 4;
+    int concurrency = 16;
+    int instances = 0; // defaults to concurrency
+    double rate = 0;   // requests per second, 0 = closed loop
+    LengthDist prompt_len{512, 512};
+    LengthDist output_len{128, 128};
+    double shared_prefix = 0; // fraction of requests starting with the shared prefix
+    int prefix_len = 256;
+    size_t prefix_cache_blocks = 0;
+    int prefix_block_len = 64;
+    int vocab = 32000;
+    uint64_t seed = 1;
+};
+
+struct Request {
+    std::vector<int> input_ids;
+    int sequence_length = 0;
+    int output_len = 0;
+    int64_t arrival_ns = 0; // offset from the benchmark start
+};
+
+struct Sample {
+    bool ok = false;
+    double ttft_ms = 0;
+    double itl_ms = 0;     // mean gap between decode steps
+    double itl_max_ms = 0; // worst gap within the request
+    double e2e_ms = 0;
+    int prompt_tokens = 0;
+    int generated_tokens = 0;
+    int prefix_hit = 0;
+};
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: turbomind_bench --model-dir DIR [options]\n"
+                 "  --config YAML           engine config passed to turbomind_create_model\n"
+                 "  --weight-type T         half (default), bfloat16, ...\n"
+                 "  --weights-dir DIR       stream raw weights from DIR\n"
+                 "  --device N              device for the instance pool and metrics (0)\n"
+                 "  --requests N            measured requests (200)\n"
+                 "  --warmup N              unmeasured requests first (4)\n"
+                 "  --concurrency N         requests in flight at most (16)\n"
+                 "  --instances N           pool size (concurrency)\n"
+                 "  --rate R                Poisson arrivals per second, 0 = closed loop (0)\n"
+                 "  --prompt-len N|MIN:MAX  prompt tokens (512)\n"
+                 "  --output-len N|MIN:MAX  generated tokens (128)\n"
+                 "  --shared-prefix F       fraction of prompts sharing one prefix (0)\n"
+                 "  --prefix-len N          shared prefix tokens (256)\n"
+                 "  --prefix-cache-blocks N enable the prefix cache index (0 = off)\n"
+                 "  --prefix-block-len N    tokens per KV block (64)\n"
+                 "  --vocab N               synthetic token id range (32000)\n"
+                 "  --seed N                workload seed (1)\n"
+                 "  --json PATH             write the summary as JSON\n"
+                 "  --trace PATH            record and dump a Chrome trace\n");
+}
+
+bool parse_length(const char* arg, LengthDist* out) {
+    char* end = nullptr;
+    long lo = std::strtol(arg, &end, 10);
+    long hi = lo;
+    if (*end == ':') {
+        hi = std::strtol(end + 1, &end, 10);
+    }
+    if (*end != '\0' || lo <= 0 || hi < lo) {
+        return false;
+    }
+    out->min = static_cast<int>(lo);
+    out->max = static_cast<int>(hi);
+    return true;
+}
+
+bool parse_args(int argc, char** argv, Options* opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            return false;
+        }
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "missing value for %s\n", flag.c_str());
+            return false;
+        }
+        const char* value = argv[++i];
+        bool ok = true;
+        if (flag == "--model-dir") {
+            opt->model_dir = value;
+        } else if (flag == "--config") {
+            opt->config = value;
+        } else if (flag == "--weight-type") {
+            opt->weight_type = value;
+        } else if (flag == "--weights-dir") {
+            opt->weights_dir = value;
+        } else if (flag == "--json") {
+            opt->json_path = value;
+        } else if (flag == "--trace") {
+            opt->trace_path = value;
+        } else if (flag == "--device") {
+            opt->device_id = std::atoi(value);
+        } else if (flag == "--requests") {
+            opt->requests = std::atoi(value);
+        } else if (flag == "--warmup") {
+            opt->warmup = std::atoi(value);
+        } else if (flag == "--concurrency") {
+            opt->concurrency = std::atoi(value);
+        } else if (flag == "--instances") {
+            opt->instances = std::atoi(value);
+        } else if (flag == "--rate") {
+            opt->rate = std::atof(value);
+        } else if (flag == "--prompt-len") {
+            ok = parse_length(value, &opt->prompt_len);
+        } else if (flag == "--output-len") {
+            ok = parse_length(value, &opt->output_len);
+        } else if (flag == "--shared-prefix") {
+            opt->shared_prefix = std::atof(value);
+        } else if (flag == "--prefix-len") {
+            opt->prefix_len = std::atoi(value);
+        } else if (flag == "--prefix-cache-blocks") {
+            opt->prefix_cache_blocks = std::strtoull(value, nullptr, 10);
+        } else if (flag == "--prefix-block-len") {
+            opt->prefix_block_len = std::atoi(value);
+        } else if (flag == "--vocab") {
+            opt->vocab = std::atoi(value);
+        } else if (flag == "--seed") {
+            opt->seed = std::strtoull(value, nullptr, 10);
+        } else {
+            std::fprintf(stderr, "unknown flag %s\n", flag.c_str());
+            return false;
+        }
+        if (!ok) {
+            std::fprintf(stderr, "invalid value for %s: %s\n", flag.c_str(), value);
+            return false;
+        }
+    }
+    if (opt->model_dir.empty() || opt->requests <= 0 || opt->concurrency <= 0 || opt->vocab <= 1) {
+        return false;
+    }
+    if (opt->instances <= 0) {
+        opt->instances = opt->concurrency;
+    }
+    opt->shared_prefix = std::clamp(opt->shared_prefix, 0.0, 1.0);
+    return true;
+}
+
+// Measured requests come after the warmup ones; arrivals restart at zero for them
+std::vector<Request> build_workload(const Options& opt) {
+    std::mt19937_64 rng(opt.seed);
+    std::uniform_int_distribution<int> token(1, opt.vocab - 1);
+    std::uniform_real_distribution<double> coin(0, 1);
+    std::exponential_distribution<double> gap(opt.rate > 0 ? opt.rate : 1);
+    
+    std::vector<int> prefix(std::max(opt.prefix_len, 0));
+    for (int& id : prefix) {
+        id = token(rng);
+    }
+    
+    std::vector<Request> requests(opt.warmup + opt.requests);
+    double arrival_s = 0;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        Request& r = requests[i];
+        const int len = opt.prompt_len.sample(rng);
+        r.input_ids.reserve(len);
+        if (coin(rng) < opt.shared_prefix) {
+            r.input_ids.assign(prefix.begin(), prefix.begin() + std::min<size_t>(prefix.size(), len));
+        }
+        while (static_cast<int>(r.input_ids.size()) < len) {
+            r.input_ids.push_back(token(rng));
+        }
+        r.sequence_length = len;
+        r.output_len = opt.output_len.sample(rng);
+        if (static_cast<int>(i) >= opt.warmup && opt.rate > 0) {
+            r.arrival_ns = static_cast<int64_t>(arrival_s * 1e9);
+            arrival_s += gap(rng);
+        }
+    }
+    return requests;
+}
+
+int fail(const char* what) {
+    std::fprintf(stderr, "%s: %s\n", what, turbomind_get_last_error());
+    return 1;
+}
+
+// Runs one request to completion on the calling thread
+Sample run_request(TurboMindInstancePool* pool, Request& r, uint64_t session_id, int64_t arrival_ns) {
+    Sample sample;
+    const int n = static_cast<int>(r.input_ids.size());
+    TurboMindTensorDesc descs[2] = {};
+    descs[0].name = "input_ids";
+    descs[0].data = r.input_ids.data();
+    descs[0].shape[0] = 1;
+    descs[0].shape[1] = n;
+    descs[0].ndim = 2;
+    descs[0].dtype = TM_TYPE_INT32;
+    descs[0].memory_type = TM_MEMORY_CPU;
+    descs[1].name = "sequence_length";
+    descs[1].data = &r.sequence_length;
+    descs[1].shape[0] = 1;
+    descs[1].ndim = 1;
+    descs[1].dtype = TM_TYPE_INT32;
+    descs[1].memory_type = TM_MEMORY_CPU;
+    
+    TurboMindTensorMap* inputs = turbomind_pool_build_inputs(pool, descs, 2);
+    if (!inputs) {
+        fail("build inputs");
+        return sample;
+    }
+    
+    // Force the sampled output length; identical configs share one handle
+    TurboMindGenerationConfig config = {};
+    config.max_new_tokens = r.output_len;
+    config.min_new_tokens = r.output_len;
+    config.top_k = 1;
+    config.top_p = 1.0f;
+    config.temperature = 1.0f;
+    config.repetition_penalty = 1.0f;
+    TurboMindGenerationConfigHandle* handle = turbomind_create_generation_config(&config);
+    
+    TurboMindSession session = {session_id, 0, true, true, TM_PRIORITY_INTERACTIVE, 0};
+    TurboMindForwardResult* result =
+        handle ? turbomind_pool_forward_with_config(pool, inputs, &session, handle, false, nullptr, nullptr) : nullptr;
+    turbomind_release_generation_config(handle);
+    if (!result) {
+        fail("forward");
+        turbomind_destroy_tensor_map(inputs);
+        return sample;
+    }
+    
+    turbomind_wait_forward(result, -1);
+    int seq_len = 0;
+    TurboMindRequestTimings t = {};
+    sample.ok = turbomind_get_forward_status(result, &seq_len) == TM_REQUEST_COMPLETED &&
+                turbomind_get_request_timings(result, &t) == 0 && t.first_token_ns > 0;
+    if (sample.ok) {
+        const int64_t start = std::min(arrival_ns, t.submit_ns);
+        sample.ttft_ms = (t.first_token_ns - start) / 1e6;
+        sample.e2e_ms = (t.finish_ns - start) / 1e6;
+        sample.itl_ms = t.decode_steps > 0 ? t.decode_total_ns / 1e6 / t.decode_steps : 0;
+        sample.itl_max_ms = t.decode_max_ns / 1e6;
+        sample.prompt_tokens = t.prompt_tokens;
+        sample.generated_tokens = t.generated_tokens;
+        sample.prefix_hit = turbomind_get_prefix_hit_length(result);
+    }
+    turbomind_destroy_forward_result(result);
+    turbomind_destroy_tensor_map(inputs);
+    return sample;
+}
+
+struct Percentiles {
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double mean = 0;
+};
+
+Percentiles percentiles(std::vector<double> v) {
+    Percentiles p;
+    if (v.empty()) {
+        return p;
+    }
+    std::sort(v.begin(), v.end());
+    const auto at = [&](double q) { return v[std::min(v.size() - 1, static_cast<size_t>(q * v.size()))]; };
+    p.p50 = at(0.50);
+    p.p90 = at(0.90);
+    p.p99 = at(0.99);
+    for (double x : v) {
+        p.mean += x;
+    }
+    p.mean /= v.size();
+    return p;
+}
+
+void write_percentiles(std::ostream& out, const char* name, const Percentiles& p, bool last = false) {
+    out << "  \"" << name << "\": {\"mean\": " << p.mean << ", \"p50\": " << p.p50 << ", \"p90\": " << p.p90
+        << ", \"p99\": " << p.p99 << "}" << (last ? "\n" : ",\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parse_args(argc, argv, &opt)) {
+        usage();
+        return 2;
+    }
+    
+    TurboMindModel* model = turbomind_create_model(opt.model_dir.c_str(), opt.config.c_str(), opt.weight_type.c_str());
+    if (!model) {
+        return fail("create model");
+    }
+    if (!opt.weights_dir.empty() && turbomind_set_weight_source(model, opt.weights_dir.c_str(), 0, nullptr, nullptr) != 0) {
+        return fail("set weight source");
+    }
+    if (opt.prefix_cache_blocks > 0 &&
+        turbomind_enable_prefix_cache(model, opt.prefix_block_len, opt.prefix_cache_blocks) != 0) {
+        return fail("enable prefix cache");
+    }
+    if (turbomind_initialize_all_ranks(model, 0, 0) != 0) {
+        return fail("initialize ranks");
+    }
+    TurboMindInstancePool* pool = turbomind_create_instance_pool(model, opt.device_id, opt.instances);
+    if (!pool) {
+        return fail("create instance pool");
+    }
+    
+    std::vector<Request> requests = build_workload(opt);
+    std::vector<Sample> samples(requests.size());
+    std::atomic<size_t> next{0};
+    std::atomic<int64_t> start_ns{0};
+    const size_t warmup = opt.warmup;
+    
+    // Workers take requests in order; each is one in-flight slot
+    const auto worker = [&](size_t end) {
+        while (true) {
+            const size_t i = next.fetch_add(1);
+            if (i >= end) {
+                return;
+            }
+            int64_t arrival = turbomind_trace_clock_ns();
+            if (i >= warmup) {
+                arrival = start_ns.load() + requests[i].arrival_ns;
+                const int64_t wait = arrival - turbomind_trace_clock_ns();
+                if (wait > 0) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+                }
+            }
+            samples[i] = run_request(pool, requests[i], i + 1, arrival);
+        }
+    };
+    const auto run_phase = [&](size_t end) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < opt.concurrency; ++t) {
+            threads.emplace_back(worker, end);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    };
+    
+    run_phase(warmup);
+    turbomind_reset_latency_histograms();
+    if (!opt.trace_path.empty()) {
+        turbomind_enable_trace(1 << 20);
+    }
+    
+    // Peak device memory, sampled while the measured phase runs
+    std::atomic<bool> sampling{true};
+    std::atomic<int64_t> peak_gpu{-1};
+    std::thread sampler([&] {
+        TurboMindMetrics m = {};
+        while (sampling.load()) {
+            if (turbomind_get_metrics(model, opt.device_id, &m) == 0) {
+                peak_gpu.store(std::max(peak_gpu.load(), m.gpu_memory_used));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    });
+    
+    start_ns = turbomind_trace_clock_ns();
+    run_phase(requests.size());
+    const double wall_s = (turbomind_trace_clock_ns() - start_ns.load()) / 1e9;
+    sampling = false;
+    sampler.join();
+    TurboMindMetrics metrics = {};
+    turbomind_get_metrics(model, opt.device_id, &metrics);
+    
+    if (!opt.trace_path.empty() && turbomind_dump_trace(opt.trace_path.c_str()) != 0) {
+        fail("dump trace");
+    }
+    
+    std::vector<double> ttft, itl, itl_max, e2e;
+    uint64_t prompt_tokens = 0, generated_tokens = 0, hit_tokens = 0;
+    int failed = 0;
+    for (size_t i = warmup; i < samples.size(); ++i) {
+        const Sample& s = samples[i];
+        if (!s.ok) {
+            ++failed;
+            continue;
+        }
+        ttft.push_back(s.ttft_ms);
+        itl.push_back(s.itl_ms);
+        itl_max.push_back(s.itl_max_ms);
+        e2e.push_back(s.e2e_ms);
+        prompt_tokens += s.prompt_tokens;
+        generated_tokens += s.generated_tokens;
+        hit_tokens += s.prefix_hit;
+    }
+    const Percentiles p_ttft = percentiles(ttft);
+    const Percentiles p_itl = percentiles(itl);
+    const Percentiles p_itl_max = percentiles(itl_max);
+    const Percentiles p_e2e = percentiles(e2e);
+    const double gib = 1024.0 * 1024.0 * 1024.0;
+    
+    std::printf("requests      %d ok, %d failed in %.2f s (%.2f req/s)\n", opt.requests - failed, failed, wall_s,
+                (opt.requests - failed) / wall_s);
+    std::printf("throughput    %.1f output tok/s, %.1f prompt tok/s\n", generated_tokens / wall_s,
+                prompt_tokens / wall_s);
+    std::printf("prefix hits   %.1f%% of prompt tokens\n", prompt_tokens ? 100.0 * hit_tokens / prompt_tokens : 0.0);
+    std::printf("%-13s %10s %10s %10s %10s\n", "latency (ms)", "mean", "p50", "p90", "p99");
+    const std::pair<const char*, Percentiles> rows[] = {
+        {"ttft", p_ttft}, {"itl", p_itl}, {"itl max", p_itl_max}, {"e2e", p_e2e}};
+    for (const auto& [name, p] : rows) {
+        std::printf("%-13s %10.2f %10.2f %10.2f %10.2f\n", name, p.mean, p.p50, p.p90, p.p99);
+    }
+    if (metrics.gpu_memory_total > 0) {
+        std::printf("gpu memory    %.2f GiB peak of %.2f GiB\n", peak_gpu.load() / gib, metrics.gpu_memory_total / gib);
+    }
+    
+    if (!opt.json_path.empty()) {
+        std::ofstream out(opt.json_path, std::ios::trunc);
+        out << "{\n  \"requests\": " << opt.requests << ",\n  \"failed\": " << failed
+            << ",\n  \"concurrency\": " << opt.concurrency << ",\n  \"rate\": " << opt.rate
+            << ",\n  \"wall_seconds\": " << wall_s << ",\n  \"output_tokens_per_second\": " << generated_tokens / wall_s
+            << ",\n  \"prompt_tokens_per_second\": " << prompt_tokens / wall_s
+            << ",\n  \"prefix_hit_tokens\": " << hit_tokens << ",\n  \"gpu_memory_peak\": " << peak_gpu.load()
+            << ",\n  \"gpu_memory_total\": " << metrics.gpu_memory_total << ",\n";
+        write_percentiles(out, "ttft_ms", p_ttft);
+        write_percentiles(out, "itl_ms", p_itl);
+        write_percentiles(out, "itl_max_ms", p_itl_max);
+        write_percentiles(out, "e2e_ms", p_e2e, true);
+        out << "}\n";
+        if (!out) {
+            std::fprintf(stderr, "failed to write %s\n", opt.json_path.c_str());
+        }
+    }
+    
+    turbomind_destroy_instance_pool(pool);
+    turbomind_destroy_model(model);
+    return failed ? 1 : 0;
+}
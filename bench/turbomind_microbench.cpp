@@ -0,0 +1,342 @@
+// Host-side overhead of the C API, built against the CPU-only mock backend
+// (-DTURBOMIND_GO_MOCK_BACKEND=ON) so it runs on machines without a GPU.
+//
+//   turbomind_microbench [--filter SUBSTRING] [--min-time SECONDS]
+//
+// Each benchmark body runs in a loop whose iteration count grows until it takes
+// at least --min-time; the reported time is per iteration. The Go side of the
+// same operations is covered by the Benchmark* functions in pkg/turbomind.
+
+#include "turbomind_wrapper.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps `value` alive through the optimizer
+template<typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Per-run state in the style of benchmark::State: `for (auto _ : state)` runs
+// the body `iterations` times; pause()/resume() exclude setup from the timing
+class State {
+public:
+    explicit State(uint64_t iterations) : iterations_(iterations) {}
+    
+    // Marked unused so `auto _` does not trip -Wunused-variable
+    struct __attribute__((unused)) Value {};
+    
+    struct Iterator {
+        State* state;
+        uint64_t left;
+        
+        bool operator!=(const Iterator&) const {
+            if (left == 0) {
+                state->stop();
+                return false;
+            }
+            return true;
+        }
+        void operator++() {
+            --left;
+        }
+        Value operator*() const {
+            return {};
+        }
+    };
+    
+    Iterator begin() {
+        start_ = Clock::now();
+        return {this, iterations_};
+    }
+    Iterator end() {
+        return {this, 0};
+    }
+    
+    void pause() {
+        elapsed_ += Clock::now() - start_;
+    }
+    void resume() {
+        start_ = Clock::now();
+    }
+    
+    uint64_t iterations() const {
+        return iterations_;
+    }
+    double seconds() const {
+        return std::chrono::duration<double>(elapsed_).count();
+    }
+
+private:
+    void stop() {
+        elapsed_ += Clock::now() - start_;
+    }
+    
+    uint64_t iterations_;
+    Clock::time_point start_;
+    Clock::duration elapsed_{};
+};
+
+struct Benchmark {
+    std::string name;
+    std::function<void(State&)> body;
+};
+
+std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+// Shared fixture: one mock model and pool for every benchmark
+struct Fixture {
+    TurboMindModel* model = nullptr;
+    TurboMindInstancePool* pool = nullptr;
+    std::vector<int> input_ids = std::vector<int>(512, 1);
+    int sequence_length = 512;
+    TurboMindGenerationConfig config{};
+    TurboMindTensorDesc descs[2]{};
+    
+    Fixture() {
+        config.max_new_tokens = 16;
+        config.top_k = 1;
+        config.top_p = 1.0f;
+        config.temperature = 1.0f;
+        config.repetition_penalty = 1.0f;
+        
+        descs[0].name = "input_ids";
+        descs[0].data = input_ids.data();
+        descs[0].shape[0] = 1;
+        descs[0].shape[1] = static_cast<int64_t>(input_ids.size());
+        descs[0].ndim = 2;
+        descs[0].dtype = TM_TYPE_INT32;
+        descs[0].memory_type = TM_MEMORY_CPU;
+        descs[1].name = "sequence_length";
+        descs[1].data = &sequence_length;
+        descs[1].shape[0] = 1;
+        descs[1].ndim = 1;
+        descs[1].dtype = TM_TYPE_INT32;
+        descs[1].memory_type = TM_MEMORY_CPU;
+    }
+    
+    TurboMindTensorMap* inputs() {
+        return turbomind_pool_build_inputs(pool, descs, 2);
+    }
+};
+
+Fixture& fixture() {
+    static Fixture f;
+    return f;
+}
+
+void register_benchmarks() {
+    auto add = [](std::string name, std::function<void(State&)> body) {
+        registry().push_back({std::move(name), std::move(body)});
+    };
+    
+    add("tensor/create_destroy", [](State& state) {
+        auto& f = fixture();
+        int64_t shape[2] = {1, 512};
+        for (auto _ : state) {
+            TurboMindTensor* t = turbomind_create_tensor(f.input_ids.data(), shape, 2, TM_TYPE_INT32, TM_MEMORY_CPU, 0);
+            do_not_optimize(t);
+            turbomind_destroy_tensor(t);
+        }
+    });
+    
+    add("tensor/create_destroy_pinned", [](State& state) {
+        int64_t shape[2] = {1, 512};
+        for (auto _ : state) {
+            void* data = nullptr;
+            TurboMindTensor* t = turbomind_create_pinned_tensor(shape, 2, TM_TYPE_INT32, 0, &data);
+            do_not_optimize(data);
+            turbomind_destroy_tensor(t);
+        }
+    });
+    
+    add("tensor_map/set_get", [](State& state) {
+        auto& f = fixture();
+        int64_t shape[2] = {1, 512};
+        TurboMindTensorMap* map = turbomind_create_tensor_map();
+        TurboMindTensor* t = turbomind_create_tensor(f.input_ids.data(), shape, 2, TM_TYPE_INT32, TM_MEMORY_CPU, 0);
+        for (auto _ : state) {
+            turbomind_tensor_map_set(map, "input_ids", t);
+            TurboMindTensor* got = turbomind_tensor_map_get(map, "input_ids");
+            do_not_optimize(got);
+            turbomind_destroy_tensor(got);
+        }
+        turbomind_destroy_tensor(t);
+        turbomind_destroy_tensor_map(map);
+    });
+    
+    add("tensor_map/build_inputs", [](State& state) {
+        auto& f = fixture();
+        for (auto _ : state) {
+            TurboMindTensorMap* map = f.inputs();
+            do_not_optimize(map);
+            turbomind_destroy_tensor_map(map);
+        }
+    });
+    
+    add("generation_config/create_release", [](State& state) {
+        auto& f = fixture();
+        for (auto _ : state) {
+            TurboMindGenerationConfigHandle* handle = turbomind_create_generation_config(&f.config);
+            do_not_optimize(handle);
+            turbomind_release_generation_config(handle);
+        }
+    });
+    
+    // Converts the C config on every call
+    add("forward/submit_wait_destroy", [](State& state) {
+        auto& f = fixture();
+        TurboMindTensorMap* map = f.inputs();
+        TurboMindSession session = {1, 0, true, true, TM_PRIORITY_INTERACTIVE, 0};
+        for (auto _ : state) {
+            TurboMindForwardResult* r =
+                turbomind_pool_forward_async(f.pool, map, &session, &f.config, false, nullptr, nullptr);
+            turbomind_wait_forward(r, -1);
+            turbomind_destroy_forward_result(r);
+        }
+        turbomind_destroy_tensor_map(map);
+    });
+    
+    add("forward/with_config_handle", [](State& state) {
+        auto& f = fixture();
+        TurboMindTensorMap* map = f.inputs();
+        TurboMindGenerationConfigHandle* handle = turbomind_create_generation_config(&f.config);
+        TurboMindSession session = {1, 0, true, true, TM_PRIORITY_INTERACTIVE, 0};
+        for (auto _ : state) {
+            TurboMindForwardResult* r =
+                turbomind_pool_forward_with_config(f.pool, map, &session, handle, false, nullptr, nullptr);
+            turbomind_wait_forward(r, -1);
+            turbomind_destroy_forward_result(r);
+        }
+        turbomind_release_generation_config(handle);
+        turbomind_destroy_tensor_map(map);
+    });
+    
+    add("forward/result_teardown", [](State& state) {
+        auto& f = fixture();
+        TurboMindTensorMap* map = f.inputs();
+        TurboMindSession session = {1, 0, true, true, TM_PRIORITY_INTERACTIVE, 0};
+        for (auto _ : state) {
+            state.pause();
+            TurboMindForwardResult* r =
+                turbomind_pool_forward_async(f.pool, map, &session, &f.config, false, nullptr, nullptr);
+            turbomind_wait_forward(r, -1);
+            state.resume();
+            turbomind_destroy_forward_result(r);
+        }
+        turbomind_destroy_tensor_map(map);
+    });
+    
+    add("forward/batch_16", [](State& state) {
+        auto& f = fixture();
+        std::vector<TurboMindTensorMap*> maps(16);
+        std::vector<TurboMindSession> sessions(16);
+        for (int i = 0; i < 16; ++i) {
+            maps[i] = f.inputs();
+            sessions[i] = {static_cast<uint64_t>(i + 1), 0, true, true, TM_PRIORITY_INTERACTIVE, 0};
+        }
+        TurboMindGenerationConfig* config = &f.config;
+        for (auto _ : state) {
+            TurboMindBatchResult* batch =
+                turbomind_forward_batch(f.pool, 16, maps.data(), sessions.data(), &config, 1, false);
+            turbomind_wait_batch(batch, -1);
+            turbomind_destroy_batch_result(batch);
+        }
+        for (auto* map : maps) {
+            turbomind_destroy_tensor_map(map);
+        }
+    });
+    
+    add("forward/output_view", [](State& state) {
+        auto& f = fixture();
+        TurboMindTensorMap* map = f.inputs();
+        TurboMindSession session = {1, 0, true, true, TM_PRIORITY_INTERACTIVE, 0};
+        TurboMindForwardResult* r = turbomind_pool_forward_async(f.pool, map, &session, &f.config, false, nullptr, nullptr);
+        turbomind_wait_forward(r, -1);
+        for (auto _ : state) {
+            TurboMindTensorView view{};
+            turbomind_get_output(r, "output_ids", &view);
+            do_not_optimize(view.data);
+        }
+        turbomind_destroy_forward_result(r);
+        turbomind_destroy_tensor_map(map);
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string filter;
+    double min_time = 0.5;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--filter") == 0) {
+            filter = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--min-time") == 0) {
+            min_time = std::atof(argv[i + 1]);
+        } else {
+            std::fprintf(stderr, "usage: turbomind_microbench [--filter SUBSTRING] [--min-time SECONDS]\n");
+            return 2;
+        }
+    }
+    
+    // The mock reads these once, before the first call
+    setenv("TURBOMIND_MOCK_VERBOSE", "0", 0);
+    setenv("TURBOMIND_MOCK_OUTPUT_TOKENS", "16", 0);
+    
+    char dir[] = "/tmp/turbomind_microbench.XXXXXX";
+    if (!mkdtemp(dir)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    auto& f = fixture();
+    f.model = turbomind_create_model(dir, "", "half");
+    f.pool = f.model ? turbomind_create_instance_pool(f.model, 0, 4) : nullptr;
+    if (!f.pool) {
+        std::fprintf(stderr, "setup failed: %s\n", turbomind_get_last_error());
+        return 1;
+    }
+    
+    register_benchmarks();
+    std::printf("%-36s %14s %14s\n", "Benchmark", "Time", "Iterations");
+    for (const auto& bench : registry()) {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        uint64_t iterations = 1;
+        double seconds = 0;
+        while (true) {
+            State state(iterations);
+            bench.body(state);
+            seconds = state.seconds();
+            if (seconds >= min_time || iterations >= (uint64_t(1) << 34)) {
+                break;
+            }
+            // Aim past min_time, growing at most 10x per round
+            const double scale = seconds > 0 ? 1.4 * min_time / seconds : 10;
+            iterations = static_cast<uint64_t>(iterations * std::min(std::max(scale, 2.0), 10.0));
+        }
+        std::printf("%-36s %11.1f ns %14llu\n", bench.name.c_str(), seconds * 1e9 / iterations,
+                    static_cast<unsigned long long>(iterations));
+    }
+    
+    turbomind_destroy_instance_pool(f.pool);
+    turbomind_destroy_model(f.model);
+    rmdir(dir);
+    return 0;
+}
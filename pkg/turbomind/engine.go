@@ -1,18 +1,39 @@
 package turbomind
 
 import (
+	"context"
 	"encoding/json"
 	"errors"
 	"fmt"
+	"io"
+	"strings"
+	"sync"
 	"unsafe"
 )
 
+// maxEnginePresets bounds the engine's cache of generation presets
+const maxEnginePresets = 64
+
 // Engine provides a high-level interface for TurboMind inference
 type Engine struct {
 	model     *Model
-	instance  *ModelInstance
+	pool      *InstancePool
 	tokenizer *Tokenizer
+	native    *NativeTokenizer // the model's C++ tokenizer, preferred when it loads
 	deviceID  int
+	draftPool *InstancePool // speculative decoding, nil without a draft model
+	
+	presetMu sync.Mutex
+	presets  map[presetKey]*GenerationPreset
+}
+
+// presetKey is the part of an InferenceRequest that shapes its generation config
+type presetKey struct {
+	maxTokens   int
+	temperature float32
+	topP        float32
+	topK        int
+	stopTokens  string
 }
 
 // EngineConfig represents configuration for creating an engine
@@ -23,6 +44,19 @@ type EngineConfig struct {
 	DeviceID    int
 	TensorPara  int
 	PipelinePara int
+	NumInstances int // Concurrent requests the engine can batch together
+	WeightsDir   string // Optional raw weight files streamed in at startup
+	LoadThreads  int
+	SnapshotDir  string // Optional cache of loaded weights for faster restarts
+	PrefixCacheBlocks int // Prefix index capacity in PrefixBlockLen blocks; 0 disables. Config must set enable_prefix_caching
+	PrefixBlockLen    int // Tokens per KV block, the engine's cache_block_seq_len (default 64)
+	SessionOffload    bool   // Allow SuspendSession/ResumeSession
+	SessionHostLimit  int64  // Bytes of suspended histories kept in memory before spilling
+	SessionSpillDir   string // Optional directory for spilled session histories
+	DraftModelDir     string // Optional small model with the same vocabulary; greedy requests then decode speculatively
+	DraftConfig       string
+	DraftTokens       int    // Tokens the draft proposes per step (default 4)
+	Scheduling        *SchedulingConfig // Optional admission control across request priorities
 }
 
 // InferenceRequest represents a high-level inference request
@@ -35,6 +69,30 @@ type InferenceRequest struct {
 	TopK          int
 	StopTokens    []string
 	StreamOutput  bool
+	// OnText, when set, receives the generated text. With StreamOutput and the
+	// native tokenizer it gets each new piece as tokens arrive; otherwise the
+	// whole text once the request finished.
+	OnText func(text string)
+	// Regex or JSONSchema, when set, constrain the output to full matches of a
+	// regular expression or to JSON the schema accepts (see Grammar). Needs the
+	// native tokenizer.
+	Regex      string
+	JSONSchema string
+	// Priority and DeadlineMs schedule the request against others on the engine
+	// (see Session); a request still queued at its deadline fails
+	Priority   Priority
+	DeadlineMs uint32
+}
+
+// session is the request's session after `step` tokens, left open
+func (r *InferenceRequest) session(step int) *Session {
+	return &Session{
+		ID:         r.SessionID,
+		Step:       step,
+		StartFlag:  step == 0,
+		Priority:   r.Priority,
+		DeadlineMs: r.DeadlineMs,
+	}
 }
 
 // InferenceResult represents the result of inference
@@ -43,6 +101,10 @@ type InferenceResult struct {
 	TokensUsed   int
 	Finished     bool
 	SessionID    uint64
+	CachedTokens int // prompt tokens reused from the prefix cache
+	Timings      RequestTimings // zero for constrained and speculative requests, which run as many engine requests
+	DraftTokens    int // proposed by the draft model (speculative decoding)
+	AcceptedTokens int // draft tokens the model kept
 }
 
 // NewEngine creates a new TurboMind inference engine
@@ -57,29 +119,82 @@ func NewEngine(config *EngineConfig) (*Engine, error) {
 		return nil, fmt.Errorf("failed to create model: %v", err)
 	}
 	
-	// Create model instance
-	instance, err := model.CreateInstance(config.DeviceID)
+	if config.WeightsDir != "" {
+		if err := model.SetWeightSource(config.WeightsDir, config.LoadThreads); err != nil {
+			model.Close()
+			return nil, err
+		}
+	}
+	if config.SnapshotDir != "" {
+		if err := model.SetSnapshotDir(config.SnapshotDir); err != nil {
+			model.Close()
+			return nil, err
+		}
+	}
+	if config.PrefixCacheBlocks > 0 {
+		blockLen := config.PrefixBlockLen
+		if blockLen <= 0 {
+			blockLen = 64
+		}
+		if err := model.EnablePrefixCache(blockLen, config.PrefixCacheBlocks); err != nil {
+			model.Close()
+			return nil, err
+		}
+	}
+	if config.SessionOffload {
+		if err := model.EnableSessionOffload(config.SessionHostLimit, config.SessionSpillDir); err != nil {
+			model.Close()
+			return nil, err
+		}
+	}
+	
+	// Create model instances
+	numInstances := config.NumInstances
+	if numInstances <= 0 {
+		numInstances = 1
+	}
+	pool, err := model.CreateInstancePool(config.DeviceID, numInstances)
 	if err != nil {
 		model.Close()
-		return nil, fmt.Errorf("failed to create model instance: %v", err)
+		return nil, fmt.Errorf("failed to create model instances: %v", err)
+	}
+	if config.Scheduling != nil {
+		if err := pool.SetScheduling(*config.Scheduling); err != nil {
+			pool.Close()
+			model.Close()
+			return nil, err
+		}
+	}
+	var draftPool *InstancePool
+	if config.DraftModelDir != "" {
+		if draftPool, err = attachDraft(model, config, numInstances); err != nil {
+			pool.Close()
+			model.Close()
+			return nil, err
+		}
 	}
 	
-	// Create tokenizer (optional)
+	// Create tokenizer (optional). The native one tokenizes straight into the
+	// pinned input buffer; the Go one covers tokenizers it does not support.
 	var tokenizer *Tokenizer
-	if config.ModelDir != "" {
+	native, nativeErr := model.Tokenizer()
+	if nativeErr != nil && config.ModelDir != "" {
 		var err error
 		tokenizer, err = NewTokenizer(config.ModelDir)
 		if err != nil {
 			// Log warning but don't fail - tokenizer is optional
-			fmt.Printf("Warning: failed to create tokenizer: %v\n", err)
+			fmt.Printf("Warning: failed to create tokenizer: %v (native: %v)\n", err, nativeErr)
 		}
 	}
 	
 	return &Engine{
 		model:     model,
-		instance:  instance,
+		pool:      pool,
 		tokenizer: tokenizer,
+		native:    native,
 		deviceID:  config.DeviceID,
+		draftPool: draftPool,
+		presets:   make(map[presetKey]*GenerationPreset),
 	}, nil
 }
 
@@ -89,91 +204,275 @@ func (e *Engine) Close() {
 		e.tokenizer.Close()
 		e.tokenizer = nil
 	}
-	if e.instance != nil {
-		e.instance.Close()
-		e.instance = nil
+	e.native = nil // owned by the model
+	if e.pool != nil {
+		e.pool.Close()
+		e.pool = nil
+	}
+	e.presetMu.Lock()
+	for key, preset := range e.presets {
+		preset.Close()
+		delete(e.presets, key)
+	}
+	e.presetMu.Unlock()
+	if e.draftPool != nil {
+		e.draftPool.Close()
+		e.draftPool = nil
 	}
 	if e.model != nil {
+		draft, _ := e.model.DraftModel()
 		e.model.Close()
 		e.model = nil
+		if draft != nil {
+			draft.Close()
+		}
+	}
+}
+
+// attachDraft loads the draft model of config next to model, with its own pool
+func attachDraft(model *Model, config *EngineConfig, numInstances int) (*InstancePool, error) {
+	draft, err := NewModel(config.DraftModelDir, config.DraftConfig, config.WeightType)
+	if err != nil {
+		return nil, fmt.Errorf("failed to create draft model: %v", err)
+	}
+	numTokens := config.DraftTokens
+	if numTokens <= 0 {
+		numTokens = 4
+	}
+	pool, err := draft.CreateInstancePool(config.DeviceID, numInstances)
+	if err != nil {
+		draft.Close()
+		return nil, fmt.Errorf("failed to create draft model instances: %v", err)
 	}
+	if err := model.AttachDraftModel(draft, numTokens); err != nil {
+		pool.Close()
+		draft.Close()
+		return nil, err
+	}
+	return pool, nil
 }
 
-// Generate performs text generation
+// Generate performs text generation. Safe for concurrent use; up to
+// EngineConfig.NumInstances requests run on the engine at once.
 func (e *Engine) Generate(request *InferenceRequest) (*InferenceResult, error) {
-	if e.instance == nil {
+	return e.GenerateContext(context.Background(), request)
+}
+
+// GenerateContext performs text generation and cancels the request when ctx is done
+func (e *Engine) GenerateContext(ctx context.Context, request *InferenceRequest) (*InferenceResult, error) {
+	if e.pool == nil {
 		return nil, errors.New("engine is closed")
 	}
 	
 	if request == nil {
 		return nil, errors.New("request cannot be nil")
 	}
+	defer StartSpan("go.generate", request.SessionID)()
+	if request.Regex != "" || request.JSONSchema != "" {
+		return e.generateConstrained(ctx, request)
+	}
+	if e.draftPool != nil && request.TopK == 1 {
+		return e.generateSpeculative(ctx, request)
+	}
 	
-	// Tokenize input (simplified - in real implementation you'd use a proper tokenizer)
-	inputTokens := e.tokenizePrompt(request.Prompt)
-	
-	// Create input tensor
-	inputTensor, err := e.createInputTensor(inputTokens)
+	// One pinned block holds input_ids followed by sequence_length
+	buf, n, err := e.encodePrompt(request.Prompt)
 	if err != nil {
 		return nil, fmt.Errorf("failed to create input tensor: %v", err)
 	}
-	defer inputTensor.Close()
+	defer ReleasePinned(buf)
 	
-	// Create tensor map
-	tensorMap := NewTensorMap()
-	if tensorMap == nil {
-		return nil, errors.New("failed to create tensor map")
+	ids := unsafe.Slice((*int32)(buf), n+1)
+	ids[n] = int32(n)
+	
+	tensorMap, err := e.pool.BuildInputs([]TensorDesc{
+		{Name: "input_ids", Data: buf, Shape: []int64{1, int64(n)}, DType: TypeInt32, Memory: MemoryCPUPinned, DeviceID: e.deviceID},
+		{Name: "sequence_length", Data: unsafe.Pointer(&ids[n]), Shape: []int64{1}, DType: TypeInt32, Memory: MemoryCPUPinned, DeviceID: e.deviceID},
+	})
+	if err != nil {
+		return nil, err
 	}
 	defer tensorMap.Close()
 	
-	// Set input tensor
-	if err := tensorMap.Set("input_ids", inputTensor); err != nil {
-		return nil, fmt.Errorf("failed to set input tensor: %v", err)
-	}
+	session := request.session(0)
 	
-	// Create sequence length tensor
-	seqLenTensor, err := e.createSequenceLengthTensor(len(inputTokens))
+	// Requests with the same sampling parameters share one converted config
+	preset, err := e.generationPreset(request)
 	if err != nil {
-		return nil, fmt.Errorf("failed to create sequence length tensor: %v", err)
+		return nil, fmt.Errorf("inference failed: %v", err)
 	}
-	defer seqLenTensor.Close()
+	defer preset.Close()
 	
-	if err := tensorMap.Set("sequence_length", seqLenTensor); err != nil {
-		return nil, fmt.Errorf("failed to set sequence length tensor: %v", err)
+	// Perform inference
+	result, err := e.pool.ForwardPreset(tensorMap, session, preset, request.StreamOutput)
+	if err != nil {
+		return nil, fmt.Errorf("inference failed: %v", err)
 	}
+	defer result.Close()
 	
-	// Create session
-	session := &Session{
-		ID:        request.SessionID,
-		Step:      0,
-		StartFlag: true,
-		EndFlag:   false,
+	streamed := request.OnText != nil && request.StreamOutput && e.native != nil
+	if streamed {
+		err = e.streamText(ctx, result, request.OnText)
+	}
+	if err == nil {
+		err = result.Wait(ctx)
 	}
-	
-	// Create generation config
-	genConfig := e.createGenerationConfig(request)
-	
-	// Perform inference
-	result, err := e.instance.Forward(tensorMap, session, genConfig, request.StreamOutput)
 	if err != nil {
+		if ctx.Err() != nil || streamed {
+			// Inputs must stay alive until the engine lets go of the request
+			result.Cancel()
+			result.Wait(context.Background())
+		}
 		return nil, fmt.Errorf("inference failed: %v", err)
 	}
-	defer result.Close()
 	
 	// Extract output
-	outputText, err := e.extractOutput(result)
+	outputText, generated, err := e.extractOutput(result)
 	if err != nil {
 		return nil, fmt.Errorf("failed to extract output: %v", err)
 	}
+	timings, _ := result.Timings()
+	if request.OnText != nil && !streamed {
+		request.OnText(outputText)
+	}
 	
 	return &InferenceResult{
 		Text:      outputText,
-		TokensUsed: len(inputTokens), // Simplified
+		TokensUsed: n + generated,
 		Finished:  true,
 		SessionID: request.SessionID,
+		CachedTokens: result.PrefixHitLen,
+		Timings:      timings,
 	}, nil
 }
 
+// PinPrefix keeps the KV cache of a shared prompt prefix (e.g. a system prompt)
+// resident until EvictPrefix. Requires EngineConfig.PrefixCacheBlocks.
+func (e *Engine) PinPrefix(name, prefix string) error {
+	if e.pool == nil {
+		return errors.New("engine is closed")
+	}
+	return e.pool.PinPrefix(name, e.tokenizePrompt(prefix))
+}
+
+// SuspendSession frees the KV cache of an idle session until ResumeSession.
+// Requires EngineConfig.SessionOffload.
+func (e *Engine) SuspendSession(sessionID uint64) error {
+	if e.pool == nil {
+		return errors.New("engine is closed")
+	}
+	return e.pool.SuspendSession(sessionID)
+}
+
+// ResumeSession rebuilds a suspended session and waits until it is ready
+func (e *Engine) ResumeSession(ctx context.Context, sessionID uint64) error {
+	if e.pool == nil {
+		return errors.New("engine is closed")
+	}
+	
+	result, err := e.pool.ResumeSession(sessionID)
+	if err != nil {
+		return err
+	}
+	defer result.Close()
+	
+	if err := result.Wait(ctx); err != nil {
+		if ctx.Err() != nil {
+			result.Cancel()
+			result.Wait(context.Background())
+		}
+		return fmt.Errorf("failed to resume session: %v", err)
+	}
+	return nil
+}
+
+// EvictPrefix releases a prefix pinned with PinPrefix
+func (e *Engine) EvictPrefix(name string) error {
+	if e.pool == nil {
+		return errors.New("engine is closed")
+	}
+	return e.pool.EvictPrefix(name)
+}
+
+// Embed returns one pooled fp32 embedding per text, prefilling all of them as
+// one batch without generating
+func (e *Engine) Embed(texts []string, pooling Pooling) ([][]float32, error) {
+	if e.pool == nil {
+		return nil, errors.New("engine is closed")
+	}
+	if len(texts) == 0 {
+		return nil, errors.New("no inputs to encode")
+	}
+	
+	inputs := make([][]int32, len(texts))
+	for i, text := range texts {
+		inputs[i] = e.tokenizePrompt(text)
+	}
+	dim, err := e.pool.HiddenSize()
+	if err != nil {
+		return nil, err
+	}
+	
+	// Pooled straight into the embeddings' backing array
+	pooled := make([]float32, len(texts)*dim)
+	if err := e.pool.Encode(inputs, pooling, TypeFP32, unsafe.Pointer(&pooled[0]), len(pooled)*4); err != nil {
+		return nil, err
+	}
+	embeddings := make([][]float32, len(texts))
+	for i := range embeddings {
+		embeddings[i] = pooled[i*dim : (i+1)*dim : (i+1)*dim]
+	}
+	return embeddings, nil
+}
+
+// Score returns the log-probability of each continuation after prompt, summed
+// over its tokens, for ranking the continuations. A continuation's tokens are
+// those the tokenizer gives prompt+continuation past the prompt's own tokens.
+func (e *Engine) Score(prompt string, continuations []string) ([]float64, error) {
+	if e.pool == nil {
+		return nil, errors.New("engine is closed")
+	}
+	
+	promptIDs := e.tokenizePrompt(prompt)
+	inputs := make([]ScoreInput, len(continuations))
+	for i, continuation := range continuations {
+		full := e.tokenizePrompt(prompt + continuation)
+		if len(full) <= len(promptIDs) {
+			return nil, fmt.Errorf("continuation %d adds no tokens", i)
+		}
+		inputs[i] = ScoreInput{Prompt: full[:len(promptIDs)], Continuation: full[len(promptIDs):]}
+	}
+	logprobs, err := e.pool.Score(inputs)
+	if err != nil {
+		return nil, err
+	}
+	
+	scores := make([]float64, len(logprobs))
+	for i, tokens := range logprobs {
+		for _, lp := range tokens {
+			scores[i] += float64(lp)
+		}
+	}
+	return scores, nil
+}
+
+// SetPrefillChunkSize changes the prefill chunk size of requests started from
+// now on (see Model.SetPrefillChunkSize); 0 prefills prompts whole
+func (e *Engine) SetPrefillChunkSize(tokens int) error {
+	if e.model == nil {
+		return errors.New("engine is closed")
+	}
+	return e.model.SetPrefillChunkSize(tokens)
+}
+
+// Metrics returns the engine's serving metrics on its device
+func (e *Engine) Metrics() (Metrics, error) {
+	if e.model == nil {
+		return Metrics{}, errors.New("engine is closed")
+	}
+	return e.model.Metrics(e.deviceID)
+}
+
 // GetModelInfo returns information about the model
 func (e *Engine) GetModelInfo() map[string]interface{} {
 	if e.model == nil {
@@ -189,21 +488,57 @@ func (e *Engine) GetModelInfo() map[string]interface{} {
 
 // EndSession ends an inference session
 func (e *Engine) EndSession(sessionID uint64) {
-	if e.instance != nil {
-		e.instance.EndSession(sessionID)
+	if e.pool != nil {
+		e.pool.EndSession(sessionID)
+	}
+	if e.draftPool != nil {
+		e.draftPool.EndSession(sessionID)
 	}
 }
 
-// Cancel cancels current inference
+// Cancel cancels all in-flight inference
 func (e *Engine) Cancel() {
-	if e.instance != nil {
-		e.instance.Cancel()
+	if e.pool != nil {
+		e.pool.CancelAll()
+	}
+	if e.draftPool != nil {
+		e.draftPool.CancelAll()
 	}
 }
 
 // Helper methods
 
+// encodePrompt tokenizes prompt into a pinned buffer with room for one more
+// int32 after the n ids; release it with ReleasePinned
+func (e *Engine) encodePrompt(prompt string) (unsafe.Pointer, int, error) {
+	if e.native != nil {
+		capacity := MaxTokens(len(prompt))
+		buf, err := AllocPinned(4 * (capacity + 1))
+		if err != nil {
+			return nil, 0, err
+		}
+		n, err := e.native.EncodeInto(prompt, true, unsafe.Slice((*int32)(buf), capacity))
+		if err == nil {
+			return buf, n, nil
+		}
+		ReleasePinned(buf)
+	}
+	
+	tokens := e.tokenizePrompt(prompt)
+	buf, err := AllocPinned(4 * (len(tokens) + 1))
+	if err != nil {
+		return nil, 0, err
+	}
+	copy(unsafe.Slice((*int32)(buf), len(tokens)), tokens)
+	return buf, len(tokens), nil
+}
+
 func (e *Engine) tokenizePrompt(prompt string) []int32 {
+	if e.native != nil {
+		if tokens, err := e.native.Encode(prompt, true); err == nil {
+			return tokens
+		}
+	}
 	if e.tokenizer != nil {
 		// Use real tokenizer
 		tokens, err := e.tokenizer.EncodeWithBOS(prompt)
@@ -231,6 +566,11 @@ func (e *Engine) tokenizePrompt(prompt string) []int32 {
 }
 
 func (e *Engine) detokenize(tokens []int32) string {
+	if e.native != nil {
+		if text, err := e.native.Decode(tokens, true); err == nil {
+			return text
+		}
+	}
 	if e.tokenizer != nil {
 		// Use real tokenizer
 		intTokens := make([]int, len(tokens))
@@ -261,21 +601,36 @@ func (e *Engine) detokenize(tokens []int32) string {
 	return result
 }
 
-func (e *Engine) createInputTensor(tokens []int32) (*Tensor, error) {
-	// Allocate memory for tokens
-	data := make([]int32, len(tokens))
-	copy(data, tokens)
+// generationPreset returns a reference to the cached preset for the request's
+// sampling parameters, creating it on first use. The caller closes it.
+func (e *Engine) generationPreset(request *InferenceRequest) (*GenerationPreset, error) {
+	key := presetKey{
+		maxTokens:   request.MaxTokens,
+		temperature: request.Temperature,
+		topP:        request.TopP,
+		topK:        request.TopK,
+		stopTokens:  strings.Join(request.StopTokens, "\x00"),
+	}
 	
-	// Create tensor
-	shape := []int64{1, int64(len(tokens))}
-	return NewTensor(unsafe.Pointer(&data[0]), shape, TypeInt32, MemoryGPU, e.deviceID)
-}
-
-func (e *Engine) createSequenceLengthTensor(length int) (*Tensor, error) {
-	// Create sequence length tensor
-	data := []int32{int32(length)}
-	shape := []int64{1}
-	return NewTensor(unsafe.Pointer(&data[0]), shape, TypeInt32, MemoryGPU, e.deviceID)
+	e.presetMu.Lock()
+	defer e.presetMu.Unlock()
+	if preset, ok := e.presets[key]; ok {
+		return preset.Clone(), nil
+	}
+	
+	preset, err := NewGenerationPreset(e.createGenerationConfig(request))
+	if err != nil {
+		return nil, err
+	}
+	if len(e.presets) >= maxEnginePresets {
+		// In-flight requests hold their own references, so dropping the cache is safe
+		for k, p := range e.presets {
+			p.Close()
+			delete(e.presets, k)
+		}
+	}
+	e.presets[key] = preset
+	return preset.Clone(), nil
 }
 
 func (e *Engine) createGenerationConfig(request *InferenceRequest) *GenerationConfig {
@@ -309,25 +664,388 @@ func (e *Engine) createGenerationConfig(request *InferenceRequest) *GenerationCo
 	return config
 }
 
-func (e *Engine) extractOutput(result *ForwardResult) (string, error) {
-	// This is a simplified implementation
-	// In real implementation, you'd extract the output_ids tensor and detokenize
+// generateConstrained decodes under a grammar. The engine fixes a request's
+// bad_ids when the request starts, so every sampled token is its own one-step
+// request carrying the mask of the current grammar state; the steps continue
+// one session, so each prefills only the tokens added since the last. Tokens
+// the grammar forces (the only one allowed) are appended without sampling and
+// ride along with the next step's input.
+func (e *Engine) generateConstrained(ctx context.Context, request *InferenceRequest) (*InferenceResult, error) {
+	if e.native == nil {
+		return nil, errors.New("constrained decoding needs the native tokenizer")
+	}
+	kind, source := GrammarRegex, request.Regex
+	if request.JSONSchema != "" {
+		kind, source = GrammarJSONSchema, request.JSONSchema
+	}
+	grammar, err := e.native.CompileGrammar(kind, source)
+	if err != nil {
+		return nil, err
+	}
+	defer grammar.Close()
+	
+	prompt, err := e.native.Encode(request.Prompt, true)
+	if err != nil {
+		return nil, fmt.Errorf("failed to tokenize prompt: %v", err)
+	}
+	config := e.createGenerationConfig(request)
+	maxTokens := config.MaxNewTokens
+	config.MaxNewTokens = 1
+	config.MinNewTokens = 0 // EOS is the grammar's call
+	
+	out, err := e.newTokenOutput(request)
+	if err != nil {
+		return nil, err
+	}
+	defer out.close()
+	
+	eos := int32(e.native.EOS())
+	state := grammar.Start()
+	pending := prompt // fed at the next step
+	// Tokens fed so far. The engine keeps that much of the session, so a sampled
+	// token is fed back explicitly with the next step.
+	step := 0
+	cached := 0
+	allowed := make([]int32, 2)
+	var bad []int32
+	for len(out.ids) < maxTokens {
+		n, err := grammar.AllowedIDs(state, allowed)
+		if err != nil {
+			return nil, err
+		}
+		accepting := grammar.Accepting(state)
+		if n == 0 && accepting {
+			break
+		}
+		if n == 1 && !accepting {
+			state = grammar.Advance(state, allowed[0])
+			pending = append(pending, allowed[0])
+			out.push(allowed[0])
+			continue
+		}
+		
+		if bad, err = grammar.BadIDs(state, bad); err != nil {
+			return nil, err
+		}
+		config.BadIds = config.BadIds[:0]
+		for _, id := range bad {
+			config.BadIds = append(config.BadIds, int(id))
+		}
+		token, hit, err := e.forwardStep(ctx, request.session(step), pending, config)
+		if err != nil {
+			return nil, fmt.Errorf("inference failed: %v", err)
+		}
+		if step == 0 {
+			cached = hit
+		}
+		step += len(pending)
+		if token == eos && accepting {
+			break
+		}
+		next := grammar.Advance(state, token)
+		if next < 0 {
+			return nil, fmt.Errorf("inference failed: token %d is outside the grammar", token)
+		}
+		state = next
+		pending = []int32{token}
+		out.push(token)
+	}
+	
+	return &InferenceResult{
+		Text:         out.finish(),
+		TokensUsed:   len(prompt) + len(out.ids),
+		Finished:     true,
+		SessionID:    request.SessionID,
+		CachedTokens: cached,
+	}, nil
+}
+
+// generateSpeculative decodes a greedy request with the draft model. Each step
+// the draft proposes up to DraftTokens tokens and one request to the model
+// verifies them all: its input is the tokens the model has not seen yet plus
+// the proposal, and its logits give the model's own choice at every position.
+// The accepted prefix and the model's next token are kept, so a step yields 1
+// to DraftTokens+1 tokens for one forward of the model, all of them the tokens
+// greedy decoding picks. Both models continue one session each; a
+// step's Session.Step keeps only the accepted part of their history.
+func (e *Engine) generateSpeculative(ctx context.Context, request *InferenceRequest) (*InferenceResult, error) {
+	prompt := e.tokenizePrompt(request.Prompt)
+	config := e.createGenerationConfig(request)
+	maxTokens := config.MaxNewTokens
+	config.MinNewTokens = 0
+	verify := *config
+	verify.MaxNewTokens = 1
+	verify.OutputLogits = true
+	_, draftTokens := e.model.DraftModel()
+	
+	out, err := e.newTokenOutput(request)
+	if err != nil {
+		return nil, err
+	}
+	defer out.close()
+	
+	stops := map[int32]bool{e.eosID(): true}
+	for _, id := range config.StopIds {
+		stops[int32(id)] = true
+	}
+	
+	// Tokens each model has not been fed yet, and how many it has
+	pending, draftPending := prompt, prompt
+	step, draftStep := 0, 0
+	proposed, accepted, cached := 0, 0, 0
+	kept := make([]int32, draftTokens+1)
+	stopped := false
+	for !stopped && len(out.ids) < maxTokens {
+		// The model adds a token of its own, so the last one is never proposed
+		var proposal []int32
+		k := min(draftTokens, maxTokens-len(out.ids)-1)
+		if k > 0 {
+			config.MaxNewTokens = k
+			result, err := e.runStep(ctx, e.draftPool, request.session(draftStep), draftPending, config)
+			if err != nil {
+				return nil, fmt.Errorf("draft failed: %v", err)
+			}
+			ids, err := e.outputIDs(result)
+			if err != nil {
+				result.Close()
+				return nil, fmt.Errorf("draft failed: %v", err)
+			}
+			// ids may view the result's memory, so copy them out before closing it
+			proposal = append(proposal, ids[:min(len(ids), k)]...)
+			result.Close()
+		}
+		
+		input := append(append(make([]int32, 0, len(pending)+len(proposal)), pending...), proposal...)
+		result, err := e.runStep(ctx, e.pool, request.session(step), input, &verify)
+		if err != nil {
+			return nil, fmt.Errorf("inference failed: %v", err)
+		}
+		if step == 0 {
+			cached = result.PrefixHitLen
+		}
+		n, err := result.VerifyDraft(proposal, kept)
+		result.Close()
+		if err != nil {
+			return nil, fmt.Errorf("inference failed: %v", err)
+		}
+		proposed += len(proposal)
+		accepted += n - 1
+		
+		// Rejected proposals are cut from both histories; the model's own token
+		// is fed to both at the next step
+		last := kept[n-1]
+		step += len(pending) + n - 1
+		pending = []int32{last}
+		if k > 0 {
+			draftStep += len(draftPending) + n - 1
+			draftPending = []int32{last}
+		} else {
+			draftPending = append(draftPending[:len(draftPending):len(draftPending)], last)
+		}
+		
+		for _, token := range kept[:min(n, maxTokens-len(out.ids))] {
+			out.push(token)
+			if stops[token] {
+				stopped = true
+				break
+			}
+		}
+	}
+	
+	return &InferenceResult{
+		Text:           out.finish(),
+		TokensUsed:     len(prompt) + len(out.ids),
+		Finished:       true,
+		SessionID:      request.SessionID,
+		CachedTokens:   cached,
+		DraftTokens:    proposed,
+		AcceptedTokens: accepted,
+	}, nil
+}
+
+// tokenOutput collects generated tokens for a request that runs as several
+// engine requests, handing their text to OnText piece by piece when streaming
+type tokenOutput struct {
+	request *InferenceRequest
+	stream  *Detokenizer
+	ids     []int32
+	text    func([]int32) string
+}
+
+func (e *Engine) newTokenOutput(request *InferenceRequest) (*tokenOutput, error) {
+	out := &tokenOutput{request: request, text: e.detokenize}
+	if request.OnText != nil && request.StreamOutput && e.native != nil {
+		stream, err := e.native.NewDetokenizer(true)
+		if err != nil {
+			return nil, err
+		}
+		out.stream = stream
+	}
+	return out, nil
+}
+
+func (o *tokenOutput) push(token int32) {
+	o.ids = append(o.ids, token)
+	if o.stream != nil {
+		if piece, err := o.stream.Push([]int32{token}); err == nil && piece != "" {
+			o.request.OnText(piece)
+		}
+	}
+}
+
+// finish returns the text, delivering the rest of it (or all of it) to OnText
+func (o *tokenOutput) finish() string {
+	text := o.text(o.ids)
+	if o.stream != nil {
+		if rest, err := o.stream.Finish(); err == nil && rest != "" {
+			o.request.OnText(rest)
+		}
+	} else if o.request.OnText != nil {
+		o.request.OnText(text)
+	}
+	return text
+}
+
+func (o *tokenOutput) close() {
+	if o.stream != nil {
+		o.stream.Close()
+	}
+}
+
+// eosID is the token that ends generation
+func (e *Engine) eosID() int32 {
+	if e.native != nil {
+		return int32(e.native.EOS())
+	}
+	return 2 // matches the fallback tokenizer
+}
+
+// forwardStep runs one request over ids and returns the last token it generated
+// and its prefix cache hit length
+func (e *Engine) forwardStep(ctx context.Context, session *Session, ids []int32, config *GenerationConfig) (int32, int, error) {
+	result, err := e.runStep(ctx, e.pool, session, ids, config)
+	if err != nil {
+		return 0, 0, err
+	}
+	defer result.Close()
+	
+	tokens, err := e.outputIDs(result)
+	if err != nil {
+		return 0, 0, err
+	}
+	if len(tokens) == 0 {
+		return 0, 0, errors.New("no token generated")
+	}
+	return tokens[len(tokens)-1], result.PrefixHitLen, nil
+}
+
+// runStep runs one request over ids on pool and returns it once it finished;
+// the caller closes it
+func (e *Engine) runStep(ctx context.Context, pool *InstancePool, session *Session, ids []int32, config *GenerationConfig) (*ForwardResult, error) {
+	n := len(ids)
+	buf, err := AllocPinned(4 * (n + 1))
+	if err != nil {
+		return nil, err
+	}
+	defer ReleasePinned(buf)
+	pinned := unsafe.Slice((*int32)(buf), n+1)
+	copy(pinned, ids)
+	pinned[n] = int32(n)
 	
-	// Generate different text based on seq_len (which varies by session)
-	mockResponses := []string{
-		"Hello! I'm doing well, thank you for asking.",
-		"The capital of France is Paris.",
-		"Quantum computing uses quantum mechanics to process information.",
-		"AI brings wisdom to code, intelligence to data, hope to humanity's future.",
-		"Generated response with varied content based on session.",
+	tensorMap, err := pool.BuildInputs([]TensorDesc{
+		{Name: "input_ids", Data: buf, Shape: []int64{1, int64(n)}, DType: TypeInt32, Memory: MemoryCPUPinned, DeviceID: e.deviceID},
+		{Name: "sequence_length", Data: unsafe.Pointer(&pinned[n]), Shape: []int64{1}, DType: TypeInt32, Memory: MemoryCPUPinned, DeviceID: e.deviceID},
+	})
+	if err != nil {
+		return nil, err
 	}
+	defer tensorMap.Close()
 	
-	// Use seq_len to pick different responses
-	responseIndex := (result.SeqLen / 10) % len(mockResponses)
-	if responseIndex >= len(mockResponses) {
-		responseIndex = len(mockResponses) - 1
+	result, err := pool.ForwardAsync(tensorMap, session, config, false)
+	if err != nil {
+		return nil, err
+	}
+	if err := result.Wait(ctx); err != nil {
+		if ctx.Err() != nil {
+			// Inputs must stay alive until the engine lets go of the request
+			result.Cancel()
+			result.Wait(context.Background())
+		}
+		result.Close()
+		return nil, err
+	}
+	return result, nil
+}
+
+// streamText hands the request's text to onText as its tokens arrive
+func (e *Engine) streamText(ctx context.Context, result *ForwardResult, onText func(string)) error {
+	stream, err := result.TokenStream()
+	if err != nil {
+		return err
+	}
+	d, err := e.native.NewDetokenizer(true)
+	if err != nil {
+		return err
+	}
+	defer d.Close()
+	
+	for {
+		text, err := stream.RecvText(ctx, d)
+		if err == io.EOF {
+			return nil
+		}
+		if err != nil {
+			return err
+		}
+		onText(text)
+	}
+}
+
+// extractOutput detokenizes the generated tokens, output_ids[:SeqLen]
+func (e *Engine) extractOutput(result *ForwardResult) (string, int, error) {
+	ids, err := e.outputIDs(result)
+	if err != nil {
+		return "", 0, err
+	}
+	return e.detokenize(ids), len(ids), nil
+}
+
+// outputIDs returns output_ids[:SeqLen], a view of the result's buffer unless
+// it lives on the GPU
+func (e *Engine) outputIDs(result *ForwardResult) ([]int32, error) {
+	view, err := result.Output("output_ids")
+	if err != nil {
+		return nil, err
+	}
+	n := result.SeqLen
+	if n*4 > view.ByteSize {
+		n = view.ByteSize / 4
+	}
+	if n <= 0 {
+		return nil, nil
+	}
+	
+	if view.Memory == MemoryGPU {
+		// Bring the used prefix over through a pinned buffer
+		buf, err := AllocPinned(n * 4)
+		if err != nil {
+			return nil, err
+		}
+		defer ReleasePinned(buf)
+		if err := result.CopyOutputAsync("output_ids", buf, n*4); err != nil {
+			return nil, err
+		}
+		if err := result.SyncOutputCopies(); err != nil {
+			return nil, err
+		}
+		return append([]int32(nil), unsafe.Slice((*int32)(buf), n)...), nil
+	}
+	
+	ids, err := view.Int32s()
+	if err != nil {
+		return nil, err
 	}
-	return mockResponses[responseIndex], nil
+	return ids[:n], nil
 }
 
 // Utility functions for creating engines
@@ -341,6 +1059,7 @@ func DefaultEngineConfig(modelDir string) *EngineConfig {
 		DeviceID:     0,
 		TensorPara:   1,
 		PipelinePara: 1,
+		NumInstances: 8,
 	}
 }
 
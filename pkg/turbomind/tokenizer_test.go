@@ -2,7 +2,9 @@ package turbomind
 
 import (
 	"os"
+	"strings"
 	"testing"
+	"unicode/utf8"
 
 	"github.com/stretchr/testify/assert"
 	"github.com/stretchr/testify/require"
@@ -315,6 +317,131 @@ func BenchmarkTokenizer(b *testing.B) {
 	})
 }
 
+func TestNativeTokenizer(t *testing.T) {
+	modelPath := os.Getenv("TEST_MODEL_PATH")
+	if modelPath == "" {
+		t.Skip("TEST_MODEL_PATH not set, skipping tokenizer tests")
+	}
+
+	native, err := NewNativeTokenizer(modelPath)
+	require.NoError(t, err)
+	defer native.Close()
+	reference, err := NewTokenizer(modelPath)
+	require.NoError(t, err)
+	defer reference.Close()
+
+	assert.Equal(t, reference.GetVocabSize(), native.VocabSize())
+
+	t.Run("MatchesReference", func(t *testing.T) {
+		texts := []string{
+			"Hello, world!",
+			"  leading and trailing spaces  ",
+			"Numbers 12345 and symbols #$%^&*()",
+			"多语言文本 and émojis 🎉",
+			"line\nbreaks\r\n\ttabs",
+		}
+		for _, text := range texts {
+			want, err := reference.EncodeWithBOS(text)
+			require.NoError(t, err)
+			got, err := native.Encode(text, true)
+			require.NoError(t, err)
+
+			wantIDs := make([]int32, len(want))
+			for i, id := range want {
+				wantIDs[i] = int32(id)
+			}
+			assert.Equal(t, wantIDs, got, "text: %q", text)
+
+			decoded, err := native.Decode(got, true)
+			require.NoError(t, err)
+			assert.Equal(t, text, decoded)
+		}
+	})
+
+	t.Run("EncodeIntoShortBuffer", func(t *testing.T) {
+		text := "The quick brown fox jumps over the lazy dog"
+		all, err := native.Encode(text, true)
+		require.NoError(t, err)
+		require.Greater(t, len(all), 4)
+
+		// The full count is reported and only the buffer is written
+		ids := make([]int32, 4)
+		n, err := native.EncodeInto(text, true, ids)
+		require.NoError(t, err)
+		assert.Equal(t, len(all), n)
+		assert.Equal(t, all[:4], ids)
+	})
+
+	t.Run("DetokenizerOneTokenAtATime", func(t *testing.T) {
+		text := "多语言文本 and émojis 🎉 split across tokens"
+		ids, err := native.Encode(text, true)
+		require.NoError(t, err)
+
+		d, err := native.NewDetokenizer(true)
+		require.NoError(t, err)
+		defer d.Close()
+
+		// Every piece is whole UTF-8 and together they make the full decode
+		var streamed strings.Builder
+		for _, id := range ids {
+			piece, err := d.Push([]int32{id})
+			require.NoError(t, err)
+			assert.True(t, utf8.ValidString(piece), "piece: %q", piece)
+			streamed.WriteString(piece)
+		}
+		rest, err := d.Finish()
+		require.NoError(t, err)
+		streamed.WriteString(rest)
+		assert.Equal(t, text, streamed.String())
+	})
+
+	t.Run("GrammarFollowsEncoding", func(t *testing.T) {
+		schema := `{"type":"object","properties":{"name":{"type":"string"},"age":{"type":"integer"}},"required":["name"]}`
+		grammar, err := native.CompileGrammar(GrammarJSONSchema, schema)
+		require.NoError(t, err)
+		defer grammar.Close()
+
+		// Any tokenization of a matching text walks the grammar to an accepting state
+		ids, err := native.Encode(`{"name": "Ada", "age": 36}`, false)
+		require.NoError(t, err)
+		state := grammar.Start()
+		for _, id := range ids {
+			state = grammar.Advance(state, id)
+			require.GreaterOrEqual(t, state, int32(0), "token %d", id)
+		}
+		assert.True(t, grammar.Accepting(state))
+
+		// Allowed and banned tokens partition the vocabulary
+		allowed, err := grammar.AllowedIDs(grammar.Start(), nil)
+		require.NoError(t, err)
+		bad, err := grammar.BadIDs(grammar.Start(), nil)
+		require.NoError(t, err)
+		assert.Equal(t, native.VocabSize(), allowed+len(bad))
+
+		_, err = native.CompileGrammar(GrammarRegex, `(unbalanced`)
+		assert.Error(t, err)
+	})
+}
+
+func BenchmarkNativeTokenizer(b *testing.B) {
+	modelPath := os.Getenv("TEST_MODEL_PATH")
+	if modelPath == "" {
+		b.Skip("TEST_MODEL_PATH not set, skipping tokenizer benchmarks")
+	}
+
+	native, err := NewNativeTokenizer(modelPath)
+	require.NoError(b, err)
+	defer native.Close()
+
+	text := "The quick brown fox jumps over the lazy dog. This is a benchmark test for tokenization performance."
+	ids := make([]int32, MaxTokens(len(text)))
+	b.SetBytes(int64(len(text)))
+	for i := 0; i < b.N; i++ {
+		_, err := native.EncodeInto(text, true, ids)
+		require.NoError(b, err)
+	}
+}
+
 // Helper function for older Go versions
 func min(a, b int) int {
 	if a < b {
@@ -10,9 +10,16 @@ package turbomind
 */
 import "C"
 import (
+	"context"
 	"errors"
 	"fmt"
+	"io"
+	"os"
 	"runtime"
+	"sync"
+	"sync/atomic"
+	"syscall"
+	"time"
 	"unsafe"
 )
 
@@ -58,7 +65,10 @@ const (
 
 // Model represents a TurboMind model
 type Model struct {
-	handle *C.TurboMindModel
+	handle    *C.TurboMindModel
+	setupOnce sync.Once
+	setupErr  error
+	draft     *Model // must outlive the handle
 }
 
 // ModelInstance represents a model instance for inference
@@ -66,12 +76,42 @@ type ModelInstance struct {
 	handle *C.TurboMindModelInstance
 }
 
+// InstancePool fans requests out over several model instances of one engine
+type InstancePool struct {
+	handle *C.TurboMindInstancePool
+}
+
 // Tensor represents a TurboMind tensor
 type Tensor struct {
 	handle *C.TurboMindTensor
 	shape  []int64
 	dtype  DataType
 	memory MemoryType
+	data   unsafe.Pointer // buffer owned by the tensor (pinned tensors only)
+}
+
+// TensorDesc describes one input tensor for BuildInputs. Data must point to C or
+// pinned memory (see AllocPinned) that stays valid until the request finishes.
+type TensorDesc struct {
+	Name     string
+	Data     unsafe.Pointer
+	Shape    []int64
+	DType    DataType
+	Memory   MemoryType
+	DeviceID int
+}
+
+// TensorView is a borrowed, zero-copy view of a tensor's buffer. Views of
+// request outputs stay valid until their ForwardResult is closed.
+type TensorView struct {
+	Data     unsafe.Pointer
+	Shape    []int64
+	DType    DataType
+	Memory   MemoryType
+	DeviceID int
+	ByteSize int
+	
+	owner interface{} // keeps the buffer's owner reachable while the view is in use
 }
 
 // TensorMap represents a collection of tensors
@@ -85,8 +125,22 @@ type Session struct {
 	Step      int
 	StartFlag bool
 	EndFlag   bool
+	// Pool submissions only: the scheduling class, and how long the request
+	// may wait in the queue before it is cancelled (0 waits indefinitely)
+	Priority   Priority
+	DeadlineMs uint32
 }
 
+// Priority is the scheduling class of a pool request. A class is served only
+// once every higher class has no queued requests.
+type Priority int
+
+const (
+	PriorityInteractive Priority = C.TM_PRIORITY_INTERACTIVE
+	PriorityBatch       Priority = C.TM_PRIORITY_BATCH
+	PriorityBackground  Priority = C.TM_PRIORITY_BACKGROUND
+)
+
 // GenerationConfig represents generation configuration
 type GenerationConfig struct {
 	MaxNewTokens             int
@@ -108,13 +162,17 @@ type GenerationConfig struct {
 // ForwardResult represents the result of forward inference
 type ForwardResult struct {
 	handle  *C.TurboMindForwardResult
+	events  *os.File
+	batch   *BatchResult // owner of batched results
 	Tensors *TensorMap
 	Status  RequestStatus
 	SeqLen  int
+	PrefixHitLen int // prompt tokens served from the prefix cache
 }
 
 // NewModel creates a new TurboMind model
 func NewModel(modelDir, config, weightType string) (*Model, error) {
+	defer lockThread()()
 	cModelDir := C.CString(modelDir)
 	defer C.free(unsafe.Pointer(cModelDir))
 	
@@ -132,7 +190,7 @@ func NewModel(modelDir, config, weightType string) (*Model, error) {
 	
 	handle := C.turbomind_create_model(cModelDir, cConfig, cWeightType)
 	if handle == nil {
-		return nil, fmt.Errorf("failed to create model: %s", GetLastError())
+		return nil, lastError("failed to create model")
 	}
 	
 	model := &Model{handle: handle}
@@ -149,25 +207,293 @@ func (m *Model) Close() {
 	}
 }
 
+// InitializeAllRanks creates, processes and binds the weights to an engine on
+// every local GPU in parallel. Rank of each device is nodeID*deviceCount+device;
+// deviceCount <= 0 uses tensor parallel size * pipeline parallel size.
+func (m *Model) InitializeAllRanks(nodeID, deviceCount int) error {
+	defer lockThread()()
+	if m.handle == nil {
+		return errors.New("model is closed")
+	}
+	
+	if C.turbomind_initialize_all_ranks(m.handle, C.int(nodeID), C.int(deviceCount)) != 0 {
+		return lastError("failed to initialize ranks")
+	}
+	return nil
+}
+
+// SetWeightSource makes InitializeAllRanks stream weights from weightsDir (one
+// raw file per parameter) using numThreads loader threads per rank
+func (m *Model) SetWeightSource(weightsDir string, numThreads int) error {
+	defer lockThread()()
+	if m.handle == nil {
+		return errors.New("model is closed")
+	}
+	
+	cDir := C.CString(weightsDir)
+	defer C.free(unsafe.Pointer(cDir))
+	
+	if C.turbomind_set_weight_source(m.handle, cDir, C.int(numThreads), nil, nil) != 0 {
+		return lastError("failed to set weight source")
+	}
+	return nil
+}
+
+// SetSnapshotDir makes InitializeAllRanks restore weights from a per-rank
+// snapshot in dir when one matches this model and GPU, and write one after
+// loading from the weight source otherwise. An empty dir disables snapshots.
+func (m *Model) SetSnapshotDir(dir string) error {
+	defer lockThread()()
+	if m.handle == nil {
+		return errors.New("model is closed")
+	}
+	
+	var cDir *C.char
+	if dir != "" {
+		cDir = C.CString(dir)
+		defer C.free(unsafe.Pointer(cDir))
+	}
+	
+	if C.turbomind_set_snapshot_dir(m.handle, cDir) != 0 {
+		return lastError("failed to set snapshot dir")
+	}
+	return nil
+}
+
+// PrefixCacheStats are counters of a model's prefix cache
+type PrefixCacheStats struct {
+	Blocks       int
+	PinnedBlocks int
+	Lookups      uint64
+	LookupTokens uint64
+	HitTokens    uint64
+}
+
+// EnablePrefixCache turns on the index of cached prompt prefixes, in blocks of
+// blockLen tokens (the engine's cache_block_seq_len) up to maxBlocks. The
+// engine itself must run with enable_prefix_caching set in its config. Call
+// before creating instances.
+func (m *Model) EnablePrefixCache(blockLen, maxBlocks int) error {
+	defer lockThread()()
+	if m.handle == nil {
+		return errors.New("model is closed")
+	}
+	if blockLen <= 0 || maxBlocks <= 0 {
+		return errors.New("block length and capacity must be positive")
+	}
+	
+	if C.turbomind_enable_prefix_cache(m.handle, C.int(blockLen), C.size_t(maxBlocks)) != 0 {
+		return lastError("failed to enable prefix cache")
+	}
+	return nil
+}
+
+// PrefixCacheStats returns the prefix cache counters (zero when disabled)
+func (m *Model) PrefixCacheStats() PrefixCacheStats {
+	var stats C.TurboMindPrefixCacheStats
+	if m.handle != nil {
+		C.turbomind_get_prefix_cache_stats(m.handle, &stats)
+	}
+	return PrefixCacheStats{
+		Blocks:       int(stats.blocks),
+		PinnedBlocks: int(stats.pinned_blocks),
+		Lookups:      uint64(stats.lookups),
+		LookupTokens: uint64(stats.lookup_tokens),
+		HitTokens:    uint64(stats.hit_tokens),
+	}
+}
+
+// SessionOffloadStats are counters of a model's session store
+type SessionOffloadStats struct {
+	Sessions  int
+	Suspended int
+	Spilled   int
+	HostBytes int64
+}
+
+// EnableSessionOffload starts recording session histories so idle sessions can
+// be suspended (freeing their KV cache) and resumed later. Suspended histories
+// beyond hostLimit bytes spill to spillDir when it is set. Call before creating
+// instances.
+func (m *Model) EnableSessionOffload(hostLimit int64, spillDir string) error {
+	defer lockThread()()
+	if m.handle == nil {
+		return errors.New("model is closed")
+	}
+	if hostLimit < 0 {
+		return errors.New("host limit cannot be negative")
+	}
+	
+	var cDir *C.char
+	if spillDir != "" {
+		cDir = C.CString(spillDir)
+		defer C.free(unsafe.Pointer(cDir))
+	}
+	
+	if C.turbomind_enable_session_offload(m.handle, C.size_t(hostLimit), cDir) != 0 {
+		return lastError("failed to enable session offload")
+	}
+	return nil
+}
+
+// SessionOffloadStats returns the session store counters (zero when disabled)
+func (m *Model) SessionOffloadStats() SessionOffloadStats {
+	var stats C.TurboMindSessionOffloadStats
+	if m.handle != nil {
+		C.turbomind_get_session_offload_stats(m.handle, &stats)
+	}
+	return SessionOffloadStats{
+		Sessions:  int(stats.sessions),
+		Suspended: int(stats.suspended),
+		Spilled:   int(stats.spilled),
+		HostBytes: int64(stats.host_bytes),
+	}
+}
+
+// Metrics is a snapshot of a model's serving state. Fields the engine does not
+// expose (KV block counts, GPU memory without a device) are -1.
+type Metrics struct {
+	ActiveRequests     int64
+	QueuedRequests     int64
+	DecodeBatchSize    int64
+	CompletedRequests  uint64
+	FailedRequests     uint64
+	CancelledRequests  uint64
+	PromptTokens       uint64
+	GeneratedTokens    uint64
+	TokensPerSecond    float64 // since the previous Metrics call
+	KVBlocksUsed       int64
+	KVBlocksFree       int64
+	PrefixCacheHitRate float64
+	GPUMemoryTotal     int64
+	GPUMemoryUsed      int64
+	PinnedHostInUse    uint64
+	PinnedHostCached   uint64
+	DraftTokensProposed uint64 // speculative decoding, see AttachDraftModel
+	DraftTokensAccepted uint64
+	DeadlineMisses      uint64 // pool requests cancelled at their queueing deadline
+	PreemptedSessions   uint64 // background sessions suspended by a pool's scheduler
+}
+
+// Metrics reads the model's counters; GPU memory is reported for deviceID.
+// It only loads atomics, so scraping it periodically does not slow requests.
+func (m *Model) Metrics(deviceID int) (Metrics, error) {
+	defer lockThread()()
+	if m.handle == nil {
+		return Metrics{}, errors.New("model is closed")
+	}
+	
+	var c C.TurboMindMetrics
+	if C.turbomind_get_metrics(m.handle, C.int(deviceID), &c) != 0 {
+		return Metrics{}, lastError("failed to read metrics")
+	}
+	return Metrics{
+		ActiveRequests:     int64(c.active_requests),
+		QueuedRequests:     int64(c.queued_requests),
+		DecodeBatchSize:    int64(c.decode_batch_size),
+		CompletedRequests:  uint64(c.completed_requests),
+		FailedRequests:     uint64(c.failed_requests),
+		CancelledRequests:  uint64(c.cancelled_requests),
+		PromptTokens:       uint64(c.prompt_tokens),
+		GeneratedTokens:    uint64(c.generated_tokens),
+		TokensPerSecond:    float64(c.tokens_per_second),
+		KVBlocksUsed:       int64(c.kv_blocks_used),
+		KVBlocksFree:       int64(c.kv_blocks_free),
+		PrefixCacheHitRate: float64(c.prefix_cache_hit_rate),
+		GPUMemoryTotal:     int64(c.gpu_memory_total),
+		GPUMemoryUsed:      int64(c.gpu_memory_used),
+		PinnedHostInUse:    uint64(c.pinned_host_in_use),
+		PinnedHostCached:   uint64(c.pinned_host_cached),
+		DraftTokensProposed: uint64(c.draft_tokens_proposed),
+		DraftTokensAccepted: uint64(c.draft_tokens_accepted),
+		DeadlineMisses:      uint64(c.deadline_misses),
+		PreemptedSessions:   uint64(c.preempted_sessions),
+	}, nil
+}
+
+// AttachDraftModel pairs the model with a smaller draft model for speculative
+// decoding: the draft proposes numTokens tokens per step and one request to
+// this model verifies them (see ForwardResult.VerifyDraft). The draft must
+// share the model's vocabulary; the model keeps it alive.
+func (m *Model) AttachDraftModel(draft *Model, numTokens int) error {
+	defer lockThread()()
+	if m.handle == nil || draft == nil || draft.handle == nil {
+		return errors.New("model is closed")
+	}
+	if C.turbomind_attach_draft_model(m.handle, draft.handle, C.int(numTokens)) != 0 {
+		return lastError("failed to attach draft model")
+	}
+	m.draft = draft
+	return nil
+}
+
+// DraftModel returns the attached draft model and its tokens per step, nil without one
+func (m *Model) DraftModel() (*Model, int) {
+	if m.handle == nil || m.draft == nil {
+		return nil, 0
+	}
+	var numTokens C.int
+	C.turbomind_get_draft_model(m.handle, &numTokens)
+	return m.draft, int(numTokens)
+}
+
+// SetPrefillChunkSize makes the model's pools prefill host prompts longer
+// than tokens in chunks of that size, so a long prompt delays the next token
+// of other sessions by one chunk rather than its whole prefill. Requests with
+// embeddings or per-position logits run whole. The config's
+// prefill_chunk_size sets the initial value; 0 disables.
+func (m *Model) SetPrefillChunkSize(tokens int) error {
+	defer lockThread()()
+	if m.handle == nil {
+		return errors.New("model is closed")
+	}
+	if C.turbomind_set_prefill_chunk_size(m.handle, C.int(tokens)) != 0 {
+		return lastError("failed to set prefill chunk size")
+	}
+	return nil
+}
+
+// PrefillChunkSize returns the prefill chunk size, 0 when prompts prefill whole
+func (m *Model) PrefillChunkSize() int {
+	if m.handle == nil {
+		return 0
+	}
+	return int(C.turbomind_get_prefill_chunk_size(m.handle))
+}
+
+// LoadProgress reports how many weight bytes have reached the GPU so far
+func (m *Model) LoadProgress() (done, total uint64) {
+	if m.handle == nil {
+		return 0, 0
+	}
+	var cDone, cTotal C.uint64_t
+	C.turbomind_get_load_progress(m.handle, &cDone, &cTotal)
+	return uint64(cDone), uint64(cTotal)
+}
+
+// setup brings up all ranks of a single-node deployment (runs once per model)
+func (m *Model) setup() error {
+	m.setupOnce.Do(func() {
+		m.setupErr = m.InitializeAllRanks(0, 0)
+	})
+	return m.setupErr
+}
+
 // CreateInstance creates a model instance for inference
 func (m *Model) CreateInstance(deviceID int) (*ModelInstance, error) {
+	defer lockThread()()
 	if m.handle == nil {
 		return nil, errors.New("model is closed")
 	}
 	
-	// Step 1: Create shared weights (uses rank index - must be 0 for single GPU)
-	C.turbomind_create_shared_weights(m.handle, C.int(0), C.int(0)) // device_id=0, rank=0 for single GPU
-	
-	// Step 2: Process weights (uses device_id index - must be 0 for single GPU)
-	C.turbomind_process_weights(m.handle, C.int(0), C.int(0)) // device_id=0, rank=0 for single GPU
-	
-	// Step 3: Create engine (uses device_id index - must be 0 for single GPU) 
-	C.turbomind_create_engine(m.handle, C.int(0), C.int(0)) // device_id=0, rank=0 for single GPU
+	if err := m.setup(); err != nil {
+		return nil, err
+	}
 	
-	// Step 3: Create model instance
+	// Create model instance
 	handle := C.turbomind_create_model_instance(m.handle, C.int(deviceID))
 	if handle == nil {
-		return nil, fmt.Errorf("failed to create model instance: %s", GetLastError())
+		return nil, lastError("failed to create model instance")
 	}
 	
 	instance := &ModelInstance{handle: handle}
@@ -175,6 +501,28 @@ func (m *Model) CreateInstance(deviceID int) (*ModelInstance, error) {
 	return instance, nil
 }
 
+// CreateInstancePool creates a pool of numInstances model instances so that
+// concurrent requests reach the engine's continuous batching together
+func (m *Model) CreateInstancePool(deviceID, numInstances int) (*InstancePool, error) {
+	defer lockThread()()
+	if m.handle == nil {
+		return nil, errors.New("model is closed")
+	}
+	
+	if err := m.setup(); err != nil {
+		return nil, err
+	}
+	
+	handle := C.turbomind_create_instance_pool(m.handle, C.int(deviceID), C.int(numInstances))
+	if handle == nil {
+		return nil, lastError("failed to create instance pool")
+	}
+	
+	pool := &InstancePool{handle: handle}
+	runtime.SetFinalizer(pool, (*InstancePool).Close)
+	return pool, nil
+}
+
 // GetTensorParaSize returns tensor parallelism size
 func (m *Model) GetTensorParaSize() int {
 	if m.handle == nil {
@@ -200,215 +548,1064 @@ func (mi *ModelInstance) Close() {
 	}
 }
 
-// Forward performs forward inference
+// Forward performs forward inference and blocks until the request finishes
 func (mi *ModelInstance) Forward(inputTensors *TensorMap, session *Session, genConfig *GenerationConfig, streamOutput bool) (*ForwardResult, error) {
+	defer lockThread()()
 	if mi.handle == nil {
 		return nil, errors.New("model instance is closed")
 	}
 	
-	// Convert session
-	cSession := C.TurboMindSession{
-		id:         C.uint64_t(session.ID),
-		step:       C.int(session.Step),
-		start_flag: C.bool(session.StartFlag),
-		end_flag:   C.bool(session.EndFlag),
-	}
-	
-	// Convert generation config
-	cGenConfig := C.TurboMindGenerationConfig{
-		max_new_tokens:              C.int(genConfig.MaxNewTokens),
-		min_new_tokens:              C.int(genConfig.MinNewTokens),
-		top_p:                       C.float(genConfig.TopP),
-		top_k:                       C.int(genConfig.TopK),
-		min_p:                       C.float(genConfig.MinP),
-		temperature:                 C.float(genConfig.Temperature),
-		repetition_penalty:          C.float(genConfig.RepetitionPenalty),
-		random_seed:                 C.uint64_t(genConfig.RandomSeed),
-		output_logprobs:             C.bool(genConfig.OutputLogprobs),
-		output_last_hidden_state:    C.bool(genConfig.OutputLastHiddenState),
-		output_logits:               C.bool(genConfig.OutputLogits),
-	}
-	
-	// Convert arrays
-	var cEosIds *C.int
-	var cStopIds *C.int
-	var cBadIds *C.int
+	cSession := session.toC()
+	cGenConfig, free := genConfig.toC()
+	defer free()
 	
-	if len(genConfig.EosIds) > 0 {
-		cEosIds = (*C.int)(C.malloc(C.size_t(len(genConfig.EosIds)) * C.sizeof_int))
-		defer C.free(unsafe.Pointer(cEosIds))
-		cEosSlice := (*[1 << 30]C.int)(unsafe.Pointer(cEosIds))
-		for i, id := range genConfig.EosIds {
-			cEosSlice[i] = C.int(id)
-		}
-		cGenConfig.eos_ids = cEosIds
-		cGenConfig.eos_ids_count = C.int(len(genConfig.EosIds))
+	// Call forward
+	handle := C.turbomind_forward(mi.handle, inputTensors.handle, &cSession, &cGenConfig, C.bool(streamOutput))
+	if handle == nil {
+		return nil, lastError("forward inference failed")
 	}
 	
-	if len(genConfig.StopIds) > 0 {
-		cStopIds = (*C.int)(C.malloc(C.size_t(len(genConfig.StopIds)) * C.sizeof_int))
-		defer C.free(unsafe.Pointer(cStopIds))
-		cStopSlice := (*[1 << 30]C.int)(unsafe.Pointer(cStopIds))
-		for i, id := range genConfig.StopIds {
-			cStopSlice[i] = C.int(id)
-		}
-		cGenConfig.stop_ids = cStopIds
-		cGenConfig.stop_ids_count = C.int(len(genConfig.StopIds))
+	result := newForwardResult(handle)
+	result.refresh()
+	return result, nil
+}
+
+// ForwardAsync submits a forward request and returns immediately. Use Wait on
+// the returned result to block until generation finishes.
+func (mi *ModelInstance) ForwardAsync(inputTensors *TensorMap, session *Session, genConfig *GenerationConfig, streamOutput bool) (*ForwardResult, error) {
+	defer lockThread()()
+	if mi.handle == nil {
+		return nil, errors.New("model instance is closed")
 	}
 	
-	if len(genConfig.BadIds) > 0 {
-		cBadIds = (*C.int)(C.malloc(C.size_t(len(genConfig.BadIds)) * C.sizeof_int))
-		defer C.free(unsafe.Pointer(cBadIds))
-		cBadSlice := (*[1 << 30]C.int)(unsafe.Pointer(cBadIds))
-		for i, id := range genConfig.BadIds {
-			cBadSlice[i] = C.int(id)
-		}
-		cGenConfig.bad_ids = cBadIds
-		cGenConfig.bad_ids_count = C.int(len(genConfig.BadIds))
-	}
+	cSession := session.toC()
+	cGenConfig, free := genConfig.toC()
+	defer free()
 	
-	// Call forward
-	handle := C.turbomind_forward(mi.handle, inputTensors.handle, &cSession, &cGenConfig, C.bool(streamOutput))
+	handle := C.turbomind_forward_async(mi.handle, inputTensors.handle, &cSession, &cGenConfig, C.bool(streamOutput), nil, nil)
 	if handle == nil {
-		return nil, fmt.Errorf("forward inference failed: %s", GetLastError())
+		return nil, lastError("forward inference failed")
 	}
 	
-	result := &ForwardResult{handle: handle}
-	runtime.SetFinalizer(result, (*ForwardResult).Close)
-	return result, nil
+	return newForwardResult(handle), nil
 }
 
-// EndSession ends an inference session
-func (mi *ModelInstance) EndSession(sessionID uint64) {
-	if mi.handle != nil {
-		C.turbomind_end_session(mi.handle, C.uint64_t(sessionID))
-	}
+func newForwardResult(handle *C.TurboMindForwardResult) *ForwardResult {
+	result := &ForwardResult{handle: handle}
+	runtime.SetFinalizer(result, (*ForwardResult).Close)
+	return result
 }
 
-// Cancel cancels current request
-func (mi *ModelInstance) Cancel() {
-	if mi.handle != nil {
-		C.turbomind_cancel_request(mi.handle)
+// toC converts the session to its C representation
+func (s *Session) toC() C.TurboMindSession {
+	return C.TurboMindSession{
+		id:         C.uint64_t(s.ID),
+		step:       C.int(s.Step),
+		start_flag: C.bool(s.StartFlag),
+		end_flag:   C.bool(s.EndFlag),
+		priority:    C.TurboMindPriority(s.Priority),
+		deadline_ms: C.uint32_t(s.DeadlineMs),
 	}
 }
 
-// NewTensor creates a new tensor
-func NewTensor(data unsafe.Pointer, shape []int64, dtype DataType, memory MemoryType, deviceID int) (*Tensor, error) {
-	if data == nil || len(shape) == 0 {
-		return nil, errors.New("invalid tensor parameters")
+// toC converts the generation config to its C representation. The returned
+// function releases the C arrays and must be called once the config is no longer used.
+func (g *GenerationConfig) toC() (C.TurboMindGenerationConfig, func()) {
+	cGenConfig := C.TurboMindGenerationConfig{
+		max_new_tokens:              C.int(g.MaxNewTokens),
+		min_new_tokens:              C.int(g.MinNewTokens),
+		top_p:                       C.float(g.TopP),
+		top_k:                       C.int(g.TopK),
+		min_p:                       C.float(g.MinP),
+		temperature:                 C.float(g.Temperature),
+		repetition_penalty:          C.float(g.RepetitionPenalty),
+		random_seed:                 C.uint64_t(g.RandomSeed),
+		output_logprobs:             C.bool(g.OutputLogprobs),
+		output_last_hidden_state:    C.bool(g.OutputLastHiddenState),
+		output_logits:               C.bool(g.OutputLogits),
 	}
 	
-	// Convert shape to C array
-	cShape := (*C.int64_t)(C.malloc(C.size_t(len(shape)) * C.sizeof_int64_t))
-	defer C.free(unsafe.Pointer(cShape))
-	cShapeSlice := (*[1 << 30]C.int64_t)(unsafe.Pointer(cShape))
-	for i, s := range shape {
-		cShapeSlice[i] = C.int64_t(s)
+	// Convert arrays
+	var allocs []unsafe.Pointer
+	toCInts := func(ids []int) (*C.int, C.int) {
+		if len(ids) == 0 {
+			return nil, 0
+		}
+		ptr := (*C.int)(C.malloc(C.size_t(len(ids)) * C.sizeof_int))
+		allocs = append(allocs, unsafe.Pointer(ptr))
+		slice := (*[1 << 30]C.int)(unsafe.Pointer(ptr))
+		for i, id := range ids {
+			slice[i] = C.int(id)
+		}
+		return ptr, C.int(len(ids))
 	}
 	
-	handle := C.turbomind_create_tensor(data, cShape, C.int(len(shape)), 
-		C.TurboMindDataType(dtype), C.TurboMindMemoryType(memory), C.int(deviceID))
-	if handle == nil {
-		return nil, fmt.Errorf("failed to create tensor: %s", GetLastError())
-	}
+	cGenConfig.eos_ids, cGenConfig.eos_ids_count = toCInts(g.EosIds)
+	cGenConfig.stop_ids, cGenConfig.stop_ids_count = toCInts(g.StopIds)
+	cGenConfig.bad_ids, cGenConfig.bad_ids_count = toCInts(g.BadIds)
 	
-	tensor := &Tensor{
-		handle: handle,
-		shape:  make([]int64, len(shape)),
-		dtype:  dtype,
-		memory: memory,
+	return cGenConfig, func() {
+		for _, ptr := range allocs {
+			C.free(ptr)
+		}
 	}
-	copy(tensor.shape, shape)
-	
-	runtime.SetFinalizer(tensor, (*Tensor).Close)
-	return tensor, nil
 }
 
-// Close destroys the tensor
-func (t *Tensor) Close() {
-	if t.handle != nil {
-		C.turbomind_destroy_tensor(t.handle)
-		t.handle = nil
-		runtime.SetFinalizer(t, nil)
-	}
+// GenerationPreset is an immutable generation config converted once on the C
+// side. Presets built from equal configs share one interned handle, and a
+// preset can be used for any number of concurrent requests.
+type GenerationPreset struct {
+	handle *C.TurboMindGenerationConfigHandle
 }
 
-// Shape returns tensor shape
-func (t *Tensor) Shape() []int64 {
-	return t.shape
+// NewGenerationPreset converts genConfig into a reusable preset
+func NewGenerationPreset(genConfig *GenerationConfig) (*GenerationPreset, error) {
+	defer lockThread()()
+	cGenConfig, free := genConfig.toC()
+	defer free()
+	
+	handle := C.turbomind_create_generation_config(&cGenConfig)
+	if handle == nil {
+		return nil, lastError("failed to create generation preset")
+	}
+	return newGenerationPreset(handle), nil
 }
 
-// DataType returns tensor data type
-func (t *Tensor) DataType() DataType {
-	return t.dtype
+func newGenerationPreset(handle *C.TurboMindGenerationConfigHandle) *GenerationPreset {
+	preset := &GenerationPreset{handle: handle}
+	runtime.SetFinalizer(preset, (*GenerationPreset).Close)
+	return preset
 }
 
-// MemoryType returns tensor memory type
-func (t *Tensor) MemoryType() MemoryType {
-	return t.memory
+// Clone returns a new reference to the same preset, closed independently
+func (p *GenerationPreset) Clone() *GenerationPreset {
+	return newGenerationPreset(C.turbomind_retain_generation_config(p.handle))
 }
 
-// Size returns tensor size in bytes
-func (t *Tensor) Size() int {
-	if t.handle == nil {
-		return 0
+// Close drops this reference to the preset
+func (p *GenerationPreset) Close() {
+	if p.handle != nil {
+		C.turbomind_release_generation_config(p.handle)
+		p.handle = nil
+		runtime.SetFinalizer(p, nil)
 	}
-	return int(C.turbomind_get_tensor_size(t.handle))
 }
 
-// CopyFrom copies data from another tensor
-func (t *Tensor) CopyFrom(src *Tensor) error {
-	if t.handle == nil || src.handle == nil {
-		return errors.New("tensor is closed")
+// ForwardPreset is ForwardAsync with a preset instead of a per-call config
+func (mi *ModelInstance) ForwardPreset(inputTensors *TensorMap, session *Session, preset *GenerationPreset, streamOutput bool) (*ForwardResult, error) {
+	defer lockThread()()
+	if mi.handle == nil {
+		return nil, errors.New("model instance is closed")
+	}
+	if preset.handle == nil {
+		return nil, errors.New("generation preset is closed")
 	}
 	
-	C.turbomind_copy_tensor(t.handle, src.handle)
-	if err := GetLastError(); err != "" {
-		return fmt.Errorf("copy failed: %s", err)
+	cSession := session.toC()
+	handle := C.turbomind_forward_with_config(mi.handle, inputTensors.handle, &cSession, preset.handle, C.bool(streamOutput), nil, nil)
+	runtime.KeepAlive(preset)
+	if handle == nil {
+		return nil, lastError("forward inference failed")
 	}
 	
+	return newForwardResult(handle), nil
+}
+
+// SuspendSession frees an idle session's KV cache, keeping its history so
+// ResumeSession can rebuild it. Requires Model.EnableSessionOffload.
+func (mi *ModelInstance) SuspendSession(sessionID uint64) error {
+	defer lockThread()()
+	if mi.handle == nil {
+		return errors.New("model instance is closed")
+	}
+	if C.turbomind_suspend_session(mi.handle, C.uint64_t(sessionID)) != 0 {
+		return lastError("failed to suspend session")
+	}
 	return nil
 }
 
-// NewTensorMap creates a new tensor map
-func NewTensorMap() *TensorMap {
-	handle := C.turbomind_create_tensor_map()
+// ResumeSession starts rebuilding a suspended session. Wait on the result
+// before sending the session's next step.
+func (mi *ModelInstance) ResumeSession(sessionID uint64) (*ForwardResult, error) {
+	defer lockThread()()
+	if mi.handle == nil {
+		return nil, errors.New("model instance is closed")
+	}
+	handle := C.turbomind_resume_session(mi.handle, C.uint64_t(sessionID))
 	if handle == nil {
-		return nil
+		return nil, lastError("failed to resume session")
 	}
-	
-	tensorMap := &TensorMap{handle: handle}
-	runtime.SetFinalizer(tensorMap, (*TensorMap).Close)
-	return tensorMap
+	return newForwardResult(handle), nil
 }
 
-// Close destroys the tensor map
-func (tm *TensorMap) Close() {
-	if tm.handle != nil {
-		C.turbomind_destroy_tensor_map(tm.handle)
-		tm.handle = nil
-		runtime.SetFinalizer(tm, nil)
+// EndSession ends an inference session
+func (mi *ModelInstance) EndSession(sessionID uint64) {
+	if mi.handle != nil {
+		C.turbomind_end_session(mi.handle, C.uint64_t(sessionID))
 	}
 }
 
-// Set sets a tensor in the map
-func (tm *TensorMap) Set(key string, tensor *Tensor) error {
-	if tm.handle == nil {
-		return errors.New("tensor map is closed")
+// Cancel cancels current request
+func (mi *ModelInstance) Cancel() {
+	if mi.handle != nil {
+		C.turbomind_cancel_request(mi.handle)
+	}
+}
+
+// Close destroys the pool, cancelling queued and running requests
+func (p *InstancePool) Close() {
+	if p.handle != nil {
+		C.turbomind_destroy_instance_pool(p.handle)
+		p.handle = nil
+		runtime.SetFinalizer(p, nil)
+	}
+}
+
+// ForwardAsync submits a request to the first free instance (or queues it) and
+// returns immediately. Safe for concurrent use.
+func (p *InstancePool) ForwardAsync(inputTensors *TensorMap, session *Session, genConfig *GenerationConfig, streamOutput bool) (*ForwardResult, error) {
+	defer lockThread()()
+	if p.handle == nil {
+		return nil, errors.New("instance pool is closed")
 	}
 	
-	cKey := C.CString(key)
-	defer C.free(unsafe.Pointer(cKey))
+	cSession := session.toC()
+	cGenConfig, free := genConfig.toC()
+	defer free()
 	
-	result := C.turbomind_tensor_map_set(tm.handle, cKey, tensor.handle)
-	if result != 0 {
-		return fmt.Errorf("failed to set tensor: %s", GetLastError())
+	handle := C.turbomind_pool_forward_async(p.handle, inputTensors.handle, &cSession, &cGenConfig, C.bool(streamOutput), nil, nil)
+	if handle == nil {
+		return nil, lastError("forward inference failed")
 	}
 	
-	return nil
+	return newForwardResult(handle), nil
 }
 
-// Get gets a tensor from the map
+// ForwardPreset is ForwardAsync with a preset instead of a per-call config.
+// Safe for concurrent use.
+func (p *InstancePool) ForwardPreset(inputTensors *TensorMap, session *Session, preset *GenerationPreset, streamOutput bool) (*ForwardResult, error) {
+	defer lockThread()()
+	if p.handle == nil {
+		return nil, errors.New("instance pool is closed")
+	}
+	if preset.handle == nil {
+		return nil, errors.New("generation preset is closed")
+	}
+	
+	cSession := session.toC()
+	handle := C.turbomind_pool_forward_with_config(p.handle, inputTensors.handle, &cSession, preset.handle, C.bool(streamOutput), nil, nil)
+	runtime.KeepAlive(preset)
+	if handle == nil {
+		return nil, lastError("forward inference failed")
+	}
+	
+	return newForwardResult(handle), nil
+}
+
+// BatchRequest is one request of a ForwardBatch call
+type BatchRequest struct {
+	Inputs    *TensorMap
+	Session   *Session
+	GenConfig *GenerationConfig // nil uses the batch's shared config
+}
+
+// BatchResult holds the results of a ForwardBatch call in submission order.
+// Results are owned by the batch: close the batch, not the results.
+type BatchResult struct {
+	handle  *C.TurboMindBatchResult
+	Results []*ForwardResult
+}
+
+// ForwardBatch submits all requests in one call. Requests without their own
+// GenConfig share genConfig, which is converted once for the whole batch.
+func (p *InstancePool) ForwardBatch(requests []BatchRequest, genConfig *GenerationConfig, streamOutput bool) (*BatchResult, error) {
+	defer lockThread()()
+	if p.handle == nil {
+		return nil, errors.New("instance pool is closed")
+	}
+	if len(requests) == 0 {
+		return nil, errors.New("empty batch")
+	}
+	
+	// Configs hold C arrays, so they live in C memory; the slices below only hold C pointers
+	configs := make(map[*GenerationConfig]*C.TurboMindGenerationConfig)
+	defer func() {
+		for _, c := range configs {
+			C.free(unsafe.Pointer(c))
+		}
+	}()
+	var frees []func()
+	defer func() {
+		for _, free := range frees {
+			free()
+		}
+	}()
+	cConfig := func(g *GenerationConfig) *C.TurboMindGenerationConfig {
+		if c, ok := configs[g]; ok {
+			return c
+		}
+		c := (*C.TurboMindGenerationConfig)(C.malloc(C.sizeof_TurboMindGenerationConfig))
+		var free func()
+		*c, free = g.toC()
+		configs[g] = c
+		frees = append(frees, free)
+		return c
+	}
+	
+	inputs := make([]*C.TurboMindTensorMap, len(requests))
+	sessions := make([]C.TurboMindSession, len(requests))
+	cConfigs := make([]*C.TurboMindGenerationConfig, len(requests))
+	shared := true
+	for i, req := range requests {
+		if req.Inputs == nil || req.Session == nil {
+			return nil, fmt.Errorf("batch request %d has no inputs or session", i)
+		}
+		g := req.GenConfig
+		if g == nil {
+			g = genConfig
+		}
+		if g == nil {
+			return nil, fmt.Errorf("batch request %d has no generation config", i)
+		}
+		inputs[i] = req.Inputs.handle
+		sessions[i] = req.Session.toC()
+		cConfigs[i] = cConfig(g)
+		shared = shared && cConfigs[i] == cConfigs[0]
+	}
+	configCount := len(requests)
+	if shared {
+		configCount = 1
+	}
+	
+	handle := C.turbomind_forward_batch(p.handle, C.int(len(requests)), &inputs[0], &sessions[0],
+		&cConfigs[0], C.int(configCount), C.bool(streamOutput))
+	if handle == nil {
+		return nil, lastError("batch forward failed")
+	}
+	
+	return newBatchResult(handle, len(requests)), nil
+}
+
+// ForwardBatchPreset submits all requests in one call with a shared preset.
+// The requests' own GenConfig fields must be nil.
+func (p *InstancePool) ForwardBatchPreset(requests []BatchRequest, preset *GenerationPreset, streamOutput bool) (*BatchResult, error) {
+	defer lockThread()()
+	if p.handle == nil {
+		return nil, errors.New("instance pool is closed")
+	}
+	if len(requests) == 0 {
+		return nil, errors.New("empty batch")
+	}
+	if preset.handle == nil {
+		return nil, errors.New("generation preset is closed")
+	}
+	
+	inputs := make([]*C.TurboMindTensorMap, len(requests))
+	sessions := make([]C.TurboMindSession, len(requests))
+	for i, req := range requests {
+		if req.Inputs == nil || req.Session == nil {
+			return nil, fmt.Errorf("batch request %d has no inputs or session", i)
+		}
+		if req.GenConfig != nil {
+			return nil, fmt.Errorf("batch request %d has its own config in a preset batch", i)
+		}
+		inputs[i] = req.Inputs.handle
+		sessions[i] = req.Session.toC()
+	}
+	
+	// A one-element C array holding the handle; C pointers only, so Go memory is fine
+	configs := []*C.TurboMindGenerationConfigHandle{preset.handle}
+	handle := C.turbomind_forward_batch_with_configs(p.handle, C.int(len(requests)), &inputs[0], &sessions[0],
+		&configs[0], 1, C.bool(streamOutput))
+	runtime.KeepAlive(preset)
+	if handle == nil {
+		return nil, lastError("batch forward failed")
+	}
+	return newBatchResult(handle, len(requests)), nil
+}
+
+func newBatchResult(handle *C.TurboMindBatchResult, count int) *BatchResult {
+	batch := &BatchResult{handle: handle, Results: make([]*ForwardResult, count)}
+	for i := range batch.Results {
+		batch.Results[i] = &ForwardResult{handle: C.turbomind_batch_get_result(handle, C.int(i)), batch: batch}
+	}
+	runtime.SetFinalizer(batch, (*BatchResult).Close)
+	return batch
+}
+
+// Wait blocks until every request in the batch finished or ctx is done, then
+// refreshes each result's Status and SeqLen
+func (b *BatchResult) Wait(ctx context.Context) error {
+	defer lockThread()()
+	if b.handle == nil {
+		return errors.New("batch result is closed")
+	}
+	
+	for {
+		rc := C.turbomind_wait_batch(b.handle, 50)
+		if rc < 0 {
+			return lastError("batch wait failed")
+		}
+		if rc == 0 {
+			break
+		}
+		if err := ctx.Err(); err != nil {
+			return err
+		}
+	}
+	for _, r := range b.Results {
+		r.refresh()
+	}
+	return nil
+}
+
+// Finished returns how many requests of the batch reached a terminal status
+func (b *BatchResult) Finished() int {
+	if b.handle == nil {
+		return 0
+	}
+	return int(C.turbomind_batch_finished_count(b.handle))
+}
+
+// Cancel cancels every request of the batch
+func (b *BatchResult) Cancel() {
+	if b.handle != nil {
+		C.turbomind_cancel_batch(b.handle)
+	}
+}
+
+// Close releases the batch and all of its results
+func (b *BatchResult) Close() {
+	if b.handle != nil {
+		for _, r := range b.Results {
+			r.closeEvents()
+			r.handle = nil
+		}
+		C.turbomind_destroy_batch_result(b.handle)
+		b.handle = nil
+		runtime.SetFinalizer(b, nil)
+	}
+}
+
+// PinPrefix prefills tokens and keeps their KV blocks resident under name, so
+// prompts starting with them skip that part of prefill. Requires
+// Model.EnablePrefixCache. Blocks until the prefill finishes.
+func (p *InstancePool) PinPrefix(name string, tokens []int32) error {
+	defer lockThread()()
+	if p.handle == nil {
+		return errors.New("instance pool is closed")
+	}
+	if len(tokens) == 0 {
+		return errors.New("empty prefix")
+	}
+	
+	cName := C.CString(name)
+	defer C.free(unsafe.Pointer(cName))
+	
+	if C.turbomind_pool_pin_prefix(p.handle, cName, (*C.int)(unsafe.Pointer(&tokens[0])), C.int(len(tokens))) != 0 {
+		return lastError("failed to pin prefix")
+	}
+	return nil
+}
+
+// EvictPrefix releases a prefix pinned with PinPrefix
+func (p *InstancePool) EvictPrefix(name string) error {
+	defer lockThread()()
+	if p.handle == nil {
+		return errors.New("instance pool is closed")
+	}
+	
+	cName := C.CString(name)
+	defer C.free(unsafe.Pointer(cName))
+	
+	if C.turbomind_pool_evict_prefix(p.handle, cName) != 0 {
+		return lastError("failed to evict prefix")
+	}
+	return nil
+}
+
+// SchedulingConfig is a pool's admission control; the zero value disables it
+type SchedulingConfig struct {
+	// Instances only interactive requests may use; fewer than the pool has
+	ReservedInteractiveSlots int
+	// Prompt tokens batch and background requests may start per Tick, 0 for
+	// no cap. The first request of a tick is always let through.
+	PrefillTokensPerTick int64
+	Tick                 time.Duration
+	// Once this many interactive requests queue, idle background sessions are
+	// suspended to free their KV cache and rebuilt on their next request.
+	// Needs Model.EnableSessionOffload; 0 never preempts.
+	PreemptQueueDepth int
+}
+
+// SetScheduling replaces the pool's admission control settings
+func (p *InstancePool) SetScheduling(config SchedulingConfig) error {
+	defer lockThread()()
+	if p.handle == nil {
+		return errors.New("instance pool is closed")
+	}
+	
+	c := C.TurboMindSchedulingConfig{
+		reserved_interactive_slots: C.int(config.ReservedInteractiveSlots),
+		prefill_tokens_per_tick:    C.int64_t(config.PrefillTokensPerTick),
+		tick_ms:                    C.int(config.Tick.Milliseconds()),
+		preempt_queue_depth:        C.int(config.PreemptQueueDepth),
+	}
+	if C.turbomind_pool_set_scheduling(p.handle, &c) != 0 {
+		return lastError("failed to set pool scheduling")
+	}
+	return nil
+}
+
+// Pooling selects how Encode reduces an input's hidden states to one vector
+type Pooling int
+
+const (
+	PoolingLast Pooling = C.TM_POOLING_LAST // final position
+	PoolingMean Pooling = C.TM_POOLING_MEAN
+)
+
+// HiddenSize is the width of Encode's output rows, hidden_units in the model's config
+func (p *InstancePool) HiddenSize() (int, error) {
+	defer lockThread()()
+	if p.handle == nil {
+		return 0, errors.New("instance pool is closed")
+	}
+	n := C.turbomind_get_hidden_size(p.handle)
+	if n < 0 {
+		return 0, lastError("failed to get hidden size")
+	}
+	return int(n), nil
+}
+
+// Encode prefills every input as one batch without generating and writes their
+// pooled last hidden states to dst, a [len(inputs), HiddenSize()] array of
+// dtype (fp16 or fp32) of size bytes, such as an AllocPinned buffer or a Go
+// slice. Blocks until all inputs are done.
+func (p *InstancePool) Encode(inputs [][]int32, pooling Pooling, dtype DataType, dst unsafe.Pointer, size int) error {
+	defer lockThread()()
+	if p.handle == nil {
+		return errors.New("instance pool is closed")
+	}
+	if len(inputs) == 0 {
+		return errors.New("no inputs to encode")
+	}
+	if dtype != TypeFP16 && dtype != TypeFP32 {
+		return fmt.Errorf("cannot encode to %v", dtype)
+	}
+	hidden, err := p.HiddenSize()
+	if err != nil {
+		return err
+	}
+	elem := 4
+	if dtype == TypeFP16 {
+		elem = 2
+	}
+	if need := len(inputs) * hidden * elem; dst == nil || size < need {
+		return fmt.Errorf("encode needs %d bytes of output, got %d", need, size)
+	}
+	
+	// The C side copies the ids before it returns, so Go memory is fine here
+	offsets := make([]int64, len(inputs)+1)
+	for i, input := range inputs {
+		offsets[i+1] = offsets[i] + int64(len(input))
+	}
+	ids := make([]int32, 0, offsets[len(inputs)]+1)
+	for _, input := range inputs {
+		ids = append(ids, input...)
+	}
+	ids = append(ids, 0) // keeps &ids[0] valid when every input is empty
+	
+	if C.turbomind_encode(p.handle, (*C.int32_t)(unsafe.Pointer(&ids[0])),
+		(*C.int64_t)(unsafe.Pointer(&offsets[0])), C.int(len(inputs)), C.TurboMindPooling(pooling),
+		C.TurboMindDataType(dtype), dst) != 0 {
+		return lastError("failed to encode")
+	}
+	return nil
+}
+
+// ScoreInput is a prompt and the continuation Score evaluates after it
+type ScoreInput struct {
+	Prompt       []int32
+	Continuation []int32
+}
+
+// Score prefills every input as one batch without generating and returns the
+// log-probability of each continuation token given the tokens before it. Only
+// those values are copied back, never the full logits. Blocks until all inputs
+// are done.
+func (p *InstancePool) Score(inputs []ScoreInput) ([][]float32, error) {
+	defer lockThread()()
+	if p.handle == nil {
+		return nil, errors.New("instance pool is closed")
+	}
+	if len(inputs) == 0 {
+		return nil, errors.New("no inputs to score")
+	}
+	
+	offsets := make([]int64, len(inputs)+1)
+	promptLens := make([]int32, len(inputs))
+	targets := 0
+	for i, input := range inputs {
+		if len(input.Prompt) == 0 || len(input.Continuation) == 0 {
+			return nil, fmt.Errorf("input %d needs a prompt and a continuation", i)
+		}
+		promptLens[i] = int32(len(input.Prompt))
+		offsets[i+1] = offsets[i] + int64(len(input.Prompt)+len(input.Continuation))
+		targets += len(input.Continuation)
+	}
+	ids := make([]int32, 0, offsets[len(inputs)])
+	for _, input := range inputs {
+		ids = append(ids, input.Prompt...)
+		ids = append(ids, input.Continuation...)
+	}
+	logprobs := make([]float32, targets)
+	
+	if C.turbomind_score(p.handle, (*C.int32_t)(unsafe.Pointer(&ids[0])), (*C.int64_t)(unsafe.Pointer(&offsets[0])),
+		(*C.int32_t)(unsafe.Pointer(&promptLens[0])), C.int(len(inputs)), (*C.float)(unsafe.Pointer(&logprobs[0]))) != 0 {
+		return nil, lastError("failed to score")
+	}
+	
+	scores := make([][]float32, len(inputs))
+	for i, input := range inputs {
+		scores[i], logprobs = logprobs[:len(input.Continuation):len(input.Continuation)], logprobs[len(input.Continuation):]
+	}
+	return scores, nil
+}
+
+// SuspendSession frees an idle session's KV cache, keeping its history so
+// ResumeSession can rebuild it. Requires Model.EnableSessionOffload.
+func (p *InstancePool) SuspendSession(sessionID uint64) error {
+	defer lockThread()()
+	if p.handle == nil {
+		return errors.New("instance pool is closed")
+	}
+	if C.turbomind_pool_suspend_session(p.handle, C.uint64_t(sessionID)) != 0 {
+		return lastError("failed to suspend session")
+	}
+	return nil
+}
+
+// ResumeSession starts rebuilding a suspended session on the pool. Wait on
+// the result before sending the session's next step.
+func (p *InstancePool) ResumeSession(sessionID uint64) (*ForwardResult, error) {
+	defer lockThread()()
+	if p.handle == nil {
+		return nil, errors.New("instance pool is closed")
+	}
+	handle := C.turbomind_pool_resume_session(p.handle, C.uint64_t(sessionID))
+	if handle == nil {
+		return nil, lastError("failed to resume session")
+	}
+	return newForwardResult(handle), nil
+}
+
+// EndSession ends an inference session
+func (p *InstancePool) EndSession(sessionID uint64) {
+	if p.handle != nil {
+		C.turbomind_pool_end_session(p.handle, C.uint64_t(sessionID))
+	}
+}
+
+// CancelAll cancels every queued and running request
+func (p *InstancePool) CancelAll() {
+	if p.handle != nil {
+		C.turbomind_pool_cancel_all(p.handle)
+	}
+}
+
+// BuildInputs builds a whole input tensor map in one call, recycling maps from
+// the pool's arena. Close the map (after the request finished) before the pool.
+func (p *InstancePool) BuildInputs(inputs []TensorDesc) (*TensorMap, error) {
+	if p.handle == nil {
+		return nil, errors.New("instance pool is closed")
+	}
+	
+	descs, err := toCDescs(inputs)
+	if err != nil {
+		return nil, err
+	}
+	defer lockThread()()
+	return newBuiltTensorMap(C.turbomind_pool_build_inputs(p.handle, &descs[0], C.int(len(descs))))
+}
+
+// BuildInputs builds a whole input tensor map in one call, recycling maps from
+// the instance's arena. Close the map (after the request finished) before the instance.
+func (mi *ModelInstance) BuildInputs(inputs []TensorDesc) (*TensorMap, error) {
+	if mi.handle == nil {
+		return nil, errors.New("model instance is closed")
+	}
+	
+	descs, err := toCDescs(inputs)
+	if err != nil {
+		return nil, err
+	}
+	defer lockThread()()
+	return newBuiltTensorMap(C.turbomind_build_inputs(mi.handle, &descs[0], C.int(len(descs))))
+}
+
+// newBuiltTensorMap wraps a build result; the caller holds lockThread across the build
+func newBuiltTensorMap(handle *C.TurboMindTensorMap) (*TensorMap, error) {
+	if handle == nil {
+		return nil, lastError("failed to build inputs")
+	}
+	
+	tensorMap := &TensorMap{handle: handle}
+	runtime.SetFinalizer(tensorMap, (*TensorMap).Close)
+	return tensorMap, nil
+}
+
+// Tensor names are converted once and kept for the life of the process
+var cTensorNames sync.Map
+
+func cTensorName(name string) *C.char {
+	if cName, ok := cTensorNames.Load(name); ok {
+		return cName.(*C.char)
+	}
+	cName := C.CString(name)
+	if prev, loaded := cTensorNames.LoadOrStore(name, cName); loaded {
+		C.free(unsafe.Pointer(cName))
+		return prev.(*C.char)
+	}
+	return cName
+}
+
+func toCDescs(inputs []TensorDesc) ([]C.TurboMindTensorDesc, error) {
+	if len(inputs) == 0 {
+		return nil, errors.New("no input tensors")
+	}
+	
+	descs := make([]C.TurboMindTensorDesc, len(inputs))
+	for i, in := range inputs {
+		if in.Data == nil || len(in.Shape) == 0 || len(in.Shape) > C.TURBOMIND_MAX_DIMS {
+			return nil, fmt.Errorf("invalid tensor descriptor %q", in.Name)
+		}
+		descs[i].name = cTensorName(in.Name)
+		descs[i].data = in.Data
+		for j, dim := range in.Shape {
+			descs[i].shape[j] = C.int64_t(dim)
+		}
+		descs[i].ndim = C.int32_t(len(in.Shape))
+		descs[i].dtype = C.TurboMindDataType(in.DType)
+		descs[i].memory_type = C.TurboMindMemoryType(in.Memory)
+		descs[i].device_id = C.int32_t(in.DeviceID)
+	}
+	return descs, nil
+}
+
+// AllocPinned returns a pinned host buffer of at least size bytes from the wrapper's pool
+func AllocPinned(size int) (unsafe.Pointer, error) {
+	defer lockThread()()
+	ptr := C.turbomind_alloc_pinned(C.size_t(size))
+	if ptr == nil {
+		return nil, lastError("failed to allocate pinned memory")
+	}
+	return ptr, nil
+}
+
+// ReleasePinned returns a buffer from AllocPinned to the pool
+func ReleasePinned(ptr unsafe.Pointer) {
+	C.turbomind_release_pinned(ptr)
+}
+
+// NewTensor creates a new tensor
+func NewTensor(data unsafe.Pointer, shape []int64, dtype DataType, memory MemoryType, deviceID int) (*Tensor, error) {
+	defer lockThread()()
+	if data == nil || len(shape) == 0 {
+		return nil, errors.New("invalid tensor parameters")
+	}
+	
+	// Convert shape to C array
+	cShape := (*C.int64_t)(C.malloc(C.size_t(len(shape)) * C.sizeof_int64_t))
+	defer C.free(unsafe.Pointer(cShape))
+	cShapeSlice := (*[1 << 30]C.int64_t)(unsafe.Pointer(cShape))
+	for i, s := range shape {
+		cShapeSlice[i] = C.int64_t(s)
+	}
+	
+	handle := C.turbomind_create_tensor(data, cShape, C.int(len(shape)), 
+		C.TurboMindDataType(dtype), C.TurboMindMemoryType(memory), C.int(deviceID))
+	if handle == nil {
+		return nil, lastError("failed to create tensor")
+	}
+	
+	tensor := &Tensor{
+		handle: handle,
+		shape:  make([]int64, len(shape)),
+		dtype:  dtype,
+		memory: memory,
+	}
+	copy(tensor.shape, shape)
+	
+	runtime.SetFinalizer(tensor, (*Tensor).Close)
+	return tensor, nil
+}
+
+// NewPinnedTensor allocates a pinned host tensor from the wrapper's pinned pool.
+// Fill it in place through Data; the buffer returns to the pool once the tensor
+// is closed and no request references it anymore.
+func NewPinnedTensor(shape []int64, dtype DataType, deviceID int) (*Tensor, error) {
+	defer lockThread()()
+	if len(shape) == 0 {
+		return nil, errors.New("invalid tensor parameters")
+	}
+	
+	var data unsafe.Pointer
+	handle := C.turbomind_create_pinned_tensor((*C.int64_t)(unsafe.Pointer(&shape[0])), C.int(len(shape)),
+		C.TurboMindDataType(dtype), C.int(deviceID), &data)
+	if handle == nil {
+		return nil, lastError("failed to create pinned tensor")
+	}
+	
+	tensor := &Tensor{
+		handle: handle,
+		shape:  make([]int64, len(shape)),
+		dtype:  dtype,
+		memory: MemoryCPUPinned,
+		data:   data,
+	}
+	copy(tensor.shape, shape)
+	
+	runtime.SetFinalizer(tensor, (*Tensor).Close)
+	return tensor, nil
+}
+
+// Data returns the buffer of a pinned tensor, nil for tensors wrapping caller memory
+func (t *Tensor) Data() unsafe.Pointer {
+	return t.data
+}
+
+// Close destroys the tensor
+func (t *Tensor) Close() {
+	if t.handle != nil {
+		C.turbomind_destroy_tensor(t.handle)
+		t.handle = nil
+		t.data = nil
+		runtime.SetFinalizer(t, nil)
+	}
+}
+
+// Shape returns tensor shape
+func (t *Tensor) Shape() []int64 {
+	return t.shape
+}
+
+// DataType returns tensor data type
+func (t *Tensor) DataType() DataType {
+	return t.dtype
+}
+
+// MemoryType returns tensor memory type
+func (t *Tensor) MemoryType() MemoryType {
+	return t.memory
+}
+
+// Size returns tensor size in bytes
+func (t *Tensor) Size() int {
+	if t.handle == nil {
+		return 0
+	}
+	return int(C.turbomind_get_tensor_size(t.handle))
+}
+
+// CopyFrom copies data from another tensor
+func (t *Tensor) CopyFrom(src *Tensor) error {
+	defer lockThread()()
+	if t.handle == nil || src.handle == nil {
+		return errors.New("tensor is closed")
+	}
+	
+	C.turbomind_clear_last_error()
+	C.turbomind_copy_tensor(t.handle, src.handle)
+	if C.turbomind_get_last_error_code() != C.TM_OK {
+		return lastError("copy failed")
+	}
+	
+	return nil
+}
+
+// Stream is a CUDA stream that asynchronous copies are ordered on
+type Stream struct {
+	handle *C.TurboMindStream
+}
+
+// Event marks the completion of an asynchronous copy. Closing it waits for
+// the copy; the copied tensors are kept alive until then.
+type Event struct {
+	handle *C.TurboMindEvent
+}
+
+// TensorCopy is one entry of a batched copy; Bytes == 0 copies the whole tensor
+type TensorCopy struct {
+	Dst, Src  *Tensor
+	DstOffset int
+	SrcOffset int
+	Bytes     int
+}
+
+// NewStream creates a non-blocking CUDA stream on deviceID
+func NewStream(deviceID int) (*Stream, error) {
+	defer lockThread()()
+	handle := C.turbomind_create_stream(C.int(deviceID))
+	if handle == nil {
+		return nil, lastError("failed to create stream")
+	}
+	
+	stream := &Stream{handle: handle}
+	runtime.SetFinalizer(stream, (*Stream).Close)
+	return stream, nil
+}
+
+// Close destroys the stream
+func (s *Stream) Close() {
+	if s.handle != nil {
+		C.turbomind_destroy_stream(s.handle)
+		s.handle = nil
+		runtime.SetFinalizer(s, nil)
+	}
+}
+
+// Synchronize waits for all work queued on the stream
+func (s *Stream) Synchronize() error {
+	defer lockThread()()
+	if s.handle == nil {
+		return errors.New("stream is closed")
+	}
+	if C.turbomind_stream_synchronize(s.handle) != 0 {
+		return lastError("stream synchronize failed")
+	}
+	return nil
+}
+
+// WaitEvent makes later work on the stream wait for ev without blocking the host
+func (s *Stream) WaitEvent(ev *Event) error {
+	defer lockThread()()
+	if s.handle == nil || ev.handle == nil {
+		return errors.New("stream or event is closed")
+	}
+	if C.turbomind_stream_wait_event(s.handle, ev.handle) != 0 {
+		return lastError("stream wait failed")
+	}
+	return nil
+}
+
+// CopyFromAsync queues a copy from src on stream (nil uses the calling
+// thread's per-thread stream) and returns its completion event
+func (t *Tensor) CopyFromAsync(src *Tensor, stream *Stream) (*Event, error) {
+	return CopyTensorsAsync([]TensorCopy{{Dst: t, Src: src}}, stream)
+}
+
+// CopyTensorsAsync submits several copies to stream at once (nil uses the
+// calling thread's per-thread stream) and returns one event for all of them
+func CopyTensorsAsync(copies []TensorCopy, stream *Stream) (*Event, error) {
+	defer lockThread()()
+	if len(copies) == 0 {
+		return nil, errors.New("no copies")
+	}
+	
+	descs := make([]C.TurboMindCopyDesc, len(copies))
+	for i, c := range copies {
+		if c.Dst == nil || c.Src == nil || c.Dst.handle == nil || c.Src.handle == nil {
+			return nil, errors.New("tensor is closed")
+		}
+		descs[i].dst = c.Dst.handle
+		descs[i].src = c.Src.handle
+		descs[i].dst_offset = C.size_t(c.DstOffset)
+		descs[i].src_offset = C.size_t(c.SrcOffset)
+		descs[i].bytes = C.size_t(c.Bytes)
+	}
+	
+	var cStream *C.TurboMindStream
+	if stream != nil {
+		cStream = stream.handle
+	}
+	handle := C.turbomind_copy_tensors_async(&descs[0], C.int(len(descs)), cStream)
+	if handle == nil {
+		return nil, lastError("copy failed")
+	}
+	
+	ev := &Event{handle: handle}
+	runtime.SetFinalizer(ev, (*Event).Close)
+	return ev, nil
+}
+
+// Done reports whether the copies behind the event have finished
+func (ev *Event) Done() (bool, error) {
+	defer lockThread()()
+	if ev.handle == nil {
+		return true, nil
+	}
+	switch C.turbomind_event_query(ev.handle) {
+	case 1:
+		return true, nil
+	case 0:
+		return false, nil
+	default:
+		return false, lastError("event query failed")
+	}
+}
+
+// Wait blocks until the copies behind the event have finished
+func (ev *Event) Wait() error {
+	defer lockThread()()
+	if ev.handle == nil {
+		return nil
+	}
+	if C.turbomind_event_synchronize(ev.handle) != 0 {
+		return lastError("event synchronize failed")
+	}
+	return nil
+}
+
+// Close waits for the copies and releases the event
+func (ev *Event) Close() {
+	if ev.handle != nil {
+		C.turbomind_destroy_event(ev.handle)
+		ev.handle = nil
+		runtime.SetFinalizer(ev, nil)
+	}
+}
+
+// NewTensorMap creates a new tensor map
+func NewTensorMap() *TensorMap {
+	handle := C.turbomind_create_tensor_map()
+	if handle == nil {
+		return nil
+	}
+	
+	tensorMap := &TensorMap{handle: handle}
+	runtime.SetFinalizer(tensorMap, (*TensorMap).Close)
+	return tensorMap
+}
+
+// Close destroys the tensor map
+func (tm *TensorMap) Close() {
+	if tm.handle != nil {
+		C.turbomind_destroy_tensor_map(tm.handle)
+		tm.handle = nil
+		runtime.SetFinalizer(tm, nil)
+	}
+}
+
+// Set sets a tensor in the map
+func (tm *TensorMap) Set(key string, tensor *Tensor) error {
+	defer lockThread()()
+	if tm.handle == nil {
+		return errors.New("tensor map is closed")
+	}
+	
+	cKey := C.CString(key)
+	defer C.free(unsafe.Pointer(cKey))
+	
+	result := C.turbomind_tensor_map_set(tm.handle, cKey, tensor.handle)
+	if result != 0 {
+		return lastError("failed to set tensor")
+	}
+	
+	return nil
+}
+
+// Get gets a tensor from the map
 func (tm *TensorMap) Get(key string) (*Tensor, error) {
 	if tm.handle == nil {
 		return nil, errors.New("tensor map is closed")
@@ -417,24 +1614,478 @@ func (tm *TensorMap) Get(key string) (*Tensor, error) {
 	cKey := C.CString(key)
 	defer C.free(unsafe.Pointer(cKey))
 	
-	handle := C.turbomind_tensor_map_get(tm.handle, cKey)
-	if handle == nil {
-		return nil, fmt.Errorf("tensor not found: %s", key)
+	handle := C.turbomind_tensor_map_get(tm.handle, cKey)
+	if handle == nil {
+		return nil, fmt.Errorf("tensor not found: %s", key)
+	}
+	
+	// The returned tensor shares the buffer of the map entry
+	var view C.TurboMindTensorView
+	C.turbomind_tensor_view(handle, &view)
+	tensor := &Tensor{
+		handle: handle,
+		shape:  viewShape(&view),
+		dtype:  DataType(view.dtype),
+		memory: MemoryType(view.memory_type),
+	}
+	runtime.SetFinalizer(tensor, (*Tensor).Close)
+	return tensor, nil
+}
+
+// View returns a zero-copy view of the tensor's buffer
+func (t *Tensor) View() (*TensorView, error) {
+	defer lockThread()()
+	if t.handle == nil {
+		return nil, errors.New("tensor is closed")
+	}
+	
+	var view C.TurboMindTensorView
+	if C.turbomind_tensor_view(t.handle, &view) != 0 {
+		return nil, lastError("failed to get tensor view")
+	}
+	return newTensorView(&view, t), nil
+}
+
+func viewShape(view *C.TurboMindTensorView) []int64 {
+	shape := make([]int64, int(view.ndim))
+	for i := range shape {
+		shape[i] = int64(view.shape[i])
+	}
+	return shape
+}
+
+func newTensorView(view *C.TurboMindTensorView, owner interface{}) *TensorView {
+	return &TensorView{
+		Data:     view.data,
+		Shape:    viewShape(view),
+		DType:    DataType(view.dtype),
+		Memory:   MemoryType(view.memory_type),
+		DeviceID: int(view.device_id),
+		ByteSize: int(view.byte_size),
+		owner:    owner,
+	}
+}
+
+// Int32s returns the buffer of a host-resident int32 tensor as a slice
+func (v *TensorView) Int32s() ([]int32, error) {
+	if v.DType != TypeInt32 {
+		return nil, fmt.Errorf("tensor is %v, not int32", v.DType)
+	}
+	if v.Memory == MemoryGPU {
+		return nil, errors.New("tensor is in GPU memory")
+	}
+	if v.Data == nil {
+		return nil, nil
+	}
+	return unsafe.Slice((*int32)(v.Data), v.ByteSize/4), nil
+}
+
+// Float32s returns the buffer of a host-resident fp32 tensor as a slice
+func (v *TensorView) Float32s() ([]float32, error) {
+	if v.DType != TypeFP32 {
+		return nil, fmt.Errorf("tensor is %v, not fp32", v.DType)
+	}
+	if v.Memory == MemoryGPU {
+		return nil, errors.New("tensor is in GPU memory")
+	}
+	if v.Data == nil {
+		return nil, nil
+	}
+	return unsafe.Slice((*float32)(v.Data), v.ByteSize/4), nil
+}
+
+// Output returns a zero-copy view of an output tensor (output_ids,
+// sequence_length, logprob_vals, logits, ...). Read it after the request
+// finished; only the first SeqLen entries of output_ids are meaningful.
+func (fr *ForwardResult) Output(key string) (*TensorView, error) {
+	defer lockThread()()
+	if fr.handle == nil {
+		return nil, errors.New("forward result is closed")
+	}
+	
+	cKey := C.CString(key)
+	defer C.free(unsafe.Pointer(cKey))
+	
+	var view C.TurboMindTensorView
+	if C.turbomind_get_output(fr.handle, cKey, &view) != 0 {
+		return nil, lastError("failed to get output " + key)
+	}
+	return newTensorView(&view, fr), nil
+}
+
+// CopyOutputAsync queues a copy of the first size bytes of an output into dst,
+// which should be pinned memory (see AllocPinned). Call SyncOutputCopies before
+// reading dst.
+func (fr *ForwardResult) CopyOutputAsync(key string, dst unsafe.Pointer, size int) error {
+	defer lockThread()()
+	if fr.handle == nil {
+		return errors.New("forward result is closed")
+	}
+	
+	cKey := C.CString(key)
+	defer C.free(unsafe.Pointer(cKey))
+	
+	if C.turbomind_copy_output_async(fr.handle, cKey, dst, C.size_t(size)) != 0 {
+		return lastError("failed to copy output " + key)
+	}
+	return nil
+}
+
+// VerifyDraft checks draft, the tokens that end the input of this finished
+// request, against the model's greedy choices; the request must have been
+// submitted with OutputLogits. It writes the accepted prefix of draft and then
+// the model's own next token to dst, which needs room for len(draft)+1 tokens,
+// and returns how many it wrote.
+func (fr *ForwardResult) VerifyDraft(draft, dst []int32) (int, error) {
+	defer lockThread()()
+	if fr.handle == nil {
+		return 0, errors.New("forward result is closed")
+	}
+	if len(dst) <= len(draft) {
+		return 0, errors.New("dst has no room for the draft and one more token")
+	}
+	var cDraft *C.int32_t
+	if len(draft) > 0 {
+		cDraft = (*C.int32_t)(unsafe.Pointer(&draft[0]))
 	}
 	
-	// Note: This is a simplified implementation - proper lifetime management needed
-	return &Tensor{handle: handle}, nil
+	n := C.turbomind_verify_draft(fr.handle, cDraft, C.int(len(draft)), (*C.int32_t)(unsafe.Pointer(&dst[0])))
+	if n < 0 {
+		return 0, lastError("failed to verify draft")
+	}
+	return int(n), nil
+}
+
+// SyncOutputCopies waits for every copy queued with CopyOutputAsync
+func (fr *ForwardResult) SyncOutputCopies() error {
+	defer lockThread()()
+	if fr.handle == nil {
+		return errors.New("forward result is closed")
+	}
+	if C.turbomind_sync_output_copies(fr.handle) != 0 {
+		return lastError("failed to sync output copies")
+	}
+	return nil
 }
 
-// Close destroys the forward result
+// Close destroys the forward result (a no-op beyond releasing the event fd
+// for results of a batch, which the batch owns)
 func (fr *ForwardResult) Close() {
-	if fr.handle != nil {
+	fr.closeEvents()
+	if fr.handle != nil && fr.batch == nil {
 		C.turbomind_destroy_forward_result(fr.handle)
 		fr.handle = nil
 		runtime.SetFinalizer(fr, nil)
 	}
 }
 
+func (fr *ForwardResult) closeEvents() {
+	if fr.events != nil {
+		fr.events.Close()
+		fr.events = nil
+	}
+}
+
+// Cancel cancels the request whether it is queued or running
+func (fr *ForwardResult) Cancel() {
+	if fr.handle != nil {
+		C.turbomind_cancel_forward(fr.handle)
+	}
+}
+
+// Done reports whether the request reached a terminal status
+func (fr *ForwardResult) Done() bool {
+	return fr.Status == RequestCompleted || fr.Status == RequestCancelled || fr.Status == RequestFailed
+}
+
+// refresh updates Status and SeqLen from the native request handle
+// RequestTimings breaks down a request's latency; stages not reached are zero
+type RequestTimings struct {
+	Queue           time.Duration // submit -> scheduled on an instance
+	TTFT            time.Duration // submit -> first token
+	Total           time.Duration // submit -> finish
+	PromptTokens    int
+	GeneratedTokens int
+	DecodeSteps     int // progress updates after the first token
+	DecodeMin       time.Duration
+	DecodeMax       time.Duration
+	DecodeTotal     time.Duration
+}
+
+// Timings returns the request's timestamps so far
+func (fr *ForwardResult) Timings() (RequestTimings, error) {
+	if fr.handle == nil {
+		return RequestTimings{}, errors.New("forward result is closed")
+	}
+	
+	var t C.TurboMindRequestTimings
+	C.turbomind_get_request_timings(fr.handle, &t)
+	since := func(ns C.int64_t) time.Duration {
+		if ns == 0 {
+			return 0
+		}
+		return time.Duration(ns - t.submit_ns)
+	}
+	return RequestTimings{
+		Queue:           since(t.scheduled_ns),
+		TTFT:            since(t.first_token_ns),
+		Total:           since(t.finish_ns),
+		PromptTokens:    int(t.prompt_tokens),
+		GeneratedTokens: int(t.generated_tokens),
+		DecodeSteps:     int(t.decode_steps),
+		DecodeMin:       time.Duration(t.decode_min_ns),
+		DecodeMax:       time.Duration(t.decode_max_ns),
+		DecodeTotal:     time.Duration(t.decode_total_ns),
+	}, nil
+}
+
+// HistogramKind selects one of the process-wide latency histograms
+type HistogramKind int
+
+const (
+	HistogramQueue       HistogramKind = C.TM_HISTOGRAM_QUEUE
+	HistogramTTFT        HistogramKind = C.TM_HISTOGRAM_TTFT
+	HistogramDecodeToken HistogramKind = C.TM_HISTOGRAM_DECODE_TOKEN
+	HistogramE2E         HistogramKind = C.TM_HISTOGRAM_E2E
+)
+
+// Histogram is a snapshot of a latency histogram. Buckets[i] counts samples
+// in [2^i, 2^(i+1)) microseconds.
+type Histogram struct {
+	Count   uint64
+	Sum     time.Duration
+	Buckets [C.TURBOMIND_HISTOGRAM_BUCKETS]uint64
+}
+
+// LatencyHistogram snapshots a histogram of completed requests without locking
+func LatencyHistogram(kind HistogramKind) Histogram {
+	var h C.TurboMindHistogram
+	C.turbomind_get_latency_histogram(C.TurboMindHistogramKind(kind), &h)
+	out := Histogram{Count: uint64(h.count), Sum: time.Duration(h.sum_us) * time.Microsecond}
+	for i := range out.Buckets {
+		out.Buckets[i] = uint64(h.buckets[i])
+	}
+	return out
+}
+
+// ResetLatencyHistograms clears every latency histogram
+func ResetLatencyHistograms() {
+	C.turbomind_reset_latency_histograms()
+}
+
+// Quantile returns the upper bound of the bucket holding quantile q (0..1)
+func (h Histogram) Quantile(q float64) time.Duration {
+	var total uint64
+	for _, n := range h.Buckets {
+		total += n
+	}
+	if total == 0 {
+		return 0
+	}
+	rank := uint64(q * float64(total))
+	var seen uint64
+	for i, n := range h.Buckets {
+		seen += n
+		if seen > rank {
+			return time.Duration(uint64(2)<<i) * time.Microsecond
+		}
+	}
+	return time.Duration(uint64(2)<<(len(h.Buckets)-1)) * time.Microsecond
+}
+
+func (fr *ForwardResult) refresh() {
+	var seqLen C.int
+	fr.Status = RequestStatus(C.turbomind_get_forward_status(fr.handle, &seqLen))
+	fr.SeqLen = int(seqLen)
+	fr.PrefixHitLen = int(C.turbomind_get_prefix_hit_length(fr.handle))
+}
+
+// Wait blocks until the request reaches a terminal status or ctx is done.
+// It parks the goroutine on the request's eventfd through the Go netpoller,
+// so many requests can be awaited without holding an OS thread each.
+func (fr *ForwardResult) Wait(ctx context.Context) error {
+	if fr.handle == nil {
+		return errors.New("forward result is closed")
+	}
+	
+	for {
+		fr.refresh()
+		if fr.Done() {
+			break
+		}
+		if err := fr.waitEvent(ctx); err != nil {
+			return err
+		}
+	}
+	
+	if fr.Status == RequestFailed {
+		return errors.New("forward request failed")
+	}
+	return nil
+}
+
+// waitEvent blocks until the request publishes its next progress update
+func (fr *ForwardResult) waitEvent(ctx context.Context) error {
+	if fr.events == nil {
+		unlock := lockThread()
+		fd := C.turbomind_get_forward_event_fd(fr.handle)
+		if fd < 0 {
+			err := lastError("failed to get event fd")
+			unlock()
+			return err
+		}
+		unlock()
+		// The native fd is owned by the result; hand the poller its own copy
+		dup, err := syscall.Dup(int(fd))
+		if err != nil {
+			return fmt.Errorf("failed to dup event fd: %v", err)
+		}
+		syscall.CloseOnExec(dup)
+		fr.events = os.NewFile(uintptr(dup), "turbomind-forward")
+	}
+	
+	// A cancelled wait leaves its deadline behind; later waits must not inherit it
+	fr.events.SetReadDeadline(time.Time{})
+	fired := make(chan struct{})
+	stop := context.AfterFunc(ctx, func() {
+		fr.events.SetReadDeadline(time.Unix(1, 0))
+		close(fired)
+	})
+	defer func() {
+		if !stop() {
+			// The cancel ran, possibly after a successful read: undo it once it is done
+			<-fired
+			fr.events.SetReadDeadline(time.Time{})
+		}
+	}()
+	
+	var buf [8]byte
+	if _, err := fr.events.Read(buf[:]); err != nil {
+		if ctx.Err() != nil {
+			return ctx.Err()
+		}
+		return fmt.Errorf("failed to wait for request: %v", err)
+	}
+	return nil
+}
+
+// TokenStream reads streamed tokens straight from the native token ring
+type TokenStream struct {
+	result *ForwardResult
+	ring   *C.TurboMindTokenStream
+	ids    []int32
+	probs  []float32
+}
+
+// TokenStream returns the token ring of a request submitted with streamOutput.
+// The stream is valid until the result is closed.
+func (fr *ForwardResult) TokenStream() (*TokenStream, error) {
+	if fr.handle == nil {
+		return nil, errors.New("forward result is closed")
+	}
+	
+	ring := C.turbomind_get_token_stream(fr.handle)
+	if ring == nil {
+		return nil, errors.New("request was not submitted with stream output")
+	}
+	
+	capacity := int(ring.capacity)
+	return &TokenStream{
+		result: fr,
+		ring:   ring,
+		ids:    unsafe.Slice((*int32)(unsafe.Pointer(ring.token_ids)), capacity),
+		probs:  unsafe.Slice((*float32)(unsafe.Pointer(ring.logprobs)), capacity),
+	}, nil
+}
+
+// Read copies the tokens generated so far into ids, and their logprobs into
+// logprobs when it is non-nil, without blocking. It returns io.EOF once the
+// request finished and every token was read.
+func (ts *TokenStream) Read(ids []int32, logprobs []float32) (int, error) {
+	if ts.result.handle == nil {
+		return 0, errors.New("forward result is closed")
+	}
+	
+	finished := atomic.LoadUint32((*uint32)(unsafe.Pointer(&ts.ring.finished))) != 0
+	head := atomic.LoadUint64((*uint64)(unsafe.Pointer(&ts.ring.head)))
+	tail := uint64(ts.ring.tail)
+	
+	n := int(head - tail)
+	if n == 0 && finished {
+		return 0, io.EOF
+	}
+	if n > len(ids) {
+		n = len(ids)
+	}
+	
+	mask := uint64(len(ts.ids) - 1)
+	for i := 0; i < n; i++ {
+		slot := (tail + uint64(i)) & mask
+		ids[i] = ts.ids[slot]
+		if logprobs != nil && i < len(logprobs) {
+			logprobs[i] = ts.probs[slot]
+		}
+	}
+	atomic.StoreUint64((*uint64)(unsafe.Pointer(&ts.ring.tail)), tail+uint64(n))
+	return n, nil
+}
+
+// Recv blocks until at least one token is available or the stream ends, then
+// behaves like Read.
+func (ts *TokenStream) Recv(ctx context.Context, ids []int32, logprobs []float32) (int, error) {
+	if len(ids) == 0 {
+		return 0, nil
+	}
+	for {
+		n, err := ts.Read(ids, logprobs)
+		if n > 0 || err != nil {
+			return n, err
+		}
+		if err := ts.result.waitEvent(ctx); err != nil {
+			return 0, err
+		}
+	}
+}
+
+// ReadText decodes the tokens generated so far through d, without blocking,
+// and returns the new text; only complete UTF-8 characters are returned. It
+// returns io.EOF once the request finished and all text was read. Read and
+// ReadText consume the same ring, so use one or the other.
+func (ts *TokenStream) ReadText(d *Detokenizer) (string, error) {
+	defer lockThread()()
+	if ts.result.handle == nil {
+		return "", errors.New("forward result is closed")
+	}
+	if d.handle == nil {
+		return "", errors.New("detokenizer is closed")
+	}
+	
+	var length C.size_t
+	var finished C.bool
+	text := C.turbomind_detokenize_stream(d.handle, ts.ring, &length, &finished)
+	if text == nil {
+		return "", lastError("failed to detokenize stream")
+	}
+	if length == 0 && bool(finished) {
+		return "", io.EOF
+	}
+	return C.GoStringN(text, C.int(length)), nil
+}
+
+// RecvText blocks until new text is available or the stream ends, then behaves
+// like ReadText
+func (ts *TokenStream) RecvText(ctx context.Context, d *Detokenizer) (string, error) {
+	for {
+		text, err := ts.ReadText(d)
+		if text != "" || err != nil {
+			return text, err
+		}
+		if err := ts.result.waitEvent(ctx); err != nil {
+			return "", err
+		}
+	}
+}
+
 // Utility functions
 
 // SetDevice sets the current CUDA device
@@ -442,11 +2093,412 @@ func SetDevice(deviceID int) {
 	C.turbomind_set_device(C.int(deviceID))
 }
 
-// GetLastError returns the last error message
+// GetLastError returns the last error message of the calling OS thread. A
+// goroutine can move between threads between two cgo calls, so callers must
+// hold runtime.LockOSThread across the failing call and this one.
 func GetLastError() string {
 	return C.GoString(C.turbomind_get_last_error())
 }
 
+// ErrorCode classifies a native error
+type ErrorCode int
+
+const (
+	ErrOK              ErrorCode = C.TM_OK
+	ErrInvalidArgument ErrorCode = C.TM_ERROR_INVALID_ARGUMENT
+	ErrInvalidState    ErrorCode = C.TM_ERROR_INVALID_STATE
+	ErrNotFound        ErrorCode = C.TM_ERROR_NOT_FOUND
+	ErrOutOfMemory     ErrorCode = C.TM_ERROR_OUT_OF_MEMORY
+	ErrCUDA            ErrorCode = C.TM_ERROR_CUDA
+	ErrIO              ErrorCode = C.TM_ERROR_IO
+	ErrEngine          ErrorCode = C.TM_ERROR_ENGINE
+	ErrInternal        ErrorCode = C.TM_ERROR_INTERNAL
+)
+
+// Error is a failure reported by the native library
+type Error struct {
+	Op      string // what the binding was doing
+	Code    ErrorCode
+	Message string
+}
+
+func (e *Error) Error() string {
+	return e.Op + ": " + e.Message
+}
+
+// lockThread pins the goroutine to its OS thread until the returned function
+// runs, so a failing C call and lastError read the same thread-local slot
+func lockThread() func() {
+	runtime.LockOSThread()
+	return runtime.UnlockOSThread
+}
+
+// lastError captures the calling thread's native error; hold lockThread
+func lastError(op string) error {
+	return &Error{
+		Op:      op,
+		Code:    ErrorCode(C.turbomind_get_last_error_code()),
+		Message: C.GoString(C.turbomind_get_last_error()),
+	}
+}
+
+// LogLevel is the minimum severity EnableLogging passes through
+type LogLevel int
+
+const (
+	LogDebug   LogLevel = C.TM_LOG_DEBUG
+	LogInfo    LogLevel = C.TM_LOG_INFO
+	LogWarning LogLevel = C.TM_LOG_WARNING
+	LogError   LogLevel = C.TM_LOG_ERROR
+)
+
+// EnableLogging writes native log messages at or above level to stderr from a
+// background thread, at most maxPerSecond per second (<= 0 for no limit)
+func EnableLogging(level LogLevel, maxPerSecond int) {
+	C.turbomind_enable_log(nil, nil, C.TurboMindLogLevel(level), C.int(maxPerSecond))
+}
+
+// DisableLogging flushes pending messages and turns native logging off
+func DisableLogging() {
+	C.turbomind_disable_log()
+}
+
+// tracing mirrors the native recorder state so disabled spans skip cgo
+var tracing atomic.Bool
+
+// EnableTracing starts recording the last capacity native spans (model setup,
+// forwards, copies, per-request queue/prefill/decode phases) plus spans added
+// with StartSpan. NVTX ranges are emitted regardless.
+func EnableTracing(capacity int) error {
+	defer lockThread()()
+	if capacity <= 0 {
+		return errors.New("trace capacity must be positive")
+	}
+	if C.turbomind_enable_trace(C.size_t(capacity)) != 0 {
+		return lastError("failed to enable tracing")
+	}
+	tracing.Store(true)
+	return nil
+}
+
+// DisableTracing stops recording; recorded spans can still be dumped
+func DisableTracing() {
+	tracing.Store(false)
+	C.turbomind_disable_trace()
+}
+
+// DumpTrace writes the recorded spans to path as Chrome trace JSON
+func DumpTrace(path string) error {
+	defer lockThread()()
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+	
+	if C.turbomind_dump_trace(cPath) != 0 {
+		return lastError("failed to dump trace")
+	}
+	return nil
+}
+
+// StartSpan begins a span on the native trace clock, so Go-side work lines up
+// with the wrapper's spans; call the returned function to end it
+func StartSpan(name string, sessionID uint64) func() {
+	if !tracing.Load() {
+		return func() {}
+	}
+	start := C.turbomind_trace_clock_ns()
+	return func() {
+		end := C.turbomind_trace_clock_ns()
+		cName := C.CString(name)
+		defer C.free(unsafe.Pointer(cName))
+		C.turbomind_trace_record(cName, C.uint64_t(sessionID), start, end)
+	}
+}
+
+// NativeTokenizer is the wrapper's C++ BPE tokenizer for a model's
+// tokenizer.json (SentencePiece style with byte fallback, or byte-level with
+// GPT-2, Llama 3 or Qwen 2 splits). It is safe for concurrent use.
+type NativeTokenizer struct {
+	handle *C.TurboMindTokenizer
+	owned  bool // false for the model's tokenizer
+}
+
+// NewNativeTokenizer loads modelDir/tokenizer.json
+func NewNativeTokenizer(modelDir string) (*NativeTokenizer, error) {
+	defer lockThread()()
+	cDir := C.CString(modelDir)
+	defer C.free(unsafe.Pointer(cDir))
+	
+	handle := C.turbomind_create_tokenizer(cDir)
+	if handle == nil {
+		return nil, lastError("failed to load tokenizer")
+	}
+	t := &NativeTokenizer{handle: handle, owned: true}
+	runtime.SetFinalizer(t, (*NativeTokenizer).Close)
+	return t, nil
+}
+
+// Tokenizer returns the model's tokenizer, loaded from its model directory on
+// first use. The model owns it; it is valid until the model is closed.
+func (m *Model) Tokenizer() (*NativeTokenizer, error) {
+	defer lockThread()()
+	if m.handle == nil {
+		return nil, errors.New("model is closed")
+	}
+	
+	handle := C.turbomind_get_tokenizer(m.handle)
+	if handle == nil {
+		return nil, lastError("failed to load tokenizer")
+	}
+	return &NativeTokenizer{handle: handle}, nil
+}
+
+// MaxTokens bounds the number of ids textBytes bytes of text encode to, BOS included
+func MaxTokens(textBytes int) int {
+	return int(C.turbomind_tokenizer_max_tokens(C.size_t(textBytes)))
+}
+
+// Encode tokenizes text, starting with BOS when addBOS is set
+func (t *NativeTokenizer) Encode(text string, addBOS bool) ([]int32, error) {
+	ids := make([]int32, MaxTokens(len(text)))
+	n, err := t.EncodeInto(text, addBOS, ids)
+	if err != nil {
+		return nil, err
+	}
+	return ids[:n], nil
+}
+
+// EncodeInto writes the ids of text to dst, which may be the pinned buffer of
+// an input tensor, and returns their count. A dst of MaxTokens(len(text)) always
+// fits; when the count exceeds len(dst), only len(dst) ids were written.
+func (t *NativeTokenizer) EncodeInto(text string, addBOS bool, dst []int32) (int, error) {
+	defer lockThread()()
+	var cText *C.char
+	if len(text) > 0 {
+		cText = (*C.char)(unsafe.Pointer(unsafe.StringData(text)))
+	}
+	var cIDs *C.int32_t
+	if len(dst) > 0 {
+		cIDs = (*C.int32_t)(unsafe.Pointer(&dst[0]))
+	}
+	
+	n := C.turbomind_tokenize(t.handle, cText, C.size_t(len(text)), C.bool(addBOS), cIDs, C.size_t(len(dst)))
+	if n < 0 {
+		return 0, lastError("failed to tokenize")
+	}
+	return int(n), nil
+}
+
+// Decode returns the text of ids, dropping special tokens when skipSpecial is set
+func (t *NativeTokenizer) Decode(ids []int32, skipSpecial bool) (string, error) {
+	defer lockThread()()
+	var cIDs *C.int32_t
+	if len(ids) > 0 {
+		cIDs = (*C.int32_t)(unsafe.Pointer(&ids[0]))
+	}
+	
+	// Most tokens are a few bytes; retry once with the exact size otherwise
+	buf := make([]byte, 8*len(ids)+16)
+	for {
+		n := C.turbomind_detokenize(t.handle, cIDs, C.size_t(len(ids)), C.bool(skipSpecial),
+			(*C.char)(unsafe.Pointer(&buf[0])), C.size_t(len(buf)))
+		if n < 0 {
+			return "", lastError("failed to detokenize")
+		}
+		if int(n) <= len(buf) {
+			return string(buf[:n]), nil
+		}
+		buf = make([]byte, n)
+	}
+}
+
+// VocabSize returns the number of token ids, added tokens included
+func (t *NativeTokenizer) VocabSize() int {
+	return int(C.turbomind_tokenizer_vocab_size(t.handle))
+}
+
+// BOS returns the beginning-of-sequence id, -1 when there is none
+func (t *NativeTokenizer) BOS() int {
+	return int(C.turbomind_tokenizer_bos_id(t.handle))
+}
+
+// EOS returns the end-of-sequence id, -1 when there is none
+func (t *NativeTokenizer) EOS() int {
+	return int(C.turbomind_tokenizer_eos_id(t.handle))
+}
+
+// Close frees a tokenizer from NewNativeTokenizer; the model's tokenizer is
+// freed with the model
+func (t *NativeTokenizer) Close() {
+	if t.owned && t.handle != nil {
+		C.turbomind_destroy_tokenizer(t.handle)
+		runtime.SetFinalizer(t, nil)
+	}
+	t.handle = nil
+}
+
+// Detokenizer decodes the tokens of one streaming request as they arrive. Each
+// step returns only the text the new tokens complete: a character split across
+// tokens is held back until its last byte arrives, so every piece is valid
+// UTF-8. Not safe for concurrent use.
+type Detokenizer struct {
+	handle    *C.TurboMindDetokenizer
+	tokenizer *NativeTokenizer // must outlive the handle
+}
+
+// NewDetokenizer starts an incremental decode, dropping special tokens when
+// skipSpecial is set
+func (t *NativeTokenizer) NewDetokenizer(skipSpecial bool) (*Detokenizer, error) {
+	defer lockThread()()
+	if t.handle == nil {
+		return nil, errors.New("tokenizer is closed")
+	}
+	
+	handle := C.turbomind_create_detokenizer(t.handle, C.bool(skipSpecial))
+	if handle == nil {
+		return nil, lastError("failed to create detokenizer")
+	}
+	d := &Detokenizer{handle: handle, tokenizer: t}
+	runtime.SetFinalizer(d, (*Detokenizer).Close)
+	return d, nil
+}
+
+// Push returns the text completed by ids
+func (d *Detokenizer) Push(ids []int32) (string, error) {
+	return d.step(ids, false)
+}
+
+// Finish returns a held-back incomplete character as U+FFFD, and resets d for
+// a new sequence
+func (d *Detokenizer) Finish() (string, error) {
+	return d.step(nil, true)
+}
+
+func (d *Detokenizer) step(ids []int32, finish bool) (string, error) {
+	defer lockThread()()
+	if d.handle == nil {
+		return "", errors.New("detokenizer is closed")
+	}
+	var cIDs *C.int32_t
+	if len(ids) > 0 {
+		cIDs = (*C.int32_t)(unsafe.Pointer(&ids[0]))
+	}
+	
+	var length C.size_t
+	text := C.turbomind_detokenize_step(d.handle, cIDs, C.size_t(len(ids)), C.bool(finish), &length)
+	if text == nil {
+		return "", lastError("failed to detokenize")
+	}
+	return C.GoStringN(text, C.int(length)), nil
+}
+
+// Close frees the detokenizer
+func (d *Detokenizer) Close() {
+	if d.handle != nil {
+		C.turbomind_destroy_detokenizer(d.handle)
+		d.handle = nil
+		runtime.SetFinalizer(d, nil)
+	}
+	runtime.KeepAlive(d.tokenizer)
+}
+
+// GrammarKind is the source language of a grammar
+type GrammarKind int
+
+const (
+	GrammarRegex      GrammarKind = C.TM_GRAMMAR_REGEX
+	GrammarJSONSchema GrammarKind = C.TM_GRAMMAR_JSON_SCHEMA
+)
+
+// Grammar is a regular expression, or the JSON texts a JSON schema accepts,
+// compiled into an automaton over a tokenizer's vocabulary. Decoding walks its
+// states: each state allows a set of tokens, and the next step's BadIds are
+// everything else. Compiled grammars are cached on the tokenizer, so compiling
+// the same source again is cheap. Safe for concurrent use.
+type Grammar struct {
+	handle    *C.TurboMindGrammar
+	tokenizer *NativeTokenizer // must outlive the handle
+	vocabSize int
+}
+
+// CompileGrammar compiles source, reusing the tokenizer's cached grammar for it
+func (t *NativeTokenizer) CompileGrammar(kind GrammarKind, source string) (*Grammar, error) {
+	defer lockThread()()
+	if t.handle == nil {
+		return nil, errors.New("tokenizer is closed")
+	}
+	var cSource *C.char
+	if len(source) > 0 {
+		cSource = (*C.char)(unsafe.Pointer(unsafe.StringData(source)))
+	}
+	
+	handle := C.turbomind_compile_grammar(t.handle, C.TurboMindGrammarKind(kind), cSource, C.size_t(len(source)))
+	if handle == nil {
+		return nil, lastError("failed to compile grammar")
+	}
+	g := &Grammar{handle: handle, tokenizer: t, vocabSize: t.VocabSize()}
+	runtime.SetFinalizer(g, (*Grammar).Close)
+	return g, nil
+}
+
+// Start returns the state decoding starts in
+func (g *Grammar) Start() int32 {
+	return int32(C.turbomind_grammar_start(g.handle))
+}
+
+// Advance returns the state after token, -1 when the grammar does not allow it
+func (g *Grammar) Advance(state, token int32) int32 {
+	return int32(C.turbomind_grammar_advance(g.handle, C.int32_t(state), C.int32_t(token)))
+}
+
+// Accepting reports whether the text so far is a complete match, so EOS may follow
+func (g *Grammar) Accepting(state int32) bool {
+	return bool(C.turbomind_grammar_accepting(g.handle, C.int32_t(state)))
+}
+
+// AllowedIDs writes the tokens allowed in state to dst and returns their number;
+// when it exceeds len(dst), only len(dst) ids were written
+func (g *Grammar) AllowedIDs(state int32, dst []int32) (int, error) {
+	defer lockThread()()
+	var cIDs *C.int32_t
+	if len(dst) > 0 {
+		cIDs = (*C.int32_t)(unsafe.Pointer(&dst[0]))
+	}
+	n := C.turbomind_grammar_allowed_ids(g.handle, C.int32_t(state), cIDs, C.size_t(len(dst)))
+	if n < 0 {
+		return 0, lastError("failed to get allowed ids")
+	}
+	return int(n), nil
+}
+
+// BadIDs returns every token not allowed in state, EOS included unless the
+// state is accepting, reusing dst when it has room for the vocabulary
+func (g *Grammar) BadIDs(state int32, dst []int32) ([]int32, error) {
+	defer lockThread()()
+	if cap(dst) < g.vocabSize {
+		dst = make([]int32, g.vocabSize)
+	}
+	dst = dst[:cap(dst)]
+	var cIDs *C.int32_t
+	if len(dst) > 0 {
+		cIDs = (*C.int32_t)(unsafe.Pointer(&dst[0]))
+	}
+	n := C.turbomind_grammar_bad_ids(g.handle, C.int32_t(state), cIDs, C.size_t(len(dst)))
+	if n < 0 {
+		return nil, lastError("failed to get bad ids")
+	}
+	return dst[:n], nil
+}
+
+// Close releases the grammar
+func (g *Grammar) Close() {
+	if g.handle != nil {
+		C.turbomind_release_grammar(g.handle)
+		g.handle = nil
+		runtime.SetFinalizer(g, nil)
+	}
+	runtime.KeepAlive(g.tokenizer)
+}
+
 // DefaultGenerationConfig returns a default generation configuration
 func DefaultGenerationConfig() *GenerationConfig {
 	return &GenerationConfig{
@@ -0,0 +1,321 @@
+package turbomind
+
+import (
+	"context"
+	"os"
+	"testing"
+	"unsafe"
+)
+
+// Host-side cost of the Go bindings, meant to run against the CPU-only mock
+// backend (cmake -DTURBOMIND_GO_MOCK_BACKEND=ON):
+//
+//	go test -run '^$' -bench . ./pkg/turbomind
+//
+// bench/turbomind_microbench.cpp measures the same operations without cgo.
+
+func init() {
+	// The mock reads its settings once, on the first call; only silence it so
+	// tests in this package see the default mock behaviour
+	if os.Getenv("TURBOMIND_MOCK_VERBOSE") == "" {
+		os.Setenv("TURBOMIND_MOCK_VERBOSE", "0")
+	}
+}
+
+type benchFixture struct {
+	model  *Model
+	pool   *InstancePool
+	ids    []int32 // pinned: input_ids followed by sequence_length
+	descs  []TensorDesc
+	config *GenerationConfig
+}
+
+func newBenchFixture(b *testing.B) *benchFixture {
+	b.Helper()
+	model, err := NewModel(b.TempDir(), "", "half")
+	if err != nil {
+		b.Skipf("backend unavailable: %v", err)
+	}
+	pool, err := model.CreateInstancePool(0, 4)
+	if err != nil {
+		model.Close()
+		b.Skipf("backend unavailable: %v", err)
+	}
+
+	// Inputs are referenced by C after the call, so they cannot live in Go memory
+	buf, err := AllocPinned(4 * 513)
+	if err != nil {
+		b.Fatal(err)
+	}
+	f := &benchFixture{model: model, pool: pool, ids: unsafe.Slice((*int32)(buf), 513), config: DefaultGenerationConfig()}
+	f.ids[512] = 512
+	f.config.MaxNewTokens = 16
+	f.descs = []TensorDesc{
+		{Name: "input_ids", Data: unsafe.Pointer(&f.ids[0]), Shape: []int64{1, 512}, DType: TypeInt32, Memory: MemoryCPU},
+		{Name: "sequence_length", Data: unsafe.Pointer(&f.ids[512]), Shape: []int64{1}, DType: TypeInt32, Memory: MemoryCPU},
+	}
+	b.Cleanup(func() {
+		pool.Close()
+		model.Close()
+		ReleasePinned(buf)
+	})
+	return f
+}
+
+func (f *benchFixture) inputs(b *testing.B) *TensorMap {
+	tm, err := f.pool.BuildInputs(f.descs)
+	if err != nil {
+		b.Fatal(err)
+	}
+	return tm
+}
+
+// Baseline: one cgo call that does no work
+func BenchmarkCgoCall(b *testing.B) {
+	for i := 0; i < b.N; i++ {
+		ResetLatencyHistograms()
+	}
+}
+
+func BenchmarkNewTensor(b *testing.B) {
+	f := newBenchFixture(b)
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		t, err := NewTensor(unsafe.Pointer(&f.ids[0]), []int64{1, 512}, TypeInt32, MemoryCPU, 0)
+		if err != nil {
+			b.Fatal(err)
+		}
+		t.Close()
+	}
+}
+
+func BenchmarkNewPinnedTensor(b *testing.B) {
+	newBenchFixture(b)
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		t, err := NewPinnedTensor([]int64{1, 512}, TypeInt32, 0)
+		if err != nil {
+			b.Fatal(err)
+		}
+		t.Close()
+	}
+}
+
+func BenchmarkTensorMapSetGet(b *testing.B) {
+	f := newBenchFixture(b)
+	t, err := NewTensor(unsafe.Pointer(&f.ids[0]), []int64{1, 512}, TypeInt32, MemoryCPU, 0)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer t.Close()
+	tm := NewTensorMap()
+	defer tm.Close()
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if err := tm.Set("input_ids", t); err != nil {
+			b.Fatal(err)
+		}
+		got, err := tm.Get("input_ids")
+		if err != nil {
+			b.Fatal(err)
+		}
+		got.Close()
+	}
+}
+
+func BenchmarkBuildInputs(b *testing.B) {
+	f := newBenchFixture(b)
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		f.inputs(b).Close()
+	}
+}
+
+func BenchmarkGenerationConfigToC(b *testing.B) {
+	config := DefaultGenerationConfig()
+	config.StopIds = []int{2, 32000}
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		_, free := config.toC()
+		free()
+	}
+}
+
+func BenchmarkGenerationPreset(b *testing.B) {
+	f := newBenchFixture(b)
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		preset, err := NewGenerationPreset(f.config)
+		if err != nil {
+			b.Fatal(err)
+		}
+		preset.Close()
+	}
+}
+
+// Submission with per-call config conversion, wait and teardown
+func BenchmarkForward(b *testing.B) {
+	f := newBenchFixture(b)
+	tm := f.inputs(b)
+	defer tm.Close()
+	session := &Session{ID: 1, StartFlag: true, EndFlag: true}
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		result, err := f.pool.ForwardAsync(tm, session, f.config, false)
+		if err != nil {
+			b.Fatal(err)
+		}
+		if err := result.Wait(context.Background()); err != nil {
+			b.Fatal(err)
+		}
+		result.Close()
+	}
+}
+
+func BenchmarkForwardPreset(b *testing.B) {
+	f := newBenchFixture(b)
+	tm := f.inputs(b)
+	defer tm.Close()
+	preset, err := NewGenerationPreset(f.config)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer preset.Close()
+	session := &Session{ID: 1, StartFlag: true, EndFlag: true}
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		result, err := f.pool.ForwardPreset(tm, session, preset, false)
+		if err != nil {
+			b.Fatal(err)
+		}
+		if err := result.Wait(context.Background()); err != nil {
+			b.Fatal(err)
+		}
+		result.Close()
+	}
+}
+
+func BenchmarkForwardBatch16(b *testing.B) {
+	f := newBenchFixture(b)
+	requests := make([]BatchRequest, 16)
+	for i := range requests {
+		tm := f.inputs(b)
+		defer tm.Close()
+		requests[i] = BatchRequest{Inputs: tm, Session: &Session{ID: uint64(i + 1), StartFlag: true, EndFlag: true}}
+	}
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		batch, err := f.pool.ForwardBatch(requests, f.config, false)
+		if err != nil {
+			b.Fatal(err)
+		}
+		if err := batch.Wait(context.Background()); err != nil {
+			b.Fatal(err)
+		}
+		batch.Close()
+	}
+}
+
+func BenchmarkOutputView(b *testing.B) {
+	f := newBenchFixture(b)
+	tm := f.inputs(b)
+	defer tm.Close()
+	result, err := f.pool.ForwardAsync(tm, &Session{ID: 1, StartFlag: true, EndFlag: true}, f.config, false)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer result.Close()
+	if err := result.Wait(context.Background()); err != nil {
+		b.Fatal(err)
+	}
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, err := result.Output("output_ids"); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+// Greedy check of a 4-token draft against the logits of a finished request
+func BenchmarkVerifyDraft(b *testing.B) {
+	f := newBenchFixture(b)
+	tm := f.inputs(b)
+	defer tm.Close()
+	config := *f.config
+	config.MaxNewTokens = 1
+	config.OutputLogits = true
+	result, err := f.pool.ForwardAsync(tm, &Session{ID: 1, StartFlag: true, EndFlag: true}, &config, false)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer result.Close()
+	if err := result.Wait(context.Background()); err != nil {
+		b.Fatal(err)
+	}
+	draft := f.ids[508:512]
+	kept := make([]int32, len(draft)+1)
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, err := result.VerifyDraft(draft, kept); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+// Mean-pooled fp32 embeddings of 16 inputs of 32 tokens
+func BenchmarkEncode16(b *testing.B) {
+	f := newBenchFixture(b)
+	inputs := make([][]int32, 16)
+	for i := range inputs {
+		inputs[i] = f.ids[i*32 : (i+1)*32]
+	}
+	hidden, err := f.pool.HiddenSize()
+	if err != nil {
+		b.Fatal(err)
+	}
+	size := len(inputs) * hidden * 4
+	out, err := AllocPinned(size)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer ReleasePinned(out)
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if err := f.pool.Encode(inputs, PoolingMean, TypeFP32, out, size); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+// Log-probabilities of 8-token continuations of 16 prompts of 24 tokens
+func BenchmarkScore16(b *testing.B) {
+	f := newBenchFixture(b)
+	inputs := make([]ScoreInput, 16)
+	for i := range inputs {
+		inputs[i] = ScoreInput{Prompt: f.ids[i*32 : i*32+24], Continuation: f.ids[i*32+24 : (i+1)*32]}
+	}
+
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, err := f.pool.Score(inputs); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
@@ -0,0 +1,507 @@
+package turbomind
+
+import (
+	"context"
+	"encoding/binary"
+	"os"
+	"path/filepath"
+	"testing"
+	"unsafe"
+)
+
+// Behaviour of the bindings that the CPU-only mock backend can check
+// (cmake -DTURBOMIND_GO_MOCK_BACKEND=ON):
+//
+//	go test -run . ./pkg/turbomind
+
+func newTestPool(t *testing.T) *InstancePool {
+	t.Helper()
+	model, err := NewModel(t.TempDir(), "", "half")
+	if err != nil {
+		t.Skipf("backend unavailable: %v", err)
+	}
+	pool, err := model.CreateInstancePool(0, 2)
+	if err != nil {
+		model.Close()
+		t.Skipf("backend unavailable: %v", err)
+	}
+	t.Cleanup(func() {
+		pool.Close()
+		model.Close()
+	})
+	return pool
+}
+
+func TestBuildInputsReusesReleasedMap(t *testing.T) {
+	pool := newTestPool(t)
+	// Inputs are referenced by C after the call, so they cannot live in Go memory
+	buf, err := AllocPinned(4 * 4)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer ReleasePinned(buf)
+	descs := []TensorDesc{{Name: "input_ids", Data: buf, Shape: []int64{1, 4}, DType: TypeInt32, Memory: MemoryCPU}}
+
+	first, err := pool.BuildInputs(descs)
+	if err != nil {
+		t.Fatal(err)
+	}
+	handle := first.handle
+	first.Close()
+	for i := 0; i < 3; i++ {
+		tm, err := pool.BuildInputs(descs)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if tm.handle != handle {
+			t.Fatalf("build %d: got a new map after the previous one was released", i)
+		}
+		tm.Close()
+	}
+
+	// A map still held is never handed out twice
+	held, err := pool.BuildInputs(descs)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer held.Close()
+	other, err := pool.BuildInputs(descs)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer other.Close()
+	if other.handle == held.handle {
+		t.Fatal("a map in use was handed out again")
+	}
+}
+
+func TestWaitAfterCancelledWait(t *testing.T) {
+	pool := newTestPool(t)
+	buf, err := AllocPinned(4 * 4)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer ReleasePinned(buf)
+	tm, err := pool.BuildInputs([]TensorDesc{{Name: "input_ids", Data: buf, Shape: []int64{1, 4}, DType: TypeInt32, Memory: MemoryCPU}})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer tm.Close()
+	config := DefaultGenerationConfig()
+	config.MaxNewTokens = 4
+	result, err := pool.ForwardAsync(tm, &Session{ID: 1, StartFlag: true, EndFlag: true}, config, false)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer result.Close()
+
+	// Take the pending update so the next wait blocks until it is cancelled
+	if err := result.waitEvent(context.Background()); err != nil {
+		t.Fatal(err)
+	}
+	ctx, cancel := context.WithCancel(context.Background())
+	cancel()
+	if err := result.waitEvent(ctx); err != context.Canceled {
+		t.Fatalf("cancelled wait returned %v", err)
+	}
+
+	// The next update must reach a wait with a live context
+	var one [8]byte
+	binary.LittleEndian.PutUint64(one[:], 1)
+	if _, err := result.events.Write(one[:]); err != nil {
+		t.Fatal(err)
+	}
+	if err := result.waitEvent(context.Background()); err != nil {
+		t.Fatalf("wait after a cancelled wait: %v", err)
+	}
+	if err := result.Wait(context.Background()); err != nil {
+		t.Fatal(err)
+	}
+}
+
+// A SentencePiece-style vocabulary small enough to spell every test grammar
+const testTokenizerJSON = `{
+  "added_tokens": [
+    {"id": 0, "content": "<unk>", "special": true},
+    {"id": 1, "content": "<s>", "special": true},
+    {"id": 2, "content": "</s>", "special": true}
+  ],
+  "pre_tokenizer": {"type": "Metaspace", "replacement": "▁", "prepend_scheme": "always", "split": false},
+  "model": {
+    "type": "BPE",
+    "unk_token": "<unk>",
+    "vocab": {
+      "<unk>": 0, "<s>": 1, "</s>": 2, "a": 3, "b": 4, "c": 5, "▁": 6, "▁a": 7, "ab": 8, "▁b": 9,
+      "0": 10, "1": 11, "2": 12, "-": 13, "{": 14, "}": 15, "\"": 16, ":": 17, "x": 18
+    },
+    "merges": ["a b", "▁ a", "▁ b"]
+  }
+}`
+
+const (
+	tokEOS   = 2
+	tokA     = 3
+	tokB     = 4
+	tokC     = 5
+	tokSpace = 6
+	tokSpA   = 7
+	tokAB    = 8
+	tokSpB   = 9
+	tokOne   = 11
+	tokTwo   = 12
+	tokMinus = 13
+	tokOpen  = 14
+	tokClose = 15
+	tokQuote = 16
+	tokColon = 17
+	tokX     = 18
+)
+
+func compileTestGrammar(t *testing.T, kind GrammarKind, source string) *Grammar {
+	t.Helper()
+	dir := t.TempDir()
+	if err := os.WriteFile(filepath.Join(dir, "tokenizer.json"), []byte(testTokenizerJSON), 0o644); err != nil {
+		t.Fatal(err)
+	}
+	tokenizer, err := NewNativeTokenizer(dir)
+	if err != nil {
+		t.Fatal(err)
+	}
+	t.Cleanup(tokenizer.Close)
+	grammar, err := tokenizer.CompileGrammar(kind, source)
+	if err != nil {
+		t.Fatalf("compile %q: %v", source, err)
+	}
+	t.Cleanup(grammar.Close)
+	return grammar
+}
+
+// walkGrammar advances through tokens, failing on the first one not allowed
+func walkGrammar(t *testing.T, g *Grammar, tokens ...int32) int32 {
+	t.Helper()
+	state := g.Start()
+	for i, token := range tokens {
+		if state = g.Advance(state, token); state < 0 {
+			t.Fatalf("token %d (#%d) not allowed", token, i)
+		}
+	}
+	return state
+}
+
+func hasID(ids []int32, id int32) bool {
+	for _, x := range ids {
+		if x == id {
+			return true
+		}
+	}
+	return false
+}
+
+func TestGrammarAdvance(t *testing.T) {
+	g := compileTestGrammar(t, GrammarRegex, "a+b|c")
+	start := g.Start()
+	if g.Accepting(start) {
+		t.Fatal("start state accepts the empty text")
+	}
+	if g.Advance(start, tokB) >= 0 {
+		t.Fatal("text may start with b")
+	}
+
+	afterA := walkGrammar(t, g, tokA)
+	if g.Accepting(afterA) {
+		t.Fatal("a is accepted")
+	}
+	if g.Advance(afterA, tokC) >= 0 {
+		t.Fatal("c allowed after a")
+	}
+	if !g.Accepting(walkGrammar(t, g, tokA, tokA, tokB)) {
+		t.Fatal("aab not accepted")
+	}
+	// A multi-byte token walks every byte
+	if !g.Accepting(walkGrammar(t, g, tokA, tokAB)) {
+		t.Fatal("a+ab not accepted")
+	}
+	if !g.Accepting(walkGrammar(t, g, tokC)) {
+		t.Fatal("c not accepted")
+	}
+
+	ids := make([]int32, 8)
+	n, err := g.AllowedIDs(afterA, ids)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if got := ids[:n]; len(got) != 3 || !hasID(got, tokA) || !hasID(got, tokB) || !hasID(got, tokAB) {
+		t.Fatalf("allowed after a: %v", got)
+	}
+	if n, err := g.AllowedIDs(walkGrammar(t, g, tokC), ids); err != nil || n != 0 {
+		t.Fatalf("allowed after c: %d, %v", n, err)
+	}
+}
+
+func TestGrammarSkipsFirstSpace(t *testing.T) {
+	g := compileTestGrammar(t, GrammarRegex, "a+b|c")
+	start := g.Start()
+	// The tokenizer prepends a space the decoder drops, so "▁a" may open the text
+	if g.Advance(start, tokSpA) != g.Advance(start, tokA) {
+		t.Fatal("▁a does not start like a")
+	}
+	if g.Advance(start, tokSpB) >= 0 {
+		t.Fatal("▁b allowed at the start")
+	}
+	// Only the first token's space is dropped
+	if g.Advance(walkGrammar(t, g, tokA), tokSpA) >= 0 {
+		t.Fatal("▁a allowed after the first token")
+	}
+	if !g.Accepting(walkGrammar(t, g, tokSpA, tokB)) {
+		t.Fatal("▁ab not accepted")
+	}
+}
+
+func TestGrammarBadIDs(t *testing.T) {
+	g := compileTestGrammar(t, GrammarRegex, "a+b|c")
+	afterA := walkGrammar(t, g, tokA)
+	bad, err := g.BadIDs(afterA, nil)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !hasID(bad, tokEOS) {
+		t.Fatal("EOS allowed in a state that does not accept")
+	}
+	for _, id := range []int32{0, 1, tokC, tokSpace, tokSpA} {
+		if !hasID(bad, id) {
+			t.Fatalf("token %d not banned after a", id)
+		}
+	}
+	for _, id := range []int32{tokA, tokB, tokAB} {
+		if hasID(bad, id) {
+			t.Fatalf("token %d banned after a", id)
+		}
+	}
+
+	// Once accepting, EOS is the only way on
+	bad, err = g.BadIDs(g.Advance(afterA, tokB), bad)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if hasID(bad, tokEOS) || len(bad) != g.vocabSize-1 {
+		t.Fatalf("banned in an accepting state: %v", bad)
+	}
+}
+
+func TestGrammarJSONSchema(t *testing.T) {
+	integer := compileTestGrammar(t, GrammarJSONSchema, `{"type": "integer"}`)
+	if !integer.Accepting(walkGrammar(t, integer, tokMinus, tokOne, tokTwo)) {
+		t.Fatal("-12 not accepted")
+	}
+	if integer.Advance(integer.Start(), tokOpen) >= 0 {
+		t.Fatal("an integer may start with {")
+	}
+
+	enum := compileTestGrammar(t, GrammarJSONSchema, `{"enum": ["x"]}`)
+	if !enum.Accepting(walkGrammar(t, enum, tokQuote, tokX, tokQuote)) {
+		t.Fatal(`"x" not accepted`)
+	}
+	if enum.Advance(walkGrammar(t, enum, tokQuote), tokA) >= 0 {
+		t.Fatal(`"a" allowed by the enum`)
+	}
+
+	object := compileTestGrammar(t, GrammarJSONSchema,
+		`{"type": "object", "properties": {"a": {"type": "integer"}}, "required": ["a"]}`)
+	if object.Advance(walkGrammar(t, object, tokOpen), tokClose) >= 0 {
+		t.Fatal("required property may be left out")
+	}
+	if !object.Accepting(walkGrammar(t, object, tokOpen, tokQuote, tokA, tokQuote, tokColon, tokOne, tokClose)) {
+		t.Fatal(`{"a":1} not accepted`)
+	}
+}
+
+func TestGrammarInvalidSchema(t *testing.T) {
+	dir := t.TempDir()
+	if err := os.WriteFile(filepath.Join(dir, "tokenizer.json"), []byte(testTokenizerJSON), 0o644); err != nil {
+		t.Fatal(err)
+	}
+	tokenizer, err := NewNativeTokenizer(dir)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer tokenizer.Close()
+	if _, err := tokenizer.CompileGrammar(GrammarJSONSchema, `{"type":`); err == nil {
+		t.Fatal("truncated schema compiled")
+	}
+	if _, err := tokenizer.CompileGrammar(GrammarRegex, "(a"); err == nil {
+		t.Fatal("unbalanced regex compiled")
+	}
+}
+
+func TestGrammarCacheOutlivesHandles(t *testing.T) {
+	dir := t.TempDir()
+	if err := os.WriteFile(filepath.Join(dir, "tokenizer.json"), []byte(testTokenizerJSON), 0o644); err != nil {
+		t.Fatal(err)
+	}
+	tokenizer, err := NewNativeTokenizer(dir)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer tokenizer.Close()
+	first, err := tokenizer.CompileGrammar(GrammarRegex, "a+b|c")
+	if err != nil {
+		t.Fatal(err)
+	}
+	state := first.Advance(first.Start(), tokA)
+	first.Close()
+
+	// The cached grammar survives its first handle, with the same states
+	again, err := tokenizer.CompileGrammar(GrammarRegex, "a+b|c")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer again.Close()
+	if again.Advance(again.Start(), tokA) != state || !again.Accepting(again.Advance(state, tokB)) {
+		t.Fatal("recompiled grammar differs")
+	}
+}
+
+func TestEncodeIntoCallerBuffer(t *testing.T) {
+	pool := newTestPool(t)
+	hidden, err := pool.HiddenSize()
+	if err != nil {
+		t.Fatal(err)
+	}
+	inputs := [][]int32{{1, 2, 3}, {10, 20}}
+	out := make([]float32, len(inputs)*hidden)
+	size := len(out) * 4
+	if err := pool.Encode(inputs, PoolingMean, TypeFP32, unsafe.Pointer(&out[0]), size-1); err == nil {
+		t.Fatal("encoded into a buffer one byte short")
+	}
+
+	// The mock's hidden state j of a token is its id times j + 1
+	if err := pool.Encode(inputs, PoolingMean, TypeFP32, unsafe.Pointer(&out[0]), size); err != nil {
+		t.Fatal(err)
+	}
+	if out[0] != 2 || out[1] != 4 || out[hidden] != 15 {
+		t.Fatalf("mean pooling gave %v", out)
+	}
+	half := make([]uint16, len(inputs)*hidden)
+	if err := pool.Encode(inputs, PoolingLast, TypeFP16, unsafe.Pointer(&half[0]), len(half)*2); err != nil {
+		t.Fatal(err)
+	}
+	if half[0] != 0x4200 || half[hidden] != 0x4D00 { // 3 and 20
+		t.Fatalf("last pooling gave %x %x", half[0], half[hidden])
+	}
+	if err := pool.Encode([][]int32{{1}, {}}, PoolingLast, TypeFP32, unsafe.Pointer(&out[0]), size); err == nil {
+		t.Fatal("empty input encoded")
+	}
+	if err := pool.Encode(nil, PoolingLast, TypeFP32, nil, 0); err == nil {
+		t.Fatal("encoded no inputs")
+	}
+}
+
+func TestEmbedNoTexts(t *testing.T) {
+	engine, err := NewEngine(&EngineConfig{ModelDir: t.TempDir(), WeightType: "half"})
+	if err != nil {
+		t.Skipf("backend unavailable: %v", err)
+	}
+	defer engine.Close()
+	if _, err := engine.Embed(nil, PoolingMean); err == nil {
+		t.Fatal("embedded no texts")
+	}
+}
+
+func TestChunkedPrefillPrefixAccounting(t *testing.T) {
+	model, err := NewModel(t.TempDir(), "", "half")
+	if err != nil {
+		t.Skipf("backend unavailable: %v", err)
+	}
+	defer model.Close()
+	if err := model.EnablePrefixCache(2, 64); err != nil {
+		t.Fatal(err)
+	}
+	if err := model.SetPrefillChunkSize(4); err != nil {
+		t.Fatal(err)
+	}
+	pool, err := model.CreateInstancePool(0, 2)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer pool.Close()
+
+	const promptLen = 12
+	buf, err := AllocPinned(promptLen * 4)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer ReleasePinned(buf)
+	ids := unsafe.Slice((*int32)(buf), promptLen)
+	for i := range ids {
+		ids[i] = int32(i + 1)
+	}
+	run := func(id uint64) int {
+		t.Helper()
+		tm, err := pool.BuildInputs([]TensorDesc{{Name: "input_ids", Data: buf, Shape: []int64{1, promptLen}, DType: TypeInt32, Memory: MemoryCPU}})
+		if err != nil {
+			t.Fatal(err)
+		}
+		defer tm.Close()
+		config := DefaultGenerationConfig()
+		config.MaxNewTokens = 2
+		result, err := pool.ForwardAsync(tm, &Session{ID: id, StartFlag: true, EndFlag: true}, config, false)
+		if err != nil {
+			t.Fatal(err)
+		}
+		defer result.Close()
+		if err := result.Wait(context.Background()); err != nil {
+			t.Fatal(err)
+		}
+		return result.PrefixHitLen
+	}
+
+	if hit := run(1); hit != 0 {
+		t.Fatalf("cold prompt hit %d tokens", hit)
+	}
+	// The whole prompt is indexed, not only its first chunk
+	if blocks := model.PrefixCacheStats().Blocks; blocks != promptLen/2 {
+		t.Fatalf("%d blocks indexed, want %d", blocks, promptLen/2)
+	}
+	// Only the first chunk starts the sequence, so only it reuses blocks; the
+	// engine always prefills the chunk's last token
+	if hit := run(2); hit != 2 {
+		t.Fatalf("chunked prompt hit %d tokens, want 2", hit)
+	}
+	if err := model.SetPrefillChunkSize(0); err != nil {
+		t.Fatal(err)
+	}
+	if hit := run(3); hit != promptLen-2 {
+		t.Fatalf("whole prompt hit %d tokens, want %d", hit, promptLen-2)
+	}
+}
+
+func TestPinPrefixTwice(t *testing.T) {
+	model, err := NewModel(t.TempDir(), "", "half")
+	if err != nil {
+		t.Skipf("backend unavailable: %v", err)
+	}
+	defer model.Close()
+	if err := model.EnablePrefixCache(2, 64); err != nil {
+		t.Fatal(err)
+	}
+	pool, err := model.CreateInstancePool(0, 1)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer pool.Close()
+
+	prefix := []int32{1, 2, 3, 4}
+	if err := pool.PinPrefix("system", prefix); err != nil {
+		t.Fatal(err)
+	}
+	err = pool.PinPrefix("system", prefix)
+	if e, ok := err.(*Error); !ok || e.Code != ErrInvalidState {
+		t.Fatalf("pinning a name twice returned %v", err)
+	}
+	if pinned := model.PrefixCacheStats().PinnedBlocks; pinned != 2 {
+		t.Fatalf("%d blocks pinned, want 2", pinned)
+	}
+	if err := pool.EvictPrefix("system"); err != nil {
+		t.Fatal(err)
+	}
+}
@@ -0,0 +1,1244 @@
+#include "turbomind_grammar.h"
+
+#include "turbomind_json.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+namespace turbomind_go {
+
+namespace {
+
+constexpr uint32_t kMaxCodePoint = 0x10ffff;
+constexpr int kMaxRepeat = 1000;
+constexpr size_t kMaxNfaStates = 1 << 20;
+constexpr size_t kMaxDfaStates = 1 << 14;
+constexpr int kMaxSchemaDepth = 32;
+constexpr int kAnyValueDepth = 2; // nesting allowed where a schema accepts any value
+
+// Sorted, disjoint code point ranges
+using Ranges = std::vector<std::pair<uint32_t, uint32_t>>;
+
+void normalize(Ranges& ranges) {
+    std::sort(ranges.begin(), ranges.end());
+    size_t n = 0;
+    for (const auto& r : ranges) {
+        if (n > 0 && r.first <= ranges[n - 1].second + 1) {
+            ranges[n - 1].second = std::max(ranges[n - 1].second, r.second);
+        } else {
+            ranges[n++] = r;
+        }
+    }
+    ranges.resize(n);
+}
+
+Ranges negate(const Ranges& ranges) {
+    Ranges out;
+    uint32_t next = 0;
+    for (const auto& r : ranges) {
+        if (r.first > next) {
+            out.push_back({next, r.first - 1});
+        }
+        next = r.second + 1;
+    }
+    if (next <= kMaxCodePoint) {
+        out.push_back({next, kMaxCodePoint});
+    }
+    return out;
+}
+
+// Byte ranges of one UTF-8 encoding length: [lo[i], hi[i]] per position
+struct ByteSequence {
+    uint8_t lo[4];
+    uint8_t hi[4];
+    int length;
+};
+
+int encode_utf8(uint32_t cp, uint8_t* out) {
+    if (cp < 0x80) {
+        out[0] = static_cast<uint8_t>(cp);
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = static_cast<uint8_t>(0xc0 | (cp >> 6));
+        out[1] = static_cast<uint8_t>(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = static_cast<uint8_t>(0xe0 | (cp >> 12));
+        out[1] = static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = static_cast<uint8_t>(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = static_cast<uint8_t>(0xf0 | (cp >> 18));
+    out[1] = static_cast<uint8_t>(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = static_cast<uint8_t>(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+// Splits [lo, hi] until each piece is a product of per-byte ranges, so a code
+// point class becomes a handful of byte paths. Surrogates are skipped.
+void utf8_sequences(uint32_t lo, uint32_t hi, std::vector<ByteSequence>& out) {
+    if (lo > hi) {
+        return;
+    }
+    if (lo <= 0xdfff && hi >= 0xd800) {
+        if (lo < 0xd800) {
+            utf8_sequences(lo, 0xd7ff, out);
+        }
+        if (hi > 0xdfff) {
+            utf8_sequences(0xe000, hi, out);
+        }
+        return;
+    }
+    static constexpr uint32_t kLengthMax[] = {0x7f, 0x7ff, 0xffff};
+    for (uint32_t max : kLengthMax) {
+        if (lo <= max && hi > max) {
+            utf8_sequences(lo, max, out);
+            utf8_sequences(max + 1, hi, out);
+            return;
+        }
+    }
+    if (hi >= 0x80) {
+        for (int i = 1; i < 4; ++i) {
+            const uint32_t m = (1u << (6 * i)) - 1;
+            if ((lo & ~m) != (hi & ~m)) {
+                if ((lo & m) != 0) {
+                    utf8_sequences(lo, lo | m, out);
+                    utf8_sequences((lo | m) + 1, hi, out);
+                    return;
+                }
+                if ((hi & m) != m) {
+                    utf8_sequences(lo, (hi & ~m) - 1, out);
+                    utf8_sequences(hi & ~m, hi, out);
+                    return;
+                }
+            }
+        }
+    }
+    ByteSequence seq;
+    seq.length = encode_utf8(lo, seq.lo);
+    encode_utf8(hi, seq.hi);
+    out.push_back(seq);
+}
+
+// Regex syntax tree
+struct Node {
+    enum class Kind { kEmpty, kSet, kConcat, kAlt, kRepeat };
+    
+    Kind kind = Kind::kEmpty;
+    Ranges ranges;             // kSet
+    std::vector<int> children; // kConcat, kAlt; kRepeat has one
+    int min = 0;
+    int max = -1; // kRepeat, -1 for unbounded
+};
+
+class RegexParser {
+public:
+    explicit RegexParser(std::string_view pattern) : pattern_(pattern) {}
+    
+    // Returns the root; nodes() holds the tree
+    int parse() {
+        if (pos_ < pattern_.size() && pattern_[pos_] == '^') {
+            ++pos_;
+        }
+        const int root = parse_alt(0);
+        if (pos_ < pattern_.size()) {
+            fail(pattern_[pos_] == ')' ? "unbalanced ')'" : "unexpected character");
+        }
+        return root;
+    }
+    
+    const std::vector<Node>& nodes() const {
+        return nodes_;
+    }
+
+private:
+    [[noreturn]] void fail(const char* what) const {
+        throw std::invalid_argument(std::string("regex: ") + what + " at offset " + std::to_string(pos_));
+    }
+    
+    bool at_end() const {
+        return pos_ >= pattern_.size();
+    }
+    char peek() const {
+        return pattern_[pos_];
+    }
+    
+    int add(Node node) {
+        nodes_.push_back(std::move(node));
+        return static_cast<int>(nodes_.size() - 1);
+    }
+    int add_set(Ranges ranges) {
+        Node node;
+        node.kind = Node::Kind::kSet;
+        normalize(ranges);
+        node.ranges = std::move(ranges);
+        return add(std::move(node));
+    }
+    
+    int parse_alt(int depth) {
+        if (depth > 64) {
+            fail("nesting too deep");
+        }
+        std::vector<int> branches{parse_concat(depth)};
+        while (!at_end() && peek() == '|') {
+            ++pos_;
+            branches.push_back(parse_concat(depth));
+        }
+        if (branches.size() == 1) {
+            return branches[0];
+        }
+        Node node;
+        node.kind = Node::Kind::kAlt;
+        node.children = std::move(branches);
+        return add(std::move(node));
+    }
+    
+    int parse_concat(int depth) {
+        std::vector<int> items;
+        while (!at_end() && peek() != '|' && peek() != ')') {
+            if (peek() == '$' && pos_ + 1 == pattern_.size()) {
+                ++pos_;
+                break;
+            }
+            items.push_back(parse_repeat(depth));
+        }
+        if (items.size() == 1) {
+            return items[0];
+        }
+        Node node;
+        node.kind = items.empty() ? Node::Kind::kEmpty : Node::Kind::kConcat;
+        node.children = std::move(items);
+        return add(std::move(node));
+    }
+    
+    // Reads "{m}", "{m,}" or "{m,n}" at pos_; leaves pos_ alone when it is not one
+    bool parse_counts(int& min, int& max) {
+        size_t p = pos_ + 1;
+        auto number = [&](int& value) {
+            const size_t begin = p;
+            long v = 0;
+            while (p < pattern_.size() && pattern_[p] >= '0' && pattern_[p] <= '9') {
+                v = std::min<long>(v * 10 + (pattern_[p] - '0'), kMaxRepeat + 1);
+                ++p;
+            }
+            value = static_cast<int>(v);
+            return p > begin;
+        };
+        if (!number(min)) {
+            return false;
+        }
+        max = min;
+        if (p < pattern_.size() && pattern_[p] == ',') {
+            ++p;
+            if (!number(max)) {
+                max = -1;
+            }
+        }
+        if (p >= pattern_.size() || pattern_[p] != '}') {
+            return false;
+        }
+        pos_ = p + 1;
+        if (min > kMaxRepeat || max > kMaxRepeat) {
+            fail("repeat count too large");
+        }
+        if (max >= 0 && max < min) {
+            fail("repeat range out of order");
+        }
+        return true;
+    }
+    
+    int parse_repeat(int depth) {
+        int atom = parse_atom(depth);
+        while (!at_end()) {
+            int min = 0;
+            int max = -1;
+            const char c = peek();
+            if (c == '*') {
+                ++pos_;
+            } else if (c == '+') {
+                ++pos_;
+                min = 1;
+            } else if (c == '?') {
+                ++pos_;
+                max = 1;
+            } else if (c != '{' || !parse_counts(min, max)) {
+                break;
+            }
+            if (!at_end() && (peek() == '?' || peek() == '+')) {
+                ++pos_; // lazy and possessive only change which match is found
+            }
+            Node node;
+            node.kind = Node::Kind::kRepeat;
+            node.children = {atom};
+            node.min = min;
+            node.max = max;
+            atom = add(std::move(node));
+        }
+        return atom;
+    }
+    
+    uint32_t next_code_point() {
+        const uint8_t b = pattern_[pos_];
+        const int n = b < 0x80 ? 1 : b >= 0xf0 ? 4 : b >= 0xe0 ? 3 : b >= 0xc2 ? 2 : 0;
+        if (n == 0 || pos_ + n > pattern_.size()) {
+            fail("invalid UTF-8");
+        }
+        uint32_t cp = n == 1 ? b : b & (0x7f >> n);
+        for (int i = 1; i < n; ++i) {
+            const uint8_t c = pattern_[pos_ + i];
+            if ((c & 0xc0) != 0x80) {
+                fail("invalid UTF-8");
+            }
+            cp = (cp << 6) | (c & 0x3f);
+        }
+        pos_ += n;
+        return cp;
+    }
+    
+    uint32_t parse_hex(int digits) {
+        if (pos_ + digits > pattern_.size()) {
+            fail("truncated escape");
+        }
+        uint32_t v = 0;
+        for (int i = 0; i < digits; ++i) {
+            const char c = pattern_[pos_++];
+            v <<= 4;
+            if (c >= '0' && c <= '9') {
+                v |= c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                v |= c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                v |= c - 'A' + 10;
+            } else {
+                fail("invalid hex escape");
+            }
+        }
+        return v;
+    }
+    
+    // Escape after the backslash: a class (\d, \w, ...) or a single code point
+    Ranges parse_escape() {
+        if (at_end()) {
+            fail("trailing backslash");
+        }
+        const char c = pattern_[pos_++];
+        static const Ranges kDigit = {{'0', '9'}};
+        static const Ranges kWord = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+        static const Ranges kSpace = {{'\t', '\r'}, {' ', ' '}};
+        switch (c) {
+            case 'd': return kDigit;
+            case 'D': return negate(kDigit);
+            case 'w': return kWord;
+            case 'W': return negate(kWord);
+            case 's': return kSpace;
+            case 'S': return negate(kSpace);
+            case 'n': return {{'\n', '\n'}};
+            case 't': return {{'\t', '\t'}};
+            case 'r': return {{'\r', '\r'}};
+            case 'f': return {{'\f', '\f'}};
+            case 'v': return {{'\v', '\v'}};
+            case '0': return {{0, 0}};
+            case 'x': {
+                const uint32_t v = parse_hex(2);
+                return {{v, v}};
+            }
+            case 'u': {
+                const uint32_t v = parse_hex(4);
+                return {{v, v}};
+            }
+            default:
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '1' && c <= '9')) {
+                    fail("unsupported escape"); // \b, \B, backreferences, ...
+                }
+                --pos_;
+                const uint32_t cp = next_code_point();
+                return {{cp, cp}};
+        }
+    }
+    
+    int parse_class() {
+        ++pos_; // '['
+        bool negated = false;
+        if (!at_end() && peek() == '^') {
+            negated = true;
+            ++pos_;
+        }
+        Ranges ranges;
+        bool first = true;
+        while (true) {
+            if (at_end()) {
+                fail("unterminated class");
+            }
+            if (peek() == ']' && !first) {
+                ++pos_;
+                break;
+            }
+            first = false;
+            Ranges item;
+            if (peek() == '\\') {
+                ++pos_;
+                item = parse_escape();
+            } else {
+                const uint32_t cp = next_code_point();
+                item = {{cp, cp}};
+            }
+            // A range needs single code points on both sides
+            if (item.size() == 1 && item[0].first == item[0].second && pos_ + 1 < pattern_.size() &&
+                peek() == '-' && pattern_[pos_ + 1] != ']') {
+                ++pos_;
+                Ranges end;
+                if (peek() == '\\') {
+                    ++pos_;
+                    end = parse_escape();
+                } else {
+                    const uint32_t cp = next_code_point();
+                    end = {{cp, cp}};
+                }
+                if (end.size() != 1 || end[0].first != end[0].second || end[0].first < item[0].first) {
+                    fail("invalid class range");
+                }
+                item[0].second = end[0].first;
+            }
+            ranges.insert(ranges.end(), item.begin(), item.end());
+        }
+        normalize(ranges);
+        return add_set(negated ? negate(ranges) : ranges);
+    }
+    
+    int parse_atom(int depth) {
+        const char c = peek();
+        switch (c) {
+            case '(': {
+                ++pos_;
+                if (pos_ + 1 < pattern_.size() && peek() == '?') {
+                    if (pattern_[pos_ + 1] != ':') {
+                        fail("unsupported group"); // lookaround, named groups, flags
+                    }
+                    pos_ += 2;
+                }
+                const int inner = parse_alt(depth + 1);
+                if (at_end() || peek() != ')') {
+                    fail("missing ')'");
+                }
+                ++pos_;
+                return inner;
+            }
+            case '[':
+                return parse_class();
+            case '.':
+                ++pos_;
+                return add_set(negate({{'\n', '\n'}}));
+            case '\\':
+                ++pos_;
+                return add_set(parse_escape());
+            case '*':
+            case '+':
+            case '?':
+                fail("nothing to repeat");
+            case '^':
+            case '$':
+                fail("anchors are only supported at the ends");
+            default: {
+                const uint32_t cp = next_code_point();
+                return add_set({{cp, cp}});
+            }
+        }
+    }
+    
+    std::string_view pattern_;
+    size_t pos_ = 0;
+    std::vector<Node> nodes_;
+};
+
+// Thompson NFA over bytes. Each state has epsilon moves and at most one byte
+// range edge.
+class Nfa {
+public:
+    struct State {
+        std::vector<int> eps;
+        int next = -1;
+        uint8_t lo = 0;
+        uint8_t hi = 0;
+    };
+    
+    Nfa(const std::vector<Node>& nodes, int root) : nodes_(nodes) {
+        start_ = add();
+        accept_ = add();
+        const auto [begin, end] = compile(root);
+        states_[start_].eps.push_back(begin);
+        states_[end].eps.push_back(accept_);
+    }
+    
+    const std::vector<State>& states() const {
+        return states_;
+    }
+    int start() const {
+        return start_;
+    }
+    int accept() const {
+        return accept_;
+    }
+
+private:
+    int add() {
+        if (states_.size() >= kMaxNfaStates) {
+            throw std::invalid_argument("regex: pattern too large");
+        }
+        states_.emplace_back();
+        return static_cast<int>(states_.size() - 1);
+    }
+    
+    // Fragment [begin, end]: end has no moves yet
+    std::pair<int, int> compile(int index) {
+        const Node& node = nodes_[index];
+        switch (node.kind) {
+            case Node::Kind::kEmpty: {
+                const int s = add();
+                return {s, s};
+            }
+            case Node::Kind::kSet: {
+                const int begin = add();
+                const int end = add();
+                std::vector<ByteSequence> seqs;
+                for (const auto& r : node.ranges) {
+                    utf8_sequences(r.first, r.second, seqs);
+                }
+                for (const ByteSequence& seq : seqs) {
+                    int from = begin;
+                    for (int i = 0; i < seq.length; ++i) {
+                        const int to = i + 1 == seq.length ? end : add();
+                        const int s = add();
+                        states_[from].eps.push_back(s);
+                        states_[s].lo = seq.lo[i];
+                        states_[s].hi = seq.hi[i];
+                        states_[s].next = to;
+                        from = to;
+                    }
+                }
+                return {begin, end};
+            }
+            case Node::Kind::kConcat: {
+                auto [begin, end] = compile(node.children[0]);
+                for (size_t i = 1; i < node.children.size(); ++i) {
+                    const auto [b, e] = compile(node.children[i]);
+                    states_[end].eps.push_back(b);
+                    end = e;
+                }
+                return {begin, end};
+            }
+            case Node::Kind::kAlt: {
+                const int begin = add();
+                const int end = add();
+                for (int child : node.children) {
+                    const auto [b, e] = compile(child);
+                    states_[begin].eps.push_back(b);
+                    states_[e].eps.push_back(end);
+                }
+                return {begin, end};
+            }
+            case Node::Kind::kRepeat: {
+                const int child = node.children[0];
+                const int begin = add();
+                int end = begin;
+                for (int i = 0; i < node.min; ++i) {
+                    const auto [b, e] = compile(child);
+                    states_[end].eps.push_back(b);
+                    end = e;
+                }
+                if (node.max < 0) {
+                    // Loop: end -> copy -> end
+                    const auto [b, e] = compile(child);
+                    const int loop = add();
+                    states_[end].eps.push_back(loop);
+                    states_[loop].eps.push_back(b);
+                    states_[e].eps.push_back(loop);
+                    return {begin, loop};
+                }
+                // Optional copies, each of which may end the repeat
+                const int exit = add();
+                for (int i = node.min; i < node.max; ++i) {
+                    const auto [b, e] = compile(child);
+                    states_[end].eps.push_back(b);
+                    states_[end].eps.push_back(exit);
+                    end = e;
+                }
+                states_[end].eps.push_back(exit);
+                return {begin, exit};
+            }
+        }
+        throw std::logic_error("regex: bad node");
+    }
+    
+    const std::vector<Node>& nodes_;
+    std::vector<State> states_;
+    int start_ = 0;
+    int accept_ = 0;
+};
+
+// Epsilon closure of `set`, sorted, holding only states with a byte edge or the
+// accept state; both are all a DFA state needs
+std::vector<int> closure(const Nfa& nfa, std::vector<int> stack, std::vector<uint32_t>& seen, uint32_t mark) {
+    std::vector<int> out;
+    const auto& states = nfa.states();
+    while (!stack.empty()) {
+        const int s = stack.back();
+        stack.pop_back();
+        if (seen[s] == mark) {
+            continue;
+        }
+        seen[s] = mark;
+        if (states[s].next >= 0 || s == nfa.accept()) {
+            out.push_back(s);
+        }
+        for (int e : states[s].eps) {
+            if (seen[e] != mark) {
+                stack.push_back(e);
+            }
+        }
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+std::string json_escape(std::string_view s) {
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                if (static_cast<uint8_t>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+    return out;
+}
+
+// Compact JSON text of a value
+std::string to_json(const Json& value) {
+    switch (value.type) {
+        case Json::Type::kNull: return "null";
+        case Json::Type::kBool: return value.boolean ? "true" : "false";
+        case Json::Type::kNumber: {
+            char buf[32];
+            if (value.number == std::floor(value.number) && std::fabs(value.number) < 1e15) {
+                std::snprintf(buf, sizeof(buf), "%.0f", value.number);
+            } else {
+                std::snprintf(buf, sizeof(buf), "%.17g", value.number);
+            }
+            return buf;
+        }
+        case Json::Type::kString: return json_escape(value.string);
+        case Json::Type::kArray: {
+            std::string out = "[";
+            for (size_t i = 0; i < value.items.size(); ++i) {
+                out += (i ? "," : "") + to_json(value.items[i]);
+            }
+            return out + "]";
+        }
+        case Json::Type::kObject: {
+            std::string out = "{";
+            for (size_t i = 0; i < value.items.size(); ++i) {
+                out += (i ? "," : "") + json_escape(value.keys[i]) + ":" + to_json(value.items[i]);
+            }
+            return out + "}";
+        }
+    }
+    return "null";
+}
+
+std::string regex_escape(std::string_view s) {
+    std::string out;
+    for (char c : s) {
+        if (std::string_view("\\.^$|?*+()[]{}").find(c) != std::string_view::npos) {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+// "{lo,hi}" with hi < 0 for unbounded
+std::string quantifier(int lo, int hi) {
+    if (lo == 0 && hi < 0) {
+        return "*";
+    }
+    if (lo == 1 && hi < 0) {
+        return "+";
+    }
+    if (lo == hi) {
+        return lo == 1 ? "" : "{" + std::to_string(lo) + "}";
+    }
+    return "{" + std::to_string(lo) + "," + (hi < 0 ? "" : std::to_string(hi)) + "}";
+}
+
+int count(const Json* j, int fallback) {
+    if (!j || j->type != Json::Type::kNumber || j->number < 0) {
+        return fallback;
+    }
+    return static_cast<int>(std::min(j->number, static_cast<double>(kMaxRepeat)));
+}
+
+class SchemaCompiler {
+public:
+    explicit SchemaCompiler(const Json& root) : root_(root) {}
+    
+    std::string value(const Json& schema, int depth) {
+        if (depth > kMaxSchemaDepth) {
+            fail("schema too deep or recursive");
+        }
+        if (schema.type == Json::Type::kBool) {
+            if (!schema.boolean) {
+                fail("false schema matches nothing");
+            }
+            return any(kAnyValueDepth);
+        }
+        if (schema.type != Json::Type::kObject) {
+            fail("schema must be an object");
+        }
+        if (const Json* ref = schema.get("$ref")) {
+            return value(resolve(*ref), depth + 1);
+        }
+        if (const Json* c = schema.get("const")) {
+            return regex_escape(to_json(*c));
+        }
+        if (const Json* e = schema.get("enum")) {
+            if (e->type != Json::Type::kArray || e->items.empty()) {
+                fail("enum must be a non-empty array");
+            }
+            std::string out;
+            for (const Json& item : e->items) {
+                out += (out.empty() ? "" : "|") + regex_escape(to_json(item));
+            }
+            return "(?:" + out + ")";
+        }
+        for (const char* key : {"anyOf", "oneOf"}) {
+            if (const Json* list = schema.get(key)) {
+                return alternatives(*list, depth);
+            }
+        }
+        if (const Json* all = schema.get("allOf")) {
+            if (all->type != Json::Type::kArray || all->items.size() != 1) {
+                fail("allOf is only supported with one schema");
+            }
+            return value(all->items[0], depth + 1);
+        }
+        
+        const Json* type = schema.get("type");
+        if (!type) {
+            if (schema.get("properties")) {
+                return object(schema, depth);
+            }
+            if (schema.get("items")) {
+                return array(schema, depth);
+            }
+            return any(kAnyValueDepth);
+        }
+        if (type->type == Json::Type::kArray) {
+            std::string out;
+            for (const Json& t : type->items) {
+                out += (out.empty() ? "" : "|") + typed(t, schema, depth);
+            }
+            if (out.empty()) {
+                fail("empty type list");
+            }
+            return "(?:" + out + ")";
+        }
+        return typed(*type, schema, depth);
+    }
+
+private:
+    [[noreturn]] static void fail(const std::string& what) {
+        throw std::invalid_argument("JSON schema: " + what);
+    }
+    
+    const Json& resolve(const Json& ref) const {
+        if (ref.type != Json::Type::kString || ref.string.compare(0, 1, "#") != 0) {
+            fail("only local $refs are supported");
+        }
+        const Json* node = &root_;
+        size_t pos = 1;
+        while (pos < ref.string.size()) {
+            if (ref.string[pos] != '/') {
+                fail("bad $ref " + ref.string);
+            }
+            const size_t end = std::min(ref.string.find('/', pos + 1), ref.string.size());
+            std::string key = ref.string.substr(pos + 1, end - pos - 1);
+            for (size_t i = 0; (i = key.find('~', i)) != std::string::npos; ++i) {
+                key.replace(i, 2, i + 1 < key.size() && key[i + 1] == '1' ? "/" : "~");
+            }
+            node = node->get(key);
+            if (!node) {
+                fail("unresolved $ref " + ref.string);
+            }
+            pos = end;
+        }
+        return *node;
+    }
+    
+    std::string alternatives(const Json& list, int depth) {
+        if (list.type != Json::Type::kArray || list.items.empty()) {
+            fail("anyOf/oneOf must be a non-empty array");
+        }
+        std::string out;
+        for (const Json& item : list.items) {
+            out += (out.empty() ? "" : "|") + value(item, depth + 1);
+        }
+        return "(?:" + out + ")";
+    }
+    
+    std::string typed(const Json& type, const Json& schema, int depth) {
+        if (type.type != Json::Type::kString) {
+            fail("type must be a string");
+        }
+        const std::string& t = type.string;
+        if (t == "string") {
+            return string(schema);
+        }
+        if (t == "integer") {
+            return kInteger;
+        }
+        if (t == "number") {
+            return kNumber;
+        }
+        if (t == "boolean") {
+            return "(?:true|false)";
+        }
+        if (t == "null") {
+            return "null";
+        }
+        if (t == "array") {
+            return array(schema, depth);
+        }
+        if (t == "object") {
+            return object(schema, depth);
+        }
+        fail("unknown type " + t);
+    }
+    
+    std::string string(const Json& schema) const {
+        if (const Json* pattern = schema.get("pattern")) {
+            if (pattern->type != Json::Type::kString) {
+                fail("pattern must be a string");
+            }
+            std::string_view p = pattern->string;
+            if (!p.empty() && p.front() == '^') {
+                p.remove_prefix(1);
+            }
+            if (!p.empty() && p.back() == '$' && (p.size() < 2 || p[p.size() - 2] != '\\')) {
+                p.remove_suffix(1);
+            }
+            return "\"(?:" + std::string(p) + ")\"";
+        }
+        if (const Json* format = schema.get("format")) {
+            const std::string_view f = format->type == Json::Type::kString ? std::string_view(format->string) : "";
+            if (f == "date-time") {
+                return "\"" + std::string(kDate) + "T" + kTime + "\"";
+            }
+            if (f == "date") {
+                return "\"" + std::string(kDate) + "\"";
+            }
+            if (f == "time") {
+                return "\"" + std::string(kTime) + "\"";
+            }
+            if (f == "uuid") {
+                return "\"[0-9a-fA-F]{8}-[0-9a-fA-F]{4}-[0-9a-fA-F]{4}-[0-9a-fA-F]{4}-[0-9a-fA-F]{12}\"";
+            }
+        }
+        const int lo = count(schema.get("minLength"), 0);
+        const int hi = count(schema.get("maxLength"), -1);
+        if (hi >= 0 && hi < lo) {
+            fail("maxLength below minLength");
+        }
+        return "\"" + std::string(kChar) + quantifier(lo, hi) + "\"";
+    }
+    
+    std::string array(const Json& schema, int depth) {
+        const Json* items = schema.get("items");
+        const std::string item = items ? value(*items, depth + 1) : any(kAnyValueDepth - 1);
+        const int lo = count(schema.get("minItems"), 0);
+        const int hi = count(schema.get("maxItems"), -1);
+        if (hi >= 0 && hi < lo) {
+            fail("maxItems below minItems");
+        }
+        return list("\\[", item, lo, hi, "\\]");
+    }
+    
+    // open ws item (ws , ws item){lo-1,hi-1} ws close, or empty when lo is 0
+    static std::string list(const char* open, const std::string& item, int lo, int hi, const char* close) {
+        if (hi == 0) {
+            return std::string(open) + kWs + close;
+        }
+        const std::string rest = "(?:" + std::string(kWs) + "," + kWs + item + ")" +
+                                 quantifier(std::max(lo - 1, 0), hi < 0 ? -1 : hi - 1);
+        const std::string items = "(?:" + item + ")" + rest;
+        return std::string(open) + kWs + (lo == 0 ? "(?:" + items + ")?" : items) + kWs + close;
+    }
+    
+    std::string object(const Json& schema, int depth) {
+        const Json* properties = schema.get("properties");
+        if (!properties || properties->type != Json::Type::kObject || properties->items.empty()) {
+            return any_object(kAnyValueDepth - 1);
+        }
+        std::vector<std::string> members;
+        std::vector<bool> required;
+        const Json* req = schema.get("required");
+        for (size_t i = 0; i < properties->keys.size(); ++i) {
+            const std::string& key = properties->keys[i];
+            members.push_back(regex_escape(json_escape(key)) + kWs + ":" + kWs + value(properties->items[i], depth + 1));
+            bool is_required = false;
+            if (req && req->type == Json::Type::kArray) {
+                for (const Json& r : req->items) {
+                    is_required |= r.type == Json::Type::kString && r.string == key;
+                }
+            }
+            required.push_back(is_required);
+        }
+        
+        // Properties in declaration order. tail(i): members i.. after one has
+        // been written, each behind a comma; head(i): the same before any has.
+        const size_t n = members.size();
+        std::vector<std::string> tail(n + 1);
+        for (size_t i = n; i-- > 0;) {
+            const std::string m = "(?:" + std::string(kWs) + "," + kWs + members[i] + ")";
+            tail[i] = (required[i] ? m : m + "?") + tail[i + 1];
+        }
+        std::string head;
+        for (size_t i = n; i-- > 0;) {
+            const std::string present = members[i] + tail[i + 1];
+            if (required[i]) {
+                head = present;
+            } else {
+                head = "(?:" + present + (head.empty() ? ")?" : "|" + head + ")");
+            }
+        }
+        return "\\{" + std::string(kWs) + head + kWs + "\\}";
+    }
+    
+    std::string any(int depth) const {
+        std::string out = std::string("(?:\"") + kChar + "*\"|" + kNumber + "|true|false|null";
+        if (depth > 0) {
+            out += "|" + list("\\[", any(depth - 1), 0, -1, "\\]") + "|" + any_object(depth - 1);
+        }
+        return out + ")";
+    }
+    
+    std::string any_object(int depth) const {
+        const std::string member = std::string("\"") + kChar + "*\"" + kWs + ":" + kWs + any(depth);
+        return list("\\{", member, 0, -1, "\\}");
+    }
+    
+    static constexpr const char* kWs = "[ ]?";
+    static constexpr const char* kChar = "(?:[^\"\\\\\\x00-\\x1f]|\\\\[\"\\\\/bfnrt]|\\\\u[0-9a-fA-F]{4})";
+    static constexpr const char* kInteger = "-?(?:0|[1-9][0-9]*)";
+    static constexpr const char* kNumber = "-?(?:0|[1-9][0-9]*)(?:\\.[0-9]+)?(?:[eE][+-]?[0-9]+)?";
+    static constexpr const char* kDate = "[0-9]{4}-(?:0[1-9]|1[0-2])-(?:0[1-9]|[12][0-9]|3[01])";
+    static constexpr const char* kTime =
+        "(?:[01][0-9]|2[0-3]):[0-5][0-9]:[0-5][0-9](?:\\.[0-9]+)?(?:Z|[+-](?:[01][0-9]|2[0-3]):[0-5][0-9])?";
+    
+    const Json& root_;
+};
+
+} // namespace
+
+Dfa Dfa::from_regex(std::string_view pattern) {
+    RegexParser parser(pattern);
+    const int root = parser.parse();
+    const Nfa nfa(parser.nodes(), root);
+    const auto& states = nfa.states();
+    
+    // Subset construction. The byte edges of a set split 0..255 into runs with
+    // one successor set each, so each run is resolved once.
+    std::vector<std::vector<int>> sets;
+    std::map<std::vector<int>, int32_t> ids;
+    std::vector<int32_t> transitions;
+    std::vector<uint32_t> seen(states.size(), 0);
+    uint32_t mark = 0;
+    
+    sets.push_back(closure(nfa, {nfa.start()}, seen, ++mark));
+    ids.emplace(sets[0], 0);
+    for (size_t d = 0; d < sets.size(); ++d) {
+        transitions.resize((d + 1) * 256, kDead);
+        std::vector<int> bounds{0, 256};
+        for (int s : sets[d]) {
+            if (states[s].next >= 0) {
+                bounds.push_back(states[s].lo);
+                bounds.push_back(states[s].hi + 1);
+            }
+        }
+        std::sort(bounds.begin(), bounds.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+        for (size_t b = 0; b + 1 < bounds.size(); ++b) {
+            const int byte = bounds[b];
+            std::vector<int> targets;
+            for (int s : sets[d]) {
+                if (states[s].next >= 0 && states[s].lo <= byte && byte <= states[s].hi) {
+                    targets.push_back(states[s].next);
+                }
+            }
+            if (targets.empty()) {
+                continue;
+            }
+            std::vector<int> next = closure(nfa, std::move(targets), seen, ++mark);
+            auto it = ids.find(next);
+            if (it == ids.end()) {
+                if (sets.size() >= kMaxDfaStates) {
+                    throw std::invalid_argument("regex: pattern too complex");
+                }
+                it = ids.emplace(next, static_cast<int32_t>(sets.size())).first;
+                sets.push_back(std::move(next));
+            }
+            std::fill(transitions.begin() + d * 256 + bounds[b], transitions.begin() + d * 256 + bounds[b + 1],
+                      it->second);
+        }
+    }
+    
+    // Keep the states that can still reach a match
+    const size_t n = sets.size();
+    std::vector<std::vector<int32_t>> preds(n);
+    for (size_t d = 0; d < n; ++d) {
+        int32_t last = kDead;
+        for (int b = 0; b < 256; ++b) {
+            const int32_t t = transitions[d * 256 + b];
+            if (t != kDead && t != last) {
+                preds[t].push_back(static_cast<int32_t>(d));
+                last = t;
+            }
+        }
+    }
+    std::vector<uint8_t> live(n, 0);
+    std::vector<int32_t> stack;
+    for (size_t d = 0; d < n; ++d) {
+        if (std::binary_search(sets[d].begin(), sets[d].end(), nfa.accept())) {
+            live[d] = 1;
+            stack.push_back(static_cast<int32_t>(d));
+        }
+    }
+    while (!stack.empty()) {
+        const int32_t d = stack.back();
+        stack.pop_back();
+        for (int32_t p : preds[d]) {
+            if (!live[p]) {
+                live[p] = 1;
+                stack.push_back(p);
+            }
+        }
+    }
+    if (!live[0]) {
+        throw std::invalid_argument("regex: pattern matches nothing");
+    }
+    
+    std::vector<int32_t> remap(n, kDead);
+    int32_t next_id = 0;
+    for (size_t d = 0; d < n; ++d) {
+        if (live[d]) {
+            remap[d] = next_id++;
+        }
+    }
+    Dfa dfa;
+    dfa.transitions_.assign(static_cast<size_t>(next_id) * 256, kDead);
+    dfa.accepting_.assign(next_id, 0);
+    for (size_t d = 0; d < n; ++d) {
+        if (!live[d]) {
+            continue;
+        }
+        const size_t base = static_cast<size_t>(remap[d]) * 256;
+        for (int b = 0; b < 256; ++b) {
+            const int32_t t = transitions[d * 256 + b];
+            dfa.transitions_[base + b] = t == kDead ? kDead : remap[t];
+        }
+        dfa.accepting_[remap[d]] = std::binary_search(sets[d].begin(), sets[d].end(), nfa.accept());
+    }
+    return dfa;
+}
+
+std::string json_schema_to_regex(const std::string& schema) {
+    const Json root = parse_json(schema, "JSON schema");
+    return SchemaCompiler(root).value(root, 0);
+}
+
+TokenGrammar::TokenGrammar(const Tokenizer& tokenizer, Dfa dfa)
+    : dfa_(std::move(dfa)),
+      skip_first_space_(tokenizer.strips_leading_space()),
+      vocab_size_(tokenizer.vocab_size()),
+      eos_id_(tokenizer.eos_id()) {
+    start_ = skip_first_space_ ? static_cast<int32_t>(dfa_.size()) : dfa_.start();
+    build_trie(tokenizer);
+    cache_.reset(new std::atomic<const std::vector<Transition>*>[num_states()]);
+    for (size_t i = 0; i < num_states(); ++i) {
+        cache_[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+TokenGrammar::~TokenGrammar() {
+    for (size_t i = 0; i < num_states(); ++i) {
+        delete cache_[i].load(std::memory_order_relaxed);
+    }
+}
+
+void TokenGrammar::build_trie(const Tokenizer& tokenizer) {
+    // Sorted by bytes, every trie node covers a contiguous run of tokens
+    std::vector<int32_t> ids;
+    for (int id = 0; id < vocab_size_; ++id) {
+        if (!tokenizer.is_special(id) && !tokenizer.token_bytes(id).empty()) {
+            ids.push_back(id);
+        }
+    }
+    std::sort(ids.begin(), ids.end(), [&](int32_t a, int32_t b) {
+        const auto x = tokenizer.token_bytes(a);
+        const auto y = tokenizer.token_bytes(b);
+        return x != y ? x < y : a < b;
+    });
+    
+    struct Frame {
+        uint32_t node;
+        size_t begin;
+        size_t end;
+        size_t depth;
+    };
+    trie_.emplace_back();
+    std::vector<Frame> stack{{0, 0, ids.size(), 0}};
+    while (!stack.empty()) {
+        const Frame f = stack.back();
+        stack.pop_back();
+        size_t i = f.begin;
+        trie_[f.node].tokens_begin = static_cast<uint32_t>(trie_tokens_.size());
+        while (i < f.end && tokenizer.token_bytes(ids[i]).size() == f.depth) {
+            trie_tokens_.push_back(ids[i++]);
+        }
+        trie_[f.node].tokens_end = static_cast<uint32_t>(trie_tokens_.size());
+        trie_[f.node].children_begin = static_cast<uint32_t>(children_.size());
+        while (i < f.end) {
+            const uint8_t byte = tokenizer.token_bytes(ids[i])[f.depth];
+            size_t j = i;
+            while (j < f.end && static_cast<uint8_t>(tokenizer.token_bytes(ids[j])[f.depth]) == byte) {
+                ++j;
+            }
+            const uint32_t child = static_cast<uint32_t>(trie_.size());
+            trie_.emplace_back();
+            children_.push_back({byte, child});
+            stack.push_back({child, i, j, f.depth + 1});
+            i = j;
+        }
+        trie_[f.node].children_end = static_cast<uint32_t>(children_.size());
+    }
+}
+
+void TokenGrammar::walk(uint32_t node, int32_t state, std::vector<Transition>& out) const {
+    const TrieNode& n = trie_[node];
+    for (uint32_t i = n.tokens_begin; i < n.tokens_end; ++i) {
+        out.push_back({trie_tokens_[i], state});
+    }
+    for (uint32_t c = n.children_begin; c < n.children_end; ++c) {
+        const int32_t next = dfa_.next(state, children_[c].byte);
+        if (next != Dfa::kDead) {
+            walk(children_[c].node, next, out);
+        }
+    }
+}
+
+std::vector<TokenGrammar::Transition> TokenGrammar::compute(int32_t state) const {
+    std::vector<Transition> out;
+    const bool virtual_start = state == static_cast<int32_t>(dfa_.size());
+    walk(0, virtual_start ? dfa_.start() : state, out);
+    if (virtual_start && skip_first_space_) {
+        // The first token's leading space is dropped when decoding
+        for (uint32_t c = trie_[0].children_begin; c < trie_[0].children_end; ++c) {
+            if (children_[c].byte == ' ') {
+                walk(children_[c].node, dfa_.start(), out);
+            }
+        }
+    }
+    std::stable_sort(out.begin(), out.end(), [](const Transition& a, const Transition& b) { return a.token < b.token; });
+    out.erase(std::unique(out.begin(), out.end(), [](const Transition& a, const Transition& b) { return a.token == b.token; }),
+              out.end());
+    out.shrink_to_fit();
+    return out;
+}
+
+bool TokenGrammar::accepting(int32_t state) const {
+    return dfa_.accepting(state == static_cast<int32_t>(dfa_.size()) ? dfa_.start() : state);
+}
+
+const std::vector<TokenGrammar::Transition>& TokenGrammar::transitions(int32_t state) const {
+    const std::vector<Transition>* cached = cache_[state].load(std::memory_order_acquire);
+    if (cached) {
+        return *cached;
+    }
+    // Racing threads compute the same list; the first one in wins
+    auto computed = std::make_unique<const std::vector<Transition>>(compute(state));
+    const std::vector<Transition>* expected = nullptr;
+    if (cache_[state].compare_exchange_strong(expected, computed.get(), std::memory_order_acq_rel)) {
+        return *computed.release();
+    }
+    return *expected;
+}
+
+int32_t TokenGrammar::advance(int32_t state, int32_t token) const {
+    const auto& t = transitions(state);
+    auto it = std::lower_bound(t.begin(), t.end(), token, [](const Transition& a, int32_t id) { return a.token < id; });
+    return it != t.end() && it->token == token ? it->state : Dfa::kDead;
+}
+
+void TokenGrammar::banned(int32_t state, std::vector<int32_t>& out) const {
+    const auto& t = transitions(state);
+    const bool eos_ok = accepting(state);
+    out.clear();
+    out.reserve(vocab_size_ - t.size());
+    size_t k = 0;
+    for (int32_t id = 0; id < vocab_size_; ++id) {
+        if (k < t.size() && t[k].token == id) {
+            ++k;
+        } else if (!(eos_ok && id == eos_id_)) {
+            out.push_back(id);
+        }
+    }
+}
+
+std::shared_ptr<const TokenGrammar> GrammarCache::get(const Tokenizer& tokenizer, TurboMindGrammarKind kind,
+                                                      std::string_view source) {
+    std::string key(1, static_cast<char>(kind));
+    key.append(source);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = grammars_.find(key);
+        if (it != grammars_.end()) {
+            return it->second;
+        }
+    }
+    
+    // Compiled outside the lock; a racing compile of the same source loses
+    std::string regex;
+    switch (kind) {
+        case TM_GRAMMAR_REGEX: regex.assign(source); break;
+        case TM_GRAMMAR_JSON_SCHEMA: regex = json_schema_to_regex(std::string(source)); break;
+        default: throw std::invalid_argument("unknown grammar kind " + std::to_string(kind));
+    }
+    auto grammar = std::make_shared<const TokenGrammar>(tokenizer, Dfa::from_regex(regex));
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (grammars_.size() >= kCapacity && !grammars_.count(key)) {
+        grammars_.erase(grammars_.begin());
+    }
+    return grammars_.emplace(std::move(key), std::move(grammar)).first->second;
+}
+
+} // namespace turbomind_go
@@ -0,0 +1,142 @@
+#ifndef TURBOMIND_GRAMMAR_H
+#define TURBOMIND_GRAMMAR_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "turbomind_tokenizer.h"
+
+namespace turbomind_go {
+
+// Deterministic automaton over UTF-8 bytes that accepts the full matches of a
+// regular expression. Supported syntax: literals, ".", classes ("[a-z]",
+// "[^...]"), ASCII \d \w \s and their negations, \n \t \r \f \v \xHH \uHHHH, groups
+// ("(...)", "(?:...)"), "|", "*", "+", "?" and "{m}", "{m,}", "{m,n}" (lazy
+// suffixes are accepted and ignored). "^" and "$" are allowed at the ends only;
+// backreferences and lookaround cannot be expressed. States from which no match
+// is reachable are pruned, so every live state can still complete.
+class Dfa {
+public:
+    static constexpr int32_t kDead = -1;
+    
+    // Throws std::invalid_argument on bad syntax, unsupported constructs or a
+    // pattern that is too large or matches nothing
+    static Dfa from_regex(std::string_view pattern);
+    
+    int32_t start() const {
+        return 0;
+    }
+    int32_t next(int32_t state, uint8_t byte) const {
+        return transitions_[static_cast<size_t>(state) * 256 + byte];
+    }
+    bool accepting(int32_t state) const {
+        return accepting_[state] != 0;
+    }
+    size_t size() const {
+        return accepting_.size();
+    }
+
+private:
+    std::vector<int32_t> transitions_; // [state * 256 + byte]
+    std::vector<uint8_t> accepting_;
+};
+
+// Regular expression for the JSON texts a JSON schema accepts. Covers type
+// (string, integer, number, boolean, null, array, object, or a list of them),
+// properties/required, items/minItems/maxItems, minLength/maxLength/pattern,
+// enum, const, anyOf/oneOf, a single-element allOf, local $refs and the
+// date-time/date/time/uuid formats. Objects without properties and {} accept
+// any JSON value nested up to a few levels. At most one space is allowed
+// between tokens. Throws std::invalid_argument for malformed or unsupported
+// schemas, including recursive ones.
+std::string json_schema_to_regex(const std::string& schema);
+
+// Token-level view of a Dfa for one tokenizer. For each state, the tokens whose
+// bytes keep the match alive, with the state each leads to, are found once, by
+// a walk of the vocabulary trie pruned at dead states, and then cached for the
+// grammar's lifetime; lookups take no lock. Special tokens are never allowed:
+// EOS is the caller's to add in accepting states. Thread-safe.
+class TokenGrammar {
+public:
+    TokenGrammar(const Tokenizer& tokenizer, Dfa dfa);
+    ~TokenGrammar();
+    
+    struct Transition {
+        int32_t token;
+        int32_t state;
+    };
+    
+    // Where decoding starts. A tokenizer that drops the space it prepends to the
+    // first word also accepts that space on the first token.
+    int32_t start() const {
+        return start_;
+    }
+    bool accepting(int32_t state) const;
+    // Allowed tokens of a state, sorted by id
+    const std::vector<Transition>& transitions(int32_t state) const;
+    // State after `token`, Dfa::kDead when the grammar does not allow it there
+    int32_t advance(int32_t state, int32_t token) const;
+    // Every token not allowed in the state, EOS included unless the state accepts:
+    // the bad_ids of the next decode step
+    void banned(int32_t state, std::vector<int32_t>& out) const;
+    
+    size_t num_states() const {
+        return dfa_.size() + 1;
+    }
+    int vocab_size() const {
+        return vocab_size_;
+    }
+
+private:
+    struct TrieNode {
+        uint32_t children_begin = 0;
+        uint32_t children_end = 0;
+        uint32_t tokens_begin = 0; // tokens whose bytes end here
+        uint32_t tokens_end = 0;
+    };
+    struct TrieChild {
+        uint8_t byte;
+        uint32_t node;
+    };
+    
+    void build_trie(const Tokenizer& tokenizer);
+    std::vector<Transition> compute(int32_t state) const;
+    void walk(uint32_t node, int32_t state, std::vector<Transition>& out) const;
+    
+    Dfa dfa_;
+    int32_t start_;
+    bool skip_first_space_;
+    int vocab_size_;
+    int eos_id_;
+    std::vector<TrieNode> trie_;
+    std::vector<TrieChild> children_;
+    std::vector<int32_t> trie_tokens_;
+    // Computed on first use; state dfa_.size() is the virtual start state
+    mutable std::unique_ptr<std::atomic<const std::vector<Transition>*>[]> cache_;
+};
+
+// Compiled grammars of one tokenizer, keyed by kind and source. Keeps at most
+// kCapacity; past that an arbitrary one is dropped, staying alive while handles
+// still hold it. Thread-safe.
+class GrammarCache {
+public:
+    static constexpr size_t kCapacity = 64;
+    
+    // Throws std::invalid_argument when the source does not compile
+    std::shared_ptr<const TokenGrammar> get(const Tokenizer& tokenizer, TurboMindGrammarKind kind,
+                                            std::string_view source);
+
+private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const TokenGrammar>> grammars_;
+};
+
+} // namespace turbomind_go
+
+#endif // TURBOMIND_GRAMMAR_H
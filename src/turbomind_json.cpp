@@ -0,0 +1,240 @@
+#include "turbomind_json.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace turbomind_go {
+
+namespace {
+
+class JsonParser {
+public:
+    JsonParser(const std::string& text, const std::string& path)
+        : begin_(text.data()), p_(text.data()), end_(text.data() + text.size()), path_(path) {}
+    
+    Json parse() {
+        Json value = parse_value(0);
+        skip_ws();
+        if (p_ != end_) {
+            fail("trailing characters");
+        }
+        return value;
+    }
+
+private:
+    [[noreturn]] void fail(const char* what) const {
+        throw std::invalid_argument(path_ + ": " + what + " at offset " + std::to_string(p_ - begin_));
+    }
+    
+    void skip_ws() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+            ++p_;
+        }
+    }
+    
+    bool consume(const char* literal) {
+        const size_t n = std::strlen(literal);
+        if (static_cast<size_t>(end_ - p_) < n || std::memcmp(p_, literal, n) != 0) {
+            return false;
+        }
+        p_ += n;
+        return true;
+    }
+    
+    Json parse_value(int depth) {
+        if (depth > 128) {
+            fail("nesting too deep");
+        }
+        skip_ws();
+        if (p_ == end_) {
+            fail("unexpected end of input");
+        }
+        Json value;
+        switch (*p_) {
+            case '{':
+                value.type = Json::Type::kObject;
+                ++p_;
+                skip_ws();
+                if (p_ < end_ && *p_ == '}') {
+                    ++p_;
+                    return value;
+                }
+                while (true) {
+                    skip_ws();
+                    if (p_ == end_ || *p_ != '"') {
+                        fail("expected object key");
+                    }
+                    value.keys.push_back(parse_string());
+                    skip_ws();
+                    if (p_ == end_ || *p_++ != ':') {
+                        fail("expected ':'");
+                    }
+                    value.items.push_back(parse_value(depth + 1));
+                    skip_ws();
+                    if (p_ < end_ && *p_ == ',') {
+                        ++p_;
+                        continue;
+                    }
+                    if (p_ < end_ && *p_ == '}') {
+                        ++p_;
+                        return value;
+                    }
+                    fail("expected ',' or '}'");
+                }
+            case '[':
+                value.type = Json::Type::kArray;
+                ++p_;
+                skip_ws();
+                if (p_ < end_ && *p_ == ']') {
+                    ++p_;
+                    return value;
+                }
+                while (true) {
+                    value.items.push_back(parse_value(depth + 1));
+                    skip_ws();
+                    if (p_ < end_ && *p_ == ',') {
+                        ++p_;
+                        continue;
+                    }
+                    if (p_ < end_ && *p_ == ']') {
+                        ++p_;
+                        return value;
+                    }
+                    fail("expected ',' or ']'");
+                }
+            case '"':
+                value.type = Json::Type::kString;
+                value.string = parse_string();
+                return value;
+            case 't':
+            case 'f':
+                value.type = Json::Type::kBool;
+                value.boolean = *p_ == 't';
+                if (!consume(value.boolean ? "true" : "false")) {
+                    fail("invalid literal");
+                }
+                return value;
+            case 'n':
+                if (!consume("null")) {
+                    fail("invalid literal");
+                }
+                return value;
+            default: {
+                const char* start = p_;
+                while (p_ < end_ && ((*p_ >= '0' && *p_ <= '9') || *p_ == '-' || *p_ == '+' || *p_ == '.' || *p_ == 'e' || *p_ == 'E')) {
+                    ++p_;
+                }
+                if (p_ == start) {
+                    fail("unexpected character");
+                }
+                value.type = Json::Type::kNumber;
+                value.number = std::strtod(std::string(start, p_).c_str(), nullptr);
+                return value;
+            }
+        }
+    }
+    
+    uint32_t parse_hex4() {
+        if (end_ - p_ < 4) {
+            fail("truncated \\u escape");
+        }
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char c = *p_++;
+            v <<= 4;
+            if (c >= '0' && c <= '9') {
+                v |= c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                v |= c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                v |= c - 'A' + 10;
+            } else {
+                fail("invalid \\u escape");
+            }
+        }
+        return v;
+    }
+    
+    std::string parse_string() {
+        ++p_; // opening quote
+        std::string out;
+        while (true) {
+            const char* run = p_;
+            while (p_ < end_ && *p_ != '"' && *p_ != '\\') {
+                ++p_;
+            }
+            out.append(run, p_);
+            if (p_ == end_) {
+                fail("unterminated string");
+            }
+            if (*p_++ == '"') {
+                return out;
+            }
+            if (p_ == end_) {
+                fail("unterminated string");
+            }
+            const char c = *p_++;
+            switch (c) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t cp = parse_hex4();
+                    if (cp >= 0xd800 && cp < 0xdc00) {
+                        // High surrogate; a lone one becomes U+FFFD
+                        if (end_ - p_ >= 6 && p_[0] == '\\' && p_[1] == 'u') {
+                            p_ += 2;
+                            const uint32_t low = parse_hex4();
+                            cp = low >= 0xdc00 && low < 0xe000 ? 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00) : 0xfffd;
+                        } else {
+                            cp = 0xfffd;
+                        }
+                    } else if (cp >= 0xdc00 && cp < 0xe000) {
+                        cp = 0xfffd;
+                    }
+                    append_utf8(out, cp);
+                    break;
+                }
+                default:
+                    fail("invalid escape");
+            }
+        }
+    }
+    
+    const char* begin_;
+    const char* p_;
+    const char* end_;
+    const std::string& path_;
+};
+
+} // namespace
+
+void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xc0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xe0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    }
+}
+
+Json parse_json(const std::string& text, const std::string& source) {
+    return JsonParser(text, source).parse();
+}
+
+} // namespace turbomind_go
@@ -0,0 +1,44 @@
+#ifndef TURBOMIND_JSON_H
+#define TURBOMIND_JSON_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace turbomind_go {
+
+// Minimal JSON DOM, enough for tokenizer.json, tokenizer_config.json and JSON schemas
+struct Json {
+    enum class Type { kNull, kBool, kNumber, kString, kArray, kObject };
+    
+    Type type = Type::kNull;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<std::string> keys; // objects only
+    std::vector<Json> items;       // array items or object values
+    
+    const Json* get(std::string_view key) const {
+        if (type != Type::kObject) {
+            return nullptr;
+        }
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] == key) {
+                return &items[i];
+            }
+        }
+        return nullptr;
+    }
+};
+
+
+// Parses a complete JSON document. Throws std::invalid_argument naming `source`
+// and the offset on malformed input.
+Json parse_json(const std::string& text, const std::string& source);
+
+void append_utf8(std::string& out, uint32_t cp);
+
+} // namespace turbomind_go
+
+#endif // TURBOMIND_JSON_H
@@ -0,0 +1,117 @@
+#include "turbomind_log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace turbomind_go {
+
+namespace {
+
+const char* level_name(TurboMindLogLevel level) {
+    switch (level) {
+        case TM_LOG_DEBUG: return "DEBUG";
+        case TM_LOG_INFO: return "INFO";
+        case TM_LOG_WARNING: return "WARNING";
+        default: return "ERROR";
+    }
+}
+
+} // namespace
+
+LogSink& LogSink::instance() {
+    // Intentionally leaked: requests may log while static destructors run
+    static LogSink* sink = new LogSink();
+    return *sink;
+}
+
+void LogSink::enable(TurboMindLogCallback callback, void* user_data, TurboMindLogLevel min_level, int max_per_second) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callback_ = callback;
+    user_data_ = user_data;
+    max_per_second_.store(max_per_second, std::memory_order_relaxed);
+    if (!writer_.joinable()) {
+        stopping_ = false;
+        writer_ = std::thread([this] { write_loop(); });
+    }
+    min_level_.store(min_level, std::memory_order_relaxed);
+}
+
+void LogSink::disable() {
+    min_level_.store(kDisabled, std::memory_order_relaxed);
+    std::thread writer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        writer.swap(writer_);
+    }
+    cv_.notify_all();
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+bool LogSink::admit() {
+    const int limit = max_per_second_.load(std::memory_order_relaxed);
+    if (limit <= 0) {
+        return true;
+    }
+    const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+                            std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t window = window_.load(std::memory_order_relaxed);
+    if (window != now && window_.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+        window_count_.store(0, std::memory_order_relaxed);
+    }
+    return window_count_.fetch_add(1, std::memory_order_relaxed) < limit;
+}
+
+void LogSink::log(TurboMindLogLevel level, std::string message) {
+    if (!admit()) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.size() >= kMaxQueued || !writer_.joinable()) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        queue_.push_back({level, std::move(message)});
+    }
+    cv_.notify_one();
+}
+
+void LogSink::write_loop() {
+    std::vector<Message> batch;
+    while (true) {
+        TurboMindLogCallback callback;
+        void* user_data;
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+            batch.assign(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.end()));
+            queue_.clear();
+            callback = callback_;
+            user_data = user_data_;
+            stop = stopping_;
+        }
+        
+        if (const uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed)) {
+            batch.push_back({TM_LOG_WARNING, std::to_string(dropped) + " log messages dropped"});
+        }
+        for (const auto& message : batch) {
+            if (callback) {
+                callback(user_data, message.level, message.text.c_str());
+            } else {
+                std::fprintf(stderr, "TurboMind %s: %s\n", level_name(message.level), message.text.c_str());
+            }
+        }
+        batch.clear();
+        if (stop) {
+            return;
+        }
+    }
+}
+
+} // namespace turbomind_go
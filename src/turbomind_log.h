@@ -0,0 +1,72 @@
+#ifndef TURBOMIND_LOG_H
+#define TURBOMIND_LOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "turbomind_wrapper.hpp"
+
+namespace turbomind_go {
+
+// Opt-in asynchronous log sink. Producers only enqueue; a background thread
+// delivers messages to the callback (or stderr), so logging never blocks a
+// request path on I/O. Messages beyond max_per_second, or arriving while the
+// queue is full, are dropped and reported as a count.
+class LogSink {
+public:
+    static LogSink& instance();
+    
+    // callback == nullptr writes to stderr; max_per_second <= 0 disables the rate limit
+    void enable(TurboMindLogCallback callback, void* user_data, TurboMindLogLevel min_level, int max_per_second);
+    // Delivers what is queued, then stops the writer thread
+    void disable();
+    
+    // One relaxed load when the level is filtered out or the sink is off
+    bool enabled(TurboMindLogLevel level) const {
+        return level >= min_level_.load(std::memory_order_relaxed);
+    }
+    void log(TurboMindLogLevel level, std::string message);
+
+private:
+    static constexpr size_t kMaxQueued = 1024;
+    static constexpr int kDisabled = 1 << 30; // above every level
+    
+    struct Message {
+        TurboMindLogLevel level;
+        std::string text;
+    };
+    
+    LogSink() = default;
+    bool admit();
+    void write_loop();
+    
+    std::atomic<int> min_level_{kDisabled};
+    std::atomic<int> max_per_second_{0};
+    std::atomic<int64_t> window_{0}; // current one-second window
+    std::atomic<int> window_count_{0};
+    std::atomic<uint64_t> dropped_{0};
+    
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Message> queue_;
+    bool stopping_ = false;
+    std::thread writer_;
+    TurboMindLogCallback callback_ = nullptr;
+    void* user_data_ = nullptr;
+};
+
+inline void log_message(TurboMindLogLevel level, std::string message) {
+    auto& sink = LogSink::instance();
+    if (sink.enabled(level)) {
+        sink.log(level, std::move(message));
+    }
+}
+
+} // namespace turbomind_go
+
+#endif // TURBOMIND_LOG_H
@@ -0,0 +1,38 @@
+#include "turbomind_metrics.h"
+
+namespace turbomind_go {
+
+void LatencyHistogram::record(int64_t ns) {
+    const uint64_t us = ns > 0 ? static_cast<uint64_t>(ns) / 1000 : 0;
+    // Bucket i holds [2^i, 2^(i+1)) us; sub-microsecond samples land in bucket 0
+    int bucket = us > 1 ? 63 - __builtin_clzll(us) : 0;
+    if (bucket >= TURBOMIND_HISTOGRAM_BUCKETS) {
+        bucket = TURBOMIND_HISTOGRAM_BUCKETS - 1;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(us, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::snapshot(TurboMindHistogram* out) const {
+    out->count = count_.load(std::memory_order_relaxed);
+    out->sum_us = sum_us_.load(std::memory_order_relaxed);
+    for (int i = 0; i < TURBOMIND_HISTOGRAM_BUCKETS; ++i) {
+        out->buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    sum_us_.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+}
+
+LatencyHistogram& latency_histogram(TurboMindHistogramKind kind) {
+    static LatencyHistogram histograms[TM_HISTOGRAM_KIND_COUNT];
+    return histograms[kind];
+}
+
+} // namespace turbomind_go
@@ -0,0 +1,59 @@
+#ifndef TURBOMIND_METRICS_H
+#define TURBOMIND_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "turbomind_wrapper.hpp"
+
+namespace turbomind_go {
+
+// Monotonic clock shared by every timestamp the wrapper reports
+inline int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Latency histogram with power-of-two microsecond buckets. Recording is a few
+// relaxed atomic adds; a snapshot reads each counter independently, so it may
+// mix samples recorded while it runs but never blocks a recorder.
+class LatencyHistogram {
+public:
+    void record(int64_t ns);
+    void snapshot(TurboMindHistogram* out) const;
+    void reset();
+
+private:
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_us_{0};
+    std::atomic<uint64_t> buckets_[TURBOMIND_HISTOGRAM_BUCKETS] = {};
+};
+
+// Live request gauges and counters of one model. The request path only does
+// relaxed atomic adds; turbomind_get_metrics reads them.
+struct EngineCounters {
+    std::atomic<int64_t> active_requests{0};   // started, not finished
+    std::atomic<int64_t> decoding_requests{0}; // active and past their first token
+    std::atomic<int64_t> queued_requests{0};   // waiting in an instance pool
+    std::atomic<uint64_t> completed_requests{0};
+    std::atomic<uint64_t> failed_requests{0};
+    std::atomic<uint64_t> cancelled_requests{0};
+    std::atomic<uint64_t> prompt_tokens{0};
+    std::atomic<uint64_t> generated_tokens{0};
+    std::atomic<uint64_t> draft_tokens_proposed{0};
+    std::atomic<uint64_t> draft_tokens_accepted{0};
+    std::atomic<uint64_t> deadline_misses{0};    // dropped from a pool queue at their deadline
+    std::atomic<uint64_t> preempted_sessions{0}; // suspended by a pool's scheduler
+    
+    // Previous turbomind_get_metrics sample, for the token rate
+    std::atomic<int64_t> rate_sample_ns{0};
+    std::atomic<uint64_t> rate_sample_tokens{0};
+};
+
+// Process-wide request latency histograms, indexed by TurboMindHistogramKind
+LatencyHistogram& latency_histogram(TurboMindHistogramKind kind);
+
+} // namespace turbomind_go
+
+#endif // TURBOMIND_METRICS_H
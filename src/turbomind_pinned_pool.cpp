@@ -0,0 +1,129 @@
+#include "turbomind_pinned_pool.h"
+
+#include <stdexcept>
+#include <string>
+
+#include "src/turbomind/utils/cuda_utils.h"
+
+namespace turbomind_go {
+
+namespace {
+
+// Prefix in front of every buffer; sized so the user pointer stays 64-byte aligned
+struct alignas(64) BlockHeader {
+    uint64_t magic;
+    int32_t size_class;
+    uint64_t block_bytes;
+};
+
+constexpr uint64_t kBlockMagic = 0x746d70696e6e6564ull; // "tmpinned"
+
+BlockHeader* header_of(void* ptr) {
+    auto header = reinterpret_cast<BlockHeader*>(static_cast<char*>(ptr) - sizeof(BlockHeader));
+    if (header->magic != kBlockMagic) {
+        throw std::runtime_error("pointer was not allocated from the pinned pool");
+    }
+    return header;
+}
+
+} // namespace
+
+PinnedPool& PinnedPool::instance() {
+    // Intentionally leaked: buffers may be released from threads that outlive static destruction
+    static PinnedPool* pool = new PinnedPool();
+    return *pool;
+}
+
+void* PinnedPool::allocate(size_t bytes) {
+    const size_t needed = bytes + sizeof(BlockHeader);
+    int size_class = kMinClass;
+    while (size_class <= kMaxClass && (size_t(1) << size_class) < needed) {
+        ++size_class;
+    }
+    const bool cached = size_class <= kMaxClass;
+    const size_t block_bytes = cached ? size_t(1) << size_class : needed;
+    
+    void* block = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cached) {
+            auto& list = free_[size_class - kMinClass];
+            if (!list.empty()) {
+                block = list.back();
+                list.pop_back();
+                cached_bytes_ -= block_bytes;
+            }
+        }
+        in_use_bytes_ += block_bytes;
+    }
+    
+    if (!block) {
+        const cudaError_t err = cudaHostAlloc(&block, block_bytes, cudaHostAllocPortable);
+        if (err != cudaSuccess) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            in_use_bytes_ -= block_bytes;
+            throw std::runtime_error("cudaHostAlloc of " + std::to_string(block_bytes) +
+                                     " bytes failed: " + cudaGetErrorString(err));
+        }
+        auto header = static_cast<BlockHeader*>(block);
+        header->magic = kBlockMagic;
+        header->size_class = cached ? size_class : kUncached;
+        header->block_bytes = block_bytes;
+    }
+    return static_cast<char*>(block) + sizeof(BlockHeader);
+}
+
+void PinnedPool::release(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    BlockHeader* header = header_of(ptr);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_use_bytes_ -= header->block_bytes;
+        if (header->size_class != kUncached && cached_bytes_ + header->block_bytes <= cache_limit_) {
+            free_[header->size_class - kMinClass].push_back(header);
+            cached_bytes_ += header->block_bytes;
+            return;
+        }
+    }
+    cudaFreeHost(header);
+}
+
+void PinnedPool::trim() {
+    std::vector<void*> blocks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& list : free_) {
+            blocks.insert(blocks.end(), list.begin(), list.end());
+            list.clear();
+        }
+        cached_bytes_ = 0;
+    }
+    for (void* block : blocks) {
+        cudaFreeHost(block);
+    }
+}
+
+void PinnedPool::set_cache_limit(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache_limit_ = bytes;
+        if (cached_bytes_ <= cache_limit_) {
+            return;
+        }
+    }
+    trim();
+}
+
+size_t PinnedPool::cached_bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cached_bytes_;
+}
+
+size_t PinnedPool::in_use_bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_use_bytes_;
+}
+
+} // namespace turbomind_go
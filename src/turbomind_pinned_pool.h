@@ -0,0 +1,46 @@
+#ifndef TURBOMIND_PINNED_POOL_H
+#define TURBOMIND_PINNED_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace turbomind_go {
+
+// Process-wide cache of page-locked host buffers in power-of-two size classes.
+// Released buffers are kept for reuse up to a byte limit, so steady-state
+// requests never call cudaHostAlloc/cudaFreeHost. Buffers are portable
+// (usable from every device) and 64-byte aligned.
+class PinnedPool {
+public:
+    static PinnedPool& instance();
+    
+    // Throws std::runtime_error when cudaHostAlloc fails
+    void* allocate(size_t bytes);
+    // Accepts only pointers returned by allocate(); nullptr is a no-op
+    void release(void* ptr);
+    // Frees every cached buffer
+    void trim();
+    void set_cache_limit(size_t bytes);
+    
+    size_t cached_bytes();
+    size_t in_use_bytes();
+
+private:
+    static constexpr int kMinClass = 12;  // 4 KiB
+    static constexpr int kMaxClass = 30;  // 1 GiB, larger blocks are not cached
+    static constexpr int kUncached = -1;
+    
+    PinnedPool() = default;
+    
+    std::mutex mutex_;
+    std::vector<void*> free_[kMaxClass - kMinClass + 1];
+    size_t cached_bytes_ = 0;
+    size_t in_use_bytes_ = 0;
+    size_t cache_limit_ = size_t(1) << 30;
+};
+
+} // namespace turbomind_go
+
+#endif // TURBOMIND_PINNED_POOL_H
@@ -0,0 +1,147 @@
+#include "turbomind_pooling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace turbomind_go {
+
+float half_to_float(uint16_t h) {
+    const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13); // inf or nan
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        // Subnormal: shift the leading one into the implicit bit
+        exponent = 113;
+        while ((mantissa & 0x400) == 0) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+uint16_t float_to_half(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    const uint32_t abs = bits & 0x7fffffff;
+    if (abs >= 0x7f800000) {
+        return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0); // inf or quiet nan
+    }
+    if (abs >= 0x477ff000) {
+        return sign | 0x7c00; // rounds past the largest half
+    }
+    if (abs < 0x38800000) {
+        // Subnormal or zero: align to 2^-24 units, then round to nearest even
+        if (abs < 0x33000000) {
+            return sign;
+        }
+        const uint32_t shift = 126 - (abs >> 23);
+        const uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+        uint32_t value = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t half = 1u << (shift - 1);
+        if (rest > half || (rest == half && (value & 1))) {
+            ++value;
+        }
+        return sign | static_cast<uint16_t>(value);
+    }
+    uint32_t value = ((abs >> 23) - 112) << 10 | ((abs >> 13) & 0x3ff);
+    const uint32_t rest = abs & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (value & 1))) {
+        ++value; // may carry into the exponent, which is still correct
+    }
+    return sign | static_cast<uint16_t>(value);
+}
+
+float bf16_to_float(uint16_t b) {
+    const uint32_t bits = static_cast<uint32_t>(b) << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+namespace {
+
+float load(const void* data, TurboMindDataType type, int64_t i) {
+    switch (type) {
+        case TM_TYPE_FP32: return static_cast<const float*>(data)[i];
+        case TM_TYPE_FP16: return half_to_float(static_cast<const uint16_t*>(data)[i]);
+        default: return bf16_to_float(static_cast<const uint16_t*>(data)[i]);
+    }
+}
+
+} // namespace
+
+void pool_hidden_states(const void* hidden, TurboMindDataType type, int64_t rows, int64_t dim,
+                        TurboMindPooling pooling, void* out, TurboMindDataType out_type) {
+    if (type != TM_TYPE_FP32 && type != TM_TYPE_FP16 && type != TM_TYPE_BF16) {
+        throw std::invalid_argument("hidden states must be fp16, bf16 or fp32");
+    }
+    if (out_type != TM_TYPE_FP32 && out_type != TM_TYPE_FP16) {
+        throw std::invalid_argument("pooled output must be fp16 or fp32");
+    }
+    if (pooling != TM_POOLING_LAST && pooling != TM_POOLING_MEAN) {
+        throw std::invalid_argument("unknown pooling mode");
+    }
+    if (rows <= 0 || dim <= 0) {
+        throw std::invalid_argument("no hidden states to pool");
+    }
+    
+    std::vector<float> acc(dim, 0.f);
+    if (pooling == TM_POOLING_LAST) {
+        const int64_t base = (rows - 1) * dim;
+        for (int64_t j = 0; j < dim; ++j) {
+            acc[j] = load(hidden, type, base + j);
+        }
+    } else {
+        // Row by row, so the reads stay sequential
+        for (int64_t r = 0; r < rows; ++r) {
+            const int64_t base = r * dim;
+            for (int64_t j = 0; j < dim; ++j) {
+                acc[j] += load(hidden, type, base + j);
+            }
+        }
+        const float scale = 1.f / static_cast<float>(rows);
+        for (float& v : acc) {
+            v *= scale;
+        }
+    }
+    
+    if (out_type == TM_TYPE_FP32) {
+        std::memcpy(out, acc.data(), dim * sizeof(float));
+    } else {
+        auto* dst = static_cast<uint16_t*>(out);
+        for (int64_t j = 0; j < dim; ++j) {
+            dst[j] = float_to_half(acc[j]);
+        }
+    }
+}
+
+float token_logprob(const float* logits, int64_t vocab, int32_t token) {
+    if (token < 0 || token >= vocab) {
+        throw std::out_of_range("token " + std::to_string(token) + " is outside the vocabulary");
+    }
+    const float max = *std::max_element(logits, logits + vocab);
+    double sum = 0;
+    for (int64_t j = 0; j < vocab; ++j) {
+        sum += std::exp(logits[j] - max);
+    }
+    return logits[token] - max - static_cast<float>(std::log(sum));
+}
+
+} // namespace turbomind_go
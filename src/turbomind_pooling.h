@@ -0,0 +1,28 @@
+#ifndef TURBOMIND_POOLING_H
+#define TURBOMIND_POOLING_H
+
+#include <cstdint>
+
+#include "turbomind_wrapper.hpp"
+
+namespace turbomind_go {
+
+// IEEE half and bfloat16 conversions, rounding to nearest even
+float half_to_float(uint16_t h);
+uint16_t float_to_half(float f);
+float bf16_to_float(uint16_t b);
+
+// Collapses `rows` hidden-state rows of width `dim` (row-major, fp16, bf16 or
+// fp32) into one vector: the last row, or the mean of all of them accumulated
+// in fp32. Writes dim fp16 or fp32 values to `out`. Throws std::invalid_argument
+// for other types or an empty input.
+void pool_hidden_states(const void* hidden, TurboMindDataType type, int64_t rows, int64_t dim,
+                        TurboMindPooling pooling, void* out, TurboMindDataType out_type);
+
+// Log-probability of `token` under one row of fp32 logits, a numerically
+// stable log-softmax evaluated at a single entry
+float token_logprob(const float* logits, int64_t vocab, int32_t token);
+
+} // namespace turbomind_go
+
+#endif // TURBOMIND_POOLING_H
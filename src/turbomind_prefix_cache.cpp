@@ -0,0 +1,143 @@
+#include "turbomind_prefix_cache.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace turbomind_go {
+
+namespace {
+
+constexpr uint64_t kFnvOffset = 0xcbf29ce484222325ull;
+constexpr uint64_t kFnvPrime = 0x100000001b3ull;
+
+} // namespace
+
+PrefixCache::PrefixCache(int block_len, size_t max_blocks) : block_len_(block_len), max_blocks_(max_blocks) {
+    if (block_len <= 0) {
+        throw std::runtime_error("prefix cache block length must be positive");
+    }
+}
+
+std::vector<uint64_t> PrefixCache::block_hashes(const int* tokens, int count) const {
+    std::vector<uint64_t> hashes;
+    if (!tokens || count <= 0) {
+        return hashes;
+    }
+    hashes.reserve(count / block_len_);
+    uint64_t hash = kFnvOffset;
+    for (int end = block_len_; end <= count; end += block_len_) {
+        // FNV-1a over the token bytes, continued from the previous block's hash
+        for (int i = end - block_len_; i < end; ++i) {
+            const uint32_t token = static_cast<uint32_t>(tokens[i]);
+            for (int b = 0; b < 4; ++b) {
+                hash = (hash ^ ((token >> (8 * b)) & 0xff)) * kFnvPrime;
+            }
+        }
+        hashes.push_back(hash);
+    }
+    return hashes;
+}
+
+int PrefixCache::match(const int* tokens, int count) {
+    const auto hashes = block_hashes(tokens, count - 1);
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t hits = 0;
+    for (; hits < hashes.size(); ++hits) {
+        auto it = blocks_.find(hashes[hits]);
+        if (it == blocks_.end()) {
+            break;
+        }
+        if (it->second.pins == 0) {
+            lru_.splice(lru_.begin(), lru_, it->second.lru);
+        }
+    }
+    const int hit_tokens = static_cast<int>(hits) * block_len_;
+    stats_.lookups++;
+    stats_.lookup_tokens += std::max(count, 0);
+    stats_.hit_tokens += hit_tokens;
+    return hit_tokens;
+}
+
+PrefixCache::Block& PrefixCache::touch(uint64_t hash) {
+    auto [it, inserted] = blocks_.try_emplace(hash);
+    Block& block = it->second;
+    if (inserted) {
+        lru_.push_front(hash);
+        block.lru = lru_.begin();
+    } else if (block.pins == 0) {
+        lru_.splice(lru_.begin(), lru_, block.lru);
+    }
+    return block;
+}
+
+void PrefixCache::evict_excess() {
+    while (blocks_.size() > max_blocks_ && !lru_.empty()) {
+        blocks_.erase(lru_.back());
+        lru_.pop_back();
+    }
+}
+
+void PrefixCache::insert(const int* tokens, int count) {
+    const auto hashes = block_hashes(tokens, count);
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint64_t hash : hashes) {
+        touch(hash);
+    }
+    evict_excess();
+}
+
+bool PrefixCache::pin(const std::string& name, const int* tokens, int count, uint64_t session_id) {
+    auto hashes = block_hashes(tokens, count);
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pinned_.count(name)) {
+        return false;
+    }
+    for (uint64_t hash : hashes) {
+        Block& block = touch(hash);
+        if (block.pins++ == 0) {
+            lru_.erase(block.lru);
+            stats_.pinned_blocks++;
+        }
+    }
+    pinned_.emplace(name, Pinned{std::move(hashes), session_id});
+    evict_excess();
+    return true;
+}
+
+bool PrefixCache::pinned(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pinned_.count(name) != 0;
+}
+
+bool PrefixCache::evict(const std::string& name, uint64_t* session_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pinned_.find(name);
+    if (it == pinned_.end()) {
+        return false;
+    }
+    for (uint64_t hash : it->second.blocks) {
+        auto block = blocks_.find(hash);
+        if (--block->second.pins == 0) {
+            // Still pinned by another name otherwise
+            blocks_.erase(block);
+            stats_.pinned_blocks--;
+        }
+    }
+    if (session_id) {
+        *session_id = it->second.session_id;
+    }
+    pinned_.erase(it);
+    return true;
+}
+
+PrefixCache::Stats PrefixCache::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.blocks = blocks_.size();
+    return stats;
+}
+
+} // namespace turbomind_go
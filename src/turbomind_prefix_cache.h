@@ -0,0 +1,76 @@
+#ifndef TURBOMIND_PREFIX_CACHE_H
+#define TURBOMIND_PREFIX_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace turbomind_go {
+
+// Index of the token prefixes whose KV blocks the engine holds. Prompts are cut
+// into blocks of block_len tokens and each block is keyed by a hash chained over
+// every token before it, so a block only matches behind the same full prefix.
+// Unpinned blocks are dropped least recently used first beyond max_blocks.
+class PrefixCache {
+public:
+    struct Stats {
+        size_t blocks = 0;
+        size_t pinned_blocks = 0;
+        uint64_t lookups = 0;
+        uint64_t lookup_tokens = 0;
+        uint64_t hit_tokens = 0;
+    };
+    
+    PrefixCache(int block_len, size_t max_blocks);
+    
+    int block_len() const { return block_len_; }
+    
+    // Length in tokens of the longest cached whole-block prefix of `tokens`. The
+    // last token is never counted: the engine always prefills at least one.
+    int match(const int* tokens, int count);
+    // Record every whole block of `tokens` as cached
+    void insert(const int* tokens, int count);
+    
+    // Record the blocks of `tokens` under `name` and exempt them from eviction.
+    // Returns false if `name` is already pinned.
+    bool pin(const std::string& name, const int* tokens, int count, uint64_t session_id);
+    // Whether `name` is pinned
+    bool pinned(const std::string& name);
+    // Drop the named prefix's blocks from the index; returns false if unknown
+    bool evict(const std::string& name, uint64_t* session_id);
+    
+    Stats stats();
+
+private:
+    struct Block {
+        int pins = 0;
+        std::list<uint64_t>::iterator lru; // valid while pins == 0
+    };
+    struct Pinned {
+        std::vector<uint64_t> blocks;
+        uint64_t session_id;
+    };
+    
+    // Chained hashes of the whole blocks in the first `count` tokens
+    std::vector<uint64_t> block_hashes(const int* tokens, int count) const;
+    // Insert or refresh one block (caller holds `mutex_`)
+    Block& touch(uint64_t hash);
+    void evict_excess();
+    
+    const int block_len_;
+    const size_t max_blocks_;
+    
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, Block> blocks_;
+    std::list<uint64_t> lru_; // unpinned blocks, most recently used first
+    std::unordered_map<std::string, Pinned> pinned_;
+    Stats stats_;
+};
+
+} // namespace turbomind_go
+
+#endif // TURBOMIND_PREFIX_CACHE_H
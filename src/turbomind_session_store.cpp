@@ -0,0 +1,150 @@
+#include "turbomind_session_store.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace turbomind_go {
+
+SessionStore::SessionStore(size_t host_limit_bytes, std::string spill_dir)
+    : host_limit_(host_limit_bytes), spill_dir_(std::move(spill_dir)) {}
+
+SessionStore::~SessionStore() {
+    for (auto& [id, entry] : entries_) {
+        remove_spill(id, entry);
+    }
+}
+
+std::string SessionStore::spill_path(uint64_t session_id) const {
+    return spill_dir_ + "/session-" + std::to_string(session_id) + ".tmhist";
+}
+
+void SessionStore::remove_spill(uint64_t session_id, Entry& entry) {
+    if (entry.spilled) {
+        std::remove(spill_path(session_id).c_str());
+        entry.spilled = false;
+    }
+}
+
+void SessionStore::record(uint64_t session_id, int step, const int* input, int input_len, const int* output,
+                          int output_len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(session_id);
+    if (step > 0 && (it == entries_.end() || static_cast<int>(it->second.tokens.size()) < step)) {
+        // History before `step` was never seen (or was dropped), it cannot be rebuilt
+        if (it != entries_.end()) {
+            remove_spill(session_id, it->second);
+            entries_.erase(it);
+        }
+        return;
+    }
+    
+    Entry& entry = it == entries_.end() ? entries_[session_id] : it->second;
+    entry.tokens.resize(std::max(step, 0));
+    entry.tokens.insert(entry.tokens.end(), input, input + std::max(input_len, 0));
+    entry.tokens.insert(entry.tokens.end(), output, output + std::max(output_len, 0));
+}
+
+void SessionStore::erase(uint64_t session_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(session_id);
+    if (it == entries_.end()) {
+        return;
+    }
+    if (it->second.suspended && !it->second.spilled) {
+        host_bytes_ -= it->second.tokens.size() * sizeof(int);
+    }
+    remove_spill(session_id, it->second);
+    entries_.erase(it);
+}
+
+bool SessionStore::suspend(uint64_t session_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(session_id);
+    if (it == entries_.end() || it->second.suspended) {
+        return false;
+    }
+    it->second.suspended = true;
+    it->second.suspend_order = next_order_++;
+    host_bytes_ += it->second.tokens.size() * sizeof(int);
+    spill_excess();
+    return true;
+}
+
+void SessionStore::spill_excess() {
+    if (spill_dir_.empty()) {
+        return;
+    }
+    while (host_bytes_ > host_limit_) {
+        // Oldest suspended session still in host memory
+        auto victim = entries_.end();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->second.suspended && !it->second.spilled &&
+                (victim == entries_.end() || it->second.suspend_order < victim->second.suspend_order)) {
+                victim = it;
+            }
+        }
+        if (victim == entries_.end()) {
+            return;
+        }
+        
+        Entry& entry = victim->second;
+        std::ofstream out(spill_path(victim->first), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(entry.tokens.data()), entry.tokens.size() * sizeof(int));
+        if (!out) {
+            // Keep the history in memory; a full disk must not lose sessions
+            std::remove(spill_path(victim->first).c_str());
+            return;
+        }
+        host_bytes_ -= entry.tokens.size() * sizeof(int);
+        entry.spilled = true;
+        entry.spilled_len = entry.tokens.size();
+        std::vector<int>().swap(entry.tokens);
+    }
+}
+
+bool SessionStore::resume(uint64_t session_id, std::vector<int>* tokens) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(session_id);
+    if (it == entries_.end() || !it->second.suspended) {
+        return false;
+    }
+    
+    Entry& entry = it->second;
+    if (entry.spilled) {
+        std::vector<int> restored(entry.spilled_len);
+        std::ifstream in(spill_path(session_id), std::ios::binary);
+        in.read(reinterpret_cast<char*>(restored.data()), restored.size() * sizeof(int));
+        if (!in) {
+            throw std::runtime_error("cannot read spilled history of session " + std::to_string(session_id));
+        }
+        entry.tokens = std::move(restored);
+        remove_spill(session_id, entry);
+    } else {
+        host_bytes_ -= entry.tokens.size() * sizeof(int);
+    }
+    entry.suspended = false;
+    *tokens = entry.tokens;
+    return true;
+}
+
+bool SessionStore::is_suspended(uint64_t session_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(session_id);
+    return it != entries_.end() && it->second.suspended;
+}
+
+SessionStore::Stats SessionStore::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.sessions = entries_.size();
+    for (const auto& [id, entry] : entries_) {
+        stats.suspended += entry.suspended;
+        stats.spilled += entry.spilled;
+    }
+    stats.host_bytes = host_bytes_;
+    return stats;
+}
+
+} // namespace turbomind_go
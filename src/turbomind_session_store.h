@@ -0,0 +1,69 @@
+#ifndef TURBOMIND_SESSION_STORE_H
+#define TURBOMIND_SESSION_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace turbomind_go {
+
+// Token histories of open sessions, kept so a session can leave the engine
+// (freeing its KV blocks) and later be rebuilt by prefilling the history.
+// Suspended histories stay in host memory up to a byte limit; beyond it the
+// longest-suspended ones are spilled to files under spill_dir.
+class SessionStore {
+public:
+    struct Stats {
+        size_t sessions = 0;
+        size_t suspended = 0;
+        size_t spilled = 0;
+        size_t host_bytes = 0; // held by suspended, unspilled sessions
+    };
+    
+    SessionStore(size_t host_limit_bytes, std::string spill_dir);
+    ~SessionStore();
+    
+    // Record a finished step: the history becomes history[:step] + input + output.
+    // A step past the known history drops the session, which can then no longer
+    // be suspended.
+    void record(uint64_t session_id, int step, const int* input, int input_len, const int* output, int output_len);
+    void erase(uint64_t session_id);
+    
+    // Returns false if the session is unknown or already suspended
+    bool suspend(uint64_t session_id);
+    // Returns the history of a suspended session (reading it back if spilled)
+    // and marks it active; false if it is not suspended
+    bool resume(uint64_t session_id, std::vector<int>* tokens);
+    bool is_suspended(uint64_t session_id);
+    
+    Stats stats();
+
+private:
+    struct Entry {
+        std::vector<int> tokens;
+        bool suspended = false;
+        bool spilled = false;
+        size_t spilled_len = 0;
+        uint64_t suspend_order = 0;
+    };
+    
+    std::string spill_path(uint64_t session_id) const;
+    // Spill suspended histories until the host limit holds (caller holds `mutex_`)
+    void spill_excess();
+    void remove_spill(uint64_t session_id, Entry& entry);
+    
+    const size_t host_limit_;
+    const std::string spill_dir_;
+    
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, Entry> entries_;
+    size_t host_bytes_ = 0;
+    uint64_t next_order_ = 0;
+};
+
+} // namespace turbomind_go
+
+#endif // TURBOMIND_SESSION_STORE_H
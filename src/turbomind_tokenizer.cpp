@@ -0,0 +1,1134 @@
+#include "turbomind_tokenizer.h"
+
+#include "turbomind_json.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <ios>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace turbomind_go {
+
+namespace {
+
+constexpr char kMeta[] = "\xe2\x96\x81"; // "▁"
+constexpr size_t kMetaLen = 3;
+constexpr size_t kMaxCachedWord = 64;
+constexpr size_t kMaxCachedWords = 1 << 16;
+
+std::string_view str(const Json* j) {
+    return j && j->type == Json::Type::kString ? std::string_view(j->string) : std::string_view();
+}
+
+bool flag(const Json* j, bool fallback) {
+    return j && j->type == Json::Type::kBool ? j->boolean : fallback;
+}
+
+bool read_file(const std::string& path, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    out = buffer.str();
+    return true;
+}
+
+// Calls f on each step of a normalizer/pre-tokenizer, flattening "Sequence"
+template<typename F>
+void for_each_step(const Json* node, const char* list_key, F&& f) {
+    if (!node || node->type != Json::Type::kObject) {
+        return;
+    }
+    if (str(node->get("type")) == "Sequence") {
+        if (const Json* steps = node->get(list_key)) {
+            for (const Json& step : steps->items) {
+                for_each_step(&step, list_key, f);
+            }
+        }
+        return;
+    }
+    f(*node);
+}
+
+// ---- character classes for pre-tokenization ----
+
+enum class CharClass : uint8_t { kLetter, kNumber, kSpace, kOther };
+
+struct ClassRange {
+    uint32_t first;
+    uint32_t last;
+    CharClass cls;
+};
+
+// Non-ASCII whitespace, digits/numerals, punctuation, symbols, marks and format
+// characters, sorted. Code points outside every range count as letters; that is
+// exact for the common scripts and close enough elsewhere.
+constexpr CharClass N = CharClass::kNumber;
+constexpr CharClass S = CharClass::kSpace;
+constexpr CharClass O = CharClass::kOther;
+constexpr ClassRange kClassRanges[] = {
+    {0x80, 0x84, O},       {0x85, 0x85, S},       {0x86, 0x9f, O},       {0xa0, 0xa0, S},
+    {0xa1, 0xa9, O},       {0xab, 0xb1, O},       {0xb2, 0xb3, N},       {0xb4, 0xb4, O},
+    {0xb6, 0xb8, O},       {0xb9, 0xb9, N},       {0xbb, 0xbb, O},       {0xbc, 0xbe, N},
+    {0xbf, 0xbf, O},       {0xd7, 0xd7, O},       {0xf7, 0xf7, O},       {0x2c2, 0x2c5, O},
+    {0x2d2, 0x2df, O},     {0x2e5, 0x2eb, O},     {0x2ed, 0x2ed, O},     {0x2ef, 0x36f, O},
+    {0x375, 0x375, O},     {0x37e, 0x37e, O},     {0x384, 0x385, O},     {0x387, 0x387, O},
+    {0x3f6, 0x3f6, O},     {0x482, 0x489, O},     {0x55a, 0x55f, O},     {0x589, 0x58a, O},
+    {0x58d, 0x58f, O},     {0x591, 0x5c7, O},     {0x5f3, 0x5f4, O},     {0x600, 0x61f, O},
+    {0x64b, 0x65f, O},     {0x660, 0x669, N},     {0x66a, 0x66d, O},     {0x670, 0x670, O},
+    {0x6d4, 0x6d4, O},     {0x6d6, 0x6ed, O},     {0x6f0, 0x6f9, N},     {0x6fd, 0x6fe, O},
+    {0x700, 0x70f, O},     {0x7c0, 0x7c9, N},     {0x900, 0x903, O},     {0x93a, 0x93c, O},
+    {0x93e, 0x94f, O},     {0x951, 0x957, O},     {0x962, 0x965, O},     {0x966, 0x96f, N},
+    {0x970, 0x970, O},     {0x981, 0x983, O},     {0x9bc, 0x9bc, O},     {0x9be, 0x9cd, O},
+    {0x9e6, 0x9ef, N},     {0xa66, 0xa6f, N},     {0xae6, 0xaef, N},     {0xb66, 0xb6f, N},
+    {0xbe6, 0xbf2, N},     {0xc66, 0xc6f, N},     {0xce6, 0xcef, N},     {0xd66, 0xd78, N},
+    {0xe31, 0xe31, O},     {0xe34, 0xe3f, O},     {0xe47, 0xe4f, O},     {0xe50, 0xe59, N},
+    {0xe5a, 0xe5b, O},     {0xeb1, 0xeb1, O},     {0xeb4, 0xebc, O},     {0xec8, 0xece, O},
+    {0xed0, 0xed9, N},     {0xf01, 0xf1f, O},     {0xf20, 0xf33, N},     {0xf34, 0xf3f, O},
+    {0x1040, 0x1049, N},   {0x10fb, 0x10fb, O},   {0x1360, 0x1368, O},   {0x1369, 0x137c, N},
+    {0x1680, 0x1680, S},   {0x16ee, 0x16f0, N},   {0x17e0, 0x17e9, N},   {0x1810, 0x1819, N},
+    {0x1ab0, 0x1aff, O},   {0x1dc0, 0x1dff, O},   {0x1fbd, 0x1fbd, O},   {0x1fbf, 0x1fc1, O},
+    {0x1fcd, 0x1fcf, O},   {0x1fdd, 0x1fdf, O},   {0x1fed, 0x1fef, O},   {0x1ffd, 0x1ffe, O},
+    {0x2000, 0x200a, S},   {0x200b, 0x2027, O},   {0x2028, 0x2029, S},   {0x202a, 0x202e, O},
+    {0x202f, 0x202f, S},   {0x2030, 0x205e, O},   {0x205f, 0x205f, S},   {0x2060, 0x206f, O},
+    {0x2070, 0x2070, N},   {0x2074, 0x2079, N},   {0x207a, 0x207e, O},   {0x2080, 0x2089, N},
+    {0x208a, 0x208e, O},   {0x20a0, 0x20ff, O},   {0x2100, 0x2101, O},   {0x2103, 0x2106, O},
+    {0x2108, 0x2109, O},   {0x2114, 0x2114, O},   {0x2116, 0x2118, O},   {0x211e, 0x2123, O},
+    {0x2125, 0x2125, O},   {0x2127, 0x2127, O},   {0x2129, 0x2129, O},   {0x212e, 0x212e, O},
+    {0x213a, 0x213b, O},   {0x2140, 0x2144, O},   {0x214a, 0x214d, O},   {0x214f, 0x214f, O},
+    {0x2150, 0x2182, N},   {0x2185, 0x2189, N},   {0x218a, 0x245f, O},   {0x2460, 0x249b, N},
+    {0x249c, 0x24e9, O},   {0x24ea, 0x24ff, N},   {0x2500, 0x2775, O},   {0x2776, 0x2793, N},
+    {0x2794, 0x2bff, O},   {0x2ce5, 0x2cea, O},   {0x2cf9, 0x2cff, O},   {0x2e00, 0x2fff, O},
+    {0x3000, 0x3000, S},   {0x3001, 0x3004, O},   {0x3007, 0x3007, N},   {0x3008, 0x3020, O},
+    {0x3021, 0x3029, N},   {0x302a, 0x3030, O},   {0x3036, 0x3037, O},   {0x3038, 0x303a, N},
+    {0x303d, 0x303f, O},   {0x3099, 0x309c, O},   {0x30a0, 0x30a0, O},   {0x30fb, 0x30fb, O},
+    {0x3190, 0x3191, O},   {0x3192, 0x3195, N},   {0x3196, 0x319f, O},   {0x31c0, 0x31e3, O},
+    {0x3200, 0x321e, O},   {0x3220, 0x3229, N},   {0x322a, 0x3247, O},   {0x3248, 0x324f, N},
+    {0x3250, 0x3250, O},   {0x3251, 0x325f, N},   {0x3260, 0x327f, O},   {0x3280, 0x3289, N},
+    {0x328a, 0x32b0, O},   {0x32b1, 0x32bf, N},   {0x32c0, 0x33ff, O},   {0x4dc0, 0x4dff, O},
+    {0xa490, 0xa4c6, O},   {0xa620, 0xa629, N},   {0xe000, 0xf8ff, O},   {0xfb29, 0xfb29, O},
+    {0xfd3e, 0xfd3f, O},   {0xfe00, 0xfe19, O},   {0xfe20, 0xfe6b, O},   {0xfeff, 0xfeff, O},
+    {0xff01, 0xff0f, O},   {0xff10, 0xff19, N},   {0xff1a, 0xff20, O},   {0xff3b, 0xff40, O},
+    {0xff5b, 0xff65, O},   {0xffe0, 0xfffd, O},   {0x10100, 0x10102, O}, {0x1d360, 0x1d378, N},
+    {0x1d7ce, 0x1d7ff, N}, {0x1f000, 0x1f0ff, O}, {0x1f100, 0x1f10c, N}, {0x1f10d, 0x1faff, O},
+    {0xe0000, 0xe01ef, O}, {0xf0000, 0x10ffff, O},
+};
+
+inline CharClass classify(uint32_t cp) {
+    if (cp < 0x80) {
+        const uint32_t lower = cp | 0x20;
+        if (lower >= 'a' && lower <= 'z') {
+            return CharClass::kLetter;
+        }
+        if (cp >= '0' && cp <= '9') {
+            return CharClass::kNumber;
+        }
+        if (cp == ' ' || (cp >= '\t' && cp <= '\r')) {
+            return CharClass::kSpace;
+        }
+        return CharClass::kOther;
+    }
+    const auto* end = std::end(kClassRanges);
+    const auto* it = std::upper_bound(std::begin(kClassRanges), end, cp,
+                                      [](uint32_t c, const ClassRange& r) { return c < r.first; });
+    if (it != std::begin(kClassRanges) && cp <= (it - 1)->last) {
+        return (it - 1)->cls;
+    }
+    return CharClass::kLetter;
+}
+
+struct Char {
+    uint32_t cp;
+    uint32_t len;
+    CharClass cls;
+};
+
+// Decodes the character at s[pos]; an invalid byte decodes as itself, class kOther
+inline Char char_at(std::string_view s, size_t pos) {
+    const uint8_t b = s[pos];
+    if (b < 0x80) {
+        return {b, 1, classify(b)};
+    }
+    uint32_t len = b >= 0xf0 ? 4 : b >= 0xe0 ? 3 : b >= 0xc0 ? 2 : 0;
+    if (len == 0 || b >= 0xf8 || pos + len > s.size()) {
+        return {b, 1, CharClass::kOther};
+    }
+    uint32_t cp = b & (0x7f >> len);
+    for (uint32_t i = 1; i < len; ++i) {
+        const uint8_t c = s[pos + i];
+        if ((c & 0xc0) != 0x80) {
+            return {b, 1, CharClass::kOther};
+        }
+        cp = (cp << 6) | (c & 0x3f);
+    }
+    return {cp, len, classify(cp)};
+}
+
+// Number of leading ASCII letters in s[0, n)
+inline size_t ascii_letters(const char* s, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i fold = _mm_set1_epi8(0x20);
+    const __m128i below = _mm_set1_epi8('a' - 1);
+    const __m128i above = _mm_set1_epi8('z' + 1);
+    for (; i + 16 <= n; i += 16) {
+        // Bytes >= 0x80 are negative as signed chars and fail the lower bound
+        const __m128i v = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)), fold);
+        const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmplt_epi8(v, above));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(letters));
+        if (mask != 0xffff) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        const unsigned lower = static_cast<unsigned char>(s[i]) | 0x20;
+        if (lower < 'a' || lower > 'z') {
+            break;
+        }
+    }
+    return i;
+}
+
+// End of the run of `cls` characters starting at pos
+size_t run_end(std::string_view s, size_t pos, CharClass cls) {
+    const size_t n = s.size();
+    while (pos < n) {
+        if (cls == CharClass::kLetter) {
+            pos += ascii_letters(s.data() + pos, n - pos);
+            if (pos == n) {
+                break;
+            }
+        }
+        const Char c = char_at(s, pos);
+        if (c.cls != cls) {
+            break;
+        }
+        pos += c.len;
+    }
+    return pos;
+}
+
+// Length of a contraction suffix ('s, 't, 're, 've, 'm, 'll, 'd) after an apostrophe
+size_t contraction(std::string_view s, size_t pos, bool ignore_case) {
+    auto at = [&](size_t i) -> char {
+        if (pos + i >= s.size()) {
+            return 0;
+        }
+        const char c = s[pos + i];
+        return ignore_case && c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+    };
+    const char c0 = at(0);
+    if (c0 == 's' || c0 == 't' || c0 == 'm' || c0 == 'd') {
+        return 1;
+    }
+    const char c1 = at(1);
+    if ((c0 == 'r' && c1 == 'e') || (c0 == 'v' && c1 == 'e') || (c0 == 'l' && c1 == 'l')) {
+        return 2;
+    }
+    return 0;
+}
+
+// `\s+(?!\S)|\s+`, and for Llama 3 `\s*[\r\n]+` first
+size_t whitespace_end(std::string_view s, size_t pos, bool llama3) {
+    const size_t n = s.size();
+    size_t end = pos;
+    size_t last = pos;
+    size_t newline_end = 0;
+    while (end < n) {
+        const Char c = char_at(s, end);
+        if (c.cls != CharClass::kSpace) {
+            break;
+        }
+        last = end;
+        end += c.len;
+        if (c.cp == '\r' || c.cp == '\n') {
+            newline_end = end;
+        }
+    }
+    if (llama3 && newline_end > 0) {
+        return newline_end;
+    }
+    if (end == n || last == pos) {
+        return end;
+    }
+    // Leave the last whitespace character to prefix the next word
+    return last;
+}
+
+// One match of the GPT-2 or Llama 3 pre-tokenizer regex starting at pos:
+//  GPT-2:   's|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+
+//  Llama 3: (?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}|
+//           ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+
+// Qwen 2 is Llama 3 with \p{N} in place of \p{N}{1,3}.
+size_t next_piece(std::string_view s, size_t pos, bool llama3, int max_digits) {
+    const size_t n = s.size();
+    const Char c = char_at(s, pos);
+    if (c.cp == '\'') {
+        if (const size_t k = contraction(s, pos + 1, llama3)) {
+            return pos + 1 + k;
+        }
+    }
+    if (!llama3) {
+        size_t start = pos;
+        CharClass cls = c.cls;
+        if (c.cp == ' ' && pos + 1 < n) {
+            const Char next = char_at(s, pos + 1);
+            if (next.cls != CharClass::kSpace) {
+                start = pos + 1;
+                cls = next.cls;
+            }
+        }
+        if (cls != CharClass::kSpace) {
+            return run_end(s, start, cls);
+        }
+        return whitespace_end(s, pos, false);
+    }
+    
+    if (c.cls == CharClass::kLetter) {
+        return run_end(s, pos, CharClass::kLetter);
+    }
+    if (c.cls != CharClass::kNumber && c.cp != '\r' && c.cp != '\n' && pos + c.len < n &&
+        char_at(s, pos + c.len).cls == CharClass::kLetter) {
+        return run_end(s, pos + c.len, CharClass::kLetter);
+    }
+    if (c.cls == CharClass::kNumber) {
+        size_t end = pos;
+        for (int i = 0; i < max_digits && end < n; ++i) {
+            const Char d = char_at(s, end);
+            if (d.cls != CharClass::kNumber) {
+                break;
+            }
+            end += d.len;
+        }
+        return end;
+    }
+    size_t start = pos;
+    if (c.cp == ' ' && pos + 1 < n && char_at(s, pos + 1).cls == CharClass::kOther) {
+        start = pos + 1;
+    }
+    if (char_at(s, start).cls == CharClass::kOther) {
+        size_t end = run_end(s, start, CharClass::kOther);
+        while (end < n && (s[end] == '\r' || s[end] == '\n')) {
+            ++end;
+        }
+        return end;
+    }
+    return whitespace_end(s, pos, true);
+}
+
+inline uint64_t pair_key(int32_t left, int32_t right) {
+    // +1 keeps the key of (0, 0) away from the empty slot
+    return (static_cast<uint64_t>(static_cast<uint32_t>(left)) + 1) << 32 | static_cast<uint32_t>(right);
+}
+
+// GPT-2's reversible byte -> printable code point mapping
+void bytes_to_unicode(uint16_t out[256]) {
+    uint16_t next = 256;
+    for (int b = 0; b < 256; ++b) {
+        const bool printable = (b >= '!' && b <= '~') || (b >= 0xa1 && b <= 0xac) || (b >= 0xae && b <= 0xff);
+        out[b] = printable ? static_cast<uint16_t>(b) : next++;
+    }
+}
+
+int parse_byte_token(const std::string& token) {
+    // "<0xAB>"
+    if (token.size() != 6 || token.compare(0, 3, "<0x") != 0 || token[5] != '>') {
+        return -1;
+    }
+    char* end = nullptr;
+    const long v = std::strtol(token.c_str() + 3, &end, 16);
+    return end == token.c_str() + 5 ? static_cast<int>(v) : -1;
+}
+
+std::atomic<uint64_t> g_next_cache_owner{1};
+
+// Per-thread memo of word -> ids, shared by all tokenizers and keyed by owner
+struct WordCache {
+    uint64_t owner = 0;
+    std::unordered_map<std::string, std::vector<int32_t>> words;
+    std::string key;
+    std::string mapped;
+    std::vector<int32_t> symbols;
+    std::string normalized;
+};
+
+WordCache& word_cache() {
+    thread_local WordCache cache;
+    return cache;
+}
+
+} // namespace
+
+void FlatTable::reserve(size_t count) {
+    size_t capacity = 16;
+    while (capacity < count * 2) {
+        capacity <<= 1;
+    }
+    if (capacity <= slots_.size()) {
+        return;
+    }
+    std::vector<Entry> old(capacity);
+    old.swap(slots_);
+    mask_ = capacity - 1;
+    size_ = 0;
+    for (const Entry& e : old) {
+        if (e.key != 0) {
+            insert(e.key, e.first, e.second);
+        }
+    }
+}
+
+void FlatTable::insert(uint64_t key, int32_t first, int32_t second) {
+    if ((size_ + 1) * 2 > slots_.size()) {
+        reserve(size_ + 1);
+    }
+    for (size_t i = hash(key) & mask_;; i = (i + 1) & mask_) {
+        Entry& e = slots_[i];
+        if (e.key == key) {
+            return;
+        }
+        if (e.key == 0) {
+            e = {key, first, second};
+            ++size_;
+            return;
+        }
+    }
+}
+
+struct Tokenizer::Sink {
+    int32_t* out;
+    size_t capacity;
+    size_t count = 0;
+    
+    void push(int32_t id) {
+        if (count < capacity) {
+            out[count] = id;
+        }
+        ++count;
+    }
+};
+
+std::unique_ptr<Tokenizer> Tokenizer::load(const std::string& model_dir) {
+    const std::string path = model_dir + "/tokenizer.json";
+    std::string text;
+    if (!read_file(path, text)) {
+        throw std::ios_base::failure("cannot read " + path);
+    }
+    const Json root = parse_json(text, path);
+    text.clear();
+    text.shrink_to_fit();
+    
+    const Json* model = root.get("model");
+    if (!model) {
+        throw std::invalid_argument(path + ": missing model");
+    }
+    const std::string_view type = str(model->get("type"));
+    if (!type.empty() && type != "BPE") {
+        throw std::invalid_argument("unsupported tokenizer model " + std::string(type) + ", only BPE is implemented");
+    }
+    const Json* vocab = model->get("vocab");
+    const Json* merges = model->get("merges");
+    if (!vocab || vocab->type != Json::Type::kObject || !merges || merges->type != Json::Type::kArray) {
+        throw std::invalid_argument(path + ": BPE model without vocab or merges");
+    }
+    const Json* added = root.get("added_tokens");
+    
+    std::unique_ptr<Tokenizer> tokenizer(new Tokenizer());
+    Tokenizer& t = *tokenizer;
+    
+    // Vocabulary, with the added tokens on top
+    int max_id = -1;
+    for (const Json& id : vocab->items) {
+        max_id = std::max(max_id, static_cast<int>(id.number));
+    }
+    if (added) {
+        for (const Json& token : added->items) {
+            if (const Json* id = token.get("id")) {
+                max_id = std::max(max_id, static_cast<int>(id->number));
+            }
+        }
+    }
+    t.id_to_token_.resize(max_id + 1);
+    t.flags_.assign(max_id + 1, 0);
+    t.token_to_id_.reserve(vocab->keys.size());
+    for (size_t i = 0; i < vocab->keys.size(); ++i) {
+        const int id = static_cast<int>(vocab->items[i].number);
+        if (id >= 0) {
+            t.id_to_token_[id] = vocab->keys[i];
+            t.token_to_id_.emplace(vocab->keys[i], id);
+        }
+    }
+    if (added) {
+        for (const Json& token : added->items) {
+            const Json* id_json = token.get("id");
+            const std::string_view content = str(token.get("content"));
+            if (!id_json || id_json->number < 0 || content.empty()) {
+                continue;
+            }
+            const int id = static_cast<int>(id_json->number);
+            t.id_to_token_[id] = std::string(content);
+            t.token_to_id_[std::string(content)] = id;
+            t.flags_[id] |= kAdded | (flag(token.get("special"), false) ? kSpecial : 0);
+        }
+    }
+    auto lookup = [&t](std::string_view token) {
+        auto it = t.token_to_id_.find(std::string(token));
+        return it == t.token_to_id_.end() ? -1 : it->second;
+    };
+    
+    t.byte_fallback_ = flag(model->get("byte_fallback"), false);
+    t.ignore_merges_ = flag(model->get("ignore_merges"), false);
+    if (const std::string_view unk = str(model->get("unk_token")); !unk.empty()) {
+        t.unk_id_ = lookup(unk);
+    }
+    
+    // Work out the family from the normalizer and pre-tokenizer
+    bool metaspace = false;
+    bool byte_level = false;
+    for_each_step(root.get("normalizer"), "normalizers", [&](const Json& step) {
+        const std::string_view kind = str(step.get("type"));
+        if (kind == "Prepend" && str(step.get("prepend")) == kMeta) {
+            metaspace = true;
+            t.prepend_ = Prepend::kAlways;
+            t.prepend_normalizer_ = true;
+        } else if (kind == "Replace" && str(step.get("content")) == kMeta) {
+            const Json* pattern = step.get("pattern");
+            if (!pattern || str(pattern->get("String")) != " ") {
+                throw std::invalid_argument("unsupported Replace normalizer");
+            }
+            metaspace = true;
+        } else if (kind != "NFC") {
+            // NFC is a no-op for the already-composed text we are given
+            throw std::invalid_argument("unsupported normalizer " + std::string(kind));
+        }
+    });
+    for_each_step(root.get("pre_tokenizer"), "pretokenizers", [&](const Json& step) {
+        const std::string_view kind = str(step.get("type"));
+        if (kind == "Metaspace") {
+            if (str(step.get("replacement")) != kMeta) {
+                throw std::invalid_argument("unsupported Metaspace replacement");
+            }
+            metaspace = true;
+            t.meta_split_ = flag(step.get("split"), true);
+            const std::string_view scheme = str(step.get("prepend_scheme"));
+            if (scheme == "first") {
+                t.prepend_ = Prepend::kFirst;
+            } else if (scheme == "never") {
+                t.prepend_ = Prepend::kNever;
+            } else if (scheme == "always" || flag(step.get("add_prefix_space"), true)) {
+                t.prepend_ = Prepend::kAlways;
+            }
+        } else if (kind == "ByteLevel") {
+            byte_level = true;
+            t.add_prefix_space_ = flag(step.get("add_prefix_space"), false);
+            if (t.split_ == Split::kNone && flag(step.get("use_regex"), true)) {
+                t.split_ = Split::kGpt2;
+            }
+        } else if (kind == "Split") {
+            const Json* pattern = step.get("pattern");
+            const std::string_view regex = pattern ? str(pattern->get("Regex")) : std::string_view();
+            if (regex.find("[^\\r\\n\\p{L}\\p{N}]?\\p{L}+") != std::string_view::npos) {
+                t.split_ = regex.find("\\p{N}{1,3}") != std::string_view::npos ? Split::kLlama3 : Split::kQwen2;
+            } else if (regex.find("'s|'t|'re") != std::string_view::npos) {
+                t.split_ = Split::kGpt2;
+            } else {
+                throw std::invalid_argument("unsupported Split pre-tokenizer pattern");
+            }
+        } else {
+            throw std::invalid_argument("unsupported pre_tokenizer " + std::string(kind));
+        }
+    });
+    if (metaspace && byte_level) {
+        throw std::invalid_argument("unsupported tokenizer: both Metaspace and ByteLevel");
+    }
+    t.kind_ = byte_level ? Kind::kByteLevel : Kind::kMetaspace;
+    t.strip_leading_space_ = !byte_level && t.prepend_ != Prepend::kNever;
+    
+    // Merge ranks; each entry is "left right" or ["left", "right"]
+    t.merges_.reserve(merges->items.size());
+    for (size_t rank = 0; rank < merges->items.size(); ++rank) {
+        const Json& m = merges->items[rank];
+        std::string left, right;
+        if (m.type == Json::Type::kString) {
+            const size_t space = m.string.find(' ');
+            if (space == std::string::npos) {
+                continue;
+            }
+            left = m.string.substr(0, space);
+            right = m.string.substr(space + 1);
+        } else if (m.type == Json::Type::kArray && m.items.size() == 2) {
+            left = m.items[0].string;
+            right = m.items[1].string;
+        } else {
+            continue;
+        }
+        const int l = lookup(left);
+        const int r = lookup(right);
+        const int merged = lookup(left + right);
+        if (l >= 0 && r >= 0 && merged >= 0) {
+            t.merges_.insert(pair_key(l, r), static_cast<int32_t>(rank), merged);
+        }
+    }
+    
+    // Symbol tables and the decoded surface of every token
+    std::fill(std::begin(t.byte_ids_), std::end(t.byte_ids_), -1);
+    std::fill(std::begin(t.fallback_ids_), std::end(t.fallback_ids_), -1);
+    t.id_to_bytes_.resize(t.id_to_token_.size());
+    if (byte_level) {
+        bytes_to_unicode(t.byte_chars_);
+        std::unordered_map<uint32_t, uint8_t> char_bytes;
+        for (int b = 0; b < 256; ++b) {
+            char_bytes[t.byte_chars_[b]] = static_cast<uint8_t>(b);
+            std::string c;
+            append_utf8(c, t.byte_chars_[b]);
+            t.byte_ids_[b] = lookup(c);
+        }
+        for (size_t id = 0; id < t.id_to_token_.size(); ++id) {
+            const std::string& token = t.id_to_token_[id];
+            if (t.flags_[id] & kAdded) {
+                t.id_to_bytes_[id] = token;
+                continue;
+            }
+            std::string& bytes = t.id_to_bytes_[id];
+            for (size_t pos = 0; pos < token.size();) {
+                const Char c = char_at(token, pos);
+                auto it = char_bytes.find(c.cp);
+                if (it != char_bytes.end()) {
+                    bytes += static_cast<char>(it->second);
+                } else {
+                    bytes.append(token, pos, c.len);
+                }
+                pos += c.len;
+            }
+        }
+    } else {
+        std::fill(std::begin(t.byte_chars_), std::end(t.byte_chars_), 0);
+        t.char_ids_.reserve(t.id_to_token_.size() / 4);
+        for (size_t id = 0; id < t.id_to_token_.size(); ++id) {
+            const std::string& token = t.id_to_token_[id];
+            std::string& bytes = t.id_to_bytes_[id];
+            if (token.empty()) {
+                continue;
+            }
+            if (t.flags_[id] & kAdded) {
+                bytes = token;
+                continue;
+            }
+            const Char c = char_at(token, 0);
+            if (c.len == token.size()) {
+                t.char_ids_.insert(c.cp + 1, static_cast<int32_t>(id), 0);
+            }
+            const int byte = t.byte_fallback_ ? parse_byte_token(token) : -1;
+            if (byte >= 0) {
+                t.fallback_ids_[byte] = static_cast<int32_t>(id);
+                bytes = std::string(1, static_cast<char>(byte));
+                continue;
+            }
+            for (size_t pos = 0; pos < token.size();) {
+                const size_t meta = token.find(kMeta, pos);
+                bytes.append(token, pos, meta == std::string::npos ? std::string::npos : meta - pos);
+                if (meta == std::string::npos) {
+                    break;
+                }
+                bytes += ' ';
+                pos = meta + kMetaLen;
+            }
+        }
+    }
+    
+    // bos/eos: tokenizer_config.json, then the post-processor template, then
+    // the usual names
+    bool have_bos = false;
+    bool have_eos = false;
+    const std::string config_path = model_dir + "/tokenizer_config.json";
+    std::string config_text;
+    if (read_file(config_path, config_text)) {
+        const Json config = parse_json(config_text, config_path);
+        auto token_id = [&](const Json* j) {
+            if (j && j->type == Json::Type::kObject) {
+                j = j->get("content");
+            }
+            const std::string_view name = str(j);
+            return name.empty() ? -1 : lookup(name);
+        };
+        if (const Json* bos = config.get("bos_token")) {
+            t.bos_id_ = token_id(bos);
+            have_bos = true;
+        }
+        if (const Json* eos = config.get("eos_token")) {
+            t.eos_id_ = token_id(eos);
+            have_eos = true;
+        }
+    }
+    if (!have_bos) {
+        for_each_step(root.get("post_processor"), "processors", [&](const Json& step) {
+            const Json* single = step.get("single");
+            if (have_bos || str(step.get("type")) != "TemplateProcessing" || !single || single->items.empty()) {
+                return;
+            }
+            if (const Json* special = single->items[0].get("SpecialToken")) {
+                t.bos_id_ = lookup(str(special->get("id")));
+                have_bos = t.bos_id_ >= 0;
+            }
+        });
+    }
+    if (!have_bos) {
+        for (const char* name : {"<s>", "<|begin_of_text|>"}) {
+            if ((t.bos_id_ = lookup(name)) >= 0) {
+                break;
+            }
+        }
+    }
+    if (!have_eos) {
+        for (const char* name : {"</s>", "<|end_of_text|>", "<|endoftext|>"}) {
+            if ((t.eos_id_ = lookup(name)) >= 0) {
+                break;
+            }
+        }
+    }
+    
+    t.build_added_trie();
+    t.cache_owner_ = g_next_cache_owner.fetch_add(1, std::memory_order_relaxed);
+    return tokenizer;
+}
+
+void Tokenizer::build_added_trie() {
+    std::vector<std::pair<std::string, int32_t>> tokens;
+    for (size_t id = 0; id < id_to_token_.size(); ++id) {
+        if ((flags_[id] & kAdded) && !id_to_token_[id].empty()) {
+            tokens.emplace_back(id_to_token_[id], static_cast<int32_t>(id));
+        }
+    }
+    std::sort(tokens.begin(), tokens.end());
+    
+    // Breadth-first, so the edges of a node are contiguous and sorted by byte
+    struct Range {
+        uint32_t node;
+        size_t begin;
+        size_t end;
+        size_t depth;
+    };
+    trie_.assign(1, TrieNode{});
+    edges_.clear();
+    std::vector<Range> queue{{0, 0, tokens.size(), 0}};
+    for (size_t q = 0; q < queue.size(); ++q) {
+        const Range r = queue[q];
+        size_t i = r.begin;
+        if (i < r.end && tokens[i].first.size() == r.depth) {
+            trie_[r.node].id = tokens[i].second;
+            ++i;
+        }
+        trie_[r.node].edges_begin = static_cast<uint32_t>(edges_.size());
+        while (i < r.end) {
+            const uint8_t byte = tokens[i].first[r.depth];
+            size_t j = i;
+            while (j < r.end && static_cast<uint8_t>(tokens[j].first[r.depth]) == byte) {
+                ++j;
+            }
+            const uint32_t child = static_cast<uint32_t>(trie_.size());
+            trie_.push_back(TrieNode{});
+            edges_.push_back({byte, child});
+            queue.push_back({child, i, j, r.depth + 1});
+            i = j;
+        }
+        trie_[r.node].edges_end = static_cast<uint32_t>(edges_.size());
+    }
+    std::fill(std::begin(first_bytes_), std::end(first_bytes_), 0);
+    for (uint32_t e = trie_[0].edges_begin; e < trie_[0].edges_end; ++e) {
+        first_bytes_[edges_[e].byte >> 6] |= uint64_t(1) << (edges_[e].byte & 63);
+    }
+}
+
+size_t Tokenizer::match_added(std::string_view text, size_t pos, int32_t* id) const {
+    size_t best = 0;
+    uint32_t node = 0;
+    for (size_t i = pos; i < text.size(); ++i) {
+        const uint8_t byte = text[i];
+        const TrieEdge* begin = edges_.data() + trie_[node].edges_begin;
+        const TrieEdge* end = edges_.data() + trie_[node].edges_end;
+        const TrieEdge* edge =
+            std::lower_bound(begin, end, byte, [](const TrieEdge& e, uint8_t b) { return e.byte < b; });
+        if (edge == end || edge->byte != byte) {
+            break;
+        }
+        node = edge->child;
+        if (trie_[node].id >= 0) {
+            best = i + 1 - pos;
+            *id = trie_[node].id;
+        }
+    }
+    return best;
+}
+
+size_t Tokenizer::encode(std::string_view text, bool add_bos, int32_t* out, size_t capacity) const {
+    Sink sink{out, capacity};
+    if (add_bos && bos_id_ >= 0) {
+        sink.push(bos_id_);
+    }
+    
+    // Added tokens split the text into segments that are tokenized separately
+    size_t start = 0;
+    bool first = true;
+    for (size_t pos = 0; pos < text.size();) {
+        const uint8_t c = text[pos];
+        int32_t id = -1;
+        size_t len = 0;
+        if ((first_bytes_[c >> 6] >> (c & 63) & 1) && (len = match_added(text, pos, &id)) > 0) {
+            if (pos > start) {
+                encode_segment(text.substr(start, pos - start), first, sink);
+            }
+            first = false;
+            sink.push(id);
+            pos += len;
+            start = pos;
+        } else {
+            ++pos;
+        }
+    }
+    if (start < text.size()) {
+        encode_segment(text.substr(start), first, sink);
+    }
+    return sink.count;
+}
+
+void Tokenizer::encode_segment(std::string_view segment, bool first, Sink& sink) const {
+    if (kind_ == Kind::kByteLevel) {
+        encode_byte_level(segment, first, sink);
+    } else {
+        encode_metaspace(segment, first, sink);
+    }
+}
+
+void Tokenizer::encode_metaspace(std::string_view segment, bool first, Sink& sink) const {
+    std::string& normalized = word_cache().normalized;
+    normalized.clear();
+    const bool prepend = prepend_ == Prepend::kAlways || (prepend_ == Prepend::kFirst && first);
+    if (prepend && (prepend_normalizer_ || segment[0] != ' ')) {
+        normalized += kMeta;
+    }
+    // Spaces become "▁"; memchr is vectorized in libc
+    const char* p = segment.data();
+    const char* const end = p + segment.size();
+    while (p < end) {
+        const char* space = static_cast<const char*>(std::memchr(p, ' ', end - p));
+        const char* stop = space ? space : end;
+        normalized.append(p, stop);
+        if (!space) {
+            break;
+        }
+        normalized += kMeta;
+        p = space + 1;
+    }
+    
+    // Without the Metaspace split a segment is one BPE word; splitting it before
+    // each "▁" run gives the same ids for SentencePiece vocabularies and keeps
+    // the words short enough to cache
+    const std::string_view s(normalized);
+    size_t word = 0;
+    for (size_t i = 0;;) {
+        const size_t meta = s.find(kMeta, i, kMetaLen);
+        if (meta == std::string_view::npos) {
+            break;
+        }
+        const bool after_meta = meta >= kMetaLen && s.compare(meta - kMetaLen, kMetaLen, kMeta) == 0;
+        if (meta > word && (meta_split_ || !after_meta)) {
+            emit_word(s.substr(word, meta - word), sink);
+            word = meta;
+        }
+        i = meta + kMetaLen;
+    }
+    if (word < s.size()) {
+        emit_word(s.substr(word), sink);
+    }
+}
+
+void Tokenizer::encode_byte_level(std::string_view segment, bool, Sink& sink) const {
+    std::string prefixed;
+    if (add_prefix_space_ && segment[0] != ' ') {
+        prefixed.reserve(segment.size() + 1);
+        prefixed += ' ';
+        prefixed.append(segment);
+        segment = prefixed;
+    }
+    if (split_ == Split::kNone) {
+        emit_word(segment, sink);
+        return;
+    }
+    const bool llama3 = split_ != Split::kGpt2;
+    const int max_digits = split_ == Split::kLlama3 ? 3 : 1;
+    for (size_t pos = 0; pos < segment.size();) {
+        const size_t end = next_piece(segment, pos, llama3, max_digits);
+        emit_word(segment.substr(pos, end - pos), sink);
+        pos = end;
+    }
+}
+
+void Tokenizer::emit_word(std::string_view word, Sink& sink) const {
+    WordCache& cache = word_cache();
+    if (cache.owner != cache_owner_) {
+        cache.words.clear();
+        cache.owner = cache_owner_;
+    }
+    const bool cacheable = word.size() <= kMaxCachedWord;
+    if (cacheable) {
+        cache.key.assign(word);
+        auto it = cache.words.find(cache.key);
+        if (it != cache.words.end()) {
+            for (int32_t id : it->second) {
+                sink.push(id);
+            }
+            return;
+        }
+    }
+    
+    std::vector<int32_t>& symbols = cache.symbols;
+    symbols.clear();
+    if (kind_ == Kind::kByteLevel) {
+        if (ignore_merges_) {
+            cache.mapped.clear();
+            for (char c : word) {
+                append_utf8(cache.mapped, byte_chars_[static_cast<uint8_t>(c)]);
+            }
+            auto it = token_to_id_.find(cache.mapped);
+            if (it != token_to_id_.end()) {
+                symbols.push_back(it->second);
+            }
+        }
+        if (symbols.empty()) {
+            for (char c : word) {
+                const int32_t id = byte_ids_[static_cast<uint8_t>(c)];
+                if (id >= 0 || unk_id_ >= 0) {
+                    symbols.push_back(id >= 0 ? id : unk_id_);
+                }
+            }
+            merge(symbols);
+        }
+    } else {
+        if (ignore_merges_) {
+            auto it = token_to_id_.find(std::string(word));
+            if (it != token_to_id_.end()) {
+                symbols.push_back(it->second);
+            }
+        }
+        if (symbols.empty()) {
+            for (size_t pos = 0; pos < word.size();) {
+                const Char c = char_at(word, pos);
+                if (const FlatTable::Entry* e = char_ids_.find(c.cp + 1)) {
+                    symbols.push_back(e->first);
+                } else if (byte_fallback_ && fallback_ids_[static_cast<uint8_t>(word[pos])] >= 0) {
+                    for (uint32_t i = 0; i < c.len; ++i) {
+                        const int32_t id = fallback_ids_[static_cast<uint8_t>(word[pos + i])];
+                        symbols.push_back(id >= 0 ? id : unk_id_);
+                    }
+                } else if (unk_id_ >= 0) {
+                    symbols.push_back(unk_id_);
+                }
+                pos += c.len;
+            }
+            symbols.erase(std::remove(symbols.begin(), symbols.end(), -1), symbols.end());
+            merge(symbols);
+        }
+    }
+    
+    for (int32_t id : symbols) {
+        sink.push(id);
+    }
+    if (cacheable) {
+        if (cache.words.size() >= kMaxCachedWords) {
+            cache.words.clear();
+        }
+        cache.words.emplace(cache.key, symbols);
+    }
+}
+
+void Tokenizer::merge(std::vector<int32_t>& symbols) const {
+    const size_t n = symbols.size();
+    if (n < 2) {
+        return;
+    }
+    // Short words: rescan for the lowest-ranked pair, leftmost on ties
+    if (n <= 16) {
+        size_t size = n;
+        while (size > 1) {
+            int32_t best_rank = INT32_MAX;
+            size_t best = 0;
+            int32_t merged = -1;
+            for (size_t i = 0; i + 1 < size; ++i) {
+                const FlatTable::Entry* e = merges_.find(pair_key(symbols[i], symbols[i + 1]));
+                if (e && e->first < best_rank) {
+                    best_rank = e->first;
+                    best = i;
+                    merged = e->second;
+                }
+            }
+            if (merged < 0) {
+                break;
+            }
+            symbols[best] = merged;
+            std::copy(symbols.begin() + best + 2, symbols.begin() + size, symbols.begin() + best + 1);
+            --size;
+        }
+        symbols.resize(size);
+        return;
+    }
+    
+    // Long words: a heap of candidate pairs over a linked list of symbols,
+    // dropping candidates whose symbols have since been merged away
+    struct Candidate {
+        int32_t rank;
+        uint32_t pos;
+        int32_t left;
+        int32_t right;
+        int32_t merged;
+        bool operator>(const Candidate& o) const {
+            return rank != o.rank ? rank > o.rank : pos > o.pos;
+        }
+    };
+    std::vector<int32_t> next(n), prev(n);
+    for (size_t i = 0; i < n; ++i) {
+        next[i] = i + 1 < n ? static_cast<int32_t>(i + 1) : -1;
+        prev[i] = static_cast<int32_t>(i) - 1;
+    }
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> heap;
+    auto push = [&](int32_t pos) {
+        if (pos < 0 || next[pos] < 0) {
+            return;
+        }
+        const int32_t left = symbols[pos];
+        const int32_t right = symbols[next[pos]];
+        if (const FlatTable::Entry* e = merges_.find(pair_key(left, right))) {
+            heap.push({e->first, static_cast<uint32_t>(pos), left, right, e->second});
+        }
+    };
+    for (size_t i = 0; i + 1 < n; ++i) {
+        push(static_cast<int32_t>(i));
+    }
+    while (!heap.empty()) {
+        const Candidate c = heap.top();
+        heap.pop();
+        const int32_t right = next[c.pos];
+        if (symbols[c.pos] != c.left || right < 0 || symbols[right] != c.right) {
+            continue;
+        }
+        symbols[c.pos] = c.merged;
+        symbols[right] = -1;
+        next[c.pos] = next[right];
+        if (next[right] >= 0) {
+            prev[next[right]] = c.pos;
+        }
+        push(prev[c.pos]);
+        push(c.pos);
+    }
+    symbols.erase(std::remove(symbols.begin(), symbols.end(), -1), symbols.end());
+}
+
+void Tokenizer::decode(const int32_t* ids, size_t count, bool skip_special, std::string& out) const {
+    const size_t base = out.size();
+    const int vocab = vocab_size();
+    for (size_t i = 0; i < count; ++i) {
+        const int32_t id = ids[i];
+        if (id < 0 || id >= vocab || (skip_special && (flags_[id] & kSpecial))) {
+            continue;
+        }
+        out += id_to_bytes_[id];
+    }
+    if (strip_leading_space_ && out.size() > base && out[base] == ' ') {
+        out.erase(base, 1);
+    }
+}
+
+void StreamDecoder::push(const int32_t* ids, size_t count, std::string& out) {
+    for (size_t i = 0; i < count; ++i) {
+        const int32_t id = ids[i];
+        if (skip_special_ && tokenizer_.is_special(id)) {
+            continue;
+        }
+        std::string_view bytes = tokenizer_.token_bytes(id);
+        if (bytes.empty()) {
+            continue;
+        }
+        // Same rule as Tokenizer::decode: drop a space opening the text
+        if (at_start_ && tokenizer_.strips_leading_space() && bytes[0] == ' ') {
+            bytes.remove_prefix(1);
+        }
+        at_start_ = false;
+        append(bytes, out);
+    }
+}
+
+void StreamDecoder::append(std::string_view bytes, std::string& out) {
+    static constexpr char kReplacement[] = "\xef\xbf\xbd"; // U+FFFD
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        const uint8_t b = bytes[i];
+        if (pending_len_ > 0) {
+            if ((b & 0xc0) == 0x80) {
+                pending_[pending_len_++] = static_cast<char>(b);
+                if (pending_len_ == pending_need_) {
+                    out.append(pending_, pending_len_);
+                    pending_len_ = 0;
+                }
+                continue;
+            }
+            // Cut short; the byte starts something new
+            out += kReplacement;
+            pending_len_ = 0;
+        }
+        if (b < 0x80) {
+            // ASCII runs are by far the common case
+            size_t end = i + 1;
+            while (end < bytes.size() && static_cast<uint8_t>(bytes[end]) < 0x80) {
+                ++end;
+            }
+            out.append(bytes.data() + i, end - i);
+            i = end - 1;
+        } else if (b >= 0xc2 && b <= 0xf4) {
+            pending_[0] = static_cast<char>(b);
+            pending_len_ = 1;
+            pending_need_ = b >= 0xf0 ? 4 : b >= 0xe0 ? 3 : 2;
+        } else {
+            out += kReplacement;
+        }
+    }
+}
+
+void StreamDecoder::finish(std::string& out) {
+    if (pending_len_ > 0) {
+        out += "\xef\xbf\xbd";
+        pending_len_ = 0;
+    }
+    at_start_ = true;
+}
+
+bool StreamDecoder::drain(TurboMindTokenStream& stream, std::string& out) {
+    // finished is published after the last head, so read it first
+    const bool finished = __atomic_load_n(&stream.finished, __ATOMIC_ACQUIRE) != 0;
+    const uint64_t head = __atomic_load_n(&stream.head, __ATOMIC_ACQUIRE);
+    const uint64_t tail = stream.tail;
+    const uint64_t mask = stream.capacity - 1;
+    for (uint64_t i = tail; i < head;) {
+        // Contiguous run up to the end of the ring
+        const uint64_t slot = i & mask;
+        const uint64_t run = std::min(head - i, stream.capacity - slot);
+        push(stream.token_ids + slot, run, out);
+        i += run;
+    }
+    __atomic_store_n(&stream.tail, head, __ATOMIC_RELEASE);
+    if (finished) {
+        finish(out);
+    }
+    return finished;
+}
+
+} // namespace turbomind_go
@@ -0,0 +1,197 @@
+#ifndef TURBOMIND_TOKENIZER_H
+#define TURBOMIND_TOKENIZER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "turbomind_wrapper.hpp"
+
+namespace turbomind_go {
+
+// Open-addressed table from non-zero 64-bit keys to a pair of ints. Used for
+// the merge ranks and the single-character vocab, which are probed for every
+// symbol; a flat array keeps those probes within a cache line or two.
+class FlatTable {
+public:
+    struct Entry {
+        uint64_t key = 0;
+        int32_t first = 0;
+        int32_t second = 0;
+    };
+    
+    void reserve(size_t count);
+    // Keeps the first value inserted for a key
+    void insert(uint64_t key, int32_t first, int32_t second);
+    const Entry* find(uint64_t key) const {
+        if (mask_ == 0) {
+            return nullptr;
+        }
+        for (size_t i = hash(key) & mask_;; i = (i + 1) & mask_) {
+            const Entry& e = slots_[i];
+            if (e.key == key) {
+                return &e;
+            }
+            if (e.key == 0) {
+                return nullptr;
+            }
+        }
+    }
+
+private:
+    static uint64_t hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return key;
+    }
+    
+    std::vector<Entry> slots_;
+    size_t mask_ = 0;
+    size_t size_ = 0;
+};
+
+// BPE tokenizer loaded from a Hugging Face tokenizer.json. Covers the two
+// families our models ship:
+//  - SentencePiece style: Metaspace pre-tokenizer or Prepend/Replace("▁")
+//    normalizer, with byte fallback (Llama 2, Mistral, Phi-3)
+//  - byte-level: GPT-2, Llama 3 or Qwen 2 style regex splits
+// Pre-tokenization is hand-written rather than regex driven, with SSE2 scans
+// for ASCII runs. Non-ASCII characters are classified from a small table
+// (whitespace, digits, punctuation and symbols, combining marks), everything
+// else counts as a letter. Encoding and decoding are thread-safe.
+class Tokenizer {
+public:
+    // Reads model_dir/tokenizer.json, plus tokenizer_config.json for the
+    // bos/eos tokens when it exists. Throws std::ios_base::failure when the file
+    // cannot be read and std::invalid_argument when it is malformed or unsupported.
+    static std::unique_ptr<Tokenizer> load(const std::string& model_dir);
+    
+    // Writes the ids of `text` to out[0, capacity) and returns the full count,
+    // which never exceeds max_tokens(text.size())
+    size_t encode(std::string_view text, bool add_bos, int32_t* out, size_t capacity) const;
+    static size_t max_tokens(size_t text_bytes) {
+        return 2 * text_bytes + 2; // one per byte, a "▁" per segment and BOS
+    }
+    
+    // Appends the text of `ids`; unknown ids are skipped
+    void decode(const int32_t* ids, size_t count, bool skip_special, std::string& out) const;
+    
+    // Bytes a token decodes to (possibly a partial UTF-8 sequence), empty for unknown ids
+    std::string_view token_bytes(int id) const {
+        return id >= 0 && id < vocab_size() ? std::string_view(id_to_bytes_[id]) : std::string_view();
+    }
+    // Whether decoding drops the space the encoder prepended to the first word
+    bool strips_leading_space() const {
+        return strip_leading_space_;
+    }
+    
+    int vocab_size() const {
+        return static_cast<int>(id_to_token_.size());
+    }
+    int bos_id() const {
+        return bos_id_;
+    }
+    int eos_id() const {
+        return eos_id_;
+    }
+    bool is_special(int id) const {
+        return id >= 0 && id < vocab_size() && (flags_[id] & kSpecial);
+    }
+
+private:
+    enum class Kind { kMetaspace, kByteLevel };
+    enum class Split { kNone, kGpt2, kLlama3, kQwen2 };
+    enum class Prepend { kNever, kFirst, kAlways };
+    static constexpr uint8_t kSpecial = 1;
+    static constexpr uint8_t kAdded = 2;
+    
+    struct Sink;
+    struct TrieNode {
+        uint32_t edges_begin = 0;
+        uint32_t edges_end = 0;
+        int32_t id = -1; // added token ending here
+    };
+    struct TrieEdge {
+        uint8_t byte;
+        uint32_t child;
+    };
+    
+    Tokenizer() = default;
+    void build_added_trie();
+    // Length of the longest added token at text[pos], 0 if none
+    size_t match_added(std::string_view text, size_t pos, int32_t* id) const;
+    
+    void encode_segment(std::string_view segment, bool first, Sink& sink) const;
+    void encode_metaspace(std::string_view segment, bool first, Sink& sink) const;
+    void encode_byte_level(std::string_view segment, bool first, Sink& sink) const;
+    // BPE over the symbols of one word, merging in place
+    void merge(std::vector<int32_t>& symbols) const;
+    void emit_word(std::string_view word, Sink& sink) const;
+    
+    Kind kind_ = Kind::kMetaspace;
+    Split split_ = Split::kNone;
+    Prepend prepend_ = Prepend::kNever;
+    bool prepend_normalizer_ = false; // "▁" is prepended even when the text starts with a space
+    bool meta_split_ = false;         // Metaspace split: a word starts at every "▁"
+    bool add_prefix_space_ = false;   // byte-level
+    bool strip_leading_space_ = false;
+    bool ignore_merges_ = false;
+    bool byte_fallback_ = false;
+    int unk_id_ = -1;
+    int bos_id_ = -1;
+    int eos_id_ = -1;
+    uint64_t cache_owner_ = 0; // tags this tokenizer's entries in the per-thread word cache
+    
+    std::vector<std::string> id_to_token_;
+    std::vector<std::string> id_to_bytes_; // decoded surface of each token
+    std::vector<uint8_t> flags_;
+    std::unordered_map<std::string, int32_t> token_to_id_;
+    FlatTable merges_;     // (left << 32 | right) -> (rank, merged id)
+    FlatTable char_ids_;   // metaspace: code point + 1 -> id
+    int32_t byte_ids_[256];     // byte-level: byte -> id of its mapped character
+    int32_t fallback_ids_[256]; // <0xXX> tokens, -1 when absent
+    uint16_t byte_chars_[256];  // byte-level: byte -> code point it is written as
+    
+    // Added tokens matched verbatim before pre-tokenization
+    std::vector<TrieNode> trie_;
+    std::vector<TrieEdge> edges_;
+    uint64_t first_bytes_[4] = {}; // bitmap of bytes that can start an added token
+};
+
+// Incremental decoding for streamed tokens. Tokens decode independently apart
+// from the leading-space strip, and a character may span tokens, so the only
+// state carried between calls is an incomplete UTF-8 tail of up to three bytes.
+// Each call costs O(new tokens) and appends only complete, valid UTF-8; bytes
+// that can never form a character are replaced with U+FFFD.
+class StreamDecoder {
+public:
+    StreamDecoder(const Tokenizer& tokenizer, bool skip_special)
+        : tokenizer_(tokenizer), skip_special_(skip_special) {}
+    
+    // Appends the text completed by `ids`
+    void push(const int32_t* ids, size_t count, std::string& out);
+    // Appends a held-back incomplete character as U+FFFD and resets the state
+    void finish(std::string& out);
+    
+    // Consumes ring entries [tail, head) of a streaming request, advancing tail.
+    // Returns true, after finishing, once the request finished and was drained.
+    bool drain(TurboMindTokenStream& stream, std::string& out);
+
+private:
+    void append(std::string_view bytes, std::string& out);
+    
+    const Tokenizer& tokenizer_;
+    bool skip_special_;
+    bool at_start_ = true;
+    char pending_[4];
+    uint32_t pending_len_ = 0;
+    uint32_t pending_need_ = 0; // full length of the pending character
+};
+
+} // namespace turbomind_go
+
+#endif // TURBOMIND_TOKENIZER_H
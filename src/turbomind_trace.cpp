@@ -0,0 +1,122 @@
+#include "turbomind_trace.h"
+#include "turbomind_metrics.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+
+#include <nvtx3/nvToolsExt.h>
+#include <unistd.h>
+
+namespace turbomind_go {
+
+namespace {
+
+// Small sequential thread ids read better in trace viewers than pthread ids
+uint32_t trace_tid() {
+    static std::atomic<uint32_t> next{1};
+    thread_local uint32_t tid = next.fetch_add(1, std::memory_order_relaxed);
+    return tid;
+}
+
+void write_json_string(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+} // namespace
+
+TraceRecorder& TraceRecorder::instance() {
+    // Intentionally leaked, like the log sink
+    static TraceRecorder* recorder = new TraceRecorder();
+    return *recorder;
+}
+
+void TraceRecorder::enable(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ring_.clear();
+    ring_.reserve(capacity);
+    capacity_ = capacity;
+    next_ = 0;
+    enabled_.store(capacity > 0, std::memory_order_relaxed);
+}
+
+void TraceRecorder::disable() {
+    enabled_.store(false, std::memory_order_relaxed);
+}
+
+void TraceRecorder::record(const char* name, uint64_t session_id, int64_t start_ns, int64_t end_ns) {
+    Span span{name ? name : "", session_id, trace_tid(), start_ns, end_ns};
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity_ == 0) {
+        return;
+    }
+    if (ring_.size() < capacity_) {
+        ring_.push_back(std::move(span));
+    } else {
+        ring_[next_] = std::move(span);
+        next_ = (next_ + 1) % capacity_;
+    }
+}
+
+bool TraceRecorder::dump(const std::string& path) {
+    std::vector<Span> spans;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Oldest first
+        spans.assign(ring_.begin() + next_, ring_.end());
+        spans.insert(spans.end(), ring_.begin(), ring_.begin() + next_);
+    }
+    
+    std::ofstream out(path, std::ios::trunc);
+    const int pid = static_cast<int>(getpid());
+    out << std::fixed << std::setprecision(3); // microseconds
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < spans.size(); ++i) {
+        const Span& span = spans[i];
+        out << (i ? ",\n" : "\n") << "{\"name\":";
+        write_json_string(out, span.name);
+        out << ",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << span.tid
+            << ",\"ts\":" << span.start_ns / 1000.0
+            << ",\"dur\":" << (span.end_ns - span.start_ns) / 1000.0;
+        if (span.session_id) {
+            out << ",\"args\":{\"session_id\":" << span.session_id << '}';
+        }
+        out << '}';
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
+
+TraceScope::TraceScope(const char* name, uint64_t session_id) : name_(name), session_id_(session_id) {
+    if (session_id) {
+        char label[96];
+        std::snprintf(label, sizeof(label), "%s session=%llu", name, static_cast<unsigned long long>(session_id));
+        nvtxRangePushA(label);
+    } else {
+        nvtxRangePushA(name);
+    }
+    if (TraceRecorder::instance().enabled()) {
+        start_ns_ = now_ns();
+    }
+}
+
+TraceScope::~TraceScope() {
+    nvtxRangePop();
+    if (start_ns_) {
+        trace_span(name_, session_id_, start_ns_, now_ns());
+    }
+}
+
+} // namespace turbomind_go
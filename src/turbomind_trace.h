@@ -0,0 +1,74 @@
+#ifndef TURBOMIND_TRACE_H
+#define TURBOMIND_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace turbomind_go {
+
+// Opt-in ring buffer of completed spans, dumped as Chrome trace JSON. When
+// disabled, recording costs one relaxed load; when the ring is full the
+// oldest spans are overwritten.
+class TraceRecorder {
+public:
+    static TraceRecorder& instance();
+    
+    // Clears the ring and starts recording up to `capacity` spans
+    void enable(size_t capacity);
+    // Stops recording; the spans stay available to dump
+    void disable();
+    
+    bool enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    void record(const char* name, uint64_t session_id, int64_t start_ns, int64_t end_ns);
+    // Writes {"traceEvents": [...]} with timestamps on the now_ns() clock
+    bool dump(const std::string& path);
+
+private:
+    struct Span {
+        std::string name;
+        uint64_t session_id;
+        uint32_t tid;
+        int64_t start_ns;
+        int64_t end_ns;
+    };
+    
+    TraceRecorder() = default;
+    
+    std::atomic<bool> enabled_{false};
+    std::mutex mutex_;
+    std::vector<Span> ring_;
+    size_t capacity_ = 0;
+    size_t next_ = 0; // slot of the next span once the ring is full
+};
+
+inline void trace_span(const char* name, uint64_t session_id, int64_t start_ns, int64_t end_ns) {
+    auto& recorder = TraceRecorder::instance();
+    if (recorder.enabled()) {
+        recorder.record(name, session_id, start_ns, end_ns);
+    }
+}
+
+// Scoped NVTX range, also recorded as a span while the trace recorder is on.
+// `name` must outlive the scope (wrapper call sites pass literals).
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, uint64_t session_id = 0);
+    ~TraceScope();
+    
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    uint64_t session_id_;
+    int64_t start_ns_ = 0;
+};
+
+} // namespace turbomind_go
+
+#endif // TURBOMIND_TRACE_H
@@ -0,0 +1,413 @@
+#include "turbomind_weight_loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "src/turbomind/utils/cuda_utils.h"
+
+namespace turbomind_go {
+
+namespace {
+
+// One parameter to upload: either a whole file (path) or a slice of an existing mapping (data)
+struct CopyJob {
+    std::string path;
+    const char* data;
+    ft::core::Tensor* tensor;
+    size_t size;
+};
+
+constexpr char kSnapshotMagic[8] = {'T', 'M', 'S', 'N', 'A', 'P', '0', '1'};
+constexpr uint32_t kSnapshotVersion = 1;
+constexpr size_t kSnapshotAlign = 4096; // tensor payloads start on page boundaries
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) {
+            throw std::ios_base::failure("cannot open " + path + ": " + strerror(errno));
+        }
+        struct stat info;
+        if (fstat(fd_, &info) != 0) {
+            close(fd_);
+            throw std::ios_base::failure("cannot stat " + path + ": " + strerror(errno));
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        if (size_ > 0) {
+            data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (data_ == MAP_FAILED) {
+                close(fd_);
+                throw std::ios_base::failure("cannot mmap " + path + ": " + strerror(errno));
+            }
+            // Aggressive read-ahead keeps the page cache ahead of the staging copy
+            madvise(data_, size_, MADV_SEQUENTIAL);
+        }
+    }
+    
+    ~MappedFile() {
+        if (data_ && data_ != MAP_FAILED) {
+            munmap(data_, size_);
+        }
+        close(fd_);
+    }
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    const char* data() const { return static_cast<const char*>(data_); }
+    size_t size() const { return size_; }
+
+private:
+    int fd_ = -1;
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Per-thread copy pipeline: two pinned staging buffers on one stream
+class StagingPipeline {
+public:
+    StagingPipeline(int device_id, size_t buffer_bytes) : buffer_bytes_(buffer_bytes) {
+        ft::check_cuda_error(cudaSetDevice(device_id));
+        ft::check_cuda_error(cudaStreamCreateWithFlags(&stream_, cudaStreamNonBlocking));
+        for (int i = 0; i < 2; ++i) {
+            ft::check_cuda_error(cudaHostAlloc(&buffers_[i], buffer_bytes_, cudaHostAllocDefault));
+            ft::check_cuda_error(cudaEventCreateWithFlags(&events_[i], cudaEventDisableTiming));
+        }
+    }
+    
+    ~StagingPipeline() {
+        cudaStreamSynchronize(stream_);
+        for (int i = 0; i < 2; ++i) {
+            cudaEventDestroy(events_[i]);
+            cudaFreeHost(buffers_[i]);
+        }
+        cudaStreamDestroy(stream_);
+    }
+    
+    StagingPipeline(const StagingPipeline&) = delete;
+    StagingPipeline& operator=(const StagingPipeline&) = delete;
+    
+    void copy(void* dst, const char* src, size_t size, const std::function<void(uint64_t)>& on_bytes) {
+        for (size_t offset = 0; offset < size; offset += buffer_bytes_) {
+            const size_t chunk = std::min(buffer_bytes_, size - offset);
+            
+            // Wait until the H2D copy that last used this buffer has drained; the
+            // other buffer's copy keeps the copy engine busy meanwhile
+            ft::check_cuda_error(cudaEventSynchronize(events_[next_]));
+            report(on_bytes, next_);
+            
+            std::memcpy(buffers_[next_], src + offset, chunk);
+            ft::check_cuda_error(cudaMemcpyAsync(static_cast<char*>(dst) + offset, buffers_[next_], chunk,
+                                                 cudaMemcpyDefault, stream_));
+            ft::check_cuda_error(cudaEventRecord(events_[next_], stream_));
+            in_flight_[next_] = chunk;
+            next_ ^= 1;
+        }
+    }
+    
+    void finish(const std::function<void(uint64_t)>& on_bytes) {
+        ft::check_cuda_error(cudaStreamSynchronize(stream_));
+        report(on_bytes, 0);
+        report(on_bytes, 1);
+    }
+
+private:
+    void report(const std::function<void(uint64_t)>& on_bytes, int buffer) {
+        if (in_flight_[buffer] && on_bytes) {
+            on_bytes(in_flight_[buffer]);
+        }
+        in_flight_[buffer] = 0;
+    }
+    
+    size_t buffer_bytes_;
+    cudaStream_t stream_ = nullptr;
+    void* buffers_[2] = {nullptr, nullptr};
+    cudaEvent_t events_[2] = {nullptr, nullptr};
+    size_t in_flight_[2] = {0, 0};
+    int next_ = 0;
+};
+
+void run_copy_jobs(std::vector<CopyJob>& jobs, int device_id, const WeightLoadOptions& options) {
+    // Largest first so the tail of the load is not one thread on a huge embedding
+    std::sort(jobs.begin(), jobs.end(), [](const CopyJob& a, const CopyJob& b) { return a.size > b.size; });
+    
+    const int num_threads = std::max(1, std::min<int>(options.num_threads, static_cast<int>(jobs.size())));
+    std::atomic<size_t> next_job{0};
+    std::mutex error_mutex;
+    std::exception_ptr first_error; // rethrown as is, so callers can classify it
+    
+    auto worker = [&] {
+        try {
+            StagingPipeline pipeline(device_id, options.staging_bytes);
+            for (size_t i = next_job++; i < jobs.size(); i = next_job++) {
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (first_error) {
+                        return;
+                    }
+                }
+                const CopyJob& job = jobs[i];
+                if (job.data) {
+                    pipeline.copy(job.tensor->raw_data(), job.data, job.size, options.on_bytes);
+                    continue;
+                }
+                MappedFile mapped(job.path);
+                if (mapped.size() != job.size) {
+                    throw std::ios_base::failure(job.path + " has " + std::to_string(mapped.size()) +
+                                                 " bytes, expected " + std::to_string(job.size));
+                }
+                pipeline.copy(job.tensor->raw_data(), mapped.data(), mapped.size(), options.on_bytes);
+            }
+            pipeline.finish(options.on_bytes);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!first_error) {
+                first_error = std::current_exception();
+            }
+        }
+    };
+    
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+}
+
+// Parameters in a stable order, so a snapshot layout does not depend on hash map iteration
+std::vector<std::pair<std::string, ft::core::Tensor*>> sorted_params(ft::core::TensorMap& params) {
+    std::vector<std::pair<std::string, ft::core::Tensor*>> sorted;
+    sorted.reserve(params.size());
+    for (auto& [key, tensor] : params) {
+        if (tensor.byte_size() > 0) {
+            sorted.emplace_back(key, &tensor);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    return sorted;
+}
+
+// Little-endian header serialization helpers
+void put_u64(std::string& out, uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void put_string(std::string& out, const std::string& value) {
+    put_u64(out, value.size());
+    out.append(value);
+}
+
+class HeaderReader {
+public:
+    HeaderReader(const char* data, size_t size) : data_(data), size_(size) {}
+    
+    uint64_t u64() {
+        uint64_t value;
+        need(sizeof(value));
+        std::memcpy(&value, data_ + pos_, sizeof(value));
+        pos_ += sizeof(value);
+        return value;
+    }
+    
+    std::string string() {
+        const uint64_t len = u64();
+        need(len);
+        std::string value(data_ + pos_, len);
+        pos_ += len;
+        return value;
+    }
+
+private:
+    void need(uint64_t bytes) {
+        if (bytes > size_ - pos_) {
+            throw std::runtime_error("truncated snapshot header");
+        }
+    }
+    
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+uint64_t weight_bytes(const ft::core::TensorMap& params) {
+    uint64_t total = 0;
+    for (const auto& [key, tensor] : params) {
+        total += static_cast<uint64_t>(tensor.byte_size());
+    }
+    return total;
+}
+
+void load_weights(ft::core::TensorMap& params, int device_id, const WeightLoadOptions& options) {
+    std::string dir = options.weights_dir;
+    if (options.per_rank_dirs) {
+        dir += "/rank_" + std::to_string(options.rank);
+    }
+    
+    std::vector<CopyJob> jobs;
+    jobs.reserve(params.size());
+    for (auto& [key, tensor] : params) {
+        if (tensor.byte_size() > 0) {
+            jobs.push_back({dir + "/" + key, nullptr, &tensor, static_cast<size_t>(tensor.byte_size())});
+        }
+    }
+    run_copy_jobs(jobs, device_id, options);
+}
+
+std::string snapshot_path(const std::string& snapshot_dir, const std::string& fingerprint, int rank) {
+    // FNV-1a keeps file names stable across builds; the full fingerprint is still checked on load
+    uint64_t hash = 1469598103934665603ull;
+    for (unsigned char c : fingerprint) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx.rank%d.tmsnap", static_cast<unsigned long long>(hash), rank);
+    return snapshot_dir + "/" + name;
+}
+
+void save_snapshot(ft::core::TensorMap& params, int device_id, const std::string& path,
+                   const std::string& fingerprint) {
+    auto sorted = sorted_params(params);
+    
+    // Header: magic, version, fingerprint, then (key, dtype, shape, offset, bytes) per tensor
+    std::string header(kSnapshotMagic, sizeof(kSnapshotMagic));
+    put_u64(header, kSnapshotVersion);
+    put_string(header, fingerprint);
+    put_u64(header, sorted.size());
+    size_t entries_size = 0;
+    for (const auto& [key, tensor] : sorted) {
+        entries_size += sizeof(uint64_t) * (5 + tensor->ndim()) + key.size();
+    }
+    uint64_t offset = align_up(header.size() + entries_size, kSnapshotAlign);
+    for (const auto& [key, tensor] : sorted) {
+        put_string(header, key);
+        put_u64(header, static_cast<uint64_t>(tensor->dtype()));
+        put_u64(header, static_cast<uint64_t>(tensor->ndim()));
+        for (auto dim : tensor->shape()) {
+            put_u64(header, static_cast<uint64_t>(dim));
+        }
+        put_u64(header, offset);
+        put_u64(header, static_cast<uint64_t>(tensor->byte_size()));
+        offset = align_up(offset + tensor->byte_size(), kSnapshotAlign);
+    }
+    
+    // Write to a temporary name and rename, so a crash never leaves a half-written snapshot
+    const std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::ios_base::failure("cannot create " + tmp_path + ": " + strerror(errno));
+    }
+    out.write(header.data(), header.size());
+    
+    ft::check_cuda_error(cudaSetDevice(device_id));
+    const size_t chunk_bytes = 32 << 20;
+    void* staging = nullptr;
+    ft::check_cuda_error(cudaHostAlloc(&staging, chunk_bytes, cudaHostAllocDefault));
+    try {
+        const std::string padding(kSnapshotAlign, '\0');
+        for (const auto& [key, tensor] : sorted) {
+            const uint64_t pos = static_cast<uint64_t>(out.tellp());
+            out.write(padding.data(), align_up(pos, kSnapshotAlign) - pos);
+            
+            const size_t size = static_cast<size_t>(tensor->byte_size());
+            const char* src = static_cast<const char*>(tensor->raw_data());
+            for (size_t done = 0; done < size; done += chunk_bytes) {
+                const size_t chunk = std::min(chunk_bytes, size - done);
+                ft::check_cuda_error(cudaMemcpy(staging, src + done, chunk, cudaMemcpyDefault));
+                out.write(static_cast<const char*>(staging), chunk);
+            }
+        }
+        out.close();
+        if (!out) {
+            throw std::ios_base::failure("failed writing " + tmp_path);
+        }
+    } catch (...) {
+        cudaFreeHost(staging);
+        unlink(tmp_path.c_str());
+        throw;
+    }
+    cudaFreeHost(staging);
+    
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        const std::string error = strerror(errno);
+        unlink(tmp_path.c_str());
+        throw std::ios_base::failure("cannot rename snapshot to " + path + ": " + error);
+    }
+}
+
+bool load_snapshot(ft::core::TensorMap& params, int device_id, const std::string& path,
+                   const std::string& fingerprint, const WeightLoadOptions& options) {
+    if (access(path.c_str(), R_OK) != 0) {
+        return false;
+    }
+    MappedFile mapped(path);
+    if (mapped.size() < sizeof(kSnapshotMagic) ||
+        std::memcmp(mapped.data(), kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) {
+        return false;
+    }
+    
+    // Any difference from the current parameter layout makes the snapshot stale
+    auto sorted = sorted_params(params);
+    std::vector<CopyJob> jobs;
+    jobs.reserve(sorted.size());
+    try {
+        HeaderReader reader(mapped.data() + sizeof(kSnapshotMagic), mapped.size() - sizeof(kSnapshotMagic));
+        if (reader.u64() != kSnapshotVersion || reader.string() != fingerprint || reader.u64() != sorted.size()) {
+            return false;
+        }
+        for (const auto& [key, tensor] : sorted) {
+            if (reader.string() != key || reader.u64() != static_cast<uint64_t>(tensor->dtype()) ||
+                reader.u64() != static_cast<uint64_t>(tensor->ndim())) {
+                return false;
+            }
+            for (auto dim : tensor->shape()) {
+                if (reader.u64() != static_cast<uint64_t>(dim)) {
+                    return false;
+                }
+            }
+            const uint64_t offset = reader.u64();
+            const uint64_t bytes = reader.u64();
+            if (bytes != static_cast<uint64_t>(tensor->byte_size()) || offset > mapped.size() ||
+                bytes > mapped.size() - offset) {
+                return false;
+            }
+            jobs.push_back({path, mapped.data() + offset, tensor, static_cast<size_t>(bytes)});
+        }
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    
+    // Payloads are laid out back to back, so the workers' reads stay sequential per tensor
+    run_copy_jobs(jobs, device_id, options);
+    return true;
+}
+
+} // namespace turbomind_go
@@ -0,0 +1,48 @@
+#ifndef TURBOMIND_WEIGHT_LOADER_H
+#define TURBOMIND_WEIGHT_LOADER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "src/turbomind/core/tensor.h"
+
+namespace turbomind_go {
+
+namespace ft = turbomind;
+
+struct WeightLoadOptions {
+    std::string weights_dir;
+    int rank = 0;
+    bool per_rank_dirs = false;            // look under weights_dir/rank_<rank>/
+    int num_threads = 4;
+    size_t staging_bytes = 32 << 20;      // per staging buffer, two per thread
+    std::function<void(uint64_t)> on_bytes; // called with each chunk's size once it is on the GPU
+};
+
+// Total bytes a load of `params` will copy
+uint64_t weight_bytes(const ft::core::TensorMap& params);
+
+// Streams one raw file per parameter (named after its key) into `params`.
+// Files are memory-mapped and copied through double-buffered pinned staging
+// buffers, so page-ins on one buffer overlap the H2D copy of the other.
+// Throws std::ios_base::failure on missing or mis-sized files.
+void load_weights(ft::core::TensorMap& params, int device_id, const WeightLoadOptions& options);
+
+// Snapshot file for one rank inside snapshot_dir, derived from `fingerprint`
+std::string snapshot_path(const std::string& snapshot_dir, const std::string& fingerprint, int rank);
+
+// Writes every parameter of `params` into one versioned file at `path`, tagged with
+// `fingerprint`. The file is written under a temporary name and renamed into place.
+void save_snapshot(ft::core::TensorMap& params, int device_id, const std::string& path,
+                   const std::string& fingerprint);
+
+// Restores `params` from a snapshot written by save_snapshot with a single mapping
+// and large sequential reads. Returns false without touching `params` when the file
+// is missing, was written for a different fingerprint, or its layout no longer matches.
+bool load_snapshot(ft::core::TensorMap& params, int device_id, const std::string& path,
+                   const std::string& fingerprint, const WeightLoadOptions& options);
+
+} // namespace turbomind_go
+
+#endif // TURBOMIND_WEIGHT_LOADER_H
@@ -12,6 +12,10 @@ extern "C" {
 // Forward declarations
 typedef struct TurboMindModel TurboMindModel;
 typedef struct TurboMindModelInstance TurboMindModelInstance;
+typedef struct TurboMindInstancePool TurboMindInstancePool;
+typedef struct TurboMindTokenizer TurboMindTokenizer;
+typedef struct TurboMindDetokenizer TurboMindDetokenizer;
+typedef struct TurboMindGrammar TurboMindGrammar;
 
 // Data types (matching Python bindings)
 typedef enum {
@@ -38,17 +42,195 @@ typedef enum {
     TM_MEMORY_GPU
 } TurboMindMemoryType;
 
+// Error codes reported by turbomind_get_last_error_code
+typedef enum {
+    TM_OK = 0,
+    TM_ERROR_INVALID_ARGUMENT,
+    TM_ERROR_INVALID_STATE,   // e.g. feature not enabled, request not started
+    TM_ERROR_NOT_FOUND,
+    TM_ERROR_OUT_OF_MEMORY,
+    TM_ERROR_CUDA,
+    TM_ERROR_IO,
+    TM_ERROR_ENGINE,          // the engine rejected or failed a request
+    TM_ERROR_INTERNAL
+} TurboMindErrorCode;
+
+// Log levels for turbomind_enable_log
+typedef enum {
+    TM_LOG_DEBUG = 0,
+    TM_LOG_INFO,
+    TM_LOG_WARNING,
+    TM_LOG_ERROR
+} TurboMindLogLevel;
+
+typedef void (*TurboMindLogCallback)(void* user_data, TurboMindLogLevel level, const char* message);
+
+// Source languages for turbomind_compile_grammar
+typedef enum {
+    TM_GRAMMAR_REGEX = 0,
+    TM_GRAMMAR_JSON_SCHEMA
+} TurboMindGrammarKind;
+
+// How turbomind_encode reduces the hidden states of an input to one vector
+typedef enum {
+    TM_POOLING_LAST = 0, // final position, for causal embedding models
+    TM_POOLING_MEAN
+} TurboMindPooling;
+
 // Forward declarations for opaque types
 typedef struct TurboMindTensor TurboMindTensor;
+typedef struct TurboMindStream TurboMindStream;
+typedef struct TurboMindEvent TurboMindEvent;
+
+#define TURBOMIND_MAX_DIMS 8
+
+// Flat description of one input tensor for turbomind_build_inputs. The shape is
+// stored inline so an array of descriptors holds no pointers besides name and data.
+typedef struct {
+    const char* name;
+    void* data;                         // borrowed, must outlive the request
+    int64_t shape[TURBOMIND_MAX_DIMS];
+    int32_t ndim;
+    TurboMindDataType dtype;
+    TurboMindMemoryType memory_type;
+    int32_t device_id;
+} TurboMindTensorDesc;
+
+// Borrowed description of a tensor's buffer; see turbomind_get_output for lifetime
+typedef struct {
+    void* data;
+    int64_t shape[TURBOMIND_MAX_DIMS];
+    int32_t ndim;
+    TurboMindDataType dtype;
+    TurboMindMemoryType memory_type;
+    int32_t device_id;
+    size_t byte_size;
+} TurboMindTensorView;
+
+// One entry of a batched copy; bytes == 0 copies the whole tensor (sizes must match)
+typedef struct {
+    TurboMindTensor* dst;
+    TurboMindTensor* src;
+    size_t dst_offset;
+    size_t src_offset;
+    size_t bytes;
+} TurboMindCopyDesc;
+
+// Counters of a model's prefix cache (see turbomind_enable_prefix_cache)
+typedef struct {
+    size_t blocks;
+    size_t pinned_blocks;
+    uint64_t lookups;
+    uint64_t lookup_tokens;
+    uint64_t hit_tokens;
+} TurboMindPrefixCacheStats;
+
+// Counters of a model's session store (see turbomind_enable_session_offload)
+typedef struct {
+    size_t sessions;   // open sessions with a known history
+    size_t suspended;
+    size_t spilled;    // suspended sessions whose history is on disk
+    size_t host_bytes; // history bytes of suspended sessions in host memory
+} TurboMindSessionOffloadStats;
+
+// Per-request timestamps in nanoseconds of the monotonic clock (0 = not reached yet)
+typedef struct {
+    int64_t submit_ns;        // request handed to the wrapper
+    int64_t scheduled_ns;     // handed to an instance (after any pool queueing)
+    int64_t first_token_ns;
+    int64_t finish_ns;        // terminal status reached
+    int32_t prompt_tokens;
+    int32_t generated_tokens;
+    // Progress updates after the first token; an update may carry several tokens
+    int32_t decode_steps;
+    int64_t decode_min_ns;    // shortest / longest / summed gap between updates
+    int64_t decode_max_ns;
+    int64_t decode_total_ns;
+} TurboMindRequestTimings;
+
+// Process-wide latency histograms of completed requests
+#define TURBOMIND_HISTOGRAM_BUCKETS 32
+typedef enum {
+    TM_HISTOGRAM_QUEUE = 0,     // submit -> scheduled
+    TM_HISTOGRAM_TTFT,          // submit -> first token
+    TM_HISTOGRAM_DECODE_TOKEN,  // mean time per generated token after the first
+    TM_HISTOGRAM_E2E,           // submit -> finish
+    TM_HISTOGRAM_KIND_COUNT
+} TurboMindHistogramKind;
+
+// buckets[i] counts samples in [2^i, 2^(i+1)) microseconds; bucket 0 also holds
+// anything shorter and the last bucket anything longer
+typedef struct {
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t buckets[TURBOMIND_HISTOGRAM_BUCKETS];
+} TurboMindHistogram;
+
+// Snapshot of a model's serving state for turbomind_get_metrics. Fields the
+// engine does not expose are -1.
+typedef struct {
+    int64_t active_requests;
+    int64_t queued_requests;
+    // Requests past their first token; the engine's own decode batch is not
+    // visible, this is the number of sequences it is decoding for the wrapper
+    int64_t decode_batch_size;
+    uint64_t completed_requests;
+    uint64_t failed_requests;
+    uint64_t cancelled_requests;
+    uint64_t prompt_tokens;
+    uint64_t generated_tokens;
+    double tokens_per_second; // generated since the previous call (0 on the first)
+    int64_t kv_blocks_used;
+    int64_t kv_blocks_free;
+    double prefix_cache_hit_rate; // hit / looked-up prompt tokens, 0 when disabled
+    int64_t gpu_memory_total;     // device-wide bytes, including the engine's KV reservation
+    int64_t gpu_memory_used;
+    uint64_t pinned_host_in_use;
+    uint64_t pinned_host_cached;
+    uint64_t draft_tokens_proposed; // speculative decoding, see turbomind_verify_draft
+    uint64_t draft_tokens_accepted;
+    uint64_t deadline_misses;    // requests dropped from a pool queue at their deadline
+    uint64_t preempted_sessions; // background sessions suspended by a pool's scheduler
+} TurboMindMetrics;
 
-// Session parameters
+// Scheduling class of a pool request. A class is served only once every class
+// before it has no queued requests. Prefills the wrapper issues itself (encode,
+// score, pool session resume, pinned prefixes) run as TM_PRIORITY_BACKGROUND.
+// The sequence of a pinned prefix is never preempted.
+typedef enum {
+    TM_PRIORITY_INTERACTIVE = 0,
+    TM_PRIORITY_BATCH,
+    TM_PRIORITY_BACKGROUND,
+    TM_PRIORITY_COUNT
+} TurboMindPriority;
+
+// Session parameters. priority and deadline_ms only apply to pool submissions.
 typedef struct {
     uint64_t id;
     int step;
     bool start_flag;
     bool end_flag;
+    TurboMindPriority priority;
+    // Start deadline in ms after submission; a request still queued then is
+    // cancelled and counted in deadline_misses. Within a class, earlier
+    // deadlines go first and requests without one (0) go last.
+    uint32_t deadline_ms;
 } TurboMindSession;
 
+// Admission control of an instance pool; all zero, the default, disables it
+typedef struct {
+    // Slots only interactive requests may take; less than the pool size
+    int reserved_interactive_slots;
+    // Prompt tokens batch and background requests may start per tick_ms,
+    // 0 for no cap. The first request of a tick is always let through.
+    int64_t prefill_tokens_per_tick;
+    int tick_ms;
+    // Once this many interactive requests queue, idle open background sessions
+    // are suspended to free their KV blocks (needs session offload, 0 = never).
+    // Their next request rebuilds them by prefilling the history first.
+    int preempt_queue_depth;
+} TurboMindSchedulingConfig;
+
 // Generation configuration
 typedef struct {
     int max_new_tokens;
@@ -84,6 +266,30 @@ typedef struct TurboMindTensorMap TurboMindTensorMap;
 
 // Forward declarations for opaque types
 typedef struct TurboMindForwardResult TurboMindForwardResult;
+typedef struct TurboMindBatchResult TurboMindBatchResult;
+typedef struct TurboMindGenerationConfigHandle TurboMindGenerationConfigHandle;
+
+// Streaming token ring for requests submitted with stream_output.
+// Single producer (engine callback) / single consumer (caller), allocated in pinned
+// host memory so it can be read directly without API calls. The producer writes
+// entries and then publishes `head` with release semantics; the consumer reads
+// entries in [tail, head) and then advances `tail`. Indices grow monotonically and
+// map to slot (index & (capacity - 1)). `finished` is set after the last token.
+typedef struct {
+    volatile uint64_t head;
+    uint8_t head_pad[56];
+    volatile uint64_t tail;
+    uint8_t tail_pad[56];
+    volatile uint32_t finished;
+    uint32_t capacity;          // power of two, at least max_new_tokens
+    int32_t* token_ids;         // [capacity]
+    float* logprobs;            // [capacity], NaN when logprobs were not requested
+} TurboMindTokenStream;
+
+// Progress/completion callback for asynchronous forward. Invoked from an engine
+// thread on every progress update and once more with a terminal status.
+// The callback must not block and must not destroy the forward result.
+typedef void (*TurboMindForwardCallback)(void* user_data, TurboMindRequestStatus status, int seq_len);
 
 // API Functions
 
@@ -96,19 +302,87 @@ void turbomind_create_shared_weights(TurboMindModel* model, int device_id, int r
 void turbomind_process_weights(TurboMindModel* model, int device_id, int rank);
 void turbomind_create_engine(TurboMindModel* model, int device_id, int rank);
 
+// Runs the setup steps for every local device in parallel threads (rank =
+// node_id * device_count + device). Each rank creates, loads (when a weight source
+// is set) and processes its weights independently; engines are then created on all
+// ranks together. device_count <= 0 uses tensor_para_size * pipeline_para_size.
+// Returns 0 on success, -1 on error.
+int turbomind_initialize_all_ranks(TurboMindModel* model, int node_id, int device_count);
+
+// Weight loading progress in bytes copied to the GPU (total grows as ranks start loading)
+typedef void (*TurboMindProgressCallback)(void* user_data, uint64_t bytes_done, uint64_t bytes_total);
+
+// Weight source: weights_dir holds one raw file per parameter, named after its key in
+// the model's parameter map (under rank_<n>/ when there is more than one rank). Files
+// are memory-mapped and streamed to the GPU through pinned staging buffers by
+// num_threads workers per rank. Returns 0 on success, -1 on error.
+int turbomind_set_weight_source(TurboMindModel* model, const char* weights_dir, int num_threads,
+                                TurboMindProgressCallback progress, void* user_data);
+// Loads one rank from the weight source (call between create_shared_weights and process_weights)
+int turbomind_load_weights(TurboMindModel* model, int device_id, int rank);
+void turbomind_get_load_progress(TurboMindModel* model, uint64_t* bytes_done, uint64_t* bytes_total);
+
+// Weight snapshots: with a snapshot directory set, initialize_all_ranks restores each
+// rank from a single versioned file keyed by model dir, config, weight type, rank,
+// parallel sizes and GPU arch, and falls back to the weight source (then writes the
+// snapshot) when it is missing or stale. NULL disables snapshots. Returns 0 or -1.
+int turbomind_set_snapshot_dir(TurboMindModel* model, const char* snapshot_dir);
+// Writes the snapshot of one rank now (after its weights are populated, before process_weights)
+int turbomind_save_snapshot(TurboMindModel* model, int device_id, int rank);
+
 // Model instance management
 TurboMindModelInstance* turbomind_create_model_instance(TurboMindModel* model, int device_id);
 void turbomind_destroy_model_instance(TurboMindModelInstance* instance);
 
+// Instance pool: owns num_instances model instances on one device. Submissions are
+// accepted from any thread and run on a free instance, or queue until one frees up.
+TurboMindInstancePool* turbomind_create_instance_pool(TurboMindModel* model, int device_id, int num_instances);
+void turbomind_destroy_instance_pool(TurboMindInstancePool* pool);
+// Replaces the pool's admission control settings (see TurboMindSchedulingConfig);
+// returns -1 if they are invalid
+int turbomind_pool_set_scheduling(TurboMindInstancePool* pool, const TurboMindSchedulingConfig* config);
+// Chunked prefill: the model's pools prefill host input_ids longer than
+// chunk_tokens in chunks of that size, one engine step each, with the decode
+// steps of other sessions in between. This bounds how long a long prompt delays
+// their next token. Requests with other positional inputs (embeddings) or with
+// logits/hidden states for every position run whole. Starts from the config's
+// prefill_chunk_size; 0 disables. Applies to requests started afterwards.
+// Returns 0, or -1 if chunk_tokens is negative.
+int turbomind_set_prefill_chunk_size(TurboMindModel* model, int chunk_tokens);
+int turbomind_get_prefill_chunk_size(TurboMindModel* model);
+
 // Tensor management
 TurboMindTensor* turbomind_create_tensor(void* data, int64_t* shape, int ndim, TurboMindDataType dtype, TurboMindMemoryType memory_type, int device_id);
+// Allocates a TM_MEMORY_CPU_PINNED tensor from the pinned pool and returns its buffer
+// in *data for the caller to fill. The tensor owns the buffer; it goes back to the
+// pool after the tensor and every request using it are done.
+TurboMindTensor* turbomind_create_pinned_tensor(int64_t* shape, int ndim, TurboMindDataType dtype, int device_id,
+                                               void** data);
 void turbomind_destroy_tensor(TurboMindTensor* tensor);
 
+// Pinned host memory pool: page-locked buffers bucketed into power-of-two size classes
+// and reused across requests. Released buffers stay cached up to a limit (1 GiB by
+// default). Buffers from turbomind_alloc_pinned must outlive any tensor wrapping them.
+void* turbomind_alloc_pinned(size_t bytes);
+void turbomind_release_pinned(void* ptr);
+void turbomind_set_pinned_pool_limit(size_t bytes);
+void turbomind_trim_pinned_pool();
+void turbomind_get_pinned_pool_stats(size_t* cached_bytes, size_t* in_use_bytes);
+
 // TensorMap management
 TurboMindTensorMap* turbomind_create_tensor_map();
 void turbomind_destroy_tensor_map(TurboMindTensorMap* tensor_map);
+// Builds a complete input map in one call from an arena owned by the instance (or
+// pool) and recycled across requests. Destroy it with turbomind_destroy_tensor_map,
+// which hands it back to the arena; maps must not outlive their instance or pool.
+TurboMindTensorMap* turbomind_build_inputs(TurboMindModelInstance* instance, const TurboMindTensorDesc* descs,
+                                           int count);
+TurboMindTensorMap* turbomind_pool_build_inputs(TurboMindInstancePool* pool, const TurboMindTensorDesc* descs,
+                                                int count);
 int turbomind_tensor_map_set(TurboMindTensorMap* tensor_map, const char* key, TurboMindTensor* tensor);
+// Returns a new tensor sharing the buffer of the map entry (destroy it with turbomind_destroy_tensor)
 TurboMindTensor* turbomind_tensor_map_get(TurboMindTensorMap* tensor_map, const char* key);
+int turbomind_tensor_view(TurboMindTensor* tensor, TurboMindTensorView* view);
 
 // Forward inference
 TurboMindForwardResult* turbomind_forward(TurboMindModelInstance* instance, 
@@ -116,24 +390,284 @@ TurboMindForwardResult* turbomind_forward(TurboMindModelInstance* instance,
                                          TurboMindSession* session,
                                          TurboMindGenerationConfig* gen_config,
                                          bool stream_output);
+TurboMindForwardResult* turbomind_forward_async(TurboMindModelInstance* instance,
+                                               TurboMindTensorMap* input_tensors,
+                                               TurboMindSession* session,
+                                               TurboMindGenerationConfig* gen_config,
+                                               bool stream_output,
+                                               TurboMindForwardCallback callback,
+                                               void* user_data);
+TurboMindForwardResult* turbomind_pool_forward_async(TurboMindInstancePool* pool,
+                                                    TurboMindTensorMap* input_tensors,
+                                                    TurboMindSession* session,
+                                                    TurboMindGenerationConfig* gen_config,
+                                                    bool stream_output,
+                                                    TurboMindForwardCallback callback,
+                                                    void* user_data);
 void turbomind_destroy_forward_result(TurboMindForwardResult* result);
 
+// Generation config handles: an immutable, refcounted, pre-converted config. Creating
+// a config equal to a live one (same fields and id array contents) returns that handle
+// with an extra reference. The caller's arrays are not referenced after create.
+TurboMindGenerationConfigHandle* turbomind_create_generation_config(const TurboMindGenerationConfig* gen_config);
+TurboMindGenerationConfigHandle* turbomind_retain_generation_config(TurboMindGenerationConfigHandle* config);
+void turbomind_release_generation_config(TurboMindGenerationConfigHandle* config);
+// Forward variants taking a handle; the handle may be released once the call returns
+TurboMindForwardResult* turbomind_forward_with_config(TurboMindModelInstance* instance,
+                                                     TurboMindTensorMap* input_tensors,
+                                                     TurboMindSession* session,
+                                                     TurboMindGenerationConfigHandle* config,
+                                                     bool stream_output,
+                                                     TurboMindForwardCallback callback,
+                                                     void* user_data);
+TurboMindForwardResult* turbomind_pool_forward_with_config(TurboMindInstancePool* pool,
+                                                          TurboMindTensorMap* input_tensors,
+                                                          TurboMindSession* session,
+                                                          TurboMindGenerationConfigHandle* config,
+                                                          bool stream_output,
+                                                          TurboMindForwardCallback callback,
+                                                          void* user_data);
+
+// Submits `count` requests to the pool in one call. gen_config_count is 1 (one config
+// shared by the whole batch) or count; each distinct config is converted once. The
+// batch owns its per-request results, which work with every turbomind_*_forward
+// accessor but must not be destroyed individually. Returns NULL on error.
+TurboMindBatchResult* turbomind_forward_batch(TurboMindInstancePool* pool,
+                                             int count,
+                                             TurboMindTensorMap** input_tensors,
+                                             TurboMindSession* sessions,
+                                             TurboMindGenerationConfig** gen_configs,
+                                             int gen_config_count,
+                                             bool stream_output);
+// Same as turbomind_forward_batch with generation config handles
+TurboMindBatchResult* turbomind_forward_batch_with_configs(TurboMindInstancePool* pool,
+                                                          int count,
+                                                          TurboMindTensorMap** input_tensors,
+                                                          TurboMindSession* sessions,
+                                                          TurboMindGenerationConfigHandle** configs,
+                                                          int config_count,
+                                                          bool stream_output);
+int turbomind_batch_size(TurboMindBatchResult* batch);
+TurboMindForwardResult* turbomind_batch_get_result(TurboMindBatchResult* batch, int index);
+// Returns 0 when every request finished (check each status), 1 on timeout, -1 on error
+int turbomind_wait_batch(TurboMindBatchResult* batch, int64_t timeout_ms);
+int turbomind_batch_finished_count(TurboMindBatchResult* batch);
+void turbomind_cancel_batch(TurboMindBatchResult* batch);
+void turbomind_destroy_batch_result(TurboMindBatchResult* batch);
+
+// Forward request handle
+TurboMindRequestStatus turbomind_get_forward_status(TurboMindForwardResult* result, int* seq_len);
+// Prompt tokens served from the prefix cache (0 when caching is off or missed)
+int turbomind_get_prefix_hit_length(TurboMindForwardResult* result);
+int turbomind_get_request_timings(TurboMindForwardResult* result, TurboMindRequestTimings* timings);
+// Lock-free snapshot; counters are read one by one, so concurrent samples may be partly included
+int turbomind_get_latency_histogram(TurboMindHistogramKind kind, TurboMindHistogram* histogram);
+void turbomind_reset_latency_histograms();
+// Returns 0 when the request finished, 1 on timeout (timeout_ms < 0 waits forever), -1 on error
+int turbomind_wait_forward(TurboMindForwardResult* result, int64_t timeout_ms);
+// Returns an eventfd (owned by the result) that becomes readable on every progress update
+int turbomind_get_forward_event_fd(TurboMindForwardResult* result);
+// Cancels the request whether it is still queued in a pool or running
+void turbomind_cancel_forward(TurboMindForwardResult* result);
+// Token ring of a streaming request (owned by the result), NULL when stream_output is off
+TurboMindTokenStream* turbomind_get_token_stream(TurboMindForwardResult* result);
+
+// Output tensors (output_ids, sequence_length, logprob_*, logits, ...). The view borrows
+// the engine's buffer and stays valid until the result is destroyed; read it once the
+// request finished. Only the first seq_len entries of output_ids are meaningful.
+// Returns 0, or -1 when the request has not started or the output does not exist.
+int turbomind_get_output(TurboMindForwardResult* result, const char* key, TurboMindTensorView* view);
+// Queues a copy of the first `bytes` of an output into dst (pinned memory for a truly
+// asynchronous D2H copy) on a stream owned by the result. Returns 0 or -1.
+int turbomind_copy_output_async(TurboMindForwardResult* result, const char* key, void* dst, size_t bytes);
+// Waits until every copy queued with turbomind_copy_output_async has landed
+int turbomind_sync_output_copies(TurboMindForwardResult* result);
+
 // Session management
 void turbomind_end_session(TurboMindModelInstance* instance, uint64_t session_id);
 void turbomind_cancel_request(TurboMindModelInstance* instance);
+void turbomind_pool_end_session(TurboMindInstancePool* pool, uint64_t session_id);
+
+// Session offload. Once enabled, the wrapper records the token history of every
+// open session whose inputs are in host memory. Suspending an idle session ends
+// its engine sequence, freeing its KV blocks, and keeps the history in host
+// memory (histories past host_limit_bytes spill to spill_dir, if set). Resuming
+// prefills the history into a new sequence; wait for the returned result before
+// the next step. Requests for a suspended session fail. Call before creating
+// instances or pools.
+int turbomind_enable_session_offload(TurboMindModel* model, size_t host_limit_bytes, const char* spill_dir);
+void turbomind_get_session_offload_stats(TurboMindModel* model, TurboMindSessionOffloadStats* stats);
+int turbomind_suspend_session(TurboMindModelInstance* instance, uint64_t session_id);
+int turbomind_pool_suspend_session(TurboMindInstancePool* pool, uint64_t session_id);
+TurboMindForwardResult* turbomind_resume_session(TurboMindModelInstance* instance, uint64_t session_id);
+TurboMindForwardResult* turbomind_pool_resume_session(TurboMindInstancePool* pool, uint64_t session_id);
+
+// Prefix caching. The engine reuses KV blocks of shared prompt prefixes when its
+// config sets enable_prefix_caching; this enables the wrapper's index of those
+// prefixes, which reports hit lengths per request. block_len must match the
+// engine's cache_block_seq_len. Call before creating instances or pools.
+int turbomind_enable_prefix_cache(TurboMindModel* model, int block_len, size_t max_blocks);
+void turbomind_get_prefix_cache_stats(TurboMindModel* model, TurboMindPrefixCacheStats* stats);
+// Prefills `token_ids` and keeps its KV blocks resident under `name` until evicted.
+// Blocks until the prefill finishes; returns 0 on success, -1 on error.
+int turbomind_pool_pin_prefix(TurboMindInstancePool* pool, const char* name, const int* token_ids, int count);
+// Releases a pinned prefix; returns -1 if `name` is not pinned
+int turbomind_pool_evict_prefix(TurboMindInstancePool* pool, const char* name);
+void turbomind_pool_cancel_all(TurboMindInstancePool* pool);
+
+// Speculative decoding with a small draft model that shares the target's
+// vocabulary. Each step the draft proposes up to num_draft_tokens tokens
+// greedily, then one target request verifies them all: its input is the tokens
+// the target has not seen yet followed by the proposal, submitted with
+// output_logits so the logits cover every input position. The draft must
+// outlive the model. Returns 0, or -1 when the vocabularies differ.
+int turbomind_attach_draft_model(TurboMindModel* model, TurboMindModel* draft, int num_draft_tokens);
+// The attached draft model (NULL when there is none) and its proposal length
+TurboMindModel* turbomind_get_draft_model(TurboMindModel* model, int* num_draft_tokens);
+// Checks the `count` draft tokens that end the input of a completed verification
+// request against the target's greedy choices. Writes the accepted prefix and
+// then the target's own next token to out_ids[0, count], and returns the number
+// written (accepted + 1), or -1. Counts into the model's draft_tokens_* metrics.
+int turbomind_verify_draft(TurboMindForwardResult* result, const int32_t* draft_ids, int count, int32_t* out_ids);
+
+// Width of turbomind_encode's output rows: `hidden_units` in the model's
+// config (config.yaml in the model directory when none was given), or -1
+int turbomind_get_hidden_size(TurboMindInstancePool* pool);
+// Embeddings. Prefills `count` inputs as one batch without generating, input i
+// being ids[offsets[i], offsets[i + 1]), and pools each input's last hidden
+// states into `out`, a host [count, turbomind_get_hidden_size] array of
+// out_dtype (TM_TYPE_FP16 or TM_TYPE_FP32). Blocks until every input is done;
+// returns 0, or -1 on error. Mean pooling needs every position recomputed, so
+// use it on engines without enable_prefix_caching.
+int turbomind_encode(TurboMindInstancePool* pool, const int32_t* ids, const int64_t* offsets, int count,
+                     TurboMindPooling pooling, TurboMindDataType out_dtype, void* out);
+// Scoring. Prefills `count` (prompt, continuation) inputs as one batch without
+// generating, input i being ids[offsets[i], offsets[i + 1]) with its first
+// prompt_lens[i] tokens the prompt. Writes the log-probability of every
+// continuation token given the tokens before it to `logprobs`, input after
+// input (offsets[count] - sum(prompt_lens) floats). Only those rows of the
+// logits are read back. Like mean pooling, this needs an engine without
+// enable_prefix_caching. Blocks; returns 0, or -1 on error.
+int turbomind_score(TurboMindInstancePool* pool, const int32_t* ids, const int64_t* offsets,
+                    const int32_t* prompt_lens, int count, float* logprobs);
+
+// Fills `metrics` from counters updated on the request path; gpu memory is
+// read for device_id. Cheap enough to scrape every second.
+int turbomind_get_metrics(TurboMindModel* model, int device_id, TurboMindMetrics* metrics);
+
+// Tracing. NVTX ranges (tm.*) are always emitted around model setup, forward
+// submission, tensor copies and session end. The recorder below is opt-in: it
+// keeps the last `capacity` spans, including per-request queue/prefill/decode
+// phases, and dumps them as Chrome trace JSON.
+int turbomind_enable_trace(size_t capacity);
+void turbomind_disable_trace(); // stops recording, keeps spans for dumping
+int turbomind_dump_trace(const char* path);
+// Clock of every recorded timestamp, so callers can add their own spans
+int64_t turbomind_trace_clock_ns();
+void turbomind_trace_record(const char* name, uint64_t session_id, int64_t start_ns, int64_t end_ns);
+
+// Tokenizer. A native BPE tokenizer for model_dir/tokenizer.json (SentencePiece
+// style with byte fallback, or byte-level with GPT-2 / Llama 3 / Qwen 2 splits);
+// other tokenizers fail to load. Thread-safe once created.
+TurboMindTokenizer* turbomind_create_tokenizer(const char* model_dir);
+void turbomind_destroy_tokenizer(TurboMindTokenizer* tokenizer);
+// The model's tokenizer, loaded from its model_dir on first use and owned by the model
+TurboMindTokenizer* turbomind_get_tokenizer(TurboMindModel* model);
+// Upper bound on the ids of `length` bytes of text, BOS included
+size_t turbomind_tokenizer_max_tokens(size_t length);
+// Writes the ids of text[0, length) to ids[0, capacity), e.g. straight into a
+// pinned input_ids buffer. Returns the number of ids, which exceeds capacity
+// when the buffer was too small (nothing past capacity is written), or -1.
+int64_t turbomind_tokenize(TurboMindTokenizer* tokenizer, const char* text, size_t length, bool add_bos,
+                           int32_t* ids, size_t capacity);
+// Writes the text of `ids` to text[0, capacity), unterminated. Returns its length,
+// which exceeds capacity when the text was truncated, or -1.
+int64_t turbomind_detokenize(TurboMindTokenizer* tokenizer, const int32_t* ids, size_t count, bool skip_special,
+                             char* text, size_t capacity);
+int turbomind_tokenizer_vocab_size(TurboMindTokenizer* tokenizer);
+// -1 when the tokenizer has no such token
+int turbomind_tokenizer_bos_id(TurboMindTokenizer* tokenizer);
+int turbomind_tokenizer_eos_id(TurboMindTokenizer* tokenizer);
+
+// Incremental detokenizer for one streaming request. Returns only the text newly
+// completed by each step, always valid UTF-8: a character split across tokens
+// is held back until its last byte arrives, so a step costs O(new tokens).
+// The tokenizer must outlive it.
+TurboMindDetokenizer* turbomind_create_detokenizer(TurboMindTokenizer* tokenizer, bool skip_special);
+void turbomind_destroy_detokenizer(TurboMindDetokenizer* detokenizer);
+// Decodes `ids` and returns the new text (unterminated, *length bytes). The buffer
+// belongs to the detokenizer and stays valid until its next call. With finish set,
+// a held-back incomplete character is flushed as U+FFFD. NULL on error.
+const char* turbomind_detokenize_step(TurboMindDetokenizer* detokenizer, const int32_t* ids, size_t count,
+                                      bool finish, size_t* length);
+// Same, for the entries waiting in a token ring: consumes [tail, head) and advances
+// tail, so it replaces reading the ring directly. Sets *finished (and flushes) once
+// the request finished and the ring is drained.
+const char* turbomind_detokenize_stream(TurboMindDetokenizer* detokenizer, TurboMindTokenStream* stream,
+                                        size_t* length, bool* finished);
+
+// Constrained decoding. A grammar is a regular expression, or the JSON texts a
+// JSON schema accepts, compiled into an automaton over the tokenizer's vocabulary.
+// Compiled grammars are cached on the tokenizer, so requests with the same source
+// share one, and the allowed tokens of each state are computed once and reused.
+// States are small integers; the engine applies a state's bad_ids on the GPU at
+// the next decode step. Thread-safe; handles are released independently.
+TurboMindGrammar* turbomind_compile_grammar(TurboMindTokenizer* tokenizer, TurboMindGrammarKind kind,
+                                            const char* source, size_t length);
+void turbomind_release_grammar(TurboMindGrammar* grammar);
+int32_t turbomind_grammar_start(TurboMindGrammar* grammar);
+// State after `token`, -1 when the grammar does not allow it (or on error)
+int32_t turbomind_grammar_advance(TurboMindGrammar* grammar, int32_t state, int32_t token);
+// Whether the text so far is a complete match, so EOS may follow
+bool turbomind_grammar_accepting(TurboMindGrammar* grammar, int32_t state);
+// Writes the tokens allowed in `state` (EOS aside) to ids[0, capacity) and returns
+// their number, which exceeds capacity when the buffer was too small, or -1
+int64_t turbomind_grammar_allowed_ids(TurboMindGrammar* grammar, int32_t state, int32_t* ids, size_t capacity);
+// Same for every other token of the vocabulary, EOS included unless the state is
+// accepting: the bad_ids for the next step. At most the vocabulary size.
+int64_t turbomind_grammar_bad_ids(TurboMindGrammar* grammar, int32_t state, int32_t* ids, size_t capacity);
 
 // Model information
 int turbomind_get_tensor_para_size(TurboMindModel* model);
 int turbomind_get_pipeline_para_size(TurboMindModel* model);
 
 // Utility functions
+// Errors are per thread: these report the last failure on the calling thread.
+// The message stays valid until the thread's next failing call.
 const char* turbomind_get_last_error();
+TurboMindErrorCode turbomind_get_last_error_code();
+void turbomind_clear_last_error();
+// Off by default. Messages are delivered from a background thread to callback
+// (stderr when NULL); beyond max_per_second (<= 0 for no limit) they are dropped
+// and counted. Every error set through the API is logged at TM_LOG_ERROR.
+void turbomind_enable_log(TurboMindLogCallback callback, void* user_data, TurboMindLogLevel min_level,
+                          int max_per_second);
+void turbomind_disable_log();
 void turbomind_set_device(int device_id);
 
 // Helper functions for tensor operations
 size_t turbomind_get_tensor_size(TurboMindTensor* tensor);
+// Blocks only the calling thread (stream-ordered on its per-thread stream)
 void turbomind_copy_tensor(TurboMindTensor* dst, TurboMindTensor* src);
 
+// Streams: create owns a non-blocking stream, wrap borrows an existing cudaStream_t
+TurboMindStream* turbomind_create_stream(int device_id);
+TurboMindStream* turbomind_wrap_stream(void* cuda_stream, int device_id);
+void turbomind_destroy_stream(TurboMindStream* stream);
+int turbomind_stream_synchronize(TurboMindStream* stream);
+int turbomind_stream_wait_event(TurboMindStream* stream, TurboMindEvent* event);
+
+// Asynchronous copies with cudaMemcpyAsync on `stream` (NULL uses the caller's
+// per-thread stream). The batched form submits every copy at once and merges
+// adjacent ranges. The returned event keeps the tensors alive until destroyed;
+// destroying it waits for the copies. Returns NULL on error.
+TurboMindEvent* turbomind_copy_tensor_async(TurboMindTensor* dst, TurboMindTensor* src, TurboMindStream* stream);
+TurboMindEvent* turbomind_copy_tensors_async(const TurboMindCopyDesc* copies, int count, TurboMindStream* stream);
+// Returns 1 when the copies finished, 0 while pending, -1 on error
+int turbomind_event_query(TurboMindEvent* event);
+int turbomind_event_synchronize(TurboMindEvent* event);
+void turbomind_destroy_event(TurboMindEvent* event);
+
 #ifdef __cplusplus
 }
 #endif
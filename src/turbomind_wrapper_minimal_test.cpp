@@ -1,29 +1,109 @@
 #include "turbomind_wrapper.hpp"
+#include "turbomind_grammar.h"
+#include "turbomind_pooling.h"
+#include "turbomind_prefix_cache.h"
+#include "turbomind_tokenizer.h"
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <memory>
+#include <cstdlib>
+#include <cstdio>
 #include <cstring>
+#include <deque>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <sstream>
+#include <chrono>
 
-// Simple test implementation without complex dependencies
-static std::string g_last_error;
+// Simple test implementation without complex dependencies. Also serves as the
+// CPU-only mock backend (TURBOMIND_GO_MOCK_BACKEND) for wrapper benchmarks,
+// configured from the environment on first use:
+//   TURBOMIND_MOCK_VERBOSE=0         silence the per-call progress output
+//   TURBOMIND_MOCK_OUTPUT_TOKENS=N   generate N tokens per request (default: 10 * session id),
+//                                    at most max_new_tokens
+struct MockConfig {
+    bool verbose = true;
+    int output_tokens = 0;
+};
+
+static const MockConfig& mock_config() {
+    static const MockConfig config = [] {
+        MockConfig c;
+        if (const char* verbose = std::getenv("TURBOMIND_MOCK_VERBOSE")) {
+            c.verbose = std::strcmp(verbose, "0") != 0;
+        }
+        if (const char* tokens = std::getenv("TURBOMIND_MOCK_OUTPUT_TOKENS")) {
+            c.output_tokens = std::max(std::atoi(tokens), 0);
+        }
+        return c;
+    }();
+    return config;
+}
+
+// Progress output; a stream without a buffer discards writes before formatting
+static std::ostream& mock_out() {
+    static std::ostream discard(nullptr);
+    return mock_config().verbose ? std::cout : discard;
+}
+
+static thread_local std::string t_last_error;
+static thread_local TurboMindErrorCode t_last_error_code = TM_OK;
 
-static void set_last_error(const std::string& error) {
-    g_last_error = error;
-    std::cerr << "Error: " << error << std::endl;
+// Mock log sink: synchronous, no rate limit
+static TurboMindLogCallback g_log_callback = nullptr;
+static void* g_log_user_data = nullptr;
+static bool g_log_enabled = false;
+
+static void set_last_error(const std::string& error, TurboMindErrorCode code) {
+    t_last_error = error;
+    t_last_error_code = code;
+    if (g_log_enabled) {
+        if (g_log_callback) {
+            g_log_callback(g_log_user_data, TM_LOG_ERROR, error.c_str());
+        } else {
+            std::cerr << "Error: " << error << std::endl;
+        }
+    }
 }
 
 // Minimal struct implementations for testing
+// The tokenizer is plain C++, so the mock uses the real one
+struct TurboMindTokenizer {
+    std::unique_ptr<turbomind_go::Tokenizer> tokenizer;
+    turbomind_go::GrammarCache grammars;
+};
+
+struct TurboMindDetokenizer {
+    turbomind_go::StreamDecoder decoder;
+    std::string text; // output of the last step
+};
+
+struct TurboMindGrammar {
+    std::shared_ptr<const turbomind_go::TokenGrammar> grammar;
+};
+
 struct TurboMindModel {
     std::string model_dir;
+    std::string weights_dir;
+    std::string snapshot_dir;
+    std::shared_ptr<turbomind_go::PrefixCache> prefix_cache; // null while prefix caching is off
+    bool session_offload = false;
+    std::map<uint64_t, bool> suspended_sessions;
     bool initialized = false;
+    std::mutex tokenizer_mutex;
+    std::unique_ptr<TurboMindTokenizer> tokenizer;
+    TurboMindModel* draft = nullptr;
+    int num_draft_tokens = 0;
+    int prefill_chunk_tokens = 0; // the mock never reads the config
     
     TurboMindModel(const std::string& dir, const std::string& config, const std::string& weight_type) 
         : model_dir(dir) {
-        std::cout << "Created model with dir: " << dir << std::endl;
+        mock_out() << "Created model with dir: " << dir << std::endl;
         
         // Check if model directory exists (for better error handling)
         struct stat info;
@@ -35,24 +115,18 @@ struct TurboMindModel {
     }
 };
 
-struct TurboMindModelInstance {
-    TurboMindModel* model;
-    int device_id;
-    
-    TurboMindModelInstance(TurboMindModel* m, int dev_id) : model(m), device_id(dev_id) {
-        std::cout << "Created model instance on device: " << device_id << std::endl;
-    }
-};
-
 struct TurboMindTensor {
     std::vector<int64_t> shape;
     TurboMindDataType dtype;
     TurboMindMemoryType memory_type;
     size_t size_bytes;
+    void* data;
+    int device_id;
+    std::shared_ptr<void> owned; // buffer of pinned tensors
     
-    TurboMindTensor(void* data, int64_t* shape_ptr, int ndim, TurboMindDataType dt, 
-                    TurboMindMemoryType mt, int device_id) 
-        : dtype(dt), memory_type(mt) {
+    TurboMindTensor(void* data_ptr, int64_t* shape_ptr, int ndim, TurboMindDataType dt, 
+                    TurboMindMemoryType mt, int dev_id) 
+        : dtype(dt), memory_type(mt), data(data_ptr), device_id(dev_id) {
         shape.assign(shape_ptr, shape_ptr + ndim);
         
         // Calculate size
@@ -69,35 +143,191 @@ struct TurboMindTensor {
             default: size_bytes *= 4; break;
         }
         
-        std::cout << "Created tensor with " << ndim << " dimensions, size: " << size_bytes << " bytes" << std::endl;
+        mock_out() << "Created tensor with " << ndim << " dimensions, size: " << size_bytes << " bytes" << std::endl;
     }
 };
 
+struct TurboMindStream {
+    int device_id;
+};
+
+struct TurboMindEvent {
+};
+
+struct TensorMapArena;
+
 struct TurboMindTensorMap {
     std::map<std::string, std::shared_ptr<TurboMindTensor>> tensors;
+    TensorMapArena* arena = nullptr; // set for maps built by turbomind_build_inputs
     
     TurboMindTensorMap() {
-        std::cout << "Created tensor map" << std::endl;
+        mock_out() << "Created tensor map" << std::endl;
     }
 };
 
+// Recycles input maps like the real backend's arena. Mock requests complete
+// within the forward call, so a slot is free as soon as its handle is destroyed.
+struct TensorMapArena {
+    struct Slot {
+        TurboMindTensorMap map;
+        bool handed_out = false;
+    };
+    
+    std::mutex mutex;
+    std::deque<Slot> slots; // stable addresses
+    
+    TurboMindTensorMap* acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& slot : slots) {
+            if (!slot.handed_out) {
+                slot.handed_out = true;
+                return &slot.map;
+            }
+        }
+        auto& slot = slots.emplace_back();
+        slot.map.arena = this;
+        slot.handed_out = true;
+        return &slot.map;
+    }
+    
+    void release(TurboMindTensorMap* map) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& slot : slots) {
+            if (&slot.map == map) {
+                slot.handed_out = false;
+                return;
+            }
+        }
+    }
+};
+
+struct TurboMindModelInstance {
+    TurboMindModel* model;
+    int device_id;
+    TensorMapArena inputs;
+    
+    TurboMindModelInstance(TurboMindModel* m, int dev_id) : model(m), device_id(dev_id) {
+        mock_out() << "Created model instance on device: " << device_id << std::endl;
+    }
+};
+
+struct TurboMindInstancePool {
+    std::vector<std::unique_ptr<TurboMindModelInstance>> instances;
+    TensorMapArena inputs;
+    
+    TurboMindInstancePool(TurboMindModel* m, int dev_id, int num_instances) {
+        if (num_instances <= 0) {
+            throw std::runtime_error("num_instances must be positive");
+        }
+        for (int i = 0; i < num_instances; i++) {
+            instances.push_back(std::make_unique<TurboMindModelInstance>(m, dev_id));
+        }
+    }
+};
+
+
+// Width of the mock's hidden states, see turbomind_encode
+static constexpr int64_t kMockHiddenSize = 16;
+
 struct TurboMindForwardResult {
     std::shared_ptr<TurboMindTensorMap> tensors;
     TurboMindRequestStatus status;
     int seq_len;
+    int event_fd = -1;
+    TurboMindTokenStream* token_stream = nullptr;
+    std::vector<int32_t> stream_ids;
+    std::vector<float> stream_logprobs;
+    std::vector<int32_t> output_ids;
+    int32_t sequence_length = 0;
+    int prompt_tokens = 0;
+    int prefix_hit_len = 0;
+    std::vector<float> logits; // [prompt_tokens + seq_len, kMockVocab] with output_logits
+    
+    static constexpr int kMockVocab = 32000;
     
     TurboMindForwardResult() : status(TM_REQUEST_COMPLETED), seq_len(0) {
         tensors = std::make_shared<TurboMindTensorMap>();
-        std::cout << "Created forward result" << std::endl;
+        mock_out() << "Created forward result" << std::endl;
+    }
+    
+    ~TurboMindForwardResult() {
+        if (event_fd >= 0) {
+            close(event_fd);
+        }
+        delete token_stream;
+    }
+    
+    // Mock outputs: seq_len tokens 100, 101, ..., where a banned one becomes the
+    // smallest id not in bad_ids
+    void fill_outputs(const TurboMindGenerationConfig& config) {
+        std::vector<int> banned;
+        if (config.bad_ids && config.bad_ids_count > 0) {
+            banned.assign(config.bad_ids, config.bad_ids + config.bad_ids_count);
+            std::sort(banned.begin(), banned.end());
+        }
+        int fallback = 0;
+        while (std::binary_search(banned.begin(), banned.end(), fallback)) {
+            ++fallback;
+        }
+        output_ids.resize(seq_len);
+        for (int i = 0; i < seq_len; i++) {
+            output_ids[i] = std::binary_search(banned.begin(), banned.end(), 100 + i) ? fallback : 100 + i;
+        }
+        sequence_length = seq_len;
+    }
+    
+    // Mock logits predict each next input token and then the generated ones, as
+    // if the model agreed with every draft it is asked to verify
+    void fill_logits(const int32_t* input_ids) {
+        const int rows = prompt_tokens + seq_len;
+        logits.assign(static_cast<size_t>(rows) * kMockVocab, 0.0f);
+        for (int r = 0; r < rows; r++) {
+            const int next = r + 1 < prompt_tokens ? input_ids[r + 1]
+                             : r + 1 - prompt_tokens < seq_len ? output_ids[r + 1 - prompt_tokens]
+                                                               : -1;
+            if (next >= 0 && next < kMockVocab) {
+                logits[static_cast<size_t>(r) * kMockVocab + next] = 1.0f;
+            }
+        }
+    }
+    
+    // Publish seq_len mock tokens into a finished token stream
+    void stream_tokens() {
+        uint32_t capacity = 16;
+        while (capacity < static_cast<uint32_t>(seq_len)) {
+            capacity <<= 1;
+        }
+        stream_ids.assign(capacity, 0);
+        stream_logprobs.assign(capacity, 0.0f);
+        for (int i = 0; i < seq_len; i++) {
+            stream_ids[i] = output_ids[i];
+        }
+        token_stream = new TurboMindTokenStream{};
+        token_stream->capacity = capacity;
+        token_stream->token_ids = stream_ids.data();
+        token_stream->logprobs = stream_logprobs.data();
+        token_stream->head = seq_len;
+        token_stream->finished = 1;
     }
 };
 
+struct TurboMindBatchResult {
+    std::vector<std::unique_ptr<TurboMindForwardResult>> results;
+};
+
+// Mock config handle: a deep copy of the C config, no interning
+struct TurboMindGenerationConfigHandle {
+    TurboMindGenerationConfig config;
+    std::vector<int> eos_ids, stop_ids, bad_ids;
+    int refs = 1;
+};
+
 // C API Implementation
 extern "C" {
 
 TurboMindModel* turbomind_create_model(const char* model_dir, const char* config, const char* weight_type) {
     if (!model_dir) {
-        set_last_error("model_dir cannot be null");
+        set_last_error("model_dir cannot be null", TM_ERROR_INVALID_ARGUMENT);
         return nullptr;
     }
     
@@ -106,7 +336,7 @@ TurboMindModel* turbomind_create_model(const char* model_dir, const char* config
         std::string wt = weight_type ? weight_type : "half";
         return new TurboMindModel(model_dir, cfg, wt);
     } catch (const std::exception& e) {
-        set_last_error("Failed to create model: " + std::string(e.what()));
+        set_last_error("Failed to create model: " + std::string(e.what()), TM_ERROR_INTERNAL);
         return nullptr;
     }
 }
@@ -115,16 +345,94 @@ void turbomind_destroy_model(TurboMindModel* model) {
     delete model;
 }
 
+// Model setup functions
+void turbomind_create_shared_weights(TurboMindModel* model, int device_id, int rank) {
+    if (!model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+    }
+}
+
+void turbomind_process_weights(TurboMindModel* model, int device_id, int rank) {
+    if (!model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+    }
+}
+
+void turbomind_create_engine(TurboMindModel* model, int device_id, int rank) {
+    if (!model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+    }
+}
+
+int turbomind_initialize_all_ranks(TurboMindModel* model, int node_id, int device_count) {
+    if (!model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    mock_out() << "Initialized ranks for node " << node_id << std::endl;
+    return 0;
+}
+
+int turbomind_set_weight_source(TurboMindModel* model, const char* weights_dir, int num_threads,
+                                TurboMindProgressCallback progress, void* user_data) {
+    if (!model || !weights_dir) {
+        set_last_error("Invalid parameters for weight source", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    model->weights_dir = weights_dir;
+    return 0;
+}
+
+int turbomind_load_weights(TurboMindModel* model, int device_id, int rank) {
+    if (!model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    mock_out() << "Loaded weights for rank " << rank << " from: " << model->weights_dir << std::endl;
+    return 0;
+}
+
+int turbomind_set_snapshot_dir(TurboMindModel* model, const char* snapshot_dir) {
+    if (!model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    model->snapshot_dir = snapshot_dir ? snapshot_dir : "";
+    return 0;
+}
+
+int turbomind_save_snapshot(TurboMindModel* model, int device_id, int rank) {
+    if (!model || model->snapshot_dir.empty()) {
+        set_last_error("no snapshot directory set", TM_ERROR_INVALID_STATE);
+        return -1;
+    }
+    mock_out() << "Saved snapshot for rank " << rank << " to: " << model->snapshot_dir << std::endl;
+    return 0;
+}
+
+void turbomind_get_load_progress(TurboMindModel* model, uint64_t* bytes_done, uint64_t* bytes_total) {
+    if (!model) {
+        set_last_error("Invalid model for load progress", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    if (bytes_done) {
+        *bytes_done = 0;
+    }
+    if (bytes_total) {
+        *bytes_total = 0;
+    }
+}
+
 TurboMindModelInstance* turbomind_create_model_instance(TurboMindModel* model, int device_id) {
     if (!model) {
-        set_last_error("model cannot be null");
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
         return nullptr;
     }
     
     try {
         return new TurboMindModelInstance(model, device_id);
     } catch (const std::exception& e) {
-        set_last_error("Failed to create model instance: " + std::string(e.what()));
+        set_last_error("Failed to create model instance: " + std::string(e.what()), TM_ERROR_INTERNAL);
         return nullptr;
     }
 }
@@ -133,41 +441,130 @@ void turbomind_destroy_model_instance(TurboMindModelInstance* instance) {
     delete instance;
 }
 
+TurboMindInstancePool* turbomind_create_instance_pool(TurboMindModel* model, int device_id, int num_instances) {
+    if (!model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        return new TurboMindInstancePool(model, device_id, num_instances);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create instance pool: " + std::string(e.what()), TM_ERROR_INTERNAL);
+        return nullptr;
+    }
+}
+
+void turbomind_destroy_instance_pool(TurboMindInstancePool* pool) {
+    delete pool;
+}
+
+// The mock runs every request on submission, so there is nothing to schedule
+int turbomind_pool_set_scheduling(TurboMindInstancePool* pool, const TurboMindSchedulingConfig* config) {
+    if (!pool || !config) {
+        set_last_error("Invalid parameters for pool scheduling", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    if (config->reserved_interactive_slots < 0 ||
+        config->reserved_interactive_slots >= static_cast<int>(pool->instances.size()) ||
+        config->prefill_tokens_per_tick < 0 || config->tick_ms < 0 || config->preempt_queue_depth < 0 ||
+        (config->prefill_tokens_per_tick > 0 && config->tick_ms == 0)) {
+        set_last_error("Failed to set pool scheduling: invalid scheduling config", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return 0;
+}
+
+int turbomind_set_prefill_chunk_size(TurboMindModel* model, int chunk_tokens) {
+    if (!model || chunk_tokens < 0) {
+        set_last_error("Invalid parameters for prefill chunk size", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    model->prefill_chunk_tokens = chunk_tokens;
+    return 0;
+}
+
+int turbomind_get_prefill_chunk_size(TurboMindModel* model) {
+    return model ? model->prefill_chunk_tokens : 0;
+}
+
 TurboMindTensor* turbomind_create_tensor(void* data, int64_t* shape, int ndim, 
                                         TurboMindDataType dtype, TurboMindMemoryType memory_type, int device_id) {
     if (!data || !shape || ndim <= 0) {
-        set_last_error("Invalid tensor parameters");
+        set_last_error("Invalid tensor parameters", TM_ERROR_INVALID_ARGUMENT);
         return nullptr;
     }
     
     try {
         return new TurboMindTensor(data, shape, ndim, dtype, memory_type, device_id);
     } catch (const std::exception& e) {
-        set_last_error("Failed to create tensor: " + std::string(e.what()));
+        set_last_error("Failed to create tensor: " + std::string(e.what()), TM_ERROR_INTERNAL);
+        return nullptr;
+    }
+}
+
+TurboMindTensor* turbomind_create_pinned_tensor(int64_t* shape, int ndim, TurboMindDataType dtype, int device_id,
+                                               void** data) {
+    if (!shape || ndim <= 0 || !data) {
+        set_last_error("Invalid tensor parameters", TM_ERROR_INVALID_ARGUMENT);
         return nullptr;
     }
+    
+    // Plain host memory stands in for the pinned pool
+    auto tensor = new TurboMindTensor(nullptr, shape, ndim, dtype, TM_MEMORY_CPU_PINNED, device_id);
+    tensor->owned.reset(calloc(1, tensor->size_bytes), free);
+    tensor->data = tensor->owned.get();
+    *data = tensor->data;
+    return tensor;
 }
 
 void turbomind_destroy_tensor(TurboMindTensor* tensor) {
     delete tensor;
 }
 
+void* turbomind_alloc_pinned(size_t bytes) {
+    return calloc(1, bytes);
+}
+
+void turbomind_release_pinned(void* ptr) {
+    free(ptr);
+}
+
+void turbomind_set_pinned_pool_limit(size_t bytes) {
+}
+
+void turbomind_trim_pinned_pool() {
+}
+
+void turbomind_get_pinned_pool_stats(size_t* cached_bytes, size_t* in_use_bytes) {
+    if (cached_bytes) {
+        *cached_bytes = 0;
+    }
+    if (in_use_bytes) {
+        *in_use_bytes = 0;
+    }
+}
+
 TurboMindTensorMap* turbomind_create_tensor_map() {
     try {
         return new TurboMindTensorMap();
     } catch (const std::exception& e) {
-        set_last_error("Failed to create tensor map: " + std::string(e.what()));
+        set_last_error("Failed to create tensor map: " + std::string(e.what()), TM_ERROR_INTERNAL);
         return nullptr;
     }
 }
 
 void turbomind_destroy_tensor_map(TurboMindTensorMap* tensor_map) {
+    if (tensor_map && tensor_map->arena) {
+        tensor_map->arena->release(tensor_map);
+        return;
+    }
     delete tensor_map;
 }
 
 int turbomind_tensor_map_set(TurboMindTensorMap* tensor_map, const char* key, TurboMindTensor* tensor) {
     if (!tensor_map || !key || !tensor) {
-        set_last_error("Invalid parameters for tensor map set");
+        set_last_error("Invalid parameters for tensor map set", TM_ERROR_INVALID_ARGUMENT);
         return -1;
     }
     
@@ -177,120 +574,1098 @@ int turbomind_tensor_map_set(TurboMindTensorMap* tensor_map, const char* key, Tu
         });
         return 0;
     } catch (const std::exception& e) {
-        set_last_error("Failed to set tensor in map: " + std::string(e.what()));
+        set_last_error("Failed to set tensor in map: " + std::string(e.what()), TM_ERROR_INTERNAL);
         return -1;
     }
 }
 
+static TurboMindTensorMap* build_inputs(TensorMapArena& arena, const TurboMindTensorDesc* descs, int count) {
+    if (!descs || count <= 0) {
+        set_last_error("Invalid parameters for build inputs", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    for (int i = 0; i < count; i++) {
+        const auto& desc = descs[i];
+        if (!desc.name || !desc.data || desc.ndim <= 0 || desc.ndim > TURBOMIND_MAX_DIMS) {
+            set_last_error("Failed to build inputs: invalid descriptor at index " + std::to_string(i), TM_ERROR_INVALID_ARGUMENT);
+            return nullptr;
+        }
+    }
+    
+    auto tensor_map = arena.acquire();
+    tensor_map->tensors.clear();
+    for (int i = 0; i < count; i++) {
+        const auto& desc = descs[i];
+        tensor_map->tensors[desc.name] = std::make_shared<TurboMindTensor>(
+            desc.data, const_cast<int64_t*>(desc.shape), desc.ndim, desc.dtype, desc.memory_type, desc.device_id);
+    }
+    return tensor_map;
+}
+
+TurboMindTensorMap* turbomind_build_inputs(TurboMindModelInstance* instance, const TurboMindTensorDesc* descs,
+                                           int count) {
+    if (!instance) {
+        set_last_error("Invalid parameters for build inputs", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    return build_inputs(instance->inputs, descs, count);
+}
+
+TurboMindTensorMap* turbomind_pool_build_inputs(TurboMindInstancePool* pool, const TurboMindTensorDesc* descs,
+                                                int count) {
+    if (!pool) {
+        set_last_error("Invalid parameters for build inputs", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    return build_inputs(pool->inputs, descs, count);
+}
+
 TurboMindTensor* turbomind_tensor_map_get(TurboMindTensorMap* tensor_map, const char* key) {
     if (!tensor_map || !key) {
-        set_last_error("Invalid parameters for tensor map get");
+        set_last_error("Invalid parameters for tensor map get", TM_ERROR_INVALID_ARGUMENT);
         return nullptr;
     }
     
     try {
         auto it = tensor_map->tensors.find(key);
         if (it == tensor_map->tensors.end()) {
-            set_last_error("Tensor not found in map: " + std::string(key));
+            set_last_error("Tensor not found in map: " + std::string(key), TM_ERROR_NOT_FOUND);
             return nullptr;
         }
-        return it->second.get();
+        return new TurboMindTensor(*it->second);
     } catch (const std::exception& e) {
-        set_last_error("Failed to get tensor from map: " + std::string(e.what()));
+        set_last_error("Failed to get tensor from map: " + std::string(e.what()), TM_ERROR_INTERNAL);
         return nullptr;
     }
 }
 
+// Prefix accounting as in the real wrapper: a new sequence reuses cached blocks
+// of its first prefill chunk (the rest continue the session), and the whole
+// prompt is indexed once the request completes, which for the mock is now
+static void track_prefix(TurboMindModel* model, const TurboMindSession& session, const TurboMindGenerationConfig& config,
+                         const int32_t* ids, TurboMindForwardResult* result) {
+    if (!model->prefix_cache || !session.start_flag || session.step != 0) {
+        return;
+    }
+    const int count = result->prompt_tokens;
+    const int chunk = model->prefill_chunk_tokens;
+    const bool chunked = chunk > 0 && count > chunk && !config.output_logits && !config.output_last_hidden_state;
+    result->prefix_hit_len = model->prefix_cache->match(ids, chunked ? chunk : count);
+    model->prefix_cache->insert(ids, count);
+}
+
 TurboMindForwardResult* turbomind_forward(TurboMindModelInstance* instance, 
                                          TurboMindTensorMap* input_tensors,
                                          TurboMindSession* session,
                                          TurboMindGenerationConfig* gen_config,
                                          bool stream_output) {
     if (!instance || !input_tensors || !session || !gen_config) {
-        set_last_error("Invalid parameters for forward");
+        set_last_error("Invalid parameters for forward", TM_ERROR_INVALID_ARGUMENT);
         return nullptr;
     }
     
     try {
-        std::cout << "Running forward inference..." << std::endl;
-        std::cout << "Session ID: " << session->id << std::endl;
-        std::cout << "Max new tokens: " << gen_config->max_new_tokens << std::endl;
-        std::cout << "Temperature: " << gen_config->temperature << std::endl;
+        mock_out() << "Running forward inference..." << std::endl;
+        mock_out() << "Session ID: " << session->id << std::endl;
+        mock_out() << "Max new tokens: " << gen_config->max_new_tokens << std::endl;
+        mock_out() << "Temperature: " << gen_config->temperature << std::endl;
         
         // Create mock result with session-specific output
         auto result = new TurboMindForwardResult();
-        result->seq_len = static_cast<int>(session->id) * 10; // Vary by session
+        const int tokens = mock_config().output_tokens;
+        result->seq_len = tokens > 0 ? tokens : static_cast<int>(session->id) * 10; // Vary by session
+        if (gen_config->max_new_tokens > 0) {
+            result->seq_len = std::min(result->seq_len, gen_config->max_new_tokens);
+        }
+        result->fill_outputs(*gen_config);
+        auto input_ids = input_tensors->tensors.find("input_ids");
+        if (input_ids != input_tensors->tensors.end() && input_ids->second->dtype == TM_TYPE_INT32) {
+            result->prompt_tokens = static_cast<int>(input_ids->second->size_bytes / sizeof(int32_t));
+            if (gen_config->output_logits && input_ids->second->memory_type != TM_MEMORY_GPU) {
+                result->fill_logits(static_cast<const int32_t*>(input_ids->second->data));
+            }
+            if (input_ids->second->memory_type != TM_MEMORY_GPU) {
+                track_prefix(instance->model, *session, *gen_config,
+                             static_cast<const int32_t*>(input_ids->second->data), result);
+            }
+        }
+        if (stream_output) {
+            result->stream_tokens();
+        }
         return result;
     } catch (const std::exception& e) {
-        set_last_error("Forward inference failed: " + std::string(e.what()));
+        set_last_error("Forward inference failed: " + std::string(e.what()), TM_ERROR_INTERNAL);
+        return nullptr;
+    }
+}
+
+TurboMindForwardResult* turbomind_forward_async(TurboMindModelInstance* instance,
+                                               TurboMindTensorMap* input_tensors,
+                                               TurboMindSession* session,
+                                               TurboMindGenerationConfig* gen_config,
+                                               bool stream_output,
+                                               TurboMindForwardCallback callback,
+                                               void* user_data) {
+    auto result = turbomind_forward(instance, input_tensors, session, gen_config, stream_output);
+    if (result && callback) {
+        // Mock requests complete synchronously
+        callback(user_data, result->status, result->seq_len);
+    }
+    return result;
+}
+
+TurboMindForwardResult* turbomind_pool_forward_async(TurboMindInstancePool* pool,
+                                                    TurboMindTensorMap* input_tensors,
+                                                    TurboMindSession* session,
+                                                    TurboMindGenerationConfig* gen_config,
+                                                    bool stream_output,
+                                                    TurboMindForwardCallback callback,
+                                                    void* user_data) {
+    if (!pool) {
+        set_last_error("Invalid parameters for pool forward", TM_ERROR_INVALID_ARGUMENT);
         return nullptr;
     }
+    return turbomind_forward_async(pool->instances[0].get(), input_tensors, session, gen_config,
+                                   stream_output, callback, user_data);
 }
 
 void turbomind_destroy_forward_result(TurboMindForwardResult* result) {
     delete result;
 }
 
-void turbomind_end_session(TurboMindModelInstance* instance, uint64_t session_id) {
-    if (!instance) {
-        set_last_error("Invalid instance for end session");
-        return;
+TurboMindGenerationConfigHandle* turbomind_create_generation_config(const TurboMindGenerationConfig* gen_config) {
+    if (!gen_config) {
+        set_last_error("gen_config cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
     }
-    std::cout << "Ended session: " << session_id << std::endl;
+    auto handle = new TurboMindGenerationConfigHandle();
+    handle->config = *gen_config;
+    auto own = [](std::vector<int>& dst, const int* ids, int count) -> int* {
+        if (ids && count > 0) {
+            dst.assign(ids, ids + count);
+        }
+        return dst.empty() ? nullptr : dst.data();
+    };
+    handle->config.eos_ids = own(handle->eos_ids, gen_config->eos_ids, gen_config->eos_ids_count);
+    handle->config.stop_ids = own(handle->stop_ids, gen_config->stop_ids, gen_config->stop_ids_count);
+    handle->config.bad_ids = own(handle->bad_ids, gen_config->bad_ids, gen_config->bad_ids_count);
+    return handle;
 }
 
-void turbomind_cancel_request(TurboMindModelInstance* instance) {
-    if (!instance) {
-        set_last_error("Invalid instance for cancel request");
-        return;
+TurboMindGenerationConfigHandle* turbomind_retain_generation_config(TurboMindGenerationConfigHandle* config) {
+    if (config) {
+        config->refs++;
     }
-    std::cout << "Cancelled request" << std::endl;
+    return config;
 }
 
-int turbomind_get_tensor_para_size(TurboMindModel* model) {
-    if (!model) {
-        set_last_error("Invalid model for tensor para size");
-        return -1;
+void turbomind_release_generation_config(TurboMindGenerationConfigHandle* config) {
+    if (config && --config->refs == 0) {
+        delete config;
     }
-    return 1; // Mock value
 }
 
-int turbomind_get_pipeline_para_size(TurboMindModel* model) {
-    if (!model) {
-        set_last_error("Invalid model for pipeline para size");
-        return -1;
+TurboMindForwardResult* turbomind_forward_with_config(TurboMindModelInstance* instance,
+                                                     TurboMindTensorMap* input_tensors,
+                                                     TurboMindSession* session,
+                                                     TurboMindGenerationConfigHandle* config,
+                                                     bool stream_output,
+                                                     TurboMindForwardCallback callback,
+                                                     void* user_data) {
+    if (!config) {
+        set_last_error("Invalid parameters for forward", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
     }
-    return 1; // Mock value
+    return turbomind_forward_async(instance, input_tensors, session, &config->config, stream_output,
+                                   callback, user_data);
 }
 
-const char* turbomind_get_last_error() {
-    return g_last_error.c_str();
+TurboMindForwardResult* turbomind_pool_forward_with_config(TurboMindInstancePool* pool,
+                                                          TurboMindTensorMap* input_tensors,
+                                                          TurboMindSession* session,
+                                                          TurboMindGenerationConfigHandle* config,
+                                                          bool stream_output,
+                                                          TurboMindForwardCallback callback,
+                                                          void* user_data) {
+    if (!pool || !config) {
+        set_last_error("Invalid parameters for pool forward", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    return turbomind_forward_async(pool->instances[0].get(), input_tensors, session, &config->config,
+                                   stream_output, callback, user_data);
 }
 
-void turbomind_set_device(int device_id) {
-    std::cout << "Set device to: " << device_id << std::endl;
+TurboMindBatchResult* turbomind_forward_batch(TurboMindInstancePool* pool,
+                                             int count,
+                                             TurboMindTensorMap** input_tensors,
+                                             TurboMindSession* sessions,
+                                             TurboMindGenerationConfig** gen_configs,
+                                             int gen_config_count,
+                                             bool stream_output) {
+    if (!pool || count <= 0 || !input_tensors || !sessions || !gen_configs ||
+        (gen_config_count != 1 && gen_config_count != count)) {
+        set_last_error("Invalid parameters for batch forward", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    auto batch = std::make_unique<TurboMindBatchResult>();
+    for (int i = 0; i < count; i++) {
+        auto result = turbomind_forward(pool->instances[0].get(), input_tensors[i], &sessions[i],
+                                        gen_configs[gen_config_count == 1 ? 0 : i], stream_output);
+        if (!result) {
+            return nullptr;
+        }
+        batch->results.emplace_back(result);
+    }
+    return batch.release();
 }
 
-size_t turbomind_get_tensor_size(TurboMindTensor* tensor) {
-    if (!tensor) {
-        set_last_error("Invalid tensor for size calculation");
-        return 0;
+TurboMindBatchResult* turbomind_forward_batch_with_configs(TurboMindInstancePool* pool,
+                                                          int count,
+                                                          TurboMindTensorMap** input_tensors,
+                                                          TurboMindSession* sessions,
+                                                          TurboMindGenerationConfigHandle** configs,
+                                                          int config_count,
+                                                          bool stream_output) {
+    if (!configs || (config_count != 1 && config_count != count)) {
+        set_last_error("Invalid parameters for batch forward", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
     }
-    return tensor->size_bytes;
+    std::vector<TurboMindGenerationConfig*> gen_configs;
+    for (int i = 0; i < config_count; i++) {
+        if (!configs[i]) {
+            set_last_error("Invalid parameters for batch forward", TM_ERROR_INVALID_ARGUMENT);
+            return nullptr;
+        }
+        gen_configs.push_back(&configs[i]->config);
+    }
+    return turbomind_forward_batch(pool, count, input_tensors, sessions, gen_configs.data(), config_count,
+                                   stream_output);
 }
 
-void turbomind_copy_tensor(TurboMindTensor* dst, TurboMindTensor* src) {
-    if (!dst || !src) {
-        set_last_error("Invalid tensors for copy");
-        return;
+int turbomind_batch_size(TurboMindBatchResult* batch) {
+    return batch ? static_cast<int>(batch->results.size()) : 0;
+}
+
+TurboMindForwardResult* turbomind_batch_get_result(TurboMindBatchResult* batch, int index) {
+    if (!batch || index < 0 || index >= static_cast<int>(batch->results.size())) {
+        set_last_error("Invalid batch result index", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
     }
-    
-    if (dst->size_bytes != src->size_bytes) {
-        set_last_error("Tensor size mismatch for copy");
-        return;
+    return batch->results[index].get();
+}
+
+int turbomind_wait_batch(TurboMindBatchResult* batch, int64_t timeout_ms) {
+    return batch ? 0 : -1;
+}
+
+int turbomind_batch_finished_count(TurboMindBatchResult* batch) {
+    return batch ? static_cast<int>(batch->results.size()) : -1;
+}
+
+void turbomind_cancel_batch(TurboMindBatchResult* batch) {
+}
+
+void turbomind_destroy_batch_result(TurboMindBatchResult* batch) {
+    delete batch;
+}
+
+int turbomind_get_request_timings(TurboMindForwardResult* result, TurboMindRequestTimings* timings) {
+    if (!result || !timings) {
+        set_last_error("Invalid parameters for request timings", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
     }
-    
-    std::cout << "Copied tensor (" << src->size_bytes << " bytes)" << std::endl;
+    // Mock requests finish as they are created
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch()).count();
+    *timings = TurboMindRequestTimings{};
+    timings->submit_ns = timings->scheduled_ns = timings->finish_ns = now;
+    if (result->seq_len > 0) {
+        timings->first_token_ns = now;
+    }
+    timings->generated_tokens = result->seq_len;
+    return 0;
+}
+
+int turbomind_get_latency_histogram(TurboMindHistogramKind kind, TurboMindHistogram* histogram) {
+    if (kind < 0 || kind >= TM_HISTOGRAM_KIND_COUNT || !histogram) {
+        set_last_error("Invalid parameters for latency histogram", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    *histogram = TurboMindHistogram{};
+    return 0;
+}
+
+void turbomind_reset_latency_histograms() {}
+
+int turbomind_get_prefix_hit_length(TurboMindForwardResult* result) {
+    if (!result) {
+        set_last_error("Invalid forward result for prefix hit length", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return result->prefix_hit_len;
+}
+
+TurboMindRequestStatus turbomind_get_forward_status(TurboMindForwardResult* result, int* seq_len) {
+    if (!result) {
+        set_last_error("Invalid forward result for status", TM_ERROR_INVALID_ARGUMENT);
+        return TM_REQUEST_FAILED;
+    }
+    if (seq_len) {
+        *seq_len = result->seq_len;
+    }
+    return result->status;
+}
+
+int turbomind_wait_forward(TurboMindForwardResult* result, int64_t timeout_ms) {
+    if (!result) {
+        set_last_error("Invalid forward result for wait", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return 0;
+}
+
+int turbomind_get_forward_event_fd(TurboMindForwardResult* result) {
+    if (!result) {
+        set_last_error("Invalid forward result for event fd", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    if (result->event_fd < 0) {
+        result->event_fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    return result->event_fd;
+}
+
+void turbomind_cancel_forward(TurboMindForwardResult* result) {
+    if (!result) {
+        set_last_error("Invalid forward result for cancel", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+}
+
+TurboMindTokenStream* turbomind_get_token_stream(TurboMindForwardResult* result) {
+    if (!result) {
+        set_last_error("Invalid forward result for token stream", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    return result->token_stream;
+}
+
+int turbomind_tensor_view(TurboMindTensor* tensor, TurboMindTensorView* view) {
+    if (!tensor || !view) {
+        set_last_error("Invalid parameters for tensor view", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    memset(view, 0, sizeof(*view));
+    view->data = tensor->data;
+    view->ndim = static_cast<int32_t>(tensor->shape.size());
+    for (size_t i = 0; i < tensor->shape.size() && i < TURBOMIND_MAX_DIMS; i++) {
+        view->shape[i] = tensor->shape[i];
+    }
+    view->dtype = tensor->dtype;
+    view->memory_type = tensor->memory_type;
+    view->device_id = tensor->device_id;
+    view->byte_size = tensor->size_bytes;
+    return 0;
+}
+
+int turbomind_get_output(TurboMindForwardResult* result, const char* key, TurboMindTensorView* view) {
+    if (!result || !key || !view) {
+        set_last_error("Invalid parameters for get output", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    memset(view, 0, sizeof(*view));
+    view->dtype = TM_TYPE_INT32;
+    view->memory_type = TM_MEMORY_CPU;
+    if (strcmp(key, "output_ids") == 0) {
+        view->data = result->output_ids.data();
+        view->ndim = 2;
+        view->shape[0] = 1;
+        view->shape[1] = result->seq_len;
+        view->byte_size = result->output_ids.size() * sizeof(int32_t);
+    } else if (strcmp(key, "sequence_length") == 0) {
+        view->data = &result->sequence_length;
+        view->ndim = 1;
+        view->shape[0] = 1;
+        view->byte_size = sizeof(int32_t);
+    } else if (strcmp(key, "logits") == 0 && !result->logits.empty()) {
+        view->dtype = TM_TYPE_FP32;
+        view->data = result->logits.data();
+        view->ndim = 2;
+        view->shape[0] = result->logits.size() / TurboMindForwardResult::kMockVocab;
+        view->shape[1] = TurboMindForwardResult::kMockVocab;
+        view->byte_size = result->logits.size() * sizeof(float);
+    } else {
+        set_last_error("Output not found: " + std::string(key), TM_ERROR_NOT_FOUND);
+        return -1;
+    }
+    return 0;
+}
+
+int turbomind_copy_output_async(TurboMindForwardResult* result, const char* key, void* dst, size_t bytes) {
+    TurboMindTensorView view;
+    if (!dst || turbomind_get_output(result, key, &view) != 0) {
+        return -1;
+    }
+    if (bytes > view.byte_size) {
+        set_last_error("Output copy larger than tensor " + std::string(key), TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    memcpy(dst, view.data, bytes);
+    return 0;
+}
+
+int turbomind_sync_output_copies(TurboMindForwardResult* result) {
+    if (!result) {
+        set_last_error("Invalid forward result", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return 0;
+}
+
+void turbomind_end_session(TurboMindModelInstance* instance, uint64_t session_id) {
+    if (!instance) {
+        set_last_error("Invalid instance for end session", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    mock_out() << "Ended session: " << session_id << std::endl;
+}
+
+void turbomind_cancel_request(TurboMindModelInstance* instance) {
+    if (!instance) {
+        set_last_error("Invalid instance for cancel request", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    mock_out() << "Cancelled request" << std::endl;
+}
+
+void turbomind_pool_end_session(TurboMindInstancePool* pool, uint64_t session_id) {
+    if (!pool) {
+        set_last_error("Invalid pool for end session", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    mock_out() << "Ended session: " << session_id << std::endl;
+}
+
+int turbomind_enable_session_offload(TurboMindModel* model, size_t host_limit_bytes, const char* spill_dir) {
+    if (!model) {
+        set_last_error("Invalid model for session offload", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    model->session_offload = true;
+    return 0;
+}
+
+void turbomind_get_session_offload_stats(TurboMindModel* model, TurboMindSessionOffloadStats* stats) {
+    if (!model || !stats) {
+        set_last_error("Invalid parameters for session offload stats", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    *stats = TurboMindSessionOffloadStats{};
+    stats->sessions = model->suspended_sessions.size();
+    stats->suspended = model->suspended_sessions.size();
+}
+
+int turbomind_suspend_session(TurboMindModelInstance* instance, uint64_t session_id) {
+    if (!instance || !instance->model->session_offload) {
+        set_last_error("Invalid instance or session offload not enabled", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    if (!instance->model->suspended_sessions.emplace(session_id, true).second) {
+        set_last_error("Session " + std::to_string(session_id) + " is not tracked or already suspended", TM_ERROR_INVALID_STATE);
+        return -1;
+    }
+    return 0;
+}
+
+int turbomind_pool_suspend_session(TurboMindInstancePool* pool, uint64_t session_id) {
+    if (!pool) {
+        set_last_error("Invalid pool for suspend session", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return turbomind_suspend_session(pool->instances[0].get(), session_id);
+}
+
+TurboMindForwardResult* turbomind_resume_session(TurboMindModelInstance* instance, uint64_t session_id) {
+    if (!instance || !instance->model->session_offload) {
+        set_last_error("Invalid instance or session offload not enabled", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    if (instance->model->suspended_sessions.erase(session_id) == 0) {
+        set_last_error("Failed to resume session: session " + std::to_string(session_id) + " is not suspended", TM_ERROR_INVALID_STATE);
+        return nullptr;
+    }
+    return new TurboMindForwardResult(); // mock prefill completes at once
+}
+
+TurboMindForwardResult* turbomind_pool_resume_session(TurboMindInstancePool* pool, uint64_t session_id) {
+    if (!pool) {
+        set_last_error("Invalid pool or session offload not enabled", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    return turbomind_resume_session(pool->instances[0].get(), session_id);
+}
+
+int turbomind_enable_prefix_cache(TurboMindModel* model, int block_len, size_t max_blocks) {
+    if (!model || block_len <= 0 || max_blocks == 0) {
+        set_last_error("Invalid parameters for prefix cache", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    model->prefix_cache = std::make_shared<turbomind_go::PrefixCache>(block_len, max_blocks);
+    return 0;
+}
+
+void turbomind_get_prefix_cache_stats(TurboMindModel* model, TurboMindPrefixCacheStats* stats) {
+    if (!model || !stats) {
+        set_last_error("Invalid parameters for prefix cache stats", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    *stats = TurboMindPrefixCacheStats{};
+    if (model->prefix_cache) {
+        auto s = model->prefix_cache->stats();
+        stats->blocks = s.blocks;
+        stats->pinned_blocks = s.pinned_blocks;
+        stats->lookups = s.lookups;
+        stats->lookup_tokens = s.lookup_tokens;
+        stats->hit_tokens = s.hit_tokens;
+    }
+}
+
+int turbomind_pool_pin_prefix(TurboMindInstancePool* pool, const char* name, const int* token_ids, int count) {
+    if (!pool || !name || !token_ids || count <= 0) {
+        set_last_error("Invalid parameters for pin prefix", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    TurboMindModel* model = pool->instances[0]->model;
+    if (!model->prefix_cache) {
+        set_last_error("Prefix caching is not enabled for this model", TM_ERROR_INVALID_STATE);
+        return -1;
+    }
+    if (!model->prefix_cache->pin(name, token_ids, count, 0)) {
+        set_last_error("Prefix already pinned: " + std::string(name), TM_ERROR_INVALID_STATE);
+        return -1;
+    }
+    return 0;
+}
+
+int turbomind_pool_evict_prefix(TurboMindInstancePool* pool, const char* name) {
+    if (!pool || !name) {
+        set_last_error("Invalid parameters for evict prefix", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    auto& cache = pool->instances[0]->model->prefix_cache;
+    uint64_t session_id = 0;
+    if (!cache || !cache->evict(name, &session_id)) {
+        set_last_error("Unknown prefix: " + std::string(name), TM_ERROR_NOT_FOUND);
+        return -1;
+    }
+    return 0;
+}
+
+void turbomind_pool_cancel_all(TurboMindInstancePool* pool) {
+    if (!pool) {
+        set_last_error("Invalid pool for cancel", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+}
+
+int turbomind_attach_draft_model(TurboMindModel* model, TurboMindModel* draft, int num_draft_tokens) {
+    if (!model || !draft || draft == model || num_draft_tokens <= 0) {
+        set_last_error("Invalid parameters for attach draft model", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    if (draft->draft) {
+        set_last_error("Draft model has a draft model of its own", TM_ERROR_INVALID_STATE);
+        return -1;
+    }
+    TurboMindTokenizer* target_tokenizer = turbomind_get_tokenizer(model);
+    TurboMindTokenizer* draft_tokenizer = turbomind_get_tokenizer(draft);
+    if (target_tokenizer && draft_tokenizer &&
+        target_tokenizer->tokenizer->vocab_size() != draft_tokenizer->tokenizer->vocab_size()) {
+        set_last_error("Draft vocabulary differs from the model's", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    model->draft = draft;
+    model->num_draft_tokens = num_draft_tokens;
+    return 0;
+}
+
+TurboMindModel* turbomind_get_draft_model(TurboMindModel* model, int* num_draft_tokens) {
+    if (num_draft_tokens) {
+        *num_draft_tokens = model ? model->num_draft_tokens : 0;
+    }
+    return model ? model->draft : nullptr;
+}
+
+int turbomind_verify_draft(TurboMindForwardResult* result, const int32_t* draft_ids, int count, int32_t* out_ids) {
+    if (!result || count < 0 || (count > 0 && !draft_ids) || !out_ids) {
+        set_last_error("Invalid parameters for draft verification", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    if (result->logits.empty()) {
+        set_last_error("Verification request has no logits; submit it with output_logits", TM_ERROR_INVALID_STATE);
+        return -1;
+    }
+    const int vocab = TurboMindForwardResult::kMockVocab;
+    const int first = result->prompt_tokens - count - 1;
+    if (first < 0) {
+        set_last_error("Failed to verify draft: request input is shorter than the draft", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    int accepted = 0;
+    for (int i = 0; i <= count; i++) {
+        const float* row = result->logits.data() + static_cast<size_t>(first + i) * vocab;
+        out_ids[i] = static_cast<int32_t>(std::max_element(row, row + vocab) - row);
+        if (i == count || out_ids[i] != draft_ids[i]) {
+            break;
+        }
+        accepted++;
+    }
+    return accepted + 1;
+}
+
+int turbomind_get_hidden_size(TurboMindInstancePool* pool) {
+    if (!pool) {
+        set_last_error("Invalid pool for hidden size", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return static_cast<int>(kMockHiddenSize);
+}
+
+int turbomind_encode(TurboMindInstancePool* pool, const int32_t* ids, const int64_t* offsets, int count,
+                     TurboMindPooling pooling, TurboMindDataType out_dtype, void* out) {
+    if (!pool || !ids || !offsets || count <= 0 || (out_dtype != TM_TYPE_FP16 && out_dtype != TM_TYPE_FP32) ||
+        (pooling != TM_POOLING_LAST && pooling != TM_POOLING_MEAN) || !out) {
+        set_last_error("Invalid parameters for encode", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (offsets[i] < 0 || offsets[i + 1] <= offsets[i]) {
+            set_last_error("Invalid parameters for encode: input " + std::to_string(i) + " is empty",
+                           TM_ERROR_INVALID_ARGUMENT);
+            return -1;
+        }
+    }
+    
+    // Mock hidden states: row r of an input is the token id scaled by j + 1
+    // in column j, so last pooling yields the final token and mean the average
+    const int64_t dim = kMockHiddenSize;
+    const size_t elem = out_dtype == TM_TYPE_FP16 ? 2 : 4;
+    std::vector<float> hidden;
+    for (int i = 0; i < count; i++) {
+        const int64_t rows = offsets[i + 1] - offsets[i];
+        hidden.resize(static_cast<size_t>(rows * dim));
+        for (int64_t r = 0; r < rows; r++) {
+            for (int64_t j = 0; j < dim; j++) {
+                hidden[r * dim + j] = static_cast<float>(ids[offsets[i] + r]) * static_cast<float>(j + 1);
+            }
+        }
+        turbomind_go::pool_hidden_states(hidden.data(), TM_TYPE_FP32, rows, dim, pooling,
+                                         static_cast<char*>(out) + i * dim * elem, out_dtype);
+    }
+    return 0;
+}
+
+int turbomind_score(TurboMindInstancePool* pool, const int32_t* ids, const int64_t* offsets,
+                    const int32_t* prompt_lens, int count, float* logprobs) {
+    if (!pool || !ids || !offsets || !prompt_lens || count <= 0 || !logprobs) {
+        set_last_error("Invalid parameters for score", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (offsets[i] < 0 || prompt_lens[i] <= 0 || prompt_lens[i] >= offsets[i + 1] - offsets[i]) {
+            set_last_error("Invalid parameters for score: input " + std::to_string(i) +
+                               " needs a prompt and a continuation",
+                           TM_ERROR_INVALID_ARGUMENT);
+            return -1;
+        }
+    }
+    
+    // Mock logits predict every next input token, as in fill_logits
+    const int vocab = TurboMindForwardResult::kMockVocab;
+    std::vector<float> row(vocab, 0.0f);
+    float* dst = logprobs;
+    try {
+        for (int i = 0; i < count; i++) {
+            for (int64_t p = offsets[i] + prompt_lens[i]; p < offsets[i + 1]; p++) {
+                const int32_t target = ids[p];
+                if (target >= 0 && target < vocab) {
+                    row[target] = 1.0f;
+                }
+                *dst++ = turbomind_go::token_logprob(row.data(), vocab, target);
+                if (target >= 0 && target < vocab) {
+                    row[target] = 0.0f;
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        set_last_error("Failed to score: " + std::string(e.what()), TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return 0;
+}
+
+int turbomind_get_metrics(TurboMindModel* model, int device_id, TurboMindMetrics* metrics) {
+    if (!model || !metrics) {
+        set_last_error("Invalid parameters for metrics", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    *metrics = TurboMindMetrics{};
+    metrics->kv_blocks_used = -1;
+    metrics->kv_blocks_free = -1;
+    metrics->gpu_memory_total = -1;
+    metrics->gpu_memory_used = -1;
+    return 0;
+}
+
+int turbomind_enable_trace(size_t capacity) {
+    if (capacity == 0) {
+        set_last_error("Trace capacity must be positive", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return 0;
+}
+
+void turbomind_disable_trace() {}
+
+int turbomind_dump_trace(const char* path) {
+    if (!path) {
+        set_last_error("Invalid path for trace dump", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        set_last_error("Failed to write trace to " + std::string(path), TM_ERROR_IO);
+        return -1;
+    }
+    fputs("{\"traceEvents\":[]}\n", out);
+    fclose(out);
+    return 0;
+}
+
+int64_t turbomind_trace_clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void turbomind_trace_record(const char* name, uint64_t session_id, int64_t start_ns, int64_t end_ns) {}
+
+TurboMindTokenizer* turbomind_create_tokenizer(const char* model_dir) {
+    if (!model_dir) {
+        set_last_error("model_dir cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    try {
+        auto tokenizer = std::make_unique<TurboMindTokenizer>();
+        tokenizer->tokenizer = turbomind_go::Tokenizer::load(model_dir);
+        return tokenizer.release();
+    } catch (const std::ios_base::failure& e) {
+        set_last_error("Failed to load tokenizer: " + std::string(e.what()), TM_ERROR_IO);
+    } catch (const std::invalid_argument& e) {
+        set_last_error("Failed to load tokenizer: " + std::string(e.what()), TM_ERROR_INVALID_ARGUMENT);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to load tokenizer: " + std::string(e.what()), TM_ERROR_INTERNAL);
+    }
+    return nullptr;
+}
+
+void turbomind_destroy_tokenizer(TurboMindTokenizer* tokenizer) {
+    delete tokenizer;
+}
+
+TurboMindTokenizer* turbomind_get_tokenizer(TurboMindModel* model) {
+    if (!model) {
+        set_last_error("Invalid model for tokenizer", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(model->tokenizer_mutex);
+    if (!model->tokenizer) {
+        model->tokenizer.reset(turbomind_create_tokenizer(model->model_dir.c_str()));
+    }
+    return model->tokenizer.get();
+}
+
+size_t turbomind_tokenizer_max_tokens(size_t length) {
+    return turbomind_go::Tokenizer::max_tokens(length);
+}
+
+int64_t turbomind_tokenize(TurboMindTokenizer* tokenizer, const char* text, size_t length, bool add_bos,
+                           int32_t* ids, size_t capacity) {
+    if (!tokenizer || (!text && length > 0) || (!ids && capacity > 0)) {
+        set_last_error("Invalid parameters for tokenize", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return static_cast<int64_t>(tokenizer->tokenizer->encode(std::string_view(text, length), add_bos, ids, capacity));
+}
+
+int64_t turbomind_detokenize(TurboMindTokenizer* tokenizer, const int32_t* ids, size_t count, bool skip_special,
+                             char* text, size_t capacity) {
+    if (!tokenizer || (!ids && count > 0) || (!text && capacity > 0)) {
+        set_last_error("Invalid parameters for detokenize", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    std::string decoded;
+    tokenizer->tokenizer->decode(ids, count, skip_special, decoded);
+    if (capacity > 0) {
+        memcpy(text, decoded.data(), std::min(decoded.size(), capacity));
+    }
+    return static_cast<int64_t>(decoded.size());
+}
+
+int turbomind_tokenizer_vocab_size(TurboMindTokenizer* tokenizer) {
+    if (!tokenizer) {
+        set_last_error("Invalid tokenizer", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return tokenizer->tokenizer->vocab_size();
+}
+
+int turbomind_tokenizer_bos_id(TurboMindTokenizer* tokenizer) {
+    return tokenizer ? tokenizer->tokenizer->bos_id() : -1;
+}
+
+int turbomind_tokenizer_eos_id(TurboMindTokenizer* tokenizer) {
+    return tokenizer ? tokenizer->tokenizer->eos_id() : -1;
+}
+
+TurboMindDetokenizer* turbomind_create_detokenizer(TurboMindTokenizer* tokenizer, bool skip_special) {
+    if (!tokenizer) {
+        set_last_error("Invalid tokenizer for detokenizer", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    return new TurboMindDetokenizer{turbomind_go::StreamDecoder(*tokenizer->tokenizer, skip_special), {}};
+}
+
+void turbomind_destroy_detokenizer(TurboMindDetokenizer* detokenizer) {
+    delete detokenizer;
+}
+
+const char* turbomind_detokenize_step(TurboMindDetokenizer* detokenizer, const int32_t* ids, size_t count,
+                                      bool finish, size_t* length) {
+    if (!detokenizer || (!ids && count > 0) || !length) {
+        set_last_error("Invalid parameters for detokenize step", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    detokenizer->text.clear();
+    detokenizer->decoder.push(ids, count, detokenizer->text);
+    if (finish) {
+        detokenizer->decoder.finish(detokenizer->text);
+    }
+    *length = detokenizer->text.size();
+    return detokenizer->text.data();
+}
+
+const char* turbomind_detokenize_stream(TurboMindDetokenizer* detokenizer, TurboMindTokenStream* stream,
+                                        size_t* length, bool* finished) {
+    if (!detokenizer || !stream || !length || !finished) {
+        set_last_error("Invalid parameters for detokenize stream", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    detokenizer->text.clear();
+    *finished = detokenizer->decoder.drain(*stream, detokenizer->text);
+    *length = detokenizer->text.size();
+    return detokenizer->text.data();
+}
+
+TurboMindGrammar* turbomind_compile_grammar(TurboMindTokenizer* tokenizer, TurboMindGrammarKind kind,
+                                            const char* source, size_t length) {
+    if (!tokenizer || (!source && length > 0)) {
+        set_last_error("Invalid parameters for compile grammar", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    try {
+        auto grammar = tokenizer->grammars.get(*tokenizer->tokenizer, kind, std::string_view(source, length));
+        return new TurboMindGrammar{std::move(grammar)};
+    } catch (const std::invalid_argument& e) {
+        set_last_error("Failed to compile grammar: " + std::string(e.what()), TM_ERROR_INVALID_ARGUMENT);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to compile grammar: " + std::string(e.what()), TM_ERROR_INTERNAL);
+    }
+    return nullptr;
+}
+
+void turbomind_release_grammar(TurboMindGrammar* grammar) {
+    delete grammar;
+}
+
+// Checks the handle and state, recording an error if either is bad
+static bool valid_grammar_state(TurboMindGrammar* grammar, int32_t state, const char* op) {
+    if (!grammar || state < 0 || static_cast<size_t>(state) >= grammar->grammar->num_states()) {
+        set_last_error(std::string("Invalid grammar or state for ") + op, TM_ERROR_INVALID_ARGUMENT);
+        return false;
+    }
+    return true;
+}
+
+int32_t turbomind_grammar_start(TurboMindGrammar* grammar) {
+    if (!grammar) {
+        set_last_error("Invalid grammar", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return grammar->grammar->start();
+}
+
+int32_t turbomind_grammar_advance(TurboMindGrammar* grammar, int32_t state, int32_t token) {
+    if (!valid_grammar_state(grammar, state, "advance")) {
+        return -1;
+    }
+    return grammar->grammar->advance(state, token);
+}
+
+bool turbomind_grammar_accepting(TurboMindGrammar* grammar, int32_t state) {
+    return valid_grammar_state(grammar, state, "accepting") && grammar->grammar->accepting(state);
+}
+
+int64_t turbomind_grammar_allowed_ids(TurboMindGrammar* grammar, int32_t state, int32_t* ids, size_t capacity) {
+    if (!valid_grammar_state(grammar, state, "allowed ids") || (!ids && capacity > 0)) {
+        return -1;
+    }
+    const auto& transitions = grammar->grammar->transitions(state);
+    const size_t n = std::min(transitions.size(), capacity);
+    for (size_t i = 0; i < n; ++i) {
+        ids[i] = transitions[i].token;
+    }
+    return static_cast<int64_t>(transitions.size());
+}
+
+int64_t turbomind_grammar_bad_ids(TurboMindGrammar* grammar, int32_t state, int32_t* ids, size_t capacity) {
+    if (!valid_grammar_state(grammar, state, "bad ids") || (!ids && capacity > 0)) {
+        return -1;
+    }
+    thread_local std::vector<int32_t> banned;
+    grammar->grammar->banned(state, banned);
+    if (capacity > 0) {
+        std::memcpy(ids, banned.data(), std::min(banned.size(), capacity) * sizeof(int32_t));
+    }
+    return static_cast<int64_t>(banned.size());
+}
+
+int turbomind_get_tensor_para_size(TurboMindModel* model) {
+    if (!model) {
+        set_last_error("Invalid model for tensor para size", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return 1; // Mock value
+}
+
+int turbomind_get_pipeline_para_size(TurboMindModel* model) {
+    if (!model) {
+        set_last_error("Invalid model for pipeline para size", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return 1; // Mock value
+}
+
+const char* turbomind_get_last_error() {
+    return t_last_error.c_str();
+}
+
+TurboMindErrorCode turbomind_get_last_error_code() {
+    return t_last_error_code;
+}
+
+void turbomind_clear_last_error() {
+    t_last_error.clear();
+    t_last_error_code = TM_OK;
+}
+
+void turbomind_enable_log(TurboMindLogCallback callback, void* user_data, TurboMindLogLevel min_level,
+                          int max_per_second) {
+    g_log_callback = callback;
+    g_log_user_data = user_data;
+    g_log_enabled = min_level <= TM_LOG_ERROR;
+}
+
+void turbomind_disable_log() {
+    g_log_enabled = false;
+}
+
+void turbomind_set_device(int device_id) {
+    mock_out() << "Set device to: " << device_id << std::endl;
+}
+
+size_t turbomind_get_tensor_size(TurboMindTensor* tensor) {
+    if (!tensor) {
+        set_last_error("Invalid tensor for size calculation", TM_ERROR_INVALID_ARGUMENT);
+        return 0;
+    }
+    return tensor->size_bytes;
+}
+
+void turbomind_copy_tensor(TurboMindTensor* dst, TurboMindTensor* src) {
+    if (!dst || !src) {
+        set_last_error("Invalid tensors for copy", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    if (dst->size_bytes != src->size_bytes) {
+        set_last_error("Tensor size mismatch for copy", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    mock_out() << "Copied tensor (" << src->size_bytes << " bytes)" << std::endl;
+}
+
+TurboMindStream* turbomind_create_stream(int device_id) {
+    return new TurboMindStream{device_id};
+}
+
+TurboMindStream* turbomind_wrap_stream(void* cuda_stream, int device_id) {
+    return new TurboMindStream{device_id};
+}
+
+void turbomind_destroy_stream(TurboMindStream* stream) {
+    delete stream;
+}
+
+int turbomind_stream_synchronize(TurboMindStream* stream) {
+    return stream ? 0 : -1;
+}
+
+int turbomind_stream_wait_event(TurboMindStream* stream, TurboMindEvent* event) {
+    return stream && event ? 0 : -1;
+}
+
+TurboMindEvent* turbomind_copy_tensor_async(TurboMindTensor* dst, TurboMindTensor* src, TurboMindStream* stream) {
+    TurboMindCopyDesc copy{dst, src, 0, 0, 0};
+    return turbomind_copy_tensors_async(&copy, 1, stream);
+}
+
+// Host copies complete immediately, so the event is always signalled
+TurboMindEvent* turbomind_copy_tensors_async(const TurboMindCopyDesc* copies, int count, TurboMindStream* stream) {
+    if (!copies || count <= 0) {
+        set_last_error("Invalid parameters for tensor copy", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    for (int i = 0; i < count; i++) {
+        const auto& copy = copies[i];
+        if (!copy.dst || !copy.src) {
+            set_last_error("Failed to copy tensors: null tensor in copy " + std::to_string(i), TM_ERROR_INVALID_ARGUMENT);
+            return nullptr;
+        }
+        size_t bytes = copy.bytes ? copy.bytes : copy.src->size_bytes;
+        if (copy.dst_offset + bytes > copy.dst->size_bytes || copy.src_offset + bytes > copy.src->size_bytes) {
+            set_last_error("Failed to copy tensors: copy " + std::to_string(i) + " is out of bounds", TM_ERROR_INVALID_ARGUMENT);
+            return nullptr;
+        }
+        if (copy.dst->data && copy.src->data) {
+            memcpy(static_cast<char*>(copy.dst->data) + copy.dst_offset,
+                   static_cast<const char*>(copy.src->data) + copy.src_offset, bytes);
+        }
+    }
+    return new TurboMindEvent{};
+}
+
+int turbomind_event_query(TurboMindEvent* event) {
+    return event ? 1 : -1;
+}
+
+int turbomind_event_synchronize(TurboMindEvent* event) {
+    return event ? 0 : -1;
+}
+
+void turbomind_destroy_event(TurboMindEvent* event) {
+    delete event;
 }
 
 } // extern "C"
\ No newline at end of file
@@ -1,31 +1,83 @@
 #include "turbomind_wrapper.hpp"
+#include "turbomind_log.h"
+#include "turbomind_metrics.h"
+#include "turbomind_pinned_pool.h"
+#include "turbomind_pooling.h"
+#include "turbomind_prefix_cache.h"
+#include "turbomind_session_store.h"
+#include "turbomind_grammar.h"
+#include "turbomind_tokenizer.h"
+#include "turbomind_trace.h"
+#include "turbomind_weight_loader.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <chrono>
 #include <stdexcept>
 #include <iostream>
 #include <cstring>
 
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 // TurboMind headers (matching Python bindings)
 #include "src/turbomind/core/data_type.h"
 #include "src/turbomind/core/tensor.h"
 #include "src/turbomind/engine/model_request.h"
+#include "src/turbomind/engine/request.h"
 #include "src/turbomind/triton_backend/llama/LlamaTritonModel.h"
 #include "src/turbomind/utils/cuda_utils.h"
 
 namespace ft = turbomind;
 
-// Global error state
-static std::string g_last_error;
-static std::mutex g_error_mutex;
+// Per-thread error state; no locking, and no thread can overwrite another's message
+static thread_local std::string t_last_error;
+static thread_local TurboMindErrorCode t_last_error_code = TM_OK;
+
+static void set_last_error(const std::string& error, TurboMindErrorCode code) {
+    t_last_error = error;
+    t_last_error_code = code;
+    turbomind_go::log_message(TM_LOG_ERROR, error);
+}
+
+// A request the wrapper issued itself failed inside the engine
+struct EngineError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
 
-static void set_last_error(const std::string& error) {
-    std::lock_guard<std::mutex> lock(g_error_mutex);
-    g_last_error = error;
-    std::cerr << "TurboMind Error: " << error << std::endl;
+// Classify an exception caught at the API boundary
+static TurboMindErrorCode error_code(const std::exception& e) {
+    if (dynamic_cast<const std::bad_alloc*>(&e)) {
+        return TM_ERROR_OUT_OF_MEMORY;
+    }
+    if (dynamic_cast<const EngineError*>(&e)) {
+        return TM_ERROR_ENGINE;
+    }
+    if (dynamic_cast<const std::invalid_argument*>(&e) || dynamic_cast<const std::out_of_range*>(&e)) {
+        return TM_ERROR_INVALID_ARGUMENT;
+    }
+    if (dynamic_cast<const std::ios_base::failure*>(&e)) {
+        return TM_ERROR_IO;
+    }
+    // check_cuda_error throws runtime_error carrying the CUDA error string
+    if (std::strstr(e.what(), "CUDA") || std::strstr(e.what(), "cuda")) {
+        return TM_ERROR_CUDA;
+    }
+    return TM_ERROR_INTERNAL;
 }
 
 // Convert C data type to TurboMind data type
@@ -58,6 +110,117 @@ ft::DeviceType convert_memory_type(TurboMindMemoryType type) {
     }
 }
 
+// Convert TurboMind data type back to the C data type
+static TurboMindDataType convert_data_type_to_c(ft::DataType type) {
+    switch (type) {
+        case ft::kBool: return TM_TYPE_BOOL;
+        case ft::kUint8: return TM_TYPE_UINT8;
+        case ft::kUint16: return TM_TYPE_UINT16;
+        case ft::kUint32: return TM_TYPE_UINT32;
+        case ft::kUint64: return TM_TYPE_UINT64;
+        case ft::kInt8: return TM_TYPE_INT8;
+        case ft::kInt16: return TM_TYPE_INT16;
+        case ft::kInt32: return TM_TYPE_INT32;
+        case ft::kInt64: return TM_TYPE_INT64;
+        case ft::kFloat16: return TM_TYPE_FP16;
+        case ft::kFloat32: return TM_TYPE_FP32;
+        case ft::kFloat64: return TM_TYPE_FP64;
+        case ft::kBfloat16: return TM_TYPE_BF16;
+        default: return TM_TYPE_INVALID;
+    }
+}
+
+// Convert TurboMind device type back to the C memory type
+static TurboMindMemoryType convert_memory_type_to_c(ft::DeviceType type) {
+    switch (type) {
+        case ft::kCPUpinned: return TM_MEMORY_CPU_PINNED;
+        case ft::kDEVICE: return TM_MEMORY_GPU;
+        default: return TM_MEMORY_CPU;
+    }
+}
+
+// Describe a tensor without copying or taking ownership of its buffer
+static void fill_tensor_view(const ft::core::Tensor& tensor, TurboMindTensorView* view) {
+    if (tensor.ndim() > TURBOMIND_MAX_DIMS) {
+        throw std::runtime_error("tensor has more than " + std::to_string(TURBOMIND_MAX_DIMS) + " dimensions");
+    }
+    std::memset(view, 0, sizeof(*view));
+    view->data = const_cast<void*>(tensor.raw_data());
+    view->ndim = tensor.ndim();
+    for (int i = 0; i < tensor.ndim(); ++i) {
+        view->shape[i] = tensor.shape(i);
+    }
+    view->dtype = convert_data_type_to_c(tensor.dtype());
+    view->memory_type = convert_memory_type_to_c(tensor.device().type);
+    view->device_id = tensor.device().id;
+    view->byte_size = static_cast<size_t>(tensor.byte_size());
+}
+
+// Size in bytes of one element of a C data type, 0 for unknown types
+static size_t data_type_size(TurboMindDataType type) {
+    switch (type) {
+        case TM_TYPE_BOOL:
+        case TM_TYPE_UINT8:
+        case TM_TYPE_INT8: return 1;
+        case TM_TYPE_UINT16:
+        case TM_TYPE_INT16:
+        case TM_TYPE_FP16:
+        case TM_TYPE_BF16: return 2;
+        case TM_TYPE_UINT32:
+        case TM_TYPE_INT32:
+        case TM_TYPE_FP32: return 4;
+        case TM_TYPE_UINT64:
+        case TM_TYPE_INT64:
+        case TM_TYPE_FP64: return 8;
+        default: return 0;
+    }
+}
+
+// Tokenizer handles
+struct TurboMindTokenizer {
+    std::unique_ptr<turbomind_go::Tokenizer> tokenizer;
+    turbomind_go::GrammarCache grammars;
+};
+
+struct TurboMindDetokenizer {
+    turbomind_go::StreamDecoder decoder;
+    std::string text; // output of the last step
+};
+
+struct TurboMindGrammar {
+    std::shared_ptr<const turbomind_go::TokenGrammar> grammar;
+};
+
+// Integer value of a wrapper setting in the engine's YAML config, matched as
+// `key: <int>` at any nesting level; `fallback` when the key is absent
+static long long config_int(const std::string& config, const std::string& key, long long fallback) {
+    for (size_t pos = 0; pos < config.size();) {
+        size_t end = config.find('\n', pos);
+        if (end == std::string::npos) {
+            end = config.size();
+        }
+        const size_t begin = config.find_first_not_of(" \t", pos);
+        const size_t colon = begin < end ? config.find_first_not_of(" \t", begin + key.size()) : end;
+        if (begin < end && config.compare(begin, key.size(), key) == 0 && colon < end && config[colon] == ':') {
+            const std::string value = config.substr(colon + 1, end - colon - 1);
+            size_t used = 0;
+            long long parsed = 0;
+            try {
+                parsed = std::stoll(value, &used);
+            } catch (const std::exception&) {
+                used = 0;
+            }
+            const size_t rest = value.find_first_not_of(" \t\r", used);
+            if (used == 0 || (rest != std::string::npos && value[rest] != '#')) {
+                throw std::invalid_argument(key + " must be an integer, got '" + value + "'");
+            }
+            return parsed;
+        }
+        pos = end + 1;
+    }
+    return fallback;
+}
+
 // TurboMind Model wrapper
 struct TurboMindModel {
     std::shared_ptr<ft::LlamaTritonModel> model;
@@ -65,9 +228,43 @@ struct TurboMindModel {
     std::string config;
     std::string weight_type;
     
+    // Weight source (empty when weights are populated by other means)
+    std::string weights_dir;
+    int load_threads = 4;
+    TurboMindProgressCallback load_progress = nullptr;
+    void* load_progress_data = nullptr;
+    std::atomic<uint64_t> load_bytes_done{0};
+    std::atomic<uint64_t> load_bytes_total{0};
+    std::mutex load_progress_mutex; // serializes progress callbacks across ranks
+    std::string snapshot_dir;       // empty disables weight snapshots
+    std::shared_ptr<turbomind_go::PrefixCache> prefix_cache; // null unless enabled
+    std::shared_ptr<turbomind_go::SessionStore> session_store; // null unless session offload is enabled
+    std::shared_ptr<turbomind_go::EngineCounters> counters = std::make_shared<turbomind_go::EngineCounters>();
+    std::mutex tokenizer_mutex;
+    std::unique_ptr<TurboMindTokenizer> tokenizer; // loaded by turbomind_get_tokenizer
+    TurboMindModel* draft = nullptr; // speculative decoding, not owned
+    int num_draft_tokens = 0;
+    // Prompt tokens per prefill step in the model's pools, 0 for whole prompts
+    std::shared_ptr<std::atomic<int>> prefill_chunk_tokens = std::make_shared<std::atomic<int>>(0);
+    int64_t hidden_units = 0; // width of last_hidden_state, 0 when the config does not say
+    
     TurboMindModel(const std::string& dir, const std::string& cfg, const std::string& wt) 
         : model_dir(dir), config(cfg), weight_type(wt) {
         
+        const long long chunk_tokens = config_int(config, "prefill_chunk_size", 0);
+        if (chunk_tokens < 0 || chunk_tokens > INT32_MAX) {
+            throw std::invalid_argument("prefill_chunk_size out of range: " + std::to_string(chunk_tokens));
+        }
+        prefill_chunk_tokens->store(static_cast<int>(chunk_tokens));
+        
+        // Like the engine, fall back to the config.yaml next to the weights
+        std::string model_config = config;
+        if (model_config.empty()) {
+            std::ifstream in(model_dir + "/config.yaml");
+            model_config.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        hidden_units = config_int(model_config, "hidden_units", 0);
+        
         // Convert weight type to data type
         ft::DataType data_type;
         if (weight_type == "half" || weight_type == "fp16" || weight_type == "float16" || weight_type == "int4") {
@@ -96,18 +293,71 @@ struct TurboMindModel {
         // Create the model
         model = std::make_shared<ft::LlamaTritonModel>(data_type, model_dir, config, gil_factory);
     }
-};
-
-// TurboMind Model Instance wrapper
-struct TurboMindModelInstance {
-    std::unique_ptr<ft::ModelRequest> request;
-    int device_id;
     
-    TurboMindModelInstance(TurboMindModel* model, int dev_id) : device_id(dev_id) {
-        request = model->model->createModelInstance(device_id);
-        if (!request) {
-            throw std::runtime_error("Failed to create model instance");
+    // Stream one rank's parameters from the weight source
+    void load_rank(int device_id, int rank) {
+        if (weights_dir.empty()) {
+            throw std::runtime_error("no weight source set");
+        }
+        auto params = model->getParams(device_id, rank);
+        turbomind_go::WeightLoadOptions options = load_options(params, rank);
+        options.weights_dir = weights_dir;
+        options.per_rank_dirs = model->getTensorParaSize() * model->getPipelineParaSize() > 1;
+        turbomind_go::load_weights(params, device_id, options);
+    }
+    
+    // Populates one rank from its snapshot; false when there is none or it is stale
+    bool restore_snapshot(int device_id, int rank) {
+        if (snapshot_dir.empty()) {
+            return false;
+        }
+        auto params = model->getParams(device_id, rank);
+        const std::string fingerprint = snapshot_fingerprint(device_id, rank);
+        const std::string path = turbomind_go::snapshot_path(snapshot_dir, fingerprint, rank);
+        return turbomind_go::load_snapshot(params, device_id, path, fingerprint, load_options(params, rank));
+    }
+    
+    void save_snapshot(int device_id, int rank) {
+        if (snapshot_dir.empty()) {
+            return;
         }
+        auto params = model->getParams(device_id, rank);
+        const std::string fingerprint = snapshot_fingerprint(device_id, rank);
+        turbomind_go::save_snapshot(params, device_id, turbomind_go::snapshot_path(snapshot_dir, fingerprint, rank),
+                                    fingerprint);
+    }
+
+private:
+    // The rank's bytes join the total on its first copy, so a snapshot that turns
+    // out missing or stale (and falls back to the weight source) counts them once
+    turbomind_go::WeightLoadOptions load_options(const ft::core::TensorMap& params, int rank) {
+        const uint64_t rank_bytes = turbomind_go::weight_bytes(params);
+        auto counted = std::make_shared<std::once_flag>();
+        
+        turbomind_go::WeightLoadOptions options;
+        options.rank = rank;
+        options.num_threads = load_threads;
+        options.on_bytes = [this, rank_bytes, counted](uint64_t bytes) {
+            std::call_once(*counted, [&] { load_bytes_total += rank_bytes; });
+            const uint64_t done = load_bytes_done += bytes;
+            if (load_progress) {
+                std::lock_guard<std::mutex> lock(load_progress_mutex);
+                load_progress(load_progress_data, done, load_bytes_total.load());
+            }
+        };
+        return options;
+    }
+    
+    // Everything the parameter layout of a rank depends on
+    std::string snapshot_fingerprint(int device_id, int rank) {
+        int major = 0;
+        int minor = 0;
+        ft::check_cuda_error(cudaDeviceGetAttribute(&major, cudaDevAttrComputeCapabilityMajor, device_id));
+        ft::check_cuda_error(cudaDeviceGetAttribute(&minor, cudaDevAttrComputeCapabilityMinor, device_id));
+        return "model_dir=" + model_dir + ";weight_type=" + weight_type + ";rank=" + std::to_string(rank) +
+               ";tp=" + std::to_string(model->getTensorParaSize()) +
+               ";pp=" + std::to_string(model->getPipelineParaSize()) + ";sm=" + std::to_string(major * 10 + minor) +
+               ";config=" + config;
     }
 };
 
@@ -134,355 +384,3473 @@ struct TurboMindTensor {
         std::shared_ptr<void> data_ptr(data, [](void*) {}); // Non-owning
         tensor = std::make_shared<ft::core::Tensor>(data_ptr, std::move(ft_shape), ft_dtype, device);
     }
+    
+    // Another reference to an existing tensor (shares its buffer)
+    explicit TurboMindTensor(const ft::core::Tensor& existing) {
+        shape_storage.assign(existing.shape().begin(), existing.shape().end());
+        tensor = std::make_shared<ft::core::Tensor>(existing);
+    }
+    
+    // Tensor owning a pinned pool buffer; the buffer returns to the pool once the
+    // last reference (including ones held by in-flight requests) is gone
+    TurboMindTensor(int64_t* shape, int ndim, TurboMindDataType dtype, int device_id, void** data) {
+        shape_storage.assign(shape, shape + ndim);
+        
+        size_t bytes = data_type_size(dtype);
+        for (int i = 0; i < ndim; ++i) {
+            if (shape[i] < 0) {
+                throw std::runtime_error("negative tensor dimension");
+            }
+            bytes *= static_cast<size_t>(shape[i]);
+        }
+        if (bytes == 0) {
+            throw std::runtime_error("empty tensor or unknown data type");
+        }
+        
+        std::shared_ptr<void> data_ptr(turbomind_go::PinnedPool::instance().allocate(bytes),
+                                       [](void* p) { turbomind_go::PinnedPool::instance().release(p); });
+        *data = data_ptr.get();
+        
+        std::vector<ft::core::ssize_t> ft_shape(shape, shape + ndim);
+        ft::core::Device device{ft::kCPUpinned, device_id};
+        tensor = std::make_shared<ft::core::Tensor>(std::move(data_ptr), std::move(ft_shape),
+                                                    convert_data_type(dtype), device);
+    }
 };
 
+struct TensorMapArena;
+
 // TurboMind TensorMap wrapper
 struct TurboMindTensorMap {
     std::shared_ptr<ft::core::TensorMap> tensor_map;
+    TensorMapArena* arena = nullptr; // set for maps built by turbomind_build_inputs
+    std::shared_ptr<char> anchor;    // shared by the arena map's borrowed tensor buffers
     
     TurboMindTensorMap() {
         tensor_map = std::make_shared<ft::core::TensorMap>();
     }
 };
 
-// TurboMind Forward Result wrapper
-struct TurboMindForwardResult {
-    std::shared_ptr<ft::core::TensorMap> tensors;
-    TurboMindRequestStatus status;
-    int seq_len;
+// Recycles input maps across requests. A slot is reused only once the caller has
+// destroyed its handle and the engine has dropped every reference to the map and
+// its tensors. Keys, hash nodes and the wrapper itself are reused, so a steady
+// stream of same-shaped requests allocates only the tensors' shape storage.
+struct TensorMapArena {
+    struct Slot {
+        TurboMindTensorMap map;
+        bool handed_out = false;
+    };
     
-    TurboMindForwardResult(std::shared_ptr<ft::core::TensorMap> t, TurboMindRequestStatus s, int len)
-        : tensors(t), status(s), seq_len(len) {}
-};
-
-// C API Implementation
-
-extern "C" {
-
-// Model creation and management
-TurboMindModel* turbomind_create_model(const char* model_dir, const char* config, const char* weight_type) {
-    if (!model_dir) {
-        set_last_error("model_dir cannot be null");
-        return nullptr;
-    }
+    std::mutex mutex;
+    std::deque<Slot> slots; // stable addresses
     
-    try {
-        std::string cfg = config ? config : "";
-        std::string wt = weight_type ? weight_type : "half";
+    TurboMindTensorMap* build(const TurboMindTensorDesc* descs, int count) {
+        for (int i = 0; i < count; ++i) {
+            const auto& desc = descs[i];
+            if (!desc.name || !desc.data || desc.ndim <= 0 || desc.ndim > TURBOMIND_MAX_DIMS) {
+                throw std::runtime_error("invalid descriptor at index " + std::to_string(i));
+            }
+        }
         
-        return new TurboMindModel(model_dir, cfg, wt);
-    } catch (const std::exception& e) {
-        set_last_error("Failed to create model: " + std::string(e.what()));
-        return nullptr;
-    }
-}
-
-void turbomind_destroy_model(TurboMindModel* model) {
-    delete model;
-}
-
-// Model setup functions
-void turbomind_create_shared_weights(TurboMindModel* model, int device_id, int rank) {
-    if (!model || !model->model) {
-        set_last_error("model cannot be null");
-        return;
+        TurboMindTensorMap* map = acquire();
+        try {
+            auto& tensors = *map->tensor_map;
+            // Drop keys this request does not set, keep the nodes of the rest
+            for (auto it = tensors.begin(); it != tensors.end();) {
+                bool keep = false;
+                for (int i = 0; i < count && !keep; ++i) {
+                    keep = it->first == descs[i].name;
+                }
+                it = keep ? std::next(it) : tensors.erase(it);
+            }
+            for (int i = 0; i < count; ++i) {
+                const auto& desc = descs[i];
+                // Aliasing the anchor makes the buffer borrowed without a control block per tensor
+                std::shared_ptr<void> data(map->anchor, desc.data);
+                tensors[desc.name] = ft::core::Tensor(std::move(data),
+                                                      std::vector<ft::core::ssize_t>(desc.shape, desc.shape + desc.ndim),
+                                                      convert_data_type(desc.dtype),
+                                                      {convert_memory_type(desc.memory_type), desc.device_id});
+            }
+        } catch (...) {
+            release(map);
+            throw;
+        }
+        return map;
     }
     
-    try {
-        model->model->createSharedWeights(device_id, rank);
-    } catch (const std::exception& e) {
-        set_last_error("Failed to create shared weights: " + std::string(e.what()));
+    void release(TurboMindTensorMap* map) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& slot : slots) {
+            if (&slot.map == map) {
+                slot.handed_out = false;
+                return;
+            }
+        }
     }
-}
 
-void turbomind_process_weights(TurboMindModel* model, int device_id, int rank) {
-    if (!model || !model->model) {
-        set_last_error("model cannot be null");
-        return;
+private:
+    TurboMindTensorMap* acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& slot : slots) {
+            // Only the arena holds the map: nobody can take new references concurrently
+            if (slot.handed_out || slot.map.tensor_map.use_count() != 1) {
+                continue;
+            }
+            // The map's own tensors alias the anchor too. Empty them, keeping the
+            // nodes, so that the count only sees copies held outside the slot.
+            for (auto& entry : *slot.map.tensor_map) {
+                entry.second = ft::core::Tensor{};
+            }
+            if (slot.map.anchor.use_count() == 1) {
+                slot.handed_out = true;
+                return &slot.map;
+            }
+        }
+        auto& slot = slots.emplace_back();
+        slot.map.arena = this;
+        slot.map.anchor = std::make_shared<char>();
+        slot.handed_out = true;
+        return &slot.map;
     }
+};
+
+// TurboMind Model Instance wrapper
+struct TurboMindModelInstance {
+    std::unique_ptr<ft::ModelRequest> request;
+    int device_id;
+    TensorMapArena inputs;
+    std::shared_ptr<turbomind_go::PrefixCache> prefix_cache;
+    std::shared_ptr<turbomind_go::SessionStore> session_store;
+    std::shared_ptr<turbomind_go::EngineCounters> counters;
     
-    try {
-        model->model->processWeights(device_id, rank);
-    } catch (const std::exception& e) {
-        set_last_error("Failed to process weights: " + std::string(e.what()));
+    TurboMindModelInstance(TurboMindModel* model, int dev_id)
+        : device_id(dev_id),
+          prefix_cache(model->prefix_cache),
+          session_store(model->session_store),
+          counters(model->counters) {
+        request = model->model->createModelInstance(device_id);
+        if (!request) {
+            throw std::runtime_error("Failed to create model instance");
+        }
     }
-}
+};
 
-void turbomind_create_engine(TurboMindModel* model, int device_id, int rank) {
-    if (!model || !model->model) {
-        set_last_error("model cannot be null");
-        return;
-    }
+
+// CUDA stream handle, owned unless wrapped from the caller
+struct TurboMindStream {
+    cudaStream_t stream = nullptr;
+    int device_id = 0;
+    bool owned = false;
     
-    try {
-        model->model->createEngine(device_id, rank);
-    } catch (const std::exception& e) {
-        set_last_error("Failed to create engine: " + std::string(e.what()));
+    ~TurboMindStream() {
+        if (owned && stream) {
+            cudaStreamDestroy(stream);
+        }
     }
-}
+};
 
-// Model instance management
-TurboMindModelInstance* turbomind_create_model_instance(TurboMindModel* model, int device_id) {
-    if (!model) {
-        set_last_error("model cannot be null");
-        return nullptr;
-    }
+// Completion marker of an asynchronous copy. Holds the copied tensors so their
+// buffers outlive the copy even if the caller drops them first.
+struct TurboMindEvent {
+    cudaEvent_t event = nullptr;
+    std::vector<std::shared_ptr<ft::core::Tensor>> tensors;
     
-    try {
-        return new TurboMindModelInstance(model, device_id);
-    } catch (const std::exception& e) {
-        set_last_error("Failed to create model instance: " + std::string(e.what()));
-        return nullptr;
+    ~TurboMindEvent();
+};
+
+// Events are recycled: creating one per copy costs more than the copy for small tensors
+static std::mutex g_event_mutex;
+static std::vector<cudaEvent_t> g_free_events;
+
+static cudaEvent_t acquire_event() {
+    {
+        std::lock_guard<std::mutex> lock(g_event_mutex);
+        if (!g_free_events.empty()) {
+            cudaEvent_t event = g_free_events.back();
+            g_free_events.pop_back();
+            return event;
+        }
     }
+    cudaEvent_t event = nullptr;
+    ft::check_cuda_error(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+    return event;
 }
 
-void turbomind_destroy_model_instance(TurboMindModelInstance* instance) {
-    delete instance;
+TurboMindEvent::~TurboMindEvent() {
+    if (event) {
+        // The copy may still be reading the tensors released below
+        cudaEventSynchronize(event);
+        std::lock_guard<std::mutex> lock(g_event_mutex);
+        g_free_events.push_back(event);
+    }
 }
 
-// Tensor management
-TurboMindTensor* turbomind_create_tensor(void* data, int64_t* shape, int ndim, 
-                                        TurboMindDataType dtype, TurboMindMemoryType memory_type, int device_id) {
-    if (!data || !shape || ndim <= 0) {
-        set_last_error("Invalid tensor parameters");
-        return nullptr;
-    }
-    
-    try {
-        return new TurboMindTensor(data, shape, ndim, dtype, memory_type, device_id);
-    } catch (const std::exception& e) {
-        set_last_error("Failed to create tensor: " + std::string(e.what()));
-        return nullptr;
+// Map engine request status codes to C API status
+static TurboMindRequestStatus convert_request_status(int status) {
+    switch (status) {
+        case ft::Request::kOk: return TM_REQUEST_RUNNING;
+        case ft::Request::kFinish: return TM_REQUEST_COMPLETED;
+        case ft::Request::kCancel: return TM_REQUEST_CANCELLED;
+        default: return TM_REQUEST_FAILED;
     }
 }
 
-void turbomind_destroy_tensor(TurboMindTensor* tensor) {
-    delete tensor;
+static bool is_terminal_status(TurboMindRequestStatus status) {
+    return status == TM_REQUEST_COMPLETED || status == TM_REQUEST_CANCELLED || status == TM_REQUEST_FAILED;
 }
 
-// TensorMap management
-TurboMindTensorMap* turbomind_create_tensor_map() {
-    try {
-        return new TurboMindTensorMap();
-    } catch (const std::exception& e) {
-        set_last_error("Failed to create tensor map: " + std::string(e.what()));
-        return nullptr;
-    }
+// Convert C session to TurboMind session param
+static ft::SessionParam convert_session(const TurboMindSession* session) {
+    ft::SessionParam session_param{};
+    session_param.id = session->id;
+    session_param.step = session->step;
+    session_param.start_flag = session->start_flag;
+    session_param.end_flag = session->end_flag;
+    return session_param;
 }
 
-void turbomind_destroy_tensor_map(TurboMindTensorMap* tensor_map) {
-    delete tensor_map;
+// Convert C generation config to TurboMind generation config
+static ft::GenerationConfig convert_generation_config(const TurboMindGenerationConfig* gen_config) {
+    ft::GenerationConfig generation_config;
+    generation_config.max_new_tokens = gen_config->max_new_tokens;
+    generation_config.min_new_tokens = gen_config->min_new_tokens;
+    generation_config.top_p = gen_config->top_p;
+    generation_config.top_k = gen_config->top_k;
+    generation_config.min_p = gen_config->min_p;
+    generation_config.temperature = gen_config->temperature;
+    generation_config.repetition_penalty = gen_config->repetition_penalty;
+    generation_config.random_seed = gen_config->random_seed;
+    generation_config.output_logprobs = gen_config->output_logprobs;
+    generation_config.output_last_hidden_state = gen_config->output_last_hidden_state;
+    generation_config.output_logits = gen_config->output_logits;
+    
+    // Convert arrays
+    if (gen_config->eos_ids && gen_config->eos_ids_count > 0) {
+        generation_config.eos_ids.assign(gen_config->eos_ids, gen_config->eos_ids + gen_config->eos_ids_count);
+    }
+    if (gen_config->stop_ids && gen_config->stop_ids_count > 0) {
+        generation_config.stop_ids[0].assign(gen_config->stop_ids, gen_config->stop_ids + gen_config->stop_ids_count);
+    }
+    if (gen_config->bad_ids && gen_config->bad_ids_count > 0) {
+        generation_config.bad_ids[0].assign(gen_config->bad_ids, gen_config->bad_ids + gen_config->bad_ids_count);
+    }
+    return generation_config;
 }
 
-int turbomind_tensor_map_set(TurboMindTensorMap* tensor_map, const char* key, TurboMindTensor* tensor) {
-    if (!tensor_map || !key || !tensor) {
-        set_last_error("Invalid parameters for tensor map set");
-        return -1;
+// Allocate a token ring with room for `max_tokens` entries in one pinned pool block
+static TurboMindTokenStream* create_token_stream(int max_tokens) {
+    uint32_t capacity = 16;
+    while (capacity < static_cast<uint32_t>(max_tokens)) {
+        capacity <<= 1;
     }
     
-    try {
-        (*tensor_map->tensor_map)[key] = *tensor->tensor;
-        return 0;
-    } catch (const std::exception& e) {
-        set_last_error("Failed to set tensor in map: " + std::string(e.what()));
-        return -1;
-    }
+    const size_t header_size = (sizeof(TurboMindTokenStream) + 63) & ~size_t(63);
+    void* block = turbomind_go::PinnedPool::instance().allocate(header_size +
+                                                                capacity * (sizeof(int32_t) + sizeof(float)));
+    
+    auto stream = static_cast<TurboMindTokenStream*>(block);
+    std::memset(stream, 0, sizeof(TurboMindTokenStream));
+    stream->capacity = capacity;
+    stream->token_ids = reinterpret_cast<int32_t*>(static_cast<char*>(block) + header_size);
+    stream->logprobs = reinterpret_cast<float*>(stream->token_ids + capacity);
+    return stream;
 }
 
-TurboMindTensor* turbomind_tensor_map_get(TurboMindTensorMap* tensor_map, const char* key) {
-    if (!tensor_map || !key) {
-        set_last_error("Invalid parameters for tensor map get");
-        return nullptr;
+static void destroy_token_stream(TurboMindTokenStream* stream) {
+    turbomind_go::PinnedPool::instance().release(stream);
+}
+
+// Per-request state shared between the caller's result handle and the engine callback.
+// The engine may keep invoking the callback after the handle is destroyed, so the
+// callback holds its own reference.
+struct ForwardContext {
+    std::shared_ptr<ft::core::TensorMap> tensors;
+    std::shared_ptr<ft::AtomicRequestState> state;
+    
+    // Streaming ring and borrowed output pointers resolved once at submit time
+    TurboMindTokenStream* token_stream = nullptr;
+    int streamed = 0;
+    const int* output_ids = nullptr;
+    const float* logprob_vals = nullptr;
+    const int* logprob_indexes = nullptr;
+    const int* logprob_nums = nullptr;
+    int logprob_stride = 0;
+    
+    std::mutex mutex;
+    std::condition_variable cv;
+    TurboMindRequestStatus status = TM_REQUEST_PENDING;
+    int engine_status = 0;
+    int seq_len = 0;
+    int event_fd = -1;
+    
+    // Instance the request runs on, null while queued
+    ft::ModelRequest* request = nullptr;
+    bool cancel_requested = false;
+    
+    // Invoked once when a started request reaches a terminal status (frees the pool slot)
+    std::function<void()> on_finish;
+    
+    // Prompt recorded in the prefix cache and session store once the request completes
+    std::shared_ptr<turbomind_go::PrefixCache> prefix_cache;
+    std::shared_ptr<turbomind_go::SessionStore> session_store;
+    ft::SessionParam session{};
+    std::vector<int> prompt;
+    std::vector<int> chunked_prompt; // the whole prompt when this request ends a chunked prefill
+    int prefix_hit_len = 0;
+    
+    // Timestamps and token counts for turbomind_get_request_timings (guarded by `mutex`)
+    TurboMindRequestTimings timings{};
+    int64_t last_token_ns = 0;
+    std::shared_ptr<turbomind_go::EngineCounters> counters; // set once the request starts
+    uint64_t session_id = 0;
+    
+    // Lazily created for turbomind_copy_output_async
+    cudaStream_t copy_stream = nullptr;
+    cudaEvent_t copy_done = nullptr;
+    
+    // Guarded separately so user callbacks never run under `mutex`
+    std::mutex callback_mutex;
+    TurboMindForwardCallback callback = nullptr;
+    void* user_data = nullptr;
+    
+    ~ForwardContext() {
+        if (event_fd >= 0) {
+            close(event_fd);
+        }
+        if (copy_stream) {
+            cudaStreamSynchronize(copy_stream);
+            cudaEventDestroy(copy_done);
+            cudaStreamDestroy(copy_stream);
+        }
+        destroy_token_stream(token_stream);
     }
     
-    try {
-        auto it = tensor_map->tensor_map->find(key);
-        if (it == tensor_map->tensor_map->end()) {
-            set_last_error("Tensor not found in map: " + std::string(key));
-            return nullptr;
+    // Resolve output buffers the producer reads from on every update
+    void attach_outputs() {
+        auto find = [&](const char* key) -> ft::core::Tensor* {
+            auto it = tensors->find(key);
+            return it == tensors->end() ? nullptr : &it->second;
+        };
+        if (auto t = find("output_ids")) {
+            output_ids = t->data<int>();
+        }
+        auto vals = find("logprob_vals");
+        auto indexes = find("logprob_indexes");
+        auto nums = find("logprob_nums");
+        if (vals && indexes && nums && vals->ndim() == 2) {
+            logprob_vals = vals->data<float>();
+            logprob_indexes = indexes->data<int>();
+            logprob_nums = nums->data<int>();
+            logprob_stride = static_cast<int>(vals->shape(1));
         }
-        
-        // Create wrapper for existing tensor
-        // Note: This is a simplified implementation - proper implementation would need
-        // to handle tensor lifetime properly
-        return nullptr; // TODO: Implement proper tensor extraction
-    } catch (const std::exception& e) {
-        set_last_error("Failed to get tensor from map: " + std::string(e.what()));
-        return nullptr;
     }
-}
-
-// Forward inference
-TurboMindForwardResult* turbomind_forward(TurboMindModelInstance* instance, 
-                                         TurboMindTensorMap* input_tensors,
-                                         TurboMindSession* session,
-                                         TurboMindGenerationConfig* gen_config,
-                                         bool stream_output) {
-    if (!instance || !input_tensors || !session || !gen_config) {
-        set_last_error("Invalid parameters for forward");
-        return nullptr;
+    
+    // Logprob of the sampled token at generation step `i`, NaN when unavailable
+    float sampled_logprob(int i, int token_id) const {
+        if (!logprob_vals) {
+            return NAN;
+        }
+        const int n = std::min(logprob_nums[i], logprob_stride);
+        for (int k = 0; k < n; ++k) {
+            if (logprob_indexes[i * logprob_stride + k] == token_id) {
+                return logprob_vals[i * logprob_stride + k];
+            }
+        }
+        return NAN;
     }
     
-    try {
-        // Create session param
-        ft::SessionParam session_param;
-        session_param.id = session->id;
-        session_param.step = session->step;
-        session_param.start_flag = session->start_flag;
-        session_param.end_flag = session->end_flag;
-        
-        // Create generation config
-        ft::GenerationConfig generation_config;
-        generation_config.max_new_tokens = gen_config->max_new_tokens;
-        generation_config.min_new_tokens = gen_config->min_new_tokens;
-        generation_config.top_p = gen_config->top_p;
-        generation_config.top_k = gen_config->top_k;
-        generation_config.min_p = gen_config->min_p;
-        generation_config.temperature = gen_config->temperature;
-        generation_config.repetition_penalty = gen_config->repetition_penalty;
-        generation_config.random_seed = gen_config->random_seed;
-        generation_config.output_logprobs = gen_config->output_logprobs;
-        generation_config.output_last_hidden_state = gen_config->output_last_hidden_state;
-        generation_config.output_logits = gen_config->output_logits;
-        
-        // Convert arrays
-        if (gen_config->eos_ids && gen_config->eos_ids_count > 0) {
-            generation_config.eos_ids.assign(gen_config->eos_ids, gen_config->eos_ids + gen_config->eos_ids_count);
+    // Copy newly generated tokens into the ring (caller holds `mutex`). The ring is
+    // sized for max_new_tokens, so the producer never has to wait on the consumer.
+    void publish_tokens() {
+        if (!token_stream || !output_ids) {
+            return;
         }
-        if (gen_config->stop_ids && gen_config->stop_ids_count > 0) {
-            generation_config.stop_ids[0].assign(gen_config->stop_ids, gen_config->stop_ids + gen_config->stop_ids_count);
+        const uint64_t mask = token_stream->capacity - 1;
+        uint64_t head = token_stream->head;
+        for (; streamed < seq_len; ++streamed, ++head) {
+            const int token_id = output_ids[streamed];
+            token_stream->token_ids[head & mask] = token_id;
+            token_stream->logprobs[head & mask] = sampled_logprob(streamed, token_id);
         }
-        if (gen_config->bad_ids && gen_config->bad_ids_count > 0) {
-            generation_config.bad_ids[0].assign(gen_config->bad_ids, gen_config->bad_ids + gen_config->bad_ids_count);
+        __atomic_store_n(&token_stream->head, head, __ATOMIC_RELEASE);
+        if (is_terminal_status(status)) {
+            __atomic_store_n(&token_stream->finished, 1u, __ATOMIC_RELEASE);
         }
-        
-        // Prepare input param
-        ft::ModelRequest::InputParam input_param;
-        input_param.tensors = input_tensors->tensor_map;
-        input_param.session = session_param;
-        input_param.gen_cfg = generation_config;
-        input_param.stream_output = stream_output;
-        
-        // Call forward
-        auto output_param = instance->request->Forward(std::move(input_param), nullptr);
-        
-        // Create result
-        TurboMindRequestStatus status = TM_REQUEST_COMPLETED; // Simplified
-        return new TurboMindForwardResult(output_param.tensors, status, 0);
-        
-    } catch (const std::exception& e) {
-        set_last_error("Forward inference failed: " + std::string(e.what()));
-        return nullptr;
     }
-}
+    
+    // Consume the latest engine state (if any) and notify waiters
+    void on_progress() {
+        TurboMindRequestStatus new_status;
+        int new_seq_len;
+        std::function<void()> finish_hook;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!state || is_terminal_status(status)) {
+                return;
+            }
+            auto update = state->exchange(nullptr);
+            if (!update) {
+                return;
+            }
+            engine_status = update->status;
+            finish_hook = apply(convert_request_status(update->status), update->seq_len);
+            new_status = status;
+            new_seq_len = seq_len;
+        }
+        notify(new_status, new_seq_len, std::move(finish_hook));
+    }
+    
+    // Move to a terminal status without an engine update (e.g. cancelled while queued)
+    void finish(TurboMindRequestStatus final_status) {
+        int new_seq_len;
+        std::function<void()> finish_hook;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (is_terminal_status(status)) {
+                return;
+            }
+            finish_hook = apply(final_status, seq_len);
+            new_seq_len = seq_len;
+        }
+        notify(final_status, new_seq_len, std::move(finish_hook));
+    }
+    
+    // Cancel the request whether it is queued or already running
+    void cancel() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (is_terminal_status(status)) {
+                return;
+            }
+            cancel_requested = true;
+            if (request) {
+                // Holding `mutex` keeps the request from finishing (and its pool
+                // instance from being reused) while the cancel is issued
+                request->Cancel();
+                return;
+            }
+        }
+        finish(TM_REQUEST_CANCELLED);
+    }
+
+private:
+    // Record a new status (caller holds `mutex`). Returns the finish hook on the
+    // terminal transition, which happens exactly once.
+    std::function<void()> apply(TurboMindRequestStatus new_status, int new_seq_len) {
+        status = new_status;
+        if (new_seq_len > seq_len) {
+            record_tokens(new_seq_len);
+        }
+        seq_len = std::max(seq_len, new_seq_len);
+        if (is_terminal_status(status)) {
+            timings.finish_ns = turbomind_go::now_ns();
+            timings.generated_tokens = seq_len;
+            count_finish();
+            trace_phases();
+        }
+        publish_tokens();
+        if (event_fd >= 0) {
+            uint64_t one = 1;
+            (void)!write(event_fd, &one, sizeof(one));
+        }
+        return is_terminal_status(status) ? std::move(on_finish) : nullptr;
+    }
+    
+    // Time the arrival of tokens up to `new_seq_len` (caller holds `mutex`)
+    void record_tokens(int new_seq_len) {
+        const int64_t now = turbomind_go::now_ns();
+        if (seq_len == 0) {
+            timings.first_token_ns = now;
+        } else {
+            const int64_t gap = now - last_token_ns;
+            timings.decode_min_ns = timings.decode_steps ? std::min(timings.decode_min_ns, gap) : gap;
+            timings.decode_max_ns = std::max(timings.decode_max_ns, gap);
+            timings.decode_total_ns += gap;
+            timings.decode_steps++;
+        }
+        if (counters) {
+            counters->generated_tokens.fetch_add(new_seq_len - seq_len, std::memory_order_relaxed);
+            if (seq_len == 0) {
+                counters->decoding_requests.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        last_token_ns = now;
+        timings.generated_tokens = new_seq_len;
+    }
+    
+    // Queue, prefill and decode spans of a finished request for the trace recorder
+    void trace_phases() const {
+        if (!turbomind_go::TraceRecorder::instance().enabled() || !timings.scheduled_ns) {
+            return;
+        }
+        turbomind_go::trace_span("tm.request.queue", session_id, timings.submit_ns, timings.scheduled_ns);
+        const int64_t first = timings.first_token_ns ? timings.first_token_ns : timings.finish_ns;
+        turbomind_go::trace_span("tm.request.prefill", session_id, timings.scheduled_ns, first);
+        if (timings.first_token_ns) {
+            turbomind_go::trace_span("tm.request.decode", session_id, timings.first_token_ns, timings.finish_ns);
+        }
+    }
+    
+    // Leave the model's gauges on the terminal transition (caller holds `mutex`)
+    void count_finish() {
+        if (!counters) {
+            return;
+        }
+        counters->active_requests.fetch_sub(1, std::memory_order_relaxed);
+        if (seq_len > 0) {
+            counters->decoding_requests.fetch_sub(1, std::memory_order_relaxed);
+        }
+        auto& finished = status == TM_REQUEST_COMPLETED ? counters->completed_requests
+                         : status == TM_REQUEST_CANCELLED ? counters->cancelled_requests
+                                                          : counters->failed_requests;
+        finished.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    // Feed a completed request into the global histograms; timings are final here
+    void record_latencies() const {
+        using turbomind_go::latency_histogram;
+        if (timings.scheduled_ns) {
+            latency_histogram(TM_HISTOGRAM_QUEUE).record(timings.scheduled_ns - timings.submit_ns);
+        }
+        if (timings.first_token_ns) {
+            latency_histogram(TM_HISTOGRAM_TTFT).record(timings.first_token_ns - timings.submit_ns);
+        }
+        if (timings.generated_tokens > 1) {
+            latency_histogram(TM_HISTOGRAM_DECODE_TOKEN)
+                .record((last_token_ns - timings.first_token_ns) / (timings.generated_tokens - 1));
+        }
+        latency_histogram(TM_HISTOGRAM_E2E).record(timings.finish_ns - timings.submit_ns);
+    }
+    
+    void notify(TurboMindRequestStatus new_status, int new_seq_len, std::function<void()> finish_hook) {
+        if (new_status == TM_REQUEST_COMPLETED) {
+            record_latencies();
+        }
+        // The engine has prefilled the prompt, so later requests can reuse its blocks
+        if (new_status == TM_REQUEST_COMPLETED && prefix_cache) {
+            const std::vector<int>& indexed = chunked_prompt.empty() ? prompt : chunked_prompt;
+            prefix_cache->insert(indexed.data(), static_cast<int>(indexed.size()));
+        }
+        if (is_terminal_status(new_status) && session_store) {
+            // A failed or cancelled step leaves the engine's history unknown
+            if (new_status == TM_REQUEST_COMPLETED && !session.end_flag) {
+                session_store->record(session.id, session.step, prompt.data(), static_cast<int>(prompt.size()),
+                                      output_ids, output_ids ? new_seq_len : 0);
+            } else {
+                session_store->erase(session.id);
+            }
+        }
+        cv.notify_all();
+        
+        if (finish_hook) {
+            finish_hook();
+        }
+        
+        std::lock_guard<std::mutex> lock(callback_mutex);
+        if (callback) {
+            callback(user_data, new_status, new_seq_len);
+        }
+    }
+};
+
+// TurboMind Forward Result wrapper
+struct TurboMindForwardResult {
+    std::shared_ptr<ForwardContext> ctx;
+    
+    explicit TurboMindForwardResult(std::shared_ptr<ForwardContext> c) : ctx(std::move(c)) {}
+    
+    ~TurboMindForwardResult() {
+        // Detach the user callback; the engine may still hold the context
+        std::lock_guard<std::mutex> lock(ctx->callback_mutex);
+        ctx->callback = nullptr;
+        ctx->user_data = nullptr;
+    }
+};
+
+// Results of one turbomind_forward_batch call, in submission order
+struct TurboMindBatchResult {
+    std::vector<std::unique_ptr<TurboMindForwardResult>> results;
+};
+
+// Create the state for a new request before it is handed to an instance
+static std::shared_ptr<ForwardContext> create_forward_context(const ft::GenerationConfig& generation_config,
+                                                              bool stream_output,
+                                                              TurboMindForwardCallback callback,
+                                                              void* user_data) {
+    auto ctx = std::make_shared<ForwardContext>();
+    ctx->timings.submit_ns = turbomind_go::now_ns();
+    ctx->callback = callback;
+    ctx->user_data = user_data;
+    if (stream_output) {
+        ctx->token_stream = create_token_stream(generation_config.max_new_tokens);
+    }
+    return ctx;
+}
+
+static ft::ModelRequest::InputParam create_input_param(std::shared_ptr<ft::core::TensorMap> input_tensors,
+                                                       const ft::SessionParam& session_param,
+                                                       const ft::GenerationConfig& generation_config,
+                                                       bool stream_output) {
+    ft::ModelRequest::InputParam input_param;
+    input_param.tensors = std::move(input_tensors);
+    input_param.session = session_param;
+    input_param.gen_cfg = generation_config;
+    input_param.stream_output = stream_output;
+    return input_param;
+}
+
+// Capture the prompt for the prefix cache and the session store. Prompts on the
+// device are not read back, so they are neither matched nor tracked.
+static void track_request(ForwardContext& ctx,
+                          TurboMindModelInstance* instance,
+                          const ft::ModelRequest::InputParam& input_param) {
+    const ft::SessionParam& session = input_param.session;
+    auto& store = instance->session_store;
+    if (store && store->is_suspended(session.id)) {
+        throw std::runtime_error("session " + std::to_string(session.id) + " is suspended; resume it first");
+    }
+    
+    const int* ids = nullptr;
+    int count = 0;
+    auto it = input_param.tensors->find("input_ids");
+    if (it != input_param.tensors->end() && it->second.device().type != ft::kDEVICE &&
+        it->second.dtype() == ft::kInt32) {
+        ids = it->second.data<int>();
+        count = static_cast<int>(it->second.size());
+    }
+    if (!ids) {
+        if (store) {
+            store->erase(session.id);
+        }
+        return;
+    }
+    
+    // Continued sessions extend history the prefix index never saw, except the
+    // end of a chunked prompt: its first chunk was matched, and it indexes the whole
+    const bool new_sequence = session.start_flag && session.step == 0;
+    const int hit_len = new_sequence && instance->prefix_cache ? instance->prefix_cache->match(ids, count) : 0;
+    
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+    const bool chunked = !ctx.chunked_prompt.empty();
+    auto cache = new_sequence || chunked ? instance->prefix_cache : nullptr;
+    if (cache || store) {
+        ctx.prompt.assign(ids, ids + count);
+    }
+    if (!chunked) {
+        ctx.prefix_hit_len = hit_len;
+    }
+    ctx.prefix_cache = std::move(cache);
+    ctx.session_store = store;
+    ctx.session = session;
+}
+
+// Submit a request to the engine without waiting for it to finish. Returns false
+// if the request was cancelled before it could start; `on_finish` is only
+// installed (and later invoked) when the request starts.
+static bool start_forward(const std::shared_ptr<ForwardContext>& ctx,
+                          TurboMindModelInstance* instance,
+                          ft::ModelRequest::InputParam input_param,
+                          std::function<void()> on_finish = nullptr) {
+    turbomind_go::TraceScope trace("tm.forward", input_param.session.id);
+    ft::ModelRequest* request = instance->request.get();
+    auto input_ids = input_param.tensors->find("input_ids");
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        if (is_terminal_status(ctx->status)) {
+            return false;
+        }
+        ctx->request = request;
+        ctx->on_finish = std::move(on_finish);
+        ctx->timings.scheduled_ns = turbomind_go::now_ns();
+        if (input_ids != input_param.tensors->end()) {
+            ctx->timings.prompt_tokens = static_cast<int32_t>(input_ids->second.size());
+        }
+        ctx->session_id = input_param.session.id;
+        ctx->counters = instance->counters;
+        ctx->counters->active_requests.fetch_add(1, std::memory_order_relaxed);
+        ctx->counters->prompt_tokens.fetch_add(ctx->timings.prompt_tokens, std::memory_order_relaxed);
+    }
+    if (instance->prefix_cache || instance->session_store) {
+        try {
+            track_request(*ctx, instance, input_param);
+        } catch (...) {
+            ctx->finish(TM_REQUEST_FAILED);
+            throw;
+        }
+    }
+    
+    try {
+        auto output_param = request->Forward(std::move(input_param), [ctx] { ctx->on_progress(); });
+        
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        ctx->tensors = output_param.tensors;
+        ctx->state = output_param.state;
+        if (ctx->tensors) {
+            ctx->attach_outputs();
+        }
+        // Cancellation may have raced with submission
+        if (ctx->cancel_requested) {
+            request->Cancel();
+        }
+    } catch (...) {
+        ctx->finish(TM_REQUEST_FAILED);
+        throw;
+    }
+    
+    // Pick up updates the engine published before `state` was attached
+    ctx->on_progress();
+    return true;
+}
+
+// Input map holding only `ids` as a host input_ids tensor, for wrapper-issued prefills
+static std::shared_ptr<ft::core::TensorMap> host_input_ids(std::vector<int> ids) {
+    auto storage = std::make_shared<std::vector<int>>(std::move(ids));
+    const auto count = static_cast<ft::core::ssize_t>(storage->size());
+    auto tensors = std::make_shared<ft::core::TensorMap>();
+    (*tensors)["input_ids"] = ft::core::Tensor(std::shared_ptr<void>(storage, storage->data()), {1, count},
+                                               ft::kInt32, ft::core::Device{ft::kCPU, 0});
+    return tensors;
+}
+
+// Pool of model instances on one engine. A submission goes straight to a free
+// instance on the calling thread; otherwise it queues and the dispatcher thread
+// hands it to the next instance that finishes.
+//
+// Queued requests wait in one queue per priority class, each ordered by start
+// deadline with deadline-free requests behind in FIFO order; a class is served
+// only once every higher class is empty. Admission control on top of that (see
+// turbomind_pool_set_scheduling) keeps slots free for interactive requests,
+// caps the prompt tokens lower classes may start per tick, and suspends idle
+// background sessions while interactive requests queue. A request for a
+// suspended session prefills its history in front of its own input.
+//
+// With chunked prefill on (turbomind_set_prefill_chunk_size), a host prompt
+// longer than the chunk size is prefilled one chunk per request on the same
+// session. Between chunks the rest of the request queues again, ahead of the
+// deadline-free requests of its class, so the engine runs decode steps of
+// other sessions in between and the token cap meters every chunk.
+struct TurboMindInstancePool {
+    struct Pending {
+        std::shared_ptr<ForwardContext> ctx;
+        ft::ModelRequest::InputParam input;
+        TurboMindPriority priority = TM_PRIORITY_INTERACTIVE;
+        int64_t deadline_ns = 0; // latest start, 0 for none
+        int64_t prompt_tokens = 0;
+        bool restore = false;    // the scheduler suspended the session; rebuild it first
+        bool resident = false;   // never preempted (the sequence of a pinned prefix)
+        // Chunked prefill: the prompt before the first split, and its first chunk's prefix hit
+        std::vector<int> whole_prompt{};
+        int prefix_hit_len = 0;
+    };
+    
+    std::vector<std::unique_ptr<TurboMindModelInstance>> instances;
+    std::vector<std::shared_ptr<ForwardContext>> running; // indexed by slot
+    std::vector<uint64_t> running_sessions;               // indexed by slot
+    TensorMapArena inputs;
+    std::vector<int> free_slots;
+    std::deque<Pending> pending[TM_PRIORITY_COUNT];
+    
+    // Admission control state (guarded by `mutex`)
+    TurboMindSchedulingConfig scheduling{};
+    int64_t tick_start_ns = 0;
+    int64_t tick_tokens = 0;      // prompt tokens of lower classes started this tick
+    std::deque<uint64_t> idle_background; // open background sessions, least recently used first
+    std::unordered_set<uint64_t> preempted;
+    std::unordered_set<uint64_t> preempting; // being suspended outside the lock
+    
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::thread dispatcher;
+    std::shared_ptr<turbomind_go::EngineCounters> counters;
+    std::shared_ptr<std::atomic<int>> prefill_chunk_tokens;
+    const int64_t hidden_units;
+    
+    TurboMindInstancePool(TurboMindModel* model, int device_id, int num_instances)
+        : counters(model->counters), prefill_chunk_tokens(model->prefill_chunk_tokens),
+          hidden_units(model->hidden_units) {
+        if (num_instances <= 0) {
+            throw std::runtime_error("num_instances must be positive");
+        }
+        for (int i = 0; i < num_instances; ++i) {
+            instances.push_back(std::make_unique<TurboMindModelInstance>(model, device_id));
+            free_slots.push_back(num_instances - 1 - i);
+        }
+        running.resize(num_instances);
+        running_sessions.resize(num_instances);
+        dispatcher = std::thread([this] { dispatch_loop(); });
+    }
+    
+    ~TurboMindInstancePool() {
+        std::vector<std::shared_ptr<ForwardContext>> to_cancel;
+        std::vector<Pending> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            for (auto& queue : pending) {
+                std::move(queue.begin(), queue.end(), std::back_inserter(dropped));
+                queue.clear();
+            }
+            for (auto& ctx : running) {
+                if (ctx) {
+                    to_cancel.push_back(ctx);
+                }
+            }
+        }
+        cv.notify_all();
+        dispatcher.join();
+        
+        counters->queued_requests.fetch_sub(dropped.size(), std::memory_order_relaxed);
+        for (auto& item : dropped) {
+            item.ctx->finish(TM_REQUEST_CANCELLED);
+        }
+        for (auto& ctx : to_cancel) {
+            ctx->cancel();
+        }
+        
+        // Instances must outlive the requests running on them
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return free_slots.size() == instances.size(); });
+    }
+    
+    // Queue entry for a caller's request, carrying the session's class and deadline
+    static Pending make_pending(std::shared_ptr<ForwardContext> ctx,
+                                ft::ModelRequest::InputParam input,
+                                const TurboMindSession& session) {
+        if (session.priority < TM_PRIORITY_INTERACTIVE || session.priority >= TM_PRIORITY_COUNT) {
+            throw std::invalid_argument("unknown priority " + std::to_string(session.priority));
+        }
+        Pending item{std::move(ctx), std::move(input), session.priority};
+        if (session.deadline_ms > 0) {
+            item.deadline_ns = item.ctx->timings.submit_ns + static_cast<int64_t>(session.deadline_ms) * 1000000;
+        }
+        return item;
+    }
+    
+    void set_scheduling(const TurboMindSchedulingConfig& config) {
+        if (config.reserved_interactive_slots < 0 ||
+            config.reserved_interactive_slots >= static_cast<int>(instances.size()) ||
+            config.prefill_tokens_per_tick < 0 || config.tick_ms < 0 || config.preempt_queue_depth < 0 ||
+            (config.prefill_tokens_per_tick > 0 && config.tick_ms == 0)) {
+            throw std::invalid_argument("invalid scheduling config");
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            scheduling = config;
+        }
+        cv.notify_all();
+    }
+    
+    void submit(Pending item) {
+        std::vector<Pending> batch;
+        batch.push_back(std::move(item));
+        submit_batch(std::move(batch));
+    }
+    
+    // Submits many requests with one lock acquisition and at most one dispatcher wakeup
+    void submit_batch(std::vector<Pending> batch) {
+        std::vector<std::pair<int, Pending>> to_start;
+        std::vector<uint64_t> victims;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                throw std::runtime_error("instance pool is shutting down");
+            }
+            const int64_t now = turbomind_go::now_ns();
+            size_t queued = 0;
+            const int64_t chunk_tokens = prefill_chunk_tokens->load(std::memory_order_relaxed);
+            for (auto& item : batch) {
+                // A chunked prompt is metered one chunk at a time
+                item.prompt_tokens = prompt_length(item.input);
+                if (chunk_tokens > 0) {
+                    item.prompt_tokens = std::min(item.prompt_tokens, chunk_tokens);
+                }
+                if (ahead_of(item.priority) == 0 && admissible(item, now)) {
+                    const int slot = admit(item, now);
+                    to_start.emplace_back(slot, std::move(item));
+                } else {
+                    enqueue(std::move(item));
+                    ++queued;
+                }
+            }
+            counters->queued_requests.fetch_add(queued, std::memory_order_relaxed);
+            if (queued > 0) {
+                victims = preemption_victims();
+                cv.notify_all();
+            }
+        }
+        preempt(victims);
+        for (auto& [slot, item] : to_start) {
+            try {
+                start(slot, std::move(item));
+            } catch (const std::exception& e) {
+                if (batch.size() == 1) {
+                    throw; // a single submission reports to its caller
+                }
+                // The request is already marked failed; keep starting the rest
+                turbomind_go::log_message(TM_LOG_ERROR, "Failed to start batched request: " + std::string(e.what()));
+            }
+        }
+    }
+    
+    static int64_t prompt_length(const ft::ModelRequest::InputParam& input) {
+        auto it = input.tensors->find("input_ids");
+        return it == input.tensors->end() ? 0 : static_cast<int64_t>(it->second.size());
+    }
+    
+    // Requests queued in classes at or above `priority` (caller holds `mutex`)
+    size_t ahead_of(TurboMindPriority priority) const {
+        size_t count = 0;
+        for (int c = 0; c <= priority; ++c) {
+            count += pending[c].size();
+        }
+        return count;
+    }
+    
+    // Whether `item` may take a slot now (caller holds `mutex`)
+    bool admissible(const Pending& item, int64_t now) {
+        if (free_slots.empty() || preempting.count(item.input.session.id)) {
+            return false;
+        }
+        if (item.priority == TM_PRIORITY_INTERACTIVE) {
+            return true;
+        }
+        if (static_cast<int>(free_slots.size()) <= scheduling.reserved_interactive_slots) {
+            return false;
+        }
+        if (scheduling.prefill_tokens_per_tick == 0) {
+            return true;
+        }
+        if (now - tick_start_ns >= static_cast<int64_t>(scheduling.tick_ms) * 1000000) {
+            tick_start_ns = now;
+            tick_tokens = 0;
+        }
+        // The first request of a tick always fits, so long prompts still start
+        return tick_tokens == 0 || tick_tokens + item.prompt_tokens <= scheduling.prefill_tokens_per_tick;
+    }
+    
+    // Take a free slot for an admissible request (caller holds `mutex`)
+    int admit(Pending& item, int64_t now) {
+        if (item.priority != TM_PRIORITY_INTERACTIVE && scheduling.prefill_tokens_per_tick > 0) {
+            tick_tokens += item.prompt_tokens;
+        }
+        const uint64_t session_id = item.input.session.id;
+        auto idle = std::find(idle_background.begin(), idle_background.end(), session_id);
+        if (idle != idle_background.end()) {
+            idle_background.erase(idle);
+        }
+        if (item.priority == TM_PRIORITY_BACKGROUND && !item.input.session.end_flag && !item.resident) {
+            idle_background.push_back(session_id); // idle again once this request finishes
+        }
+        item.restore = preempted.erase(session_id) > 0;
+        
+        const int slot = free_slots.back();
+        free_slots.pop_back();
+        running[slot] = item.ctx;
+        running_sessions[slot] = session_id;
+        return slot;
+    }
+    
+    // Prepend the history of a session the scheduler suspended, so the request
+    // rebuilds it in a new engine sequence
+    ft::ModelRequest::InputParam restore_input(ft::ModelRequest::InputParam input) {
+        std::vector<int> history;
+        auto& store = instances[0]->session_store;
+        if (!store || !store->resume(input.session.id, &history)) {
+            return input; // resumed by the caller in the meantime
+        }
+        if (!input.session.start_flag || input.session.step > 0) {
+            history.resize(std::min<size_t>(history.size(), std::max(input.session.step, 0)));
+        } else {
+            history.clear(); // the request starts over anyway
+        }
+        auto it = input.tensors->find("input_ids");
+        if (it == input.tensors->end() || it->second.device().type == ft::kDEVICE || it->second.dtype() != ft::kInt32) {
+            throw std::runtime_error("session " + std::to_string(input.session.id) +
+                                     " was preempted and needs host input_ids to resume");
+        }
+        const int* ids = it->second.data<int>();
+        history.insert(history.end(), ids, ids + it->second.size());
+        
+        auto tensors = std::make_shared<ft::core::TensorMap>(*input.tensors);
+        (*tensors)["input_ids"] = (*host_input_ids(std::move(history)))["input_ids"];
+        input.tensors = std::move(tensors);
+        input.session.start_flag = true;
+        input.session.step = 0;
+        return input;
+    }
+    
+    // Insert by deadline; requests without one keep FIFO order behind (caller holds `mutex`)
+    void enqueue(Pending item) {
+        auto& queue = pending[item.priority];
+        auto pos = queue.end();
+        if (item.deadline_ns > 0) {
+            pos = std::find_if(queue.begin(), queue.end(), [&](const Pending& other) {
+                return other.deadline_ns == 0 || other.deadline_ns > item.deadline_ns;
+            });
+        }
+        queue.insert(pos, std::move(item));
+    }
+    
+    // Idle background sessions to suspend while interactive requests pile up, so
+    // their KV blocks go to the interactive ones (caller holds `mutex`). They stay
+    // in `preempting`, and their requests wait, until preempt() is done with them.
+    std::vector<uint64_t> preemption_victims() {
+        std::vector<uint64_t> victims;
+        if (!instances[0]->session_store || scheduling.preempt_queue_depth == 0 ||
+            pending[TM_PRIORITY_INTERACTIVE].size() < static_cast<size_t>(scheduling.preempt_queue_depth)) {
+            return victims;
+        }
+        for (auto it = idle_background.begin(); it != idle_background.end();) {
+            if (std::find(running_sessions.begin(), running_sessions.end(), *it) != running_sessions.end()) {
+                ++it;
+                continue;
+            }
+            victims.push_back(*it);
+            preempting.insert(*it);
+            it = idle_background.erase(it);
+        }
+        return victims;
+    }
+    
+    // Suspending may write the history to disk, so it runs without `mutex`
+    void preempt(const std::vector<uint64_t>& victims) {
+        auto& store = instances[0]->session_store;
+        for (const uint64_t session_id : victims) {
+            bool suspended = false;
+            try {
+                if (store->suspend(session_id)) {
+                    instances[0]->request->End([](int){}, session_id);
+                    suspended = true;
+                }
+            } catch (const std::exception& e) {
+                turbomind_go::log_message(TM_LOG_WARNING, "Failed to preempt session " + std::to_string(session_id) +
+                                                              ": " + e.what());
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            // Skipped when the caller ended or resumed the session meanwhile
+            if (preempting.erase(session_id) && suspended) {
+                preempted.insert(session_id);
+                counters->preempted_sessions.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (!victims.empty()) {
+            cv.notify_all();
+        }
+    }
+    
+    // A session is gone from the engine: forget its scheduling state
+    void forget_session(uint64_t session_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto idle = std::find(idle_background.begin(), idle_background.end(), session_id);
+        if (idle != idle_background.end()) {
+            idle_background.erase(idle);
+        }
+        preempted.erase(session_id);
+        preempting.erase(session_id);
+    }
+    
+    // Split the first chunk off a long host prompt into `chunk`, a prefill-only
+    // request, leaving the rest in `item`. Other inputs and outputs that cover
+    // every prompt position are positional, so those requests run whole.
+    bool split_chunk(Pending& item, ft::ModelRequest::InputParam& chunk) {
+        const int chunk_tokens = prefill_chunk_tokens->load(std::memory_order_relaxed);
+        auto& input = item.input;
+        if (chunk_tokens <= 0 || input.gen_cfg.output_logits || input.gen_cfg.output_last_hidden_state) {
+            return false;
+        }
+        for (const auto& entry : *input.tensors) {
+            if (entry.first != "input_ids" && entry.first != "sequence_length") {
+                return false;
+            }
+        }
+        auto it = input.tensors->find("input_ids");
+        if (it == input.tensors->end() || it->second.device().type == ft::kDEVICE ||
+            it->second.dtype() != ft::kInt32 || it->second.size() <= chunk_tokens) {
+            return false;
+        }
+        const int* ids = it->second.data<int>();
+        const auto count = it->second.size();
+        if (item.whole_prompt.empty()) {
+            item.whole_prompt.assign(ids, ids + count);
+        }
+        
+        ft::SessionParam session = input.session;
+        session.end_flag = false;
+        ft::GenerationConfig prefill;
+        prefill.max_new_tokens = 0;
+        chunk = create_input_param(host_input_ids(std::vector<int>(ids, ids + chunk_tokens)), session, prefill, false);
+        
+        auto tensors = std::make_shared<ft::core::TensorMap>(*input.tensors);
+        (*tensors)["input_ids"] = (*host_input_ids(std::vector<int>(ids + chunk_tokens, ids + count)))["input_ids"];
+        input.tensors = std::move(tensors);
+        input.session.start_flag = false;
+        input.session.step += chunk_tokens;
+        item.prompt_tokens = std::min<int64_t>(count - chunk_tokens, chunk_tokens);
+        item.deadline_ns = 0; // it has started
+        return true;
+    }
+    
+    // Prefill one chunk on `slot`; the rest of the request queues once it finishes
+    void start_chunk(int slot, Pending rest, ft::ModelRequest::InputParam chunk) {
+        auto ctx = create_forward_context(chunk.gen_cfg, false, nullptr, nullptr);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running[slot] = ctx; // cancelling the pool cancels the chunk
+        }
+        ForwardContext* chunk_ctx = ctx.get(); // alive while its finish hook runs
+        auto next = std::make_shared<Pending>(std::move(rest));
+        auto on_finish = [this, slot, chunk_ctx, next] {
+            TurboMindRequestStatus status;
+            {
+                std::lock_guard<std::mutex> lock(chunk_ctx->mutex);
+                status = chunk_ctx->status;
+                next->prefix_hit_len = std::max(next->prefix_hit_len, chunk_ctx->prefix_hit_len);
+            }
+            continue_chunked(std::move(*next), status);
+            release(slot); // last: the destructor waits for every slot
+        };
+        if (!start_forward(ctx, instances[slot].get(), std::move(chunk), std::move(on_finish))) {
+            release(slot);
+        }
+    }
+    
+    // Queue the rest of a chunked request after a chunk finished. When the chunk
+    // failed, or the request was cancelled meanwhile, the engine sequence holds
+    // part of the prompt, so the session is ended and the request fails.
+    void continue_chunked(Pending rest, TurboMindRequestStatus chunk_status) {
+        bool live;
+        {
+            std::lock_guard<std::mutex> lock(rest.ctx->mutex);
+            live = !is_terminal_status(rest.ctx->status);
+        }
+        const uint64_t session_id = rest.input.session.id;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (live && chunk_status == TM_REQUEST_COMPLETED && !stopping) {
+                auto& queue = pending[rest.priority];
+                auto pos = std::find_if(queue.begin(), queue.end(), [](const Pending& other) {
+                    return other.deadline_ns == 0;
+                });
+                queue.insert(pos, std::move(rest));
+                counters->queued_requests.fetch_add(1, std::memory_order_relaxed);
+                cv.notify_all();
+                return;
+            }
+        }
+        forget_session(session_id);
+        try {
+            if (auto& store = instances[0]->session_store) {
+                store->erase(session_id);
+            }
+            instances[0]->request->End([](int){}, session_id);
+        } catch (const std::exception& e) {
+            turbomind_go::log_message(TM_LOG_WARNING, "Failed to end session " + std::to_string(session_id) +
+                                                          " after a partial prefill: " + e.what());
+        }
+        rest.ctx->finish(chunk_status == TM_REQUEST_FAILED ? TM_REQUEST_FAILED : TM_REQUEST_CANCELLED);
+    }
+    
+    void start(int slot, Pending item) {
+        if (item.restore) {
+            try {
+                item.input = restore_input(std::move(item.input));
+            } catch (...) {
+                item.ctx->finish(TM_REQUEST_FAILED);
+                release(slot);
+                throw;
+            }
+        }
+        ft::ModelRequest::InputParam chunk;
+        if (split_chunk(item, chunk)) {
+            start_chunk(slot, std::move(item), std::move(chunk));
+            return;
+        }
+        if (!item.whole_prompt.empty()) {
+            // Report and index the prompt the caller submitted, not its last chunk
+            std::lock_guard<std::mutex> lock(item.ctx->mutex);
+            item.ctx->chunked_prompt = std::move(item.whole_prompt);
+            item.ctx->prefix_hit_len = item.prefix_hit_len;
+        }
+        // A failed start finishes the request, which releases the slot
+        if (!start_forward(item.ctx, instances[slot].get(), std::move(item.input), [this, slot] { release(slot); })) {
+            release(slot);
+        }
+    }
+    
+    void release(int slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        running[slot].reset();
+        running_sessions[slot] = 0;
+        free_slots.push_back(slot);
+        cv.notify_all();
+    }
+    
+    // Drop queued requests whose start deadline passed and return the earliest
+    // deadline still ahead, 0 if none (caller holds `mutex`)
+    int64_t expire(int64_t now, std::vector<std::shared_ptr<ForwardContext>>& expired) {
+        int64_t next = 0;
+        for (auto& queue : pending) {
+            // Deadlines ascend from the front, so expired requests lead the queue
+            while (!queue.empty() && queue.front().deadline_ns > 0 && queue.front().deadline_ns <= now) {
+                expired.push_back(std::move(queue.front().ctx));
+                queue.pop_front();
+            }
+            if (!queue.empty() && queue.front().deadline_ns > 0 && (next == 0 || queue.front().deadline_ns < next)) {
+                next = queue.front().deadline_ns;
+            }
+        }
+        return next;
+    }
+    
+    void dispatch_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            const int64_t now = turbomind_go::now_ns();
+            std::vector<std::shared_ptr<ForwardContext>> expired;
+            int64_t wake_ns = expire(now, expired);
+            if (!expired.empty()) {
+                counters->queued_requests.fetch_sub(expired.size(), std::memory_order_relaxed);
+                counters->deadline_misses.fetch_add(expired.size(), std::memory_order_relaxed);
+                lock.unlock();
+                for (auto& ctx : expired) {
+                    ctx->finish(TM_REQUEST_CANCELLED);
+                }
+                lock.lock();
+                continue;
+            }
+            
+            // Only the highest non-empty class may start; a lower one waits even
+            // when the head of the higher one is held back by admission control
+            std::deque<Pending>* queue = nullptr;
+            for (auto& q : pending) {
+                if (!q.empty()) {
+                    queue = &q;
+                    break;
+                }
+            }
+            if (!queue || !admissible(queue->front(), now)) {
+                if (queue && !free_slots.empty() && scheduling.prefill_tokens_per_tick > 0) {
+                    // Held back by the token cap: retry when the tick ends
+                    const int64_t tick_end = tick_start_ns + static_cast<int64_t>(scheduling.tick_ms) * 1000000;
+                    wake_ns = wake_ns == 0 ? tick_end : std::min(wake_ns, tick_end);
+                }
+                if (wake_ns > 0) {
+                    cv.wait_for(lock, std::chrono::nanoseconds(wake_ns - now));
+                } else {
+                    cv.wait(lock);
+                }
+                continue;
+            }
+            
+            Pending item = std::move(queue->front());
+            queue->pop_front();
+            counters->queued_requests.fetch_sub(1, std::memory_order_relaxed);
+            const int slot = admit(item, now);
+            lock.unlock();
+            try {
+                // Requests cancelled while queued never reach the engine
+                start(slot, std::move(item));
+            } catch (const std::exception& e) {
+                // No caller to report to; the request itself is marked failed
+                turbomind_go::log_message(TM_LOG_ERROR, "Failed to dispatch forward request: " + std::string(e.what()));
+            }
+            lock.lock();
+        }
+    }
+    
+    void cancel_all() {
+        std::vector<std::shared_ptr<ForwardContext>> to_cancel;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& queue : pending) {
+                for (auto& item : queue) {
+                    to_cancel.push_back(item.ctx);
+                }
+            }
+            for (auto& ctx : running) {
+                if (ctx) {
+                    to_cancel.push_back(ctx);
+                }
+            }
+        }
+        for (auto& ctx : to_cancel) {
+            ctx->cancel();
+        }
+    }
+};
+
+// Build the request that rebuilds a suspended session: its whole history is
+// prefilled into a new engine sequence without generating tokens
+static ft::ModelRequest::InputParam resume_input(turbomind_go::SessionStore& store, uint64_t session_id) {
+    std::vector<int> history;
+    if (!store.resume(session_id, &history)) {
+        throw std::runtime_error("session " + std::to_string(session_id) + " is not suspended");
+    }
+    if (history.empty()) {
+        throw std::runtime_error("session " + std::to_string(session_id) + " has no history");
+    }
+    ft::SessionParam session{};
+    session.id = session_id;
+    session.step = 0;
+    session.start_flag = true;
+    session.end_flag = false;
+    ft::GenerationConfig generation_config;
+    generation_config.max_new_tokens = 0;
+    return create_input_param(host_input_ids(std::move(history)), session, generation_config, false);
+}
+
+// Shared body of the batch entry points; config_at(i) yields request i's converted config
+template<typename ConfigAt>
+static TurboMindBatchResult* submit_batch(TurboMindInstancePool* pool,
+                                          int count,
+                                          TurboMindTensorMap** input_tensors,
+                                          TurboMindSession* sessions,
+                                          bool stream_output,
+                                          ConfigAt config_at) {
+    auto batch = std::make_unique<TurboMindBatchResult>();
+    batch->results.reserve(count);
+    std::vector<TurboMindInstancePool::Pending> pending;
+    pending.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        if (!input_tensors[i]) {
+            throw std::runtime_error("null input at index " + std::to_string(i));
+        }
+        const ft::GenerationConfig& generation_config = *config_at(i);
+        auto ctx = create_forward_context(generation_config, stream_output, nullptr, nullptr);
+        pending.push_back(TurboMindInstancePool::make_pending(
+            ctx, create_input_param(input_tensors[i]->tensor_map, convert_session(&sessions[i]), generation_config,
+                                    stream_output),
+            sessions[i]));
+        batch->results.push_back(std::make_unique<TurboMindForwardResult>(std::move(ctx)));
+    }
+    
+    pool->submit_batch(std::move(pending));
+    return batch.release();
+}
+
+// Interned generation configs: identical presets share one converted config
+struct TurboMindGenerationConfigHandle {
+    ft::GenerationConfig config;
+    std::string key;
+    std::atomic<int> refs{1};
+};
+
+static std::mutex g_config_mutex;
+static std::unordered_map<std::string, TurboMindGenerationConfigHandle*> g_configs;
+
+// Byte-wise identity of a C config, including the contents of its id arrays
+static std::string generation_config_key(const TurboMindGenerationConfig* cfg) {
+    std::string key;
+    auto put = [&](const void* data, size_t size) { key.append(static_cast<const char*>(data), size); };
+    auto put_ids = [&](const int* ids, int count) {
+        count = ids ? std::max(count, 0) : 0;
+        put(&count, sizeof(count));
+        put(ids, count * sizeof(int));
+    };
+    put(&cfg->max_new_tokens, sizeof(cfg->max_new_tokens));
+    put(&cfg->min_new_tokens, sizeof(cfg->min_new_tokens));
+    put_ids(cfg->eos_ids, cfg->eos_ids_count);
+    put_ids(cfg->stop_ids, cfg->stop_ids_count);
+    put_ids(cfg->bad_ids, cfg->bad_ids_count);
+    put(&cfg->top_p, sizeof(cfg->top_p));
+    put(&cfg->top_k, sizeof(cfg->top_k));
+    put(&cfg->min_p, sizeof(cfg->min_p));
+    put(&cfg->temperature, sizeof(cfg->temperature));
+    put(&cfg->repetition_penalty, sizeof(cfg->repetition_penalty));
+    put(&cfg->random_seed, sizeof(cfg->random_seed));
+    const bool flags[] = {cfg->output_logprobs, cfg->output_last_hidden_state, cfg->output_logits};
+    put(flags, sizeof(flags));
+    return key;
+}
+
+// C API Implementation
+
+extern "C" {
+
+// Model creation and management
+TurboMindModel* turbomind_create_model(const char* model_dir, const char* config, const char* weight_type) {
+    if (!model_dir) {
+        set_last_error("model_dir cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    turbomind_go::TraceScope trace("tm.create_model");
+    try {
+        std::string cfg = config ? config : "";
+        std::string wt = weight_type ? weight_type : "half";
+        
+        return new TurboMindModel(model_dir, cfg, wt);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create model: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+void turbomind_destroy_model(TurboMindModel* model) {
+    delete model;
+}
+
+// Model setup functions
+void turbomind_create_shared_weights(TurboMindModel* model, int device_id, int rank) {
+    if (!model || !model->model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    turbomind_go::TraceScope trace("tm.create_shared_weights");
+    try {
+        model->model->createSharedWeights(device_id, rank);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create shared weights: " + std::string(e.what()), error_code(e));
+    }
+}
+
+void turbomind_process_weights(TurboMindModel* model, int device_id, int rank) {
+    if (!model || !model->model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    turbomind_go::TraceScope trace("tm.process_weights");
+    try {
+        model->model->processWeights(device_id, rank);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to process weights: " + std::string(e.what()), error_code(e));
+    }
+}
+
+void turbomind_create_engine(TurboMindModel* model, int device_id, int rank) {
+    if (!model || !model->model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    turbomind_go::TraceScope trace("tm.create_engine");
+    try {
+        model->model->createEngine(device_id, rank);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create engine: " + std::string(e.what()), error_code(e));
+    }
+}
+
+int turbomind_initialize_all_ranks(TurboMindModel* model, int node_id, int device_count) {
+    if (!model || !model->model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    turbomind_go::TraceScope trace("tm.initialize_all_ranks");
+    try {
+        if (device_count <= 0) {
+            device_count = model->model->getTensorParaSize() * model->model->getPipelineParaSize();
+        }
+        
+        // Weights of each rank are independent, so a rank moves on to processing as
+        // soon as its own load finishes and overlaps with the others still loading
+        auto prepare_weights = [model](int device_id, int rank) {
+            model->model->createSharedWeights(device_id, rank);
+            if (!model->restore_snapshot(device_id, rank) && !model->weights_dir.empty()) {
+                model->load_rank(device_id, rank);
+                model->save_snapshot(device_id, rank);
+            }
+            model->model->processWeights(device_id, rank);
+        };
+        // Engine creation needs all ranks to join their communicators together
+        auto create_engine = [model](int device_id, int rank) {
+            model->model->createEngine(device_id, rank);
+        };
+        
+        const std::pair<const char*, std::function<void(int, int)>> phases[] = {
+            {"prepare weights", prepare_weights},
+            {"create engine", create_engine},
+        };
+        for (const auto& [name, phase] : phases) {
+            std::vector<std::string> errors(device_count);
+            std::vector<TurboMindErrorCode> codes(device_count, TM_OK);
+            std::vector<std::thread> threads;
+            for (int device_id = 0; device_id < device_count; ++device_id) {
+                threads.emplace_back([&, name = name, device_id] {
+                    try {
+                        phase(device_id, node_id * device_count + device_id);
+                    } catch (const std::exception& e) {
+                        errors[device_id] = "Failed to " + std::string(name) + " on device " +
+                                            std::to_string(device_id) + ": " + e.what();
+                        codes[device_id] = error_code(e);
+                    }
+                });
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+            for (int device_id = 0; device_id < device_count; ++device_id) {
+                if (!errors[device_id].empty()) {
+                    set_last_error(errors[device_id], codes[device_id]);
+                    return -1;
+                }
+            }
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to initialize ranks: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+// Weight loading
+int turbomind_set_weight_source(TurboMindModel* model, const char* weights_dir, int num_threads,
+                                TurboMindProgressCallback progress, void* user_data) {
+    if (!model || !weights_dir) {
+        set_last_error("Invalid parameters for weight source", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    model->weights_dir = weights_dir;
+    model->load_threads = num_threads > 0 ? num_threads : 4;
+    model->load_progress = progress;
+    model->load_progress_data = user_data;
+    return 0;
+}
+
+int turbomind_load_weights(TurboMindModel* model, int device_id, int rank) {
+    if (!model || !model->model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    turbomind_go::TraceScope trace("tm.load_weights");
+    try {
+        model->load_rank(device_id, rank);
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to load weights: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+int turbomind_set_snapshot_dir(TurboMindModel* model, const char* snapshot_dir) {
+    if (!model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    model->snapshot_dir = snapshot_dir ? snapshot_dir : "";
+    return 0;
+}
+
+int turbomind_save_snapshot(TurboMindModel* model, int device_id, int rank) {
+    if (!model || !model->model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    if (model->snapshot_dir.empty()) {
+        set_last_error("no snapshot directory set", TM_ERROR_INVALID_STATE);
+        return -1;
+    }
+    
+    try {
+        model->save_snapshot(device_id, rank);
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to save snapshot: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+void turbomind_get_load_progress(TurboMindModel* model, uint64_t* bytes_done, uint64_t* bytes_total) {
+    if (!model) {
+        set_last_error("Invalid model for load progress", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    if (bytes_done) {
+        *bytes_done = model->load_bytes_done.load();
+    }
+    if (bytes_total) {
+        *bytes_total = model->load_bytes_total.load();
+    }
+}
+
+// Model instance management
+TurboMindModelInstance* turbomind_create_model_instance(TurboMindModel* model, int device_id) {
+    if (!model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        return new TurboMindModelInstance(model, device_id);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create model instance: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+void turbomind_destroy_model_instance(TurboMindModelInstance* instance) {
+    delete instance;
+}
+
+// Tensor management
+TurboMindTensor* turbomind_create_tensor(void* data, int64_t* shape, int ndim, 
+                                        TurboMindDataType dtype, TurboMindMemoryType memory_type, int device_id) {
+    if (!data || !shape || ndim <= 0) {
+        set_last_error("Invalid tensor parameters", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        return new TurboMindTensor(data, shape, ndim, dtype, memory_type, device_id);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create tensor: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+TurboMindTensor* turbomind_create_pinned_tensor(int64_t* shape, int ndim, TurboMindDataType dtype, int device_id,
+                                               void** data) {
+    if (!shape || ndim <= 0 || !data) {
+        set_last_error("Invalid tensor parameters", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        return new TurboMindTensor(shape, ndim, dtype, device_id, data);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create pinned tensor: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+void turbomind_destroy_tensor(TurboMindTensor* tensor) {
+    delete tensor;
+}
+
+// Pinned host memory pool
+void* turbomind_alloc_pinned(size_t bytes) {
+    try {
+        return turbomind_go::PinnedPool::instance().allocate(bytes);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to allocate pinned memory: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+void turbomind_release_pinned(void* ptr) {
+    try {
+        turbomind_go::PinnedPool::instance().release(ptr);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to release pinned memory: " + std::string(e.what()), error_code(e));
+    }
+}
+
+void turbomind_set_pinned_pool_limit(size_t bytes) {
+    turbomind_go::PinnedPool::instance().set_cache_limit(bytes);
+}
+
+void turbomind_trim_pinned_pool() {
+    turbomind_go::PinnedPool::instance().trim();
+}
+
+void turbomind_get_pinned_pool_stats(size_t* cached_bytes, size_t* in_use_bytes) {
+    auto& pool = turbomind_go::PinnedPool::instance();
+    if (cached_bytes) {
+        *cached_bytes = pool.cached_bytes();
+    }
+    if (in_use_bytes) {
+        *in_use_bytes = pool.in_use_bytes();
+    }
+}
+
+// TensorMap management
+TurboMindTensorMap* turbomind_create_tensor_map() {
+    try {
+        return new TurboMindTensorMap();
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create tensor map: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+void turbomind_destroy_tensor_map(TurboMindTensorMap* tensor_map) {
+    if (tensor_map && tensor_map->arena) {
+        tensor_map->arena->release(tensor_map);
+        return;
+    }
+    delete tensor_map;
+}
+
+TurboMindTensorMap* turbomind_build_inputs(TurboMindModelInstance* instance, const TurboMindTensorDesc* descs,
+                                           int count) {
+    if (!instance || !descs || count <= 0) {
+        set_last_error("Invalid parameters for build inputs", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        return instance->inputs.build(descs, count);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to build inputs: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+TurboMindTensorMap* turbomind_pool_build_inputs(TurboMindInstancePool* pool, const TurboMindTensorDesc* descs,
+                                                int count) {
+    if (!pool || !descs || count <= 0) {
+        set_last_error("Invalid parameters for build inputs", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        return pool->inputs.build(descs, count);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to build inputs: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+int turbomind_tensor_map_set(TurboMindTensorMap* tensor_map, const char* key, TurboMindTensor* tensor) {
+    if (!tensor_map || !key || !tensor) {
+        set_last_error("Invalid parameters for tensor map set", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    try {
+        (*tensor_map->tensor_map)[key] = *tensor->tensor;
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to set tensor in map: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+TurboMindTensor* turbomind_tensor_map_get(TurboMindTensorMap* tensor_map, const char* key) {
+    if (!tensor_map || !key) {
+        set_last_error("Invalid parameters for tensor map get", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        auto it = tensor_map->tensor_map->find(key);
+        if (it == tensor_map->tensor_map->end()) {
+            set_last_error("Tensor not found in map: " + std::string(key), TM_ERROR_NOT_FOUND);
+            return nullptr;
+        }
+        
+        // The wrapper shares the buffer, so it stays valid after the map is destroyed
+        return new TurboMindTensor(it->second);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to get tensor from map: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+// Forward inference
+TurboMindForwardResult* turbomind_forward(TurboMindModelInstance* instance, 
+                                         TurboMindTensorMap* input_tensors,
+                                         TurboMindSession* session,
+                                         TurboMindGenerationConfig* gen_config,
+                                         bool stream_output) {
+    TurboMindForwardResult* result = turbomind_forward_async(instance, input_tensors, session, gen_config,
+                                                             stream_output, nullptr, nullptr);
+    if (result && turbomind_wait_forward(result, -1) != 0) {
+        turbomind_destroy_forward_result(result);
+        return nullptr;
+    }
+    return result;
+}
+
+TurboMindForwardResult* turbomind_forward_async(TurboMindModelInstance* instance,
+                                               TurboMindTensorMap* input_tensors,
+                                               TurboMindSession* session,
+                                               TurboMindGenerationConfig* gen_config,
+                                               bool stream_output,
+                                               TurboMindForwardCallback callback,
+                                               void* user_data) {
+    if (!instance || !input_tensors || !session || !gen_config) {
+        set_last_error("Invalid parameters for forward", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        auto generation_config = convert_generation_config(gen_config);
+        auto ctx = create_forward_context(generation_config, stream_output, callback, user_data);
+        start_forward(ctx, instance,
+                      create_input_param(input_tensors->tensor_map, convert_session(session),
+                                         generation_config, stream_output));
+        return new TurboMindForwardResult(ctx);
+    } catch (const std::exception& e) {
+        set_last_error("Forward inference failed: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
 
 void turbomind_destroy_forward_result(TurboMindForwardResult* result) {
     delete result;
 }
 
-// Session management
-void turbomind_end_session(TurboMindModelInstance* instance, uint64_t session_id) {
-    if (!instance) {
-        set_last_error("Invalid instance for end session");
-        return;
+// Generation config handles
+TurboMindGenerationConfigHandle* turbomind_create_generation_config(const TurboMindGenerationConfig* gen_config) {
+    if (!gen_config) {
+        set_last_error("gen_config cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        std::string key = generation_config_key(gen_config);
+        std::lock_guard<std::mutex> lock(g_config_mutex);
+        auto it = g_configs.find(key);
+        if (it != g_configs.end()) {
+            it->second->refs.fetch_add(1, std::memory_order_relaxed);
+            return it->second;
+        }
+        auto handle = new TurboMindGenerationConfigHandle();
+        handle->config = convert_generation_config(gen_config);
+        handle->key = std::move(key);
+        g_configs.emplace(handle->key, handle);
+        return handle;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create generation config: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+TurboMindGenerationConfigHandle* turbomind_retain_generation_config(TurboMindGenerationConfigHandle* config) {
+    if (config) {
+        config->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    return config;
+}
+
+void turbomind_release_generation_config(TurboMindGenerationConfigHandle* config) {
+    if (!config) {
+        return;
+    }
+    // Drop the last reference under the table lock so a concurrent create cannot revive it
+    std::lock_guard<std::mutex> lock(g_config_mutex);
+    if (config->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        g_configs.erase(config->key);
+        delete config;
+    }
+}
+
+TurboMindForwardResult* turbomind_forward_with_config(TurboMindModelInstance* instance,
+                                                     TurboMindTensorMap* input_tensors,
+                                                     TurboMindSession* session,
+                                                     TurboMindGenerationConfigHandle* config,
+                                                     bool stream_output,
+                                                     TurboMindForwardCallback callback,
+                                                     void* user_data) {
+    if (!instance || !input_tensors || !session || !config) {
+        set_last_error("Invalid parameters for forward", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        auto ctx = create_forward_context(config->config, stream_output, callback, user_data);
+        start_forward(ctx, instance,
+                      create_input_param(input_tensors->tensor_map, convert_session(session),
+                                         config->config, stream_output));
+        return new TurboMindForwardResult(ctx);
+    } catch (const std::exception& e) {
+        set_last_error("Forward inference failed: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+TurboMindForwardResult* turbomind_pool_forward_with_config(TurboMindInstancePool* pool,
+                                                          TurboMindTensorMap* input_tensors,
+                                                          TurboMindSession* session,
+                                                          TurboMindGenerationConfigHandle* config,
+                                                          bool stream_output,
+                                                          TurboMindForwardCallback callback,
+                                                          void* user_data) {
+    if (!pool || !input_tensors || !session || !config) {
+        set_last_error("Invalid parameters for pool forward", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        auto ctx = create_forward_context(config->config, stream_output, callback, user_data);
+        pool->submit(TurboMindInstancePool::make_pending(
+            ctx, create_input_param(input_tensors->tensor_map, convert_session(session), config->config, stream_output),
+            *session));
+        return new TurboMindForwardResult(ctx);
+    } catch (const std::exception& e) {
+        set_last_error("Pool forward failed: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+// Instance pool
+TurboMindInstancePool* turbomind_create_instance_pool(TurboMindModel* model, int device_id, int num_instances) {
+    if (!model) {
+        set_last_error("model cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        return new TurboMindInstancePool(model, device_id, num_instances);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create instance pool: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+void turbomind_destroy_instance_pool(TurboMindInstancePool* pool) {
+    delete pool;
+}
+
+int turbomind_pool_set_scheduling(TurboMindInstancePool* pool, const TurboMindSchedulingConfig* config) {
+    if (!pool || !config) {
+        set_last_error("Invalid parameters for pool scheduling", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    try {
+        pool->set_scheduling(*config);
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to set pool scheduling: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+int turbomind_set_prefill_chunk_size(TurboMindModel* model, int chunk_tokens) {
+    if (!model || chunk_tokens < 0) {
+        set_last_error("Invalid parameters for prefill chunk size", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    model->prefill_chunk_tokens->store(chunk_tokens, std::memory_order_relaxed);
+    return 0;
+}
+
+int turbomind_get_prefill_chunk_size(TurboMindModel* model) {
+    return model ? model->prefill_chunk_tokens->load(std::memory_order_relaxed) : 0;
+}
+
+TurboMindForwardResult* turbomind_pool_forward_async(TurboMindInstancePool* pool,
+                                                    TurboMindTensorMap* input_tensors,
+                                                    TurboMindSession* session,
+                                                    TurboMindGenerationConfig* gen_config,
+                                                    bool stream_output,
+                                                    TurboMindForwardCallback callback,
+                                                    void* user_data) {
+    if (!pool || !input_tensors || !session || !gen_config) {
+        set_last_error("Invalid parameters for pool forward", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        auto generation_config = convert_generation_config(gen_config);
+        auto ctx = create_forward_context(generation_config, stream_output, callback, user_data);
+        pool->submit(TurboMindInstancePool::make_pending(
+            ctx, create_input_param(input_tensors->tensor_map, convert_session(session), generation_config, stream_output),
+            *session));
+        return new TurboMindForwardResult(ctx);
+    } catch (const std::exception& e) {
+        set_last_error("Pool forward failed: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+TurboMindBatchResult* turbomind_forward_batch(TurboMindInstancePool* pool,
+                                             int count,
+                                             TurboMindTensorMap** input_tensors,
+                                             TurboMindSession* sessions,
+                                             TurboMindGenerationConfig** gen_configs,
+                                             int gen_config_count,
+                                             bool stream_output) {
+    if (!pool || count <= 0 || !input_tensors || !sessions || !gen_configs ||
+        (gen_config_count != 1 && gen_config_count != count)) {
+        set_last_error("Invalid parameters for batch forward", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        // Convert each distinct config once; batches usually share one or a few
+        std::vector<std::pair<TurboMindGenerationConfig*, ft::GenerationConfig>> converted;
+        converted.reserve(gen_config_count); // pointers handed out below stay valid
+        return submit_batch(pool, count, input_tensors, sessions, stream_output, [&](int i) {
+            TurboMindGenerationConfig* cfg = gen_configs[gen_config_count == 1 ? 0 : i];
+            if (!cfg) {
+                throw std::runtime_error("null generation config at index " + std::to_string(i));
+            }
+            for (const auto& [key, value] : converted) {
+                if (key == cfg) {
+                    return &value;
+                }
+            }
+            converted.emplace_back(cfg, convert_generation_config(cfg));
+            return static_cast<const ft::GenerationConfig*>(&converted.back().second);
+        });
+    } catch (const std::exception& e) {
+        set_last_error("Batch forward failed: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+TurboMindBatchResult* turbomind_forward_batch_with_configs(TurboMindInstancePool* pool,
+                                                          int count,
+                                                          TurboMindTensorMap** input_tensors,
+                                                          TurboMindSession* sessions,
+                                                          TurboMindGenerationConfigHandle** configs,
+                                                          int config_count,
+                                                          bool stream_output) {
+    if (!pool || count <= 0 || !input_tensors || !sessions || !configs || (config_count != 1 && config_count != count)) {
+        set_last_error("Invalid parameters for batch forward", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        return submit_batch(pool, count, input_tensors, sessions, stream_output, [&](int i) {
+            TurboMindGenerationConfigHandle* handle = configs[config_count == 1 ? 0 : i];
+            if (!handle) {
+                throw std::runtime_error("null generation config at index " + std::to_string(i));
+            }
+            return &handle->config;
+        });
+    } catch (const std::exception& e) {
+        set_last_error("Batch forward failed: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+int turbomind_batch_size(TurboMindBatchResult* batch) {
+    return batch ? static_cast<int>(batch->results.size()) : 0;
+}
+
+TurboMindForwardResult* turbomind_batch_get_result(TurboMindBatchResult* batch, int index) {
+    if (!batch || index < 0 || index >= static_cast<int>(batch->results.size())) {
+        set_last_error("Invalid batch result index", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    return batch->results[index].get();
+}
+
+int turbomind_wait_batch(TurboMindBatchResult* batch, int64_t timeout_ms) {
+    if (!batch) {
+        set_last_error("Invalid batch result for wait", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max<int64_t>(timeout_ms, 0));
+    for (auto& result : batch->results) {
+        auto& ctx = *result->ctx;
+        std::unique_lock<std::mutex> lock(ctx.mutex);
+        auto done = [&] { return is_terminal_status(ctx.status); };
+        if (timeout_ms < 0) {
+            ctx.cv.wait(lock, done);
+        } else if (!ctx.cv.wait_until(lock, deadline, done)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int turbomind_batch_finished_count(TurboMindBatchResult* batch) {
+    if (!batch) {
+        set_last_error("Invalid batch result", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    int finished = 0;
+    for (auto& result : batch->results) {
+        std::lock_guard<std::mutex> lock(result->ctx->mutex);
+        finished += is_terminal_status(result->ctx->status);
+    }
+    return finished;
+}
+
+void turbomind_cancel_batch(TurboMindBatchResult* batch) {
+    if (!batch) {
+        set_last_error("Invalid batch result for cancel", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    for (auto& result : batch->results) {
+        result->ctx->cancel();
+    }
+}
+
+void turbomind_destroy_batch_result(TurboMindBatchResult* batch) {
+    delete batch;
+}
+
+void turbomind_pool_end_session(TurboMindInstancePool* pool, uint64_t session_id) {
+    if (!pool) {
+        set_last_error("Invalid pool for end session", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    turbomind_go::TraceScope trace("tm.end_session", session_id);
+    try {
+        pool->forget_session(session_id);
+        if (pool->instances[0]->session_store) {
+            pool->instances[0]->session_store->erase(session_id);
+        }
+        // Sessions live in the shared engine, so any instance can end them
+        pool->instances[0]->request->End([](int){}, session_id);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to end session: " + std::string(e.what()), error_code(e));
+    }
+}
+
+// Session offload
+int turbomind_enable_session_offload(TurboMindModel* model, size_t host_limit_bytes, const char* spill_dir) {
+    if (!model) {
+        set_last_error("Invalid model for session offload", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    try {
+        model->session_store = std::make_shared<turbomind_go::SessionStore>(host_limit_bytes, spill_dir ? spill_dir : "");
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to enable session offload: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+void turbomind_get_session_offload_stats(TurboMindModel* model, TurboMindSessionOffloadStats* stats) {
+    if (!model || !stats) {
+        set_last_error("Invalid parameters for session offload stats", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    *stats = TurboMindSessionOffloadStats{};
+    if (model->session_store) {
+        auto s = model->session_store->stats();
+        stats->sessions = s.sessions;
+        stats->suspended = s.suspended;
+        stats->spilled = s.spilled;
+        stats->host_bytes = s.host_bytes;
+    }
+}
+
+// Shared by the instance and pool variants; `request` is any instance of the engine
+static int suspend_session(const std::shared_ptr<turbomind_go::SessionStore>& store,
+                           ft::ModelRequest* request,
+                           uint64_t session_id) {
+    if (!store) {
+        set_last_error("Session offload is not enabled for this model", TM_ERROR_INVALID_STATE);
+        return -1;
+    }
+    
+    try {
+        if (!store->suspend(session_id)) {
+            set_last_error("Session " + std::to_string(session_id) + " is not tracked or already suspended", TM_ERROR_INVALID_STATE);
+            return -1;
+        }
+        // Ending the engine sequence frees its KV blocks; the history rebuilds it
+        request->End([](int){}, session_id);
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to suspend session: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+int turbomind_suspend_session(TurboMindModelInstance* instance, uint64_t session_id) {
+    if (!instance) {
+        set_last_error("Invalid instance for suspend session", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return suspend_session(instance->session_store, instance->request.get(), session_id);
+}
+
+int turbomind_pool_suspend_session(TurboMindInstancePool* pool, uint64_t session_id) {
+    if (!pool) {
+        set_last_error("Invalid pool for suspend session", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    pool->forget_session(session_id);
+    return suspend_session(pool->instances[0]->session_store, pool->instances[0]->request.get(), session_id);
+}
+
+TurboMindForwardResult* turbomind_resume_session(TurboMindModelInstance* instance, uint64_t session_id) {
+    if (!instance || !instance->session_store) {
+        set_last_error("Invalid instance or session offload not enabled", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        auto input = resume_input(*instance->session_store, session_id);
+        auto ctx = create_forward_context(input.gen_cfg, false, nullptr, nullptr);
+        start_forward(ctx, instance, std::move(input));
+        return new TurboMindForwardResult(ctx);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to resume session: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+TurboMindForwardResult* turbomind_pool_resume_session(TurboMindInstancePool* pool, uint64_t session_id) {
+    if (!pool || !pool->instances[0]->session_store) {
+        set_last_error("Invalid pool or session offload not enabled", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        pool->forget_session(session_id);
+        auto input = resume_input(*pool->instances[0]->session_store, session_id);
+        auto ctx = create_forward_context(input.gen_cfg, false, nullptr, nullptr);
+        // Rebuilding history is bulk work: it goes through the background limits
+        pool->submit({ctx, std::move(input), TM_PRIORITY_BACKGROUND});
+        return new TurboMindForwardResult(ctx);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to resume session: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+// Prefix caching
+int turbomind_enable_prefix_cache(TurboMindModel* model, int block_len, size_t max_blocks) {
+    if (!model || block_len <= 0 || max_blocks == 0) {
+        set_last_error("Invalid parameters for prefix cache", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    try {
+        model->prefix_cache = std::make_shared<turbomind_go::PrefixCache>(block_len, max_blocks);
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to enable prefix cache: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+void turbomind_get_prefix_cache_stats(TurboMindModel* model, TurboMindPrefixCacheStats* stats) {
+    if (!model || !stats) {
+        set_last_error("Invalid parameters for prefix cache stats", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    *stats = TurboMindPrefixCacheStats{};
+    if (model->prefix_cache) {
+        auto s = model->prefix_cache->stats();
+        stats->blocks = s.blocks;
+        stats->pinned_blocks = s.pinned_blocks;
+        stats->lookups = s.lookups;
+        stats->lookup_tokens = s.lookup_tokens;
+        stats->hit_tokens = s.hit_tokens;
+    }
+}
+
+// Sessions the wrapper opens itself (pinned prefixes, encode inputs), kept out
+// of the range callers use
+static std::atomic<uint64_t> g_next_wrapper_session{uint64_t(1) << 63};
+
+int turbomind_pool_pin_prefix(TurboMindInstancePool* pool, const char* name, const int* token_ids, int count) {
+    if (!pool || !name || !token_ids || count <= 0) {
+        set_last_error("Invalid parameters for pin prefix", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    auto& cache = pool->instances[0]->prefix_cache;
+    if (!cache) {
+        set_last_error("Prefix caching is not enabled for this model", TM_ERROR_INVALID_STATE);
+        return -1;
+    }
+    
+    try {
+        // Checked again after the prefill, for a racing pin of the same name
+        if (cache->pinned(name)) {
+            set_last_error("Prefix already pinned: " + std::string(name), TM_ERROR_INVALID_STATE);
+            return -1;
+        }
+        
+        // Prefill the prefix in a session that is never closed: the engine keeps a live
+        // sequence's blocks resident, and new prompts share them through its prefix trie
+        auto tensors = host_input_ids(std::vector<int>(token_ids, token_ids + count));
+        
+        ft::SessionParam session{};
+        session.id = g_next_wrapper_session++;
+        session.step = 0;
+        session.start_flag = true;
+        session.end_flag = false;
+        ft::GenerationConfig generation_config;
+        generation_config.max_new_tokens = 1;
+        
+        auto ctx = create_forward_context(generation_config, false, nullptr, nullptr);
+        TurboMindInstancePool::Pending item{ctx, create_input_param(std::move(tensors), session, generation_config, false),
+                                            TM_PRIORITY_BACKGROUND};
+        item.resident = true;
+        pool->submit(std::move(item));
+        
+        std::unique_lock<std::mutex> lock(ctx->mutex);
+        ctx->cv.wait(lock, [&] { return is_terminal_status(ctx->status); });
+        if (ctx->status != TM_REQUEST_COMPLETED) {
+            set_last_error("Prefix prefill failed with engine status " + std::to_string(ctx->engine_status), TM_ERROR_ENGINE);
+            return -1;
+        }
+        lock.unlock();
+        
+        if (!cache->pin(name, token_ids, count, session.id)) {
+            pool->instances[0]->request->End([](int){}, session.id);
+            set_last_error("Prefix already pinned: " + std::string(name), TM_ERROR_INVALID_STATE);
+            return -1;
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to pin prefix: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+int turbomind_pool_evict_prefix(TurboMindInstancePool* pool, const char* name) {
+    if (!pool || !name) {
+        set_last_error("Invalid parameters for evict prefix", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    auto& cache = pool->instances[0]->prefix_cache;
+    
+    try {
+        uint64_t session_id = 0;
+        if (!cache || !cache->evict(name, &session_id)) {
+            set_last_error("Unknown prefix: " + std::string(name), TM_ERROR_NOT_FOUND);
+            return -1;
+        }
+        // Ending the holding session lets the engine reclaim the blocks
+        pool->instances[0]->request->End([](int){}, session_id);
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to evict prefix: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+void turbomind_pool_cancel_all(TurboMindInstancePool* pool) {
+    if (!pool) {
+        set_last_error("Invalid pool for cancel", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    try {
+        pool->cancel_all();
+    } catch (const std::exception& e) {
+        set_last_error("Failed to cancel pool requests: " + std::string(e.what()), error_code(e));
+    }
+}
+
+// Forward request handle
+int turbomind_get_request_timings(TurboMindForwardResult* result, TurboMindRequestTimings* timings) {
+    if (!result || !timings) {
+        set_last_error("Invalid parameters for request timings", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    std::lock_guard<std::mutex> lock(result->ctx->mutex);
+    *timings = result->ctx->timings;
+    return 0;
+}
+
+int turbomind_get_latency_histogram(TurboMindHistogramKind kind, TurboMindHistogram* histogram) {
+    if (kind < 0 || kind >= TM_HISTOGRAM_KIND_COUNT || !histogram) {
+        set_last_error("Invalid parameters for latency histogram", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    turbomind_go::latency_histogram(kind).snapshot(histogram);
+    return 0;
+}
+
+void turbomind_reset_latency_histograms() {
+    for (int kind = 0; kind < TM_HISTOGRAM_KIND_COUNT; ++kind) {
+        turbomind_go::latency_histogram(static_cast<TurboMindHistogramKind>(kind)).reset();
+    }
+}
+
+int turbomind_get_prefix_hit_length(TurboMindForwardResult* result) {
+    if (!result) {
+        set_last_error("Invalid forward result for prefix hit length", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    std::lock_guard<std::mutex> lock(result->ctx->mutex);
+    return result->ctx->prefix_hit_len;
+}
+
+TurboMindRequestStatus turbomind_get_forward_status(TurboMindForwardResult* result, int* seq_len) {
+    if (!result) {
+        set_last_error("Invalid forward result for status", TM_ERROR_INVALID_ARGUMENT);
+        return TM_REQUEST_FAILED;
+    }
+    
+    std::lock_guard<std::mutex> lock(result->ctx->mutex);
+    if (seq_len) {
+        *seq_len = result->ctx->seq_len;
+    }
+    return result->ctx->status;
+}
+
+int turbomind_wait_forward(TurboMindForwardResult* result, int64_t timeout_ms) {
+    if (!result) {
+        set_last_error("Invalid forward result for wait", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    auto& ctx = *result->ctx;
+    std::unique_lock<std::mutex> lock(ctx.mutex);
+    auto done = [&] { return is_terminal_status(ctx.status); };
+    if (timeout_ms < 0) {
+        ctx.cv.wait(lock, done);
+    } else if (!ctx.cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), done)) {
+        return 1;
+    }
+    
+    if (ctx.status == TM_REQUEST_FAILED) {
+        set_last_error("Forward request failed with engine status " + std::to_string(ctx.engine_status), TM_ERROR_ENGINE);
+        return -1;
+    }
+    return 0;
+}
+
+int turbomind_get_forward_event_fd(TurboMindForwardResult* result) {
+    if (!result) {
+        set_last_error("Invalid forward result for event fd", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    auto& ctx = *result->ctx;
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+    if (ctx.event_fd < 0) {
+        ctx.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ctx.event_fd < 0) {
+            set_last_error("Failed to create event fd: " + std::string(strerror(errno)), TM_ERROR_IO);
+            return -1;
+        }
+        // Make progress published before the fd existed observable
+        if (ctx.status != TM_REQUEST_PENDING) {
+            uint64_t one = 1;
+            (void)!write(ctx.event_fd, &one, sizeof(one));
+        }
+    }
+    return ctx.event_fd;
+}
+
+void turbomind_cancel_forward(TurboMindForwardResult* result) {
+    if (!result) {
+        set_last_error("Invalid forward result for cancel", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    try {
+        result->ctx->cancel();
+    } catch (const std::exception& e) {
+        set_last_error("Failed to cancel forward: " + std::string(e.what()), error_code(e));
+    }
+}
+
+TurboMindTokenStream* turbomind_get_token_stream(TurboMindForwardResult* result) {
+    if (!result) {
+        set_last_error("Invalid forward result for token stream", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    return result->ctx->token_stream;
+}
+
+int turbomind_tensor_view(TurboMindTensor* tensor, TurboMindTensorView* view) {
+    if (!tensor || !view) {
+        set_last_error("Invalid parameters for tensor view", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    try {
+        fill_tensor_view(*tensor->tensor, view);
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to get tensor view: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+int turbomind_get_output(TurboMindForwardResult* result, const char* key, TurboMindTensorView* view) {
+    if (!result || !key || !view) {
+        set_last_error("Invalid parameters for get output", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    try {
+        auto& ctx = result->ctx;
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        if (!ctx->tensors) {
+            set_last_error("Request has not started", TM_ERROR_INVALID_STATE);
+            return -1;
+        }
+        auto it = ctx->tensors->find(key);
+        if (it == ctx->tensors->end()) {
+            set_last_error("Output not found: " + std::string(key), TM_ERROR_NOT_FOUND);
+            return -1;
+        }
+        fill_tensor_view(it->second, view);
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to get output: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+int turbomind_copy_output_async(TurboMindForwardResult* result, const char* key, void* dst, size_t bytes) {
+    if (!result || !key || !dst) {
+        set_last_error("Invalid parameters for output copy", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    turbomind_go::TraceScope trace("tm.copy_output");
+    try {
+        auto& ctx = result->ctx;
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        if (!ctx->tensors) {
+            set_last_error("Request has not started", TM_ERROR_INVALID_STATE);
+            return -1;
+        }
+        auto it = ctx->tensors->find(key);
+        if (it == ctx->tensors->end()) {
+            set_last_error("Output not found: " + std::string(key), TM_ERROR_NOT_FOUND);
+            return -1;
+        }
+        const ft::core::Tensor& tensor = it->second;
+        if (bytes > static_cast<size_t>(tensor.byte_size())) {
+            set_last_error("Output copy larger than tensor " + std::string(key), TM_ERROR_INVALID_ARGUMENT);
+            return -1;
+        }
+        if (!ctx->copy_stream) {
+            ft::check_cuda_error(cudaSetDevice(tensor.device().id));
+            ft::check_cuda_error(cudaStreamCreateWithFlags(&ctx->copy_stream, cudaStreamNonBlocking));
+            ft::check_cuda_error(cudaEventCreateWithFlags(&ctx->copy_done, cudaEventDisableTiming));
+        }
+        ft::check_cuda_error(cudaMemcpyAsync(dst, tensor.raw_data(), bytes, cudaMemcpyDefault, ctx->copy_stream));
+        ft::check_cuda_error(cudaEventRecord(ctx->copy_done, ctx->copy_stream));
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to copy output: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+int turbomind_sync_output_copies(TurboMindForwardResult* result) {
+    if (!result) {
+        set_last_error("Invalid forward result", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    try {
+        cudaEvent_t done;
+        {
+            std::lock_guard<std::mutex> lock(result->ctx->mutex);
+            done = result->ctx->copy_done;
+        }
+        if (done) {
+            ft::check_cuda_error(cudaEventSynchronize(done));
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to sync output copies: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+// Session management
+void turbomind_end_session(TurboMindModelInstance* instance, uint64_t session_id) {
+    if (!instance) {
+        set_last_error("Invalid instance for end session", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    turbomind_go::TraceScope trace("tm.end_session", session_id);
+    try {
+        if (instance->session_store) {
+            instance->session_store->erase(session_id);
+        }
+        instance->request->End([](int){}, session_id);
+    } catch (const std::exception& e) {
+        set_last_error("Failed to end session: " + std::string(e.what()), error_code(e));
+    }
+}
+
+void turbomind_cancel_request(TurboMindModelInstance* instance) {
+    if (!instance) {
+        set_last_error("Invalid instance for cancel request", TM_ERROR_INVALID_ARGUMENT);
+        return;
+    }
+    
+    try {
+        instance->request->Cancel();
+    } catch (const std::exception& e) {
+        set_last_error("Failed to cancel request: " + std::string(e.what()), error_code(e));
+    }
+}
+
+// Speculative decoding
+int turbomind_attach_draft_model(TurboMindModel* model, TurboMindModel* draft, int num_draft_tokens) {
+    if (!model || !draft || draft == model || num_draft_tokens <= 0) {
+        set_last_error("Invalid parameters for attach draft model", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    if (draft->draft) {
+        set_last_error("Draft model has a draft model of its own", TM_ERROR_INVALID_STATE);
+        return -1;
+    }
+    
+    // Token ids only mean the same thing under one vocabulary. Models whose
+    // tokenizer the wrapper cannot load are trusted.
+    TurboMindTokenizer* target_tokenizer = turbomind_get_tokenizer(model);
+    TurboMindTokenizer* draft_tokenizer = turbomind_get_tokenizer(draft);
+    if (target_tokenizer && draft_tokenizer &&
+        target_tokenizer->tokenizer->vocab_size() != draft_tokenizer->tokenizer->vocab_size()) {
+        set_last_error("Draft vocabulary has " + std::to_string(draft_tokenizer->tokenizer->vocab_size()) +
+                           " tokens, the model's " + std::to_string(target_tokenizer->tokenizer->vocab_size()),
+                       TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    model->draft = draft;
+    model->num_draft_tokens = num_draft_tokens;
+    return 0;
+}
+
+TurboMindModel* turbomind_get_draft_model(TurboMindModel* model, int* num_draft_tokens) {
+    if (num_draft_tokens) {
+        *num_draft_tokens = model ? model->num_draft_tokens : 0;
+    }
+    return model ? model->draft : nullptr;
+}
+
+int turbomind_verify_draft(TurboMindForwardResult* result, const int32_t* draft_ids, int count, int32_t* out_ids) {
+    if (!result || count < 0 || (count > 0 && !draft_ids) || !out_ids) {
+        set_last_error("Invalid parameters for draft verification", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    turbomind_go::TraceScope trace("tm.verify_draft");
+    try {
+        auto& ctx = result->ctx;
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        if (ctx->status != TM_REQUEST_COMPLETED || !ctx->tensors) {
+            set_last_error("Verification request has not completed", TM_ERROR_INVALID_STATE);
+            return -1;
+        }
+        auto it = ctx->tensors->find("logits");
+        if (it == ctx->tensors->end()) {
+            set_last_error("Verification request has no logits; submit it with output_logits",
+                           TM_ERROR_INVALID_STATE);
+            return -1;
+        }
+        ft::core::Tensor& logits = it->second;
+        if (logits.dtype() != ft::kFloat32 || logits.ndim() < 2) {
+            throw std::invalid_argument("logits must be a float32 matrix");
+        }
+        
+        // Rows follow the request's input: the last count + 1 predict each draft
+        // token and the one after the proposal
+        const int64_t vocab = logits.shape(logits.ndim() - 1);
+        const int64_t rows = logits.size() / vocab;
+        const int64_t first = static_cast<int64_t>(ctx->timings.prompt_tokens) - count - 1;
+        if (first < 0 || first + count + 1 > rows) {
+            throw std::invalid_argument("request input is shorter than the draft");
+        }
+        const float* data = logits.data<float>() + first * vocab;
+        std::vector<float> host;
+        if (logits.device().type == ft::kDEVICE) {
+            host.resize((count + 1) * vocab);
+            ft::check_cuda_error(cudaMemcpy(host.data(), data, host.size() * sizeof(float), cudaMemcpyDefault));
+            data = host.data();
+        }
+        
+        int accepted = 0;
+        for (int i = 0; i <= count; ++i) {
+            const float* row = data + i * vocab;
+            out_ids[i] = static_cast<int32_t>(std::max_element(row, row + vocab) - row);
+            if (i == count || out_ids[i] != draft_ids[i]) {
+                break;
+            }
+            ++accepted;
+        }
+        if (ctx->counters) {
+            ctx->counters->draft_tokens_proposed.fetch_add(count, std::memory_order_relaxed);
+            ctx->counters->draft_tokens_accepted.fetch_add(accepted, std::memory_order_relaxed);
+        }
+        return accepted + 1;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to verify draft: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+// Prefill-only requests: embeddings and scoring
+// Prefills input i = ids[offsets[i], offsets[i + 1]) in a fresh wrapper session
+// for every input, submitted as one batch in the background class
+static std::vector<std::shared_ptr<ForwardContext>> submit_prefills(TurboMindInstancePool* pool,
+                                                                    const int32_t* ids,
+                                                                    const int64_t* offsets,
+                                                                    int count,
+                                                                    const ft::GenerationConfig& generation_config) {
+    std::vector<std::shared_ptr<ForwardContext>> contexts;
+    std::vector<TurboMindInstancePool::Pending> pending;
+    contexts.reserve(count);
+    pending.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        ft::SessionParam session{};
+        session.id = g_next_wrapper_session++;
+        session.step = 0;
+        session.start_flag = true;
+        session.end_flag = true;
+        auto ctx = create_forward_context(generation_config, false, nullptr, nullptr);
+        auto tensors = host_input_ids(std::vector<int>(ids + offsets[i], ids + offsets[i + 1]));
+        pending.push_back({ctx, create_input_param(std::move(tensors), session, generation_config, false),
+                           TM_PRIORITY_BACKGROUND});
+        contexts.push_back(std::move(ctx));
+    }
+    pool->submit_batch(std::move(pending));
+    return contexts;
+}
+
+// Waits for a prefill from submit_prefills and returns its `key` output, which
+// must hold at least `rows` rows. Throws EngineError when the request failed.
+static ft::core::Tensor& prefill_output(ForwardContext& ctx, const char* key, int64_t rows) {
+    std::unique_lock<std::mutex> lock(ctx.mutex);
+    ctx.cv.wait(lock, [&] { return is_terminal_status(ctx.status); });
+    if (ctx.status != TM_REQUEST_COMPLETED) {
+        throw EngineError("request failed with engine status " + std::to_string(ctx.engine_status));
+    }
+    if (!ctx.tensors) {
+        throw std::runtime_error("engine returned no outputs");
+    }
+    auto it = ctx.tensors->find(key);
+    if (it == ctx.tensors->end()) {
+        throw std::runtime_error("engine returned no " + std::string(key));
+    }
+    ft::core::Tensor& tensor = it->second;
+    if (tensor.ndim() < 2 || tensor.size() / tensor.shape(tensor.ndim() - 1) < rows) {
+        throw std::runtime_error(std::string(key) + " is shorter than the input");
+    }
+    return tensor;
+}
+
+// Checks the inputs of the batched prefill entry points, recording an error
+static bool valid_prefill_inputs(const int64_t* offsets, int count, const char* op) {
+    for (int i = 0; i < count; ++i) {
+        if (offsets[i] < 0 || offsets[i + 1] <= offsets[i]) {
+            set_last_error("Invalid parameters for " + std::string(op) + ": input " + std::to_string(i) +
+                               " is empty",
+                           TM_ERROR_INVALID_ARGUMENT);
+            return false;
+        }
+    }
+    return true;
+}
+
+int turbomind_get_hidden_size(TurboMindInstancePool* pool) {
+    if (!pool) {
+        set_last_error("Invalid pool for hidden size", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    if (pool->hidden_units <= 0) {
+        set_last_error("Model config has no hidden_units", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return static_cast<int>(pool->hidden_units);
+}
+
+int turbomind_encode(TurboMindInstancePool* pool, const int32_t* ids, const int64_t* offsets, int count,
+                     TurboMindPooling pooling, TurboMindDataType out_dtype, void* out) {
+    if (!pool || !ids || !offsets || count <= 0 || (out_dtype != TM_TYPE_FP16 && out_dtype != TM_TYPE_FP32) ||
+        (pooling != TM_POOLING_LAST && pooling != TM_POOLING_MEAN) || !out) {
+        set_last_error("Invalid parameters for encode", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    if (pool->hidden_units <= 0) {
+        set_last_error("Invalid parameters for encode: model config has no hidden_units", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    if (!valid_prefill_inputs(offsets, count, "encode")) {
+        return -1;
     }
     
+    turbomind_go::TraceScope trace("tm.encode");
+    std::vector<std::shared_ptr<ForwardContext>> contexts;
     try {
-        instance->request->End([](int){}, session_id);
+        // Prefill only: no tokens are generated, so no sampling state is set up
+        ft::GenerationConfig generation_config;
+        generation_config.max_new_tokens = 0;
+        generation_config.output_last_hidden_state = 1;
+        contexts = submit_prefills(pool, ids, offsets, count, generation_config);
+        
+        char* dst = static_cast<char*>(out);
+        const int64_t dim = pool->hidden_units;
+        std::vector<char> host;
+        for (int i = 0; i < count; ++i) {
+            const int64_t rows = offsets[i + 1] - offsets[i];
+            ft::core::Tensor& hidden = prefill_output(*contexts[i], "last_hidden_state", rows);
+            const TurboMindDataType type = convert_data_type_to_c(hidden.dtype());
+            if (hidden.shape(hidden.ndim() - 1) != dim) {
+                throw std::runtime_error("hidden states are " + std::to_string(hidden.shape(hidden.ndim() - 1)) +
+                                         " wide, the config's hidden_units " + std::to_string(dim));
+            }
+            
+            const void* src = hidden.raw_data();
+            if (hidden.device().type == ft::kDEVICE) {
+                host.resize(static_cast<size_t>(rows * dim) * data_type_size(type));
+                ft::check_cuda_error(cudaMemcpy(host.data(), src, host.size(), cudaMemcpyDefault));
+                src = host.data();
+            }
+            turbomind_go::pool_hidden_states(src, type, rows, dim, pooling,
+                                             dst + static_cast<size_t>(i * dim) * data_type_size(out_dtype), out_dtype);
+        }
+        return 0;
     } catch (const std::exception& e) {
-        set_last_error("Failed to end session: " + std::string(e.what()));
+        for (auto& ctx : contexts) {
+            ctx->cancel();
+        }
+        set_last_error("Failed to encode: " + std::string(e.what()), error_code(e));
+        return -1;
     }
 }
 
-void turbomind_cancel_request(TurboMindModelInstance* instance) {
-    if (!instance) {
-        set_last_error("Invalid instance for cancel request");
-        return;
+int turbomind_score(TurboMindInstancePool* pool, const int32_t* ids, const int64_t* offsets,
+                    const int32_t* prompt_lens, int count, float* logprobs) {
+    if (!pool || !ids || !offsets || !prompt_lens || count <= 0 || !logprobs) {
+        set_last_error("Invalid parameters for score", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    if (!valid_prefill_inputs(offsets, count, "score")) {
+        return -1;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (prompt_lens[i] <= 0 || prompt_lens[i] >= offsets[i + 1] - offsets[i]) {
+            set_last_error("Invalid parameters for score: input " + std::to_string(i) +
+                               " needs a prompt and a continuation",
+                           TM_ERROR_INVALID_ARGUMENT);
+            return -1;
+        }
     }
     
+    turbomind_go::TraceScope trace("tm.score");
+    std::vector<std::shared_ptr<ForwardContext>> contexts;
     try {
-        instance->request->Cancel();
+        // Row p of the logits predicts input token p + 1
+        ft::GenerationConfig generation_config;
+        generation_config.max_new_tokens = 0;
+        generation_config.output_logits = 1;
+        contexts = submit_prefills(pool, ids, offsets, count, generation_config);
+        
+        float* dst = logprobs;
+        std::vector<float> host;
+        for (int i = 0; i < count; ++i) {
+            const int64_t len = offsets[i + 1] - offsets[i];
+            ft::core::Tensor& logits = prefill_output(*contexts[i], "logits", len - 1);
+            if (logits.dtype() != ft::kFloat32) {
+                throw std::invalid_argument("logits must be float32");
+            }
+            const int64_t vocab = logits.shape(logits.ndim() - 1);
+            const int64_t first = prompt_lens[i] - 1;
+            const int64_t rows = len - prompt_lens[i];
+            
+            // Only the continuation's rows are read, and only they cross PCIe
+            const float* data = logits.data<float>() + first * vocab;
+            if (logits.device().type == ft::kDEVICE) {
+                host.resize(rows * vocab);
+                ft::check_cuda_error(cudaMemcpy(host.data(), data, host.size() * sizeof(float), cudaMemcpyDefault));
+                data = host.data();
+            }
+            const int32_t* targets = ids + offsets[i] + prompt_lens[i];
+            for (int64_t r = 0; r < rows; ++r) {
+                *dst++ = turbomind_go::token_logprob(data + r * vocab, vocab, targets[r]);
+            }
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        for (auto& ctx : contexts) {
+            ctx->cancel();
+        }
+        set_last_error("Failed to score: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+// Metrics
+int turbomind_get_metrics(TurboMindModel* model, int device_id, TurboMindMetrics* metrics) {
+    if (!model || !metrics) {
+        set_last_error("Invalid parameters for metrics", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    auto& c = *model->counters;
+    const auto load = [](const auto& counter) { return counter.load(std::memory_order_relaxed); };
+    *metrics = TurboMindMetrics{};
+    metrics->active_requests = load(c.active_requests);
+    metrics->queued_requests = load(c.queued_requests);
+    metrics->decode_batch_size = load(c.decoding_requests);
+    metrics->completed_requests = load(c.completed_requests);
+    metrics->failed_requests = load(c.failed_requests);
+    metrics->cancelled_requests = load(c.cancelled_requests);
+    metrics->prompt_tokens = load(c.prompt_tokens);
+    metrics->generated_tokens = load(c.generated_tokens);
+    
+    // Rate over the interval since the previous scrape
+    const int64_t now = turbomind_go::now_ns();
+    const int64_t last_ns = c.rate_sample_ns.exchange(now, std::memory_order_relaxed);
+    const uint64_t last_tokens = c.rate_sample_tokens.exchange(metrics->generated_tokens, std::memory_order_relaxed);
+    if (last_ns > 0 && now > last_ns) {
+        metrics->tokens_per_second = (metrics->generated_tokens - last_tokens) * 1e9 / (now - last_ns);
+    }
+    
+    // The block manager lives inside the engine and is not exposed
+    metrics->kv_blocks_used = -1;
+    metrics->kv_blocks_free = -1;
+    
+    if (model->prefix_cache) {
+        auto stats = model->prefix_cache->stats();
+        if (stats.lookup_tokens > 0) {
+            metrics->prefix_cache_hit_rate = static_cast<double>(stats.hit_tokens) / stats.lookup_tokens;
+        }
+    }
+    
+    metrics->gpu_memory_total = -1;
+    metrics->gpu_memory_used = -1;
+    int current = 0;
+    size_t free_bytes = 0;
+    size_t total_bytes = 0;
+    if (cudaGetDevice(&current) == cudaSuccess && cudaSetDevice(device_id) == cudaSuccess) {
+        if (cudaMemGetInfo(&free_bytes, &total_bytes) == cudaSuccess) {
+            metrics->gpu_memory_total = static_cast<int64_t>(total_bytes);
+            metrics->gpu_memory_used = static_cast<int64_t>(total_bytes - free_bytes);
+        }
+        cudaSetDevice(current);
+    }
+    
+    auto& pinned = turbomind_go::PinnedPool::instance();
+    metrics->pinned_host_in_use = pinned.in_use_bytes();
+    metrics->pinned_host_cached = pinned.cached_bytes();
+    metrics->draft_tokens_proposed = load(c.draft_tokens_proposed);
+    metrics->draft_tokens_accepted = load(c.draft_tokens_accepted);
+    metrics->deadline_misses = load(c.deadline_misses);
+    metrics->preempted_sessions = load(c.preempted_sessions);
+    return 0;
+}
+
+// Tracing
+int turbomind_enable_trace(size_t capacity) {
+    if (capacity == 0) {
+        set_last_error("Trace capacity must be positive", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    try {
+        turbomind_go::TraceRecorder::instance().enable(capacity);
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to enable trace: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+void turbomind_disable_trace() {
+    turbomind_go::TraceRecorder::instance().disable();
+}
+
+int turbomind_dump_trace(const char* path) {
+    if (!path) {
+        set_last_error("Invalid path for trace dump", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    try {
+        if (!turbomind_go::TraceRecorder::instance().dump(path)) {
+            set_last_error("Failed to write trace to " + std::string(path), TM_ERROR_IO);
+            return -1;
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to dump trace: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+int64_t turbomind_trace_clock_ns() {
+    return turbomind_go::now_ns();
+}
+
+void turbomind_trace_record(const char* name, uint64_t session_id, int64_t start_ns, int64_t end_ns) {
+    turbomind_go::trace_span(name, session_id, start_ns, end_ns);
+}
+
+// Tokenizer
+TurboMindTokenizer* turbomind_create_tokenizer(const char* model_dir) {
+    if (!model_dir) {
+        set_last_error("model_dir cannot be null", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        auto tokenizer = std::make_unique<TurboMindTokenizer>();
+        tokenizer->tokenizer = turbomind_go::Tokenizer::load(model_dir);
+        return tokenizer.release();
+    } catch (const std::exception& e) {
+        set_last_error("Failed to load tokenizer: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+void turbomind_destroy_tokenizer(TurboMindTokenizer* tokenizer) {
+    delete tokenizer;
+}
+
+TurboMindTokenizer* turbomind_get_tokenizer(TurboMindModel* model) {
+    if (!model) {
+        set_last_error("Invalid model for tokenizer", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    std::lock_guard<std::mutex> lock(model->tokenizer_mutex);
+    if (!model->tokenizer) {
+        model->tokenizer.reset(turbomind_create_tokenizer(model->model_dir.c_str()));
+    }
+    return model->tokenizer.get();
+}
+
+size_t turbomind_tokenizer_max_tokens(size_t length) {
+    return turbomind_go::Tokenizer::max_tokens(length);
+}
+
+int64_t turbomind_tokenize(TurboMindTokenizer* tokenizer, const char* text, size_t length, bool add_bos,
+                           int32_t* ids, size_t capacity) {
+    if (!tokenizer || (!text && length > 0) || (!ids && capacity > 0)) {
+        set_last_error("Invalid parameters for tokenize", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    try {
+        return static_cast<int64_t>(tokenizer->tokenizer->encode(std::string_view(text, length), add_bos, ids, capacity));
+    } catch (const std::exception& e) {
+        set_last_error("Failed to tokenize: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+int64_t turbomind_detokenize(TurboMindTokenizer* tokenizer, const int32_t* ids, size_t count, bool skip_special,
+                             char* text, size_t capacity) {
+    if (!tokenizer || (!ids && count > 0) || (!text && capacity > 0)) {
+        set_last_error("Invalid parameters for detokenize", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    try {
+        thread_local std::string decoded;
+        decoded.clear();
+        tokenizer->tokenizer->decode(ids, count, skip_special, decoded);
+        if (capacity > 0) {
+            std::memcpy(text, decoded.data(), std::min(decoded.size(), capacity));
+        }
+        return static_cast<int64_t>(decoded.size());
+    } catch (const std::exception& e) {
+        set_last_error("Failed to detokenize: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+int turbomind_tokenizer_vocab_size(TurboMindTokenizer* tokenizer) {
+    if (!tokenizer) {
+        set_last_error("Invalid tokenizer", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return tokenizer->tokenizer->vocab_size();
+}
+
+int turbomind_tokenizer_bos_id(TurboMindTokenizer* tokenizer) {
+    return tokenizer ? tokenizer->tokenizer->bos_id() : -1;
+}
+
+int turbomind_tokenizer_eos_id(TurboMindTokenizer* tokenizer) {
+    return tokenizer ? tokenizer->tokenizer->eos_id() : -1;
+}
+
+TurboMindDetokenizer* turbomind_create_detokenizer(TurboMindTokenizer* tokenizer, bool skip_special) {
+    if (!tokenizer) {
+        set_last_error("Invalid tokenizer for detokenizer", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        return new TurboMindDetokenizer{turbomind_go::StreamDecoder(*tokenizer->tokenizer, skip_special), {}};
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create detokenizer: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+void turbomind_destroy_detokenizer(TurboMindDetokenizer* detokenizer) {
+    delete detokenizer;
+}
+
+const char* turbomind_detokenize_step(TurboMindDetokenizer* detokenizer, const int32_t* ids, size_t count,
+                                      bool finish, size_t* length) {
+    if (!detokenizer || (!ids && count > 0) || !length) {
+        set_last_error("Invalid parameters for detokenize step", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        detokenizer->text.clear();
+        detokenizer->decoder.push(ids, count, detokenizer->text);
+        if (finish) {
+            detokenizer->decoder.finish(detokenizer->text);
+        }
+        *length = detokenizer->text.size();
+        return detokenizer->text.data();
+    } catch (const std::exception& e) {
+        set_last_error("Failed to detokenize step: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+const char* turbomind_detokenize_stream(TurboMindDetokenizer* detokenizer, TurboMindTokenStream* stream,
+                                        size_t* length, bool* finished) {
+    if (!detokenizer || !stream || !length || !finished) {
+        set_last_error("Invalid parameters for detokenize stream", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        detokenizer->text.clear();
+        *finished = detokenizer->decoder.drain(*stream, detokenizer->text);
+        *length = detokenizer->text.size();
+        return detokenizer->text.data();
+    } catch (const std::exception& e) {
+        set_last_error("Failed to detokenize stream: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+TurboMindGrammar* turbomind_compile_grammar(TurboMindTokenizer* tokenizer, TurboMindGrammarKind kind,
+                                            const char* source, size_t length) {
+    if (!tokenizer || (!source && length > 0)) {
+        set_last_error("Invalid parameters for compile grammar", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    try {
+        auto grammar = tokenizer->grammars.get(*tokenizer->tokenizer, kind, std::string_view(source, length));
+        return new TurboMindGrammar{std::move(grammar)};
     } catch (const std::exception& e) {
-        set_last_error("Failed to cancel request: " + std::string(e.what()));
+        set_last_error("Failed to compile grammar: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+void turbomind_release_grammar(TurboMindGrammar* grammar) {
+    delete grammar;
+}
+
+// Checks the handle and state, recording an error if either is bad
+static bool valid_grammar_state(TurboMindGrammar* grammar, int32_t state, const char* op) {
+    if (!grammar || state < 0 || static_cast<size_t>(state) >= grammar->grammar->num_states()) {
+        set_last_error(std::string("Invalid grammar or state for ") + op, TM_ERROR_INVALID_ARGUMENT);
+        return false;
+    }
+    return true;
+}
+
+int32_t turbomind_grammar_start(TurboMindGrammar* grammar) {
+    if (!grammar) {
+        set_last_error("Invalid grammar", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return grammar->grammar->start();
+}
+
+int32_t turbomind_grammar_advance(TurboMindGrammar* grammar, int32_t state, int32_t token) {
+    if (!valid_grammar_state(grammar, state, "advance")) {
+        return -1;
+    }
+    return grammar->grammar->advance(state, token);
+}
+
+bool turbomind_grammar_accepting(TurboMindGrammar* grammar, int32_t state) {
+    return valid_grammar_state(grammar, state, "accepting") && grammar->grammar->accepting(state);
+}
+
+int64_t turbomind_grammar_allowed_ids(TurboMindGrammar* grammar, int32_t state, int32_t* ids, size_t capacity) {
+    if (!valid_grammar_state(grammar, state, "allowed ids") || (!ids && capacity > 0)) {
+        return -1;
+    }
+    const auto& transitions = grammar->grammar->transitions(state);
+    const size_t n = std::min(transitions.size(), capacity);
+    for (size_t i = 0; i < n; ++i) {
+        ids[i] = transitions[i].token;
+    }
+    return static_cast<int64_t>(transitions.size());
+}
+
+int64_t turbomind_grammar_bad_ids(TurboMindGrammar* grammar, int32_t state, int32_t* ids, size_t capacity) {
+    if (!valid_grammar_state(grammar, state, "bad ids") || (!ids && capacity > 0)) {
+        return -1;
     }
+    thread_local std::vector<int32_t> banned;
+    grammar->grammar->banned(state, banned);
+    if (capacity > 0) {
+        std::memcpy(ids, banned.data(), std::min(banned.size(), capacity) * sizeof(int32_t));
+    }
+    return static_cast<int64_t>(banned.size());
 }
 
 // Model information
 int turbomind_get_tensor_para_size(TurboMindModel* model) {
     if (!model) {
-        set_last_error("Invalid model for tensor para size");
+        set_last_error("Invalid model for tensor para size", TM_ERROR_INVALID_ARGUMENT);
         return -1;
     }
     
     try {
         return model->model->getTensorParaSize();
     } catch (const std::exception& e) {
-        set_last_error("Failed to get tensor para size: " + std::string(e.what()));
+        set_last_error("Failed to get tensor para size: " + std::string(e.what()), error_code(e));
         return -1;
     }
 }
 
 int turbomind_get_pipeline_para_size(TurboMindModel* model) {
     if (!model) {
-        set_last_error("Invalid model for pipeline para size");
+        set_last_error("Invalid model for pipeline para size", TM_ERROR_INVALID_ARGUMENT);
         return -1;
     }
     
     try {
         return model->model->getPipelineParaSize();
     } catch (const std::exception& e) {
-        set_last_error("Failed to get pipeline para size: " + std::string(e.what()));
+        set_last_error("Failed to get pipeline para size: " + std::string(e.what()), error_code(e));
         return -1;
     }
 }
 
 // Utility functions
 const char* turbomind_get_last_error() {
-    std::lock_guard<std::mutex> lock(g_error_mutex);
-    return g_last_error.c_str();
+    return t_last_error.c_str();
+}
+
+TurboMindErrorCode turbomind_get_last_error_code() {
+    return t_last_error_code;
+}
+
+void turbomind_clear_last_error() {
+    t_last_error.clear();
+    t_last_error_code = TM_OK;
+}
+
+void turbomind_enable_log(TurboMindLogCallback callback, void* user_data, TurboMindLogLevel min_level,
+                          int max_per_second) {
+    turbomind_go::LogSink::instance().enable(callback, user_data, min_level, max_per_second);
+}
+
+void turbomind_disable_log() {
+    turbomind_go::LogSink::instance().disable();
 }
 
 void turbomind_set_device(int device_id) {
     try {
         ft::check_cuda_error(cudaSetDevice(device_id));
     } catch (const std::exception& e) {
-        set_last_error("Failed to set device: " + std::string(e.what()));
+        set_last_error("Failed to set device: " + std::string(e.what()), error_code(e));
     }
 }
 
 // Helper functions for tensor operations
 size_t turbomind_get_tensor_size(TurboMindTensor* tensor) {
     if (!tensor) {
-        set_last_error("Invalid tensor for size calculation");
+        set_last_error("Invalid tensor for size calculation", TM_ERROR_INVALID_ARGUMENT);
         return 0;
     }
     
     try {
         return tensor->tensor->byte_size();
     } catch (const std::exception& e) {
-        set_last_error("Failed to get tensor size: " + std::string(e.what()));
+        set_last_error("Failed to get tensor size: " + std::string(e.what()), error_code(e));
         return 0;
     }
 }
 
 void turbomind_copy_tensor(TurboMindTensor* dst, TurboMindTensor* src) {
     if (!dst || !src) {
-        set_last_error("Invalid tensors for copy");
+        set_last_error("Invalid tensors for copy", TM_ERROR_INVALID_ARGUMENT);
         return;
     }
     
+    turbomind_go::TraceScope trace("tm.copy_tensor");
+    // Stream-ordered on the caller's per-thread stream, so only this thread waits
+    TurboMindCopyDesc copy{dst, src, 0, 0, 0};
+    TurboMindEvent* event = turbomind_copy_tensors_async(&copy, 1, nullptr);
+    if (event) {
+        turbomind_event_synchronize(event);
+        turbomind_destroy_event(event);
+    }
+}
+
+// Streams and events
+TurboMindStream* turbomind_create_stream(int device_id) {
+    try {
+        auto stream = std::make_unique<TurboMindStream>();
+        stream->device_id = device_id;
+        stream->owned = true;
+        ft::check_cuda_error(cudaSetDevice(device_id));
+        ft::check_cuda_error(cudaStreamCreateWithFlags(&stream->stream, cudaStreamNonBlocking));
+        return stream.release();
+    } catch (const std::exception& e) {
+        set_last_error("Failed to create stream: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+TurboMindStream* turbomind_wrap_stream(void* cuda_stream, int device_id) {
+    auto stream = new TurboMindStream();
+    stream->stream = static_cast<cudaStream_t>(cuda_stream);
+    stream->device_id = device_id;
+    return stream;
+}
+
+void turbomind_destroy_stream(TurboMindStream* stream) {
+    delete stream;
+}
+
+int turbomind_stream_synchronize(TurboMindStream* stream) {
+    if (!stream) {
+        set_last_error("Invalid stream", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
     try {
-        if (dst->tensor->byte_size() != src->tensor->byte_size()) {
-            set_last_error("Tensor size mismatch for copy");
-            return;
+        ft::check_cuda_error(cudaStreamSynchronize(stream->stream));
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to synchronize stream: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+int turbomind_stream_wait_event(TurboMindStream* stream, TurboMindEvent* event) {
+    if (!stream || !event) {
+        set_last_error("Invalid parameters for stream wait", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    try {
+        ft::check_cuda_error(cudaStreamWaitEvent(stream->stream, event->event, 0));
+        return 0;
+    } catch (const std::exception& e) {
+        set_last_error("Failed to wait for event: " + std::string(e.what()), error_code(e));
+        return -1;
+    }
+}
+
+TurboMindEvent* turbomind_copy_tensor_async(TurboMindTensor* dst, TurboMindTensor* src, TurboMindStream* stream) {
+    TurboMindCopyDesc copy{dst, src, 0, 0, 0};
+    return turbomind_copy_tensors_async(&copy, 1, stream);
+}
+
+TurboMindEvent* turbomind_copy_tensors_async(const TurboMindCopyDesc* copies, int count, TurboMindStream* stream) {
+    if (!copies || count <= 0) {
+        set_last_error("Invalid parameters for tensor copy", TM_ERROR_INVALID_ARGUMENT);
+        return nullptr;
+    }
+    
+    turbomind_go::TraceScope trace("tm.copy_tensors");
+    try {
+        struct Range {
+            char* dst;
+            const char* src;
+            size_t bytes;
+        };
+        std::vector<Range> ranges;
+        ranges.reserve(count);
+        auto event = std::make_unique<TurboMindEvent>();
+        event->tensors.reserve(2 * count);
+        int gpu_device = -1;
+        
+        for (int i = 0; i < count; ++i) {
+            const auto& copy = copies[i];
+            if (!copy.dst || !copy.src) {
+                throw std::runtime_error("null tensor in copy " + std::to_string(i));
+            }
+            const auto& dst = copy.dst->tensor;
+            const auto& src = copy.src->tensor;
+            size_t bytes = copy.bytes;
+            if (bytes == 0) {
+                if (dst->byte_size() != src->byte_size()) {
+                    throw std::runtime_error("tensor size mismatch in copy " + std::to_string(i));
+                }
+                bytes = static_cast<size_t>(src->byte_size());
+            }
+            if (copy.dst_offset + bytes > static_cast<size_t>(dst->byte_size()) ||
+                copy.src_offset + bytes > static_cast<size_t>(src->byte_size())) {
+                throw std::runtime_error("copy " + std::to_string(i) + " is out of bounds");
+            }
+            if (gpu_device < 0 && src->device().type == ft::kDEVICE) {
+                gpu_device = src->device().id;
+            }
+            if (gpu_device < 0 && dst->device().type == ft::kDEVICE) {
+                gpu_device = dst->device().id;
+            }
+            
+            Range range{static_cast<char*>(dst->raw_data()) + copy.dst_offset,
+                        static_cast<const char*>(src->raw_data()) + copy.src_offset, bytes};
+            // Gathers of adjacent slices into adjacent slots collapse into one copy
+            if (!ranges.empty() && ranges.back().dst + ranges.back().bytes == range.dst &&
+                ranges.back().src + ranges.back().bytes == range.src) {
+                ranges.back().bytes += range.bytes;
+            } else {
+                ranges.push_back(range);
+            }
+            event->tensors.push_back(dst);
+            event->tensors.push_back(src);
         }
         
-        // Use CUDA memcpy for tensor copying
-        ft::check_cuda_error(cudaMemcpy(dst->tensor->raw_data(), src->tensor->raw_data(), 
-                                       dst->tensor->byte_size(), cudaMemcpyDefault));
+        cudaStream_t cuda_stream = cudaStreamPerThread;
+        if (stream) {
+            cuda_stream = stream->stream;
+            ft::check_cuda_error(cudaSetDevice(stream->device_id));
+        } else if (gpu_device >= 0) {
+            ft::check_cuda_error(cudaSetDevice(gpu_device));
+        }
+        for (const auto& range : ranges) {
+            ft::check_cuda_error(cudaMemcpyAsync(range.dst, range.src, range.bytes, cudaMemcpyDefault, cuda_stream));
+        }
+        event->event = acquire_event();
+        ft::check_cuda_error(cudaEventRecord(event->event, cuda_stream));
+        return event.release();
+    } catch (const std::exception& e) {
+        set_last_error("Failed to copy tensors: " + std::string(e.what()), error_code(e));
+        return nullptr;
+    }
+}
+
+int turbomind_event_query(TurboMindEvent* event) {
+    if (!event) {
+        set_last_error("Invalid event", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    const cudaError_t err = cudaEventQuery(event->event);
+    if (err == cudaSuccess) {
+        return 1;
+    }
+    if (err == cudaErrorNotReady) {
+        return 0;
+    }
+    set_last_error("Failed to query event: " + std::string(cudaGetErrorString(err)), TM_ERROR_CUDA);
+    return -1;
+}
+
+int turbomind_event_synchronize(TurboMindEvent* event) {
+    if (!event) {
+        set_last_error("Invalid event", TM_ERROR_INVALID_ARGUMENT);
+        return -1;
+    }
+    
+    try {
+        ft::check_cuda_error(cudaEventSynchronize(event->event));
+        return 0;
     } catch (const std::exception& e) {
-        set_last_error("Failed to copy tensor: " + std::string(e.what()));
+        set_last_error("Failed to synchronize event: " + std::string(e.what()), error_code(e));
+        return -1;
     }
 }
 
+void turbomind_destroy_event(TurboMindEvent* event) {
+    delete event;
+}
+
 } // extern "C"
\ No newline at end of file